@@ -29,17 +29,18 @@ ELSE()
 	SET(CONFIG_MAX_WRITE_BUFFER_SIZE 5120)
 ENDIF()
 
-# This parameter configures the maximum amount of states that can be
-# handled in a jet. The number of states is 2^ELEMENT_TABLE_ORDER.
+# This parameter configures the initial size of the table of states,
+# which is 2^ELEMENT_TABLE_ORDER. The table grows if more states are
+# added.
 IF(CONFIG_ELEMENT_TABLE_ORDER)
 	SET(CONFIG_ELEMENT_TABLE_ORDER ${CONFIG_ELEMENT_TABLE_ORDER} CACHE STRING "" FORCE)
 ELSE()
 	SET(CONFIG_ELEMENT_TABLE_ORDER 13)
 ENDIF()
 
-# This parameter configures the maximum ongoing routed messages per
-# peer.
-
+# This parameter configures the initial size of the table of ongoing
+# routed messages per peer, which is 2^ROUTING_TABLE_ORDER. The table
+# grows if more messages are routed at the same time.
 IF(CONFIG_ROUTING_TABLE_ORDER)
 	SET(CONFIG_ROUTING_TABLE_ORDER ${CONFIG_ROUTING_TABLE_ORDER} CACHE STRING "" FORCE)
 ELSE()
@@ -52,10 +53,22 @@ ELSE()
 	SET(CONFIG_MAX_EPOLL_EVENTS 10)
 ENDIF()
 
-IF(CONFIG_INITIAL_FETCH_TABLE_SIZE)
-	SET(CONFIG_INITIAL_FETCH_TABLE_SIZE ${CONFIG_INITIAL_FETCH_TABLE_SIZE} CACHE STRING "" FORCE)
+# States with the same fetch expressions attached share one fetcher
+# set. The number of distinct fetcher sets is 2^FETCHER_SET_TABLE_ORDER
+# initially, the table grows if more sets are needed.
+IF(CONFIG_FETCHER_SET_TABLE_ORDER)
+	SET(CONFIG_FETCHER_SET_TABLE_ORDER ${CONFIG_FETCHER_SET_TABLE_ORDER} CACHE STRING "" FORCE)
+ELSE()
+	SET(CONFIG_FETCHER_SET_TABLE_ORDER 10)
+ENDIF()
+
+# Requests and rendered responses are allocated from an arena that is
+# released after each message. The arena grows in blocks of
+# MESSAGE_ARENA_BLOCK_SIZE bytes, one block is kept between messages.
+IF(CONFIG_MESSAGE_ARENA_BLOCK_SIZE)
+	SET(CONFIG_MESSAGE_ARENA_BLOCK_SIZE ${CONFIG_MESSAGE_ARENA_BLOCK_SIZE} CACHE STRING "" FORCE)
 ELSE()
-	SET(CONFIG_INITIAL_FETCH_TABLE_SIZE 4)
+	SET(CONFIG_MESSAGE_ARENA_BLOCK_SIZE 4096)
 ENDIF()
 
 IF(CONFIG_ROUTED_MESSAGES_TIMEOUT)
@@ -64,12 +77,38 @@ ELSE()
 	SET(CONFIG_ROUTED_MESSAGES_TIMEOUT 5.0)
 ENDIF()
 
+# The interval in seconds in which a snapshot of all states is written
+# if cjet is started with a snapshot file.
+IF(CONFIG_SNAPSHOT_INTERVAL)
+	SET(CONFIG_SNAPSHOT_INTERVAL ${CONFIG_SNAPSHOT_INTERVAL} CACHE STRING "" FORCE)
+ELSE()
+	SET(CONFIG_SNAPSHOT_INTERVAL 10.0)
+ENDIF()
+
 IF(CONFIG_MAX_NUMBERS_OF_MATCHERS_IN_FETCH)
 	SET(CONFIG_MAX_NUMBERS_OF_MATCHERS_IN_FETCH ${CONFIG_MAX_NUMBERS_OF_MATCHERS_IN_FETCH} CACHE STRING "" FORCE)
 ELSE()
 	SET(CONFIG_MAX_NUMBERS_OF_MATCHERS_IN_FETCH 12)
 ENDIF()
 
+# Fetches with identical path expressions share the matchers and the
+# links to the matching states. The table of shared fetch expressions
+# has 2^FETCH_EXPRESSION_TABLE_ORDER entries initially, it grows if more
+# distinct expressions are fetched.
+IF(CONFIG_FETCH_EXPRESSION_TABLE_ORDER)
+	SET(CONFIG_FETCH_EXPRESSION_TABLE_ORDER ${CONFIG_FETCH_EXPRESSION_TABLE_ORDER} CACHE STRING "" FORCE)
+ELSE()
+	SET(CONFIG_FETCH_EXPRESSION_TABLE_ORDER 12)
+ENDIF()
+
+# This parameter configures how many automaton states a compiled regex
+# matcher of a fetch may have. The maximum is 65536.
+IF(CONFIG_MAX_DFA_STATES_IN_REGEX)
+	SET(CONFIG_MAX_DFA_STATES_IN_REGEX ${CONFIG_MAX_DFA_STATES_IN_REGEX} CACHE STRING "" FORCE)
+ELSE()
+	SET(CONFIG_MAX_DFA_STATES_IN_REGEX 256)
+ENDIF()
+
 IF(CONFIG_ALLOW_ADD_ONLY_FROM_LOCALHOST)
 	SET(CONFIG_ALLOW_ADD_ONLY_FROM_LOCALHOST ${CONFIG_ALLOW_ADD_ONLY_FROM_LOCALHOST} CACHE STRING "" FORCE)
 ELSE()
@@ -0,0 +1,180 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alloc.h"
+#include "arena.h"
+#include "compiler.h"
+#include "generated/cjet_config.h"
+
+/*
+ * Allocations are aligned for doubles and pointers even if cjet_malloc()
+ * only aligns to size_t.
+ */
+enum { ARENA_ALIGNMENT = 8 };
+
+struct arena_block {
+	struct arena_block *next;
+	char *data;
+	size_t size;
+};
+
+static struct arena message_arena = {.block_size = CONFIG_MESSAGE_ARENA_BLOCK_SIZE};
+
+static char *align(char *ptr)
+{
+	return (char *)(((uintptr_t)ptr + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1));
+}
+
+static struct arena_block *alloc_block(size_t size)
+{
+	struct arena_block *block = cjet_malloc(sizeof(*block) + size + ARENA_ALIGNMENT - 1);
+	if (unlikely(block == NULL)) {
+		return NULL;
+	}
+	block->data = align((char *)(block + 1));
+	block->size = size;
+	return block;
+}
+
+void arena_init(struct arena *arena, size_t block_size)
+{
+	arena->blocks = NULL;
+	arena->next = NULL;
+	arena->end = NULL;
+	arena->block_size = block_size;
+}
+
+/*
+ * Allocations larger than a quarter of a block get a block of their own,
+ * which is put behind the current block so the rest of it is still used.
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	if (likely((arena->blocks != NULL) && ((size_t)(arena->end - arena->next) >= size))) {
+		void *ptr = arena->next;
+		arena->next += size;
+		return ptr;
+	}
+
+	if ((size > arena->block_size / 4) && (arena->blocks != NULL)) {
+		struct arena_block *block = alloc_block(size);
+		if (unlikely(block == NULL)) {
+			return NULL;
+		}
+		block->next = arena->blocks->next;
+		arena->blocks->next = block;
+		return block->data;
+	}
+
+	size_t block_size = (size > arena->block_size) ? size : arena->block_size;
+	struct arena_block *block = alloc_block(block_size);
+	if (unlikely(block == NULL)) {
+		return NULL;
+	}
+	block->next = arena->blocks;
+	arena->blocks = block;
+	arena->next = block->data + size;
+	arena->end = block->data + block_size;
+	return block->data;
+}
+
+bool arena_owns(const struct arena *arena, const void *ptr)
+{
+	const char *p = (const char *)ptr;
+	for (const struct arena_block *block = arena->blocks; block != NULL; block = block->next) {
+		if ((p >= block->data) && (p < block->data + block->size)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void arena_reset(struct arena *arena)
+{
+	struct arena_block *kept = NULL;
+	struct arena_block *block = arena->blocks;
+	while (block != NULL) {
+		struct arena_block *next = block->next;
+		if ((kept == NULL) && (block->size == arena->block_size)) {
+			kept = block;
+		} else {
+			cjet_free(block);
+		}
+		block = next;
+	}
+
+	arena->blocks = kept;
+	if (kept != NULL) {
+		kept->next = NULL;
+		arena->next = kept->data;
+		arena->end = kept->data + kept->size;
+	} else {
+		arena->next = NULL;
+		arena->end = NULL;
+	}
+}
+
+void arena_destroy(struct arena *arena)
+{
+	arena_reset(arena);
+	if (arena->blocks != NULL) {
+		cjet_free(arena->blocks);
+	}
+	arena_init(arena, arena->block_size);
+}
+
+/*
+ * Allocations of the message arena are preceded by a zero tag, where
+ * cjet_malloc() keeps the non zero size of a block. So memory of the
+ * message can be told apart without looking at the blocks of the arena.
+ */
+static const size_t MESSAGE_ARENA_TAG = 0;
+
+void *message_arena_alloc(size_t size)
+{
+	char *ptr = arena_alloc(&message_arena, ARENA_ALIGNMENT + size);
+	if (unlikely(ptr == NULL)) {
+		return NULL;
+	}
+	ptr += ARENA_ALIGNMENT;
+	((size_t *)ptr)[-1] = MESSAGE_ARENA_TAG;
+	return ptr;
+}
+
+bool message_arena_owns(const void *ptr)
+{
+	return ((const size_t *)ptr)[-1] == MESSAGE_ARENA_TAG;
+}
+
+void message_arena_reset(void)
+{
+	arena_reset(&message_arena);
+}
@@ -0,0 +1,72 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_ARENA_H
+#define CJET_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct arena_block;
+
+/*
+ * Bump pointer allocator for memory that is released all at once.
+ * Single allocations can't be freed, arena_reset() releases everything
+ * but keeps one block for the next round. Blocks are taken from
+ * cjet_malloc(), so they count against the configured heap size.
+ */
+struct arena {
+	struct arena_block *blocks; /* The block allocations are taken from comes first */
+	char *next;
+	char *end;
+	size_t block_size;
+};
+
+void arena_init(struct arena *arena, size_t block_size);
+void *arena_alloc(struct arena *arena, size_t size);
+bool arena_owns(const struct arena *arena, const void *ptr);
+void arena_reset(struct arena *arena);
+void arena_destroy(struct arena *arena);
+
+/*
+ * The arena of the message that is currently handled. It is reset after
+ * each message, so parts of a request that are kept have to be copied.
+ * message_arena_owns() reads the word in front of ptr, so it only takes
+ * memory from message_arena_alloc() or cjet_malloc().
+ */
+void *message_arena_alloc(size_t size);
+bool message_arena_owns(const void *ptr);
+void message_arena_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
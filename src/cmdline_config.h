@@ -37,6 +37,7 @@ struct cmdline_config {
 	const char *user_name;
 	const char *passwd_file;
 	const char *request_target;
+	const char *snapshot_file;
 };
 
 #ifdef __cplusplus
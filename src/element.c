@@ -25,17 +25,24 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "alloc.h"
+#include "arena.h"
 #include "compiler.h"
 #include "element.h"
+#include "element_directory.h"
+#include "fetch_sort.h"
 #include "generated/cjet_config.h"
 #include "groups.h"
 #include "hashtable.h"
 #include "jet_string.h"
+#include "json_index.h"
+#include "json_patch.h"
 #include "linux/linux_io.h"
 #include "list.h"
+#include "path_index.h"
 #include "peer.h"
 #include "request.h"
 #include "response.h"
@@ -43,11 +50,37 @@
 #include "table.h"
 #include "json/cJSON.h"
 
+/*
+ * Longer paths are left to the full parse of the request.
+ */
+enum { MAX_INDEXED_PATH_SIZE = 256 };
+
 static bool is_state(const struct element *e)
 {
 	return (e->value != NULL);
 }
 
+/*
+ * States are read far more often than they change, so the value is
+ * rendered once per add or change and spliced into get responses and
+ * notifications as raw JSON text.
+ */
+static cJSON *render_value(const cJSON *value)
+{
+	char *rendered = cJSON_PrintUnformatted(value);
+	if (unlikely(rendered == NULL)) {
+		return NULL;
+	}
+
+	cJSON *raw = cJSON_CreateRaw(rendered);
+	cjet_free(rendered);
+	if (unlikely((raw != NULL) && (raw->valuestring == NULL))) {
+		cJSON_Delete(raw);
+		return NULL;
+	}
+	return raw;
+}
+
 #define FILL_GROUP(access_groups, json_key)                                                                                                      \
 	static int fill_##access_groups(struct element *e, const struct peer *p, const cJSON *request, const cJSON *access, cJSON **response)    \
 	{                                                                                                                                        \
@@ -132,13 +165,45 @@ static int get_fetch_only_from_params(const struct peer *p, const cJSON *request
 	return -1;
 }
 
-static int init_element(struct element *e, const cJSON *request, struct peer *p, cJSON **response)
+static bool can_reclaim(const struct element *e, const struct peer *p)
 {
-	const cJSON *params = get_params(p, request, response);
-	if (unlikely(params == NULL)) {
-		return -1;
+	if (!element_is_orphaned(e)) {
+		return false;
+	}
+
+	if (e->orphan_owner == NULL) {
+		return true;
+	}
+
+	return (p->name != NULL) && (strcmp(e->orphan_owner, p->name) == 0);
+}
+
+/*
+ * Requests handled by parse_message() live in the message arena, so
+ * their value is copied to the heap. Only requests built on the heap,
+ * like the ones of the unit tests, have their value moved out instead.
+ * A reference is left behind, so the request keeps its value until it is
+ * deleted without freeing the moved tree.
+ *
+ * message_arena_owns() reads the word in front of the value, which is
+ * only valid because all cJSON nodes come from cjet_malloc() or the
+ * message arena.
+ */
+static cJSON *take_value_from_params(cJSON *params)
+{
+	const cJSON *value = cJSON_GetObjectItem(params, "value");
+	if (((value->type & cJSON_IsReference) == cJSON_IsReference) || message_arena_owns(value)) {
+		/* Already taken over by another state or released with the message, so copy it */
+		return cJSON_Duplicate(value, 1);
 	}
 
+	cJSON *taken_value = cJSON_DetachItemFromObject(params, "value");
+	cJSON_AddItemReferenceToObject(params, "value", taken_value);
+	return taken_value;
+}
+
+static int init_element(struct element *e, const cJSON *request, cJSON *params, struct peer *p, cJSON **response)
+{
 	const char *path = get_path_from_params(p, request, params, response);
 	if (unlikely(path == NULL)) {
 		return -1;
@@ -157,40 +222,37 @@ static int init_element(struct element *e, const cJSON *request, struct peer *p,
 		e->timeout_nsec = timeout_nsec;
 	}
 
-	if (unlikely(element_table_get(path) != NULL)) {
+	const struct element *existing = element_table_get(path);
+	if (unlikely((existing != NULL) && !can_reclaim(existing, p))) {
 		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "exists", path);
 		return -1;
 	}
-	const cJSON *value = cJSON_GetObjectItem(params, "value");
+	bool has_value = (cJSON_GetObjectItem(params, "value") != NULL);
 	const cJSON *access = cJSON_GetObjectItem(params, "access");
 
 	e->flags = flags;
-	e->fetch_table_size = CONFIG_INITIAL_FETCH_TABLE_SIZE;
-	e->fetcher_table = cjet_calloc(e->fetch_table_size, sizeof(struct fetch *));
-	if (e->fetcher_table == NULL) {
-		log_peer_err(p, "Could not allocate memory for fetch table!\n");
-		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to create fetch table");
-		return -1;
-	}
-
 	e->path = duplicate_string(path);
 	if (unlikely(e->path == NULL)) {
 		log_peer_err(p, "Could not allocate memory for %s object!\n", "path");
 		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to copy path");
-		goto alloc_path_failed;
+		return -1;
 	}
-
-	if (value != NULL) {
-		cJSON *value_copy = cJSON_Duplicate(value, 1);
-		if (unlikely(value_copy == NULL)) {
-			log_peer_err(p, "could not copy value object\n");
-			*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not copy value object");
-			goto value_copy_failed;
+	e->path_length = strlen(e->path);
+
+	if (has_value) {
+		cJSON *value = take_value_from_params(params);
+		e->rendered_value = render_value(value);
+		if (unlikely(e->rendered_value == NULL)) {
+			log_peer_err(p, "could not render value object\n");
+			*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not render value object");
+			cJSON_Delete(value);
+			goto render_value_failed;
 		}
-		e->value = value_copy;
+		e->value = value;
 	}
 
-	INIT_LIST_HEAD(&e->element_list);
+	INIT_LIST_HEAD(&e->sort_nodes);
+	INIT_LIST_HEAD(&e->throttle_entries);
 	e->peer = p;
 
 	if (fill_access(e, request, p, access, response) < 0) {
@@ -203,12 +265,11 @@ static int init_element(struct element *e, const cJSON *request, struct peer *p,
 
 fill_access_failed:
 	if (e->value != NULL) {
+		cJSON_Delete(e->rendered_value);
 		cJSON_Delete(e->value);
 	}
-value_copy_failed:
+render_value_failed:
 	cjet_free(e->path);
-alloc_path_failed:
-	cjet_free(e->fetcher_table);
 	return -1;
 }
 
@@ -226,14 +287,33 @@ static struct element *alloc_element(const struct peer *p)
 static void free_element(struct element *e)
 {
 	if (e->value != NULL) {
+		cJSON_Delete(e->rendered_value);
 		cJSON_Delete(e->value);
 	}
 
+	remove_all_fetchers_from_element(e);
+	if (e->lowercase_path != NULL) {
+		cjet_free(e->lowercase_path);
+	}
+	if (e->orphan_owner != NULL) {
+		cjet_free(e->orphan_owner);
+	}
 	cjet_free(e->path);
-	cjet_free(e->fetcher_table);
 	cjet_free(e);
 }
 
+static uint64_t state_changes = 0;
+
+void count_state_change(void)
+{
+	state_changes++;
+}
+
+uint64_t get_state_changes(void)
+{
+	return state_changes;
+}
+
 bool element_is_fetch_only(const struct element *e)
 {
 	if ((e->flags & FETCH_ONLY_FLAG) == FETCH_ONLY_FLAG) {
@@ -243,66 +323,183 @@ bool element_is_fetch_only(const struct element *e)
 	}
 }
 
-cJSON *change_state(const struct peer *p, const cJSON *request)
+bool element_is_orphaned(const struct element *e)
 {
-	cJSON *response = NULL;
-
-	const cJSON *params = get_params(p, request, &response);
-	if (unlikely(params == NULL)) {
-		return response;
-	}
+	return ((e->flags & ORPHANED_FLAG) == ORPHANED_FLAG);
+}
 
-	const char *path = get_path_from_params(p, request, params, &response);
-	if (unlikely(path == NULL)) {
-		return response;
+const char *get_lowercase_path(struct element *e)
+{
+	if (e->lowercase_path == NULL) {
+		e->lowercase_path = duplicate_string_lowercase(e->path);
 	}
+	return e->lowercase_path;
+}
 
-	const cJSON *value = cJSON_GetObjectItem(params, "value");
-	if (unlikely(value == NULL)) {
-		return create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "no value found");
-	}
+struct state_change {
+	struct element *e;
+	cJSON *new_value;
+	cJSON *rendered_value;
+	const cJSON *patch;
+};
 
+static struct element *get_changeable_state(const struct peer *p, const cJSON *request, const char *path, cJSON **response)
+{
 	struct element *e = element_table_get(path);
 	if (unlikely(e == NULL)) {
-		return create_error_response_from_request(p, request, INVALID_PARAMS, "not exists", path);
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "not exists", path);
+		return NULL;
 	}
 
 	if (unlikely(e->peer != p)) {
-		return create_error_response_from_request(p, request, INVALID_PARAMS, "not owner of state", path);
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "not owner of state", path);
+		return NULL;
 	}
 
 	if (unlikely(e->value == NULL)) {
-		return create_error_response_from_request(p, request, INVALID_PARAMS, "change on method not possible", path);
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "change on method not possible", path);
+		return NULL;
+	}
+
+	return e;
+}
+
+static int prepare_change(const struct peer *p, const cJSON *request, cJSON *params, struct state_change *change, cJSON **response)
+{
+	const char *path = get_path_from_params(p, request, params, response);
+	if (unlikely(path == NULL)) {
+		return -1;
 	}
 
-	cJSON *value_copy = cJSON_Duplicate(value, 1);
-	if (value_copy == NULL) {
-		return create_error_response_from_request(p, request, INTERNAL_ERROR, "not enough memory", path);
+	const cJSON *value = cJSON_GetObjectItem(params, "value");
+	const cJSON *patch = NULL;
+	if (value == NULL) {
+		patch = cJSON_GetObjectItem(params, "patch");
+		if (unlikely(patch == NULL)) {
+			*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "no value found");
+			return -1;
+		}
+		if (unlikely(patch->type != cJSON_Object)) {
+			*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "patch is not an object");
+			return -1;
+		}
 	}
 
-	cJSON_Delete(e->value);
-	e->value = value_copy;
-	if (unlikely(notify_fetchers(e, "change") != 0)) {
-		return create_error_response_from_request(p, request, INTERNAL_ERROR, "could not notify fetching peer", path);
+	struct element *e = get_changeable_state(p, request, path, response);
+	if (unlikely(e == NULL)) {
+		return -1;
 	}
 
-	return create_success_response_from_request(p, request);
+	cJSON *new_value;
+	if (patch != NULL) {
+		new_value = apply_merge_patch(e->value, patch);
+	} else {
+		new_value = take_value_from_params(params);
+	}
+	if (new_value == NULL) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "not enough memory", path);
+		return -1;
+	}
+
+	cJSON *rendered_value = render_value(new_value);
+	if (unlikely(rendered_value == NULL)) {
+		cJSON_Delete(new_value);
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "not enough memory", path);
+		return -1;
+	}
+
+	change->e = e;
+	change->new_value = new_value;
+	change->rendered_value = rendered_value;
+	change->patch = patch;
+	return 0;
 }
 
-cJSON *set_or_call(const struct peer *p, const cJSON *request, enum type what)
+static void discard_change(struct state_change *change)
+{
+	cJSON_Delete(change->rendered_value);
+	cJSON_Delete(change->new_value);
+}
+
+static int apply_change(const struct state_change *change)
+{
+	struct element *e = change->e;
+	cJSON *old_value = e->value;
+	cJSON_Delete(e->rendered_value);
+	e->value = change->new_value;
+	e->rendered_value = change->rendered_value;
+	count_state_change();
+	int ret = notify_fetchers_of_change(e, old_value, change->patch);
+	cJSON_Delete(old_value);
+	return ret;
+}
+
+cJSON *change_state(const struct peer *p, cJSON *request)
 {
 	cJSON *response = NULL;
 
-	const cJSON *params = get_params(p, request, &response);
+	cJSON *params = get_mutable_params(p, request, &response);
 	if (unlikely(params == NULL)) {
 		return response;
 	}
 
-	const char *path = get_path_from_params(p, request, params, &response);
-	if (unlikely(path == NULL)) {
+	struct state_change change;
+	if (unlikely(prepare_change(p, request, params, &change, &response) < 0)) {
 		return response;
 	}
 
+	if (unlikely(apply_change(&change) != 0)) {
+		return create_error_response_from_request(p, request, INTERNAL_ERROR, "could not notify fetching peer", change.e->path);
+	}
+
+	return create_success_response_from_request(p, request);
+}
+
+int change_state_indexed(const struct peer *p, const cJSON *request, const struct json_index *index, unsigned int params, cJSON **response)
+{
+	char path[MAX_INDEXED_PATH_SIZE];
+	unsigned int path_token = json_index_get_member(index, params, "path");
+	if ((path_token == JSON_INDEX_NO_TOKEN) || (json_index_copy_string(index, path_token, path, sizeof(path)) < 0)) {
+		return INDEXED_REQUEST_DECLINED;
+	}
+
+	unsigned int value_token = json_index_get_member(index, params, "value");
+	if (value_token == JSON_INDEX_NO_TOKEN) {
+		return INDEXED_REQUEST_DECLINED;
+	}
+
+	struct state_change change;
+	change.e = get_changeable_state(p, request, path, response);
+	if (unlikely(change.e == NULL)) {
+		return 0;
+	}
+
+	/*
+	 * The value was already validated by the index, its text is kept
+	 * as the rendered value.
+	 */
+	const char *value_text = json_index_token_text(index, value_token);
+	change.new_value = cJSON_ParseWithOpts(value_text, NULL, 0);
+	change.rendered_value = cJSON_CreateRawWithLength(value_text, json_index_token_length(index, value_token));
+	change.patch = NULL;
+	if (unlikely((change.new_value == NULL) || (change.rendered_value == NULL))) {
+		discard_change(&change);
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "not enough memory", path);
+		return 0;
+	}
+
+	if (unlikely(apply_change(&change) != 0)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "could not notify fetching peer", path);
+		return 0;
+	}
+
+	*response = create_success_response_from_request(p, request);
+	return 0;
+}
+
+static cJSON *route_request(const struct peer *p, const cJSON *request, const char *path, const cJSON *value, const cJSON *timeout, enum type what)
+{
+	cJSON *response = NULL;
 	struct element *e = element_table_get(path);
 	if (unlikely(e == NULL)) {
 		return create_error_response_from_request(p, request, INVALID_PARAMS, "not exists", path);
@@ -312,6 +509,10 @@ cJSON *set_or_call(const struct peer *p, const cJSON *request, enum type what)
 		return create_error_response_from_request(p, request, INVALID_PARAMS, "fetchOnly", path);
 	}
 
+	if (unlikely(element_is_orphaned(e))) {
+		return create_error_response_from_request(p, request, INVALID_PARAMS, "owner not connected", path);
+	}
+
 	if (unlikely(((what == STATE) && (e->value == NULL)) ||
 	             ((what == METHOD) && (e->value != NULL)))) {
 		return create_error_response_from_request(p, request, INVALID_PARAMS, "set/call on element not possible", path);
@@ -334,15 +535,9 @@ cJSON *set_or_call(const struct peer *p, const cJSON *request, enum type what)
 		return create_error_response_from_request(p, request, INTERNAL_ERROR, "could not create routing request", path);
 	}
 
-	const cJSON *value;
-	if (what == STATE) {
-		value = cJSON_GetObjectItem(params, "value");
-		if (unlikely(value == NULL)) {
-			response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "no value found");
-			goto no_value_found;
-		}
-	} else {
-		value = cJSON_GetObjectItem(params, "args");
+	if (unlikely((what == STATE) && (value == NULL))) {
+		response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "no value found");
+		goto no_value_found;
 	}
 
 	cJSON *routed_message = create_routed_message(p, path, what, value, routing_request->id);
@@ -351,7 +546,6 @@ cJSON *set_or_call(const struct peer *p, const cJSON *request, enum type what)
 		goto routed_message_creation_failed;
 	}
 
-	const cJSON *timeout = cJSON_GetObjectItem(params, "timeout");
 	if (unlikely(setup_routing_information(e, request, timeout, routing_request, &response) < 0)) {
 		goto delete_json;
 	}
@@ -362,8 +556,8 @@ cJSON *set_or_call(const struct peer *p, const cJSON *request, enum type what)
 		goto delete_json;
 	}
 
-	if (unlikely(e->peer->send_message(e->peer, rendered_message,
-	                                   strlen(rendered_message)) != 0)) {
+	if (unlikely((flush_notification_batch(e->peer) != 0) ||
+	             (e->peer->send_message(e->peer, rendered_message, strlen(rendered_message)) != 0))) {
 		response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not send routing information");
 	}
 
@@ -380,46 +574,279 @@ no_value_found:
 	return response;
 }
 
-cJSON *add_element_to_peer(struct peer *p, const cJSON *request)
+cJSON *set_or_call(const struct peer *p, const cJSON *request, enum type what)
 {
-	if (CONFIG_ALLOW_ADD_ONLY_FROM_LOCALHOST) {
-		if (!p->is_local_connection) {
-			return create_error_response_from_request(p, request, INVALID_REQUEST, "reason", "add only allowed from localhost");
+	cJSON *response = NULL;
+
+	const cJSON *params = get_params(p, request, &response);
+	if (unlikely(params == NULL)) {
+		return response;
+	}
+
+	const char *path = get_path_from_params(p, request, params, &response);
+	if (unlikely(path == NULL)) {
+		return response;
+	}
+
+	const cJSON *value = cJSON_GetObjectItem(params, (what == STATE) ? "value" : "args");
+	const cJSON *timeout = cJSON_GetObjectItem(params, "timeout");
+	return route_request(p, request, path, value, timeout, what);
+}
+
+/*
+ * The value is forwarded to the owner as raw text, only the timeout is
+ * parsed.
+ */
+int set_or_call_indexed(const struct peer *p, const cJSON *request, const struct json_index *index, unsigned int params, enum type what, cJSON **response)
+{
+	char path[MAX_INDEXED_PATH_SIZE];
+	unsigned int path_token = json_index_get_member(index, params, "path");
+	if ((path_token == JSON_INDEX_NO_TOKEN) || (json_index_copy_string(index, path_token, path, sizeof(path)) < 0)) {
+		return INDEXED_REQUEST_DECLINED;
+	}
+
+	cJSON *value = NULL;
+	unsigned int value_token = json_index_get_member(index, params, (what == STATE) ? "value" : "args");
+	if (value_token != JSON_INDEX_NO_TOKEN) {
+		value = cJSON_CreateRawWithLength(json_index_token_text(index, value_token), json_index_token_length(index, value_token));
+		if (unlikely(value == NULL)) {
+			return INDEXED_REQUEST_DECLINED;
+		}
+	}
+
+	cJSON *timeout = NULL;
+	unsigned int timeout_token = json_index_get_member(index, params, "timeout");
+	if (timeout_token != JSON_INDEX_NO_TOKEN) {
+		timeout = cJSON_ParseWithOpts(json_index_token_text(index, timeout_token), NULL, 0);
+		if (unlikely(timeout == NULL)) {
+			cJSON_Delete(value);
+			return INDEXED_REQUEST_DECLINED;
 		}
 	}
 
+	*response = route_request(p, request, path, value, timeout, what);
+	cJSON_Delete(timeout);
+	cJSON_Delete(value);
+	return 0;
+}
+
+static void remove_element(struct element *e)
+{
+	notify_fetchers(e, "remove");
+	count_state_change();
+	element_directory_remove(&e->peer->elements, e);
+	element_table_remove(e->path);
+	path_index_remove(&e->path_index_entry);
+	free_element(e);
+}
+
+/*
+ * The orphaned state is taken over in place, so fetchers keep their
+ * links and are only notified if the owner brings a different value or
+ * different fetch groups.
+ */
+static int reclaim_element(struct element *orphan, struct element *e, struct peer *p)
+{
+	int ret = 0;
+	if (orphan->fetch_groups != e->fetch_groups) {
+		ret |= notify_fetchers(orphan, "remove");
+		orphan->fetch_groups = e->fetch_groups;
+		ret |= notify_fetchers(orphan, "add");
+	}
+
+	orphan->set_groups = e->set_groups;
+	orphan->call_groups = e->call_groups;
+	orphan->flags = e->flags;
+	orphan->timeout_nsec = e->timeout_nsec;
+	element_directory_remove(&orphan->peer->elements, orphan);
+	if (orphan->peer != p) {
+		/* Room reserved in the directory of p is kept */
+		element_directory_compact(&orphan->peer->elements);
+	}
+	orphan->peer = p;
+	element_directory_add(&p->elements, orphan);
+	count_state_change();
+	if (orphan->orphan_owner != NULL) {
+		cjet_free(orphan->orphan_owner);
+		orphan->orphan_owner = NULL;
+	}
+
+	cJSON *old_value = orphan->value;
+	cJSON *old_rendered_value = orphan->rendered_value;
+	orphan->value = e->value;
+	orphan->rendered_value = e->rendered_value;
+	e->value = old_value;
+	e->rendered_value = old_rendered_value;
+	if (!json_equal(old_value, orphan->value)) {
+		ret |= notify_fetchers_of_change(orphan, old_value, NULL);
+	}
+
+	free_element(e);
+	return ret;
+}
+
+static struct element *create_element(struct peer *p, const cJSON *request, cJSON *params, cJSON **response)
+{
 	struct element *e = alloc_element(p);
 	if (unlikely(e == NULL)) {
-		return create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate jet element");
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate jet element");
+		return NULL;
 	}
 
-	cJSON *response;
-	if (unlikely(init_element(e, request, p, &response) < 0)) {
+	if (unlikely(init_element(e, request, params, p, response) < 0)) {
 		cjet_free(e);
-		return response;
+		return NULL;
+	}
+
+	return e;
+}
+
+/*
+ * Makes the element visible to fetchers and adds it to the peer. The
+ * element is freed on error, the reason is returned. If the element
+ * reclaims an orphaned state, *element is set to the orphaned state.
+ */
+static const char *publish_element(struct peer *p, struct element **element)
+{
+	struct element *e = *element;
+	if (unlikely(element_directory_reserve(&p->elements, 1, e->path_length) != 0)) {
+		free_element(e);
+		return "not enough memory to add element to directory";
+	}
+
+	struct element *orphan = element_table_get(e->path);
+	if (orphan != NULL) {
+		if (is_state(e)) {
+			*element = orphan;
+			if (unlikely(reclaim_element(orphan, e, p) != 0)) {
+				return "could not notify fetching peer";
+			}
+			return NULL;
+		}
+		remove_element(orphan);
 	}
 
 	if (unlikely(find_fetchers_for_element(e) != 0)) {
 		free_element(e);
-		return create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not notify fetching peer");
+		return "could not notify fetching peer";
 	}
 
 	if (unlikely(element_table_put(e->path, e) != HASHTABLE_SUCCESS)) {
 		free_element(e);
-		return create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "element table full");
+		return "element table full";
 	}
 
-	list_add_tail(&e->element_list, &p->element_list);
+	e->path_index_entry.path = e->path;
+	if (unlikely(path_index_insert(&e->path_index_entry) != 0)) {
+		element_table_remove(e->path);
+		free_element(e);
+		return "could not add element to path index";
+	}
+
+	element_directory_add(&p->elements, e);
+	count_state_change();
+	return NULL;
+}
+
+cJSON *add_element_to_peer(struct peer *p, cJSON *request)
+{
+	if (CONFIG_ALLOW_ADD_ONLY_FROM_LOCALHOST) {
+		if (!p->is_local_connection) {
+			return create_error_response_from_request(p, request, INVALID_REQUEST, "reason", "add only allowed from localhost");
+		}
+	}
+
+	cJSON *response;
+	cJSON *params = get_mutable_params(p, request, &response);
+	if (unlikely(params == NULL)) {
+		return response;
+	}
+
+	struct element *e = create_element(p, request, params, &response);
+	if (unlikely(e == NULL)) {
+		return response;
+	}
+
+	const char *reason = publish_element(p, &e);
+	if (unlikely(reason != NULL)) {
+		return create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", reason);
+	}
 
 	return create_success_response_from_request(p, request);
 }
 
-static void remove_element(struct element *e)
+int add_orphaned_element(struct peer *p, const char *path, const char *owner_name, cJSON *value, int flags, group_t fetch_groups, group_t set_groups, group_t call_groups)
 {
-	notify_fetchers(e, "remove");
-	list_del(&e->element_list);
-	element_table_remove(e->path);
+	if (unlikely((element_table_get(path) != NULL) || (element_directory_reserve(&p->elements, 1, strlen(path)) != 0))) {
+		return -1;
+	}
+
+	struct element *e = alloc_element(p);
+	if (unlikely(e == NULL)) {
+		return -1;
+	}
+
+	e->path = duplicate_string(path);
+	if (unlikely(e->path == NULL)) {
+		goto alloc_path_failed;
+	}
+	e->path_length = strlen(e->path);
+
+	if (owner_name != NULL) {
+		e->orphan_owner = duplicate_string(owner_name);
+		if (unlikely(e->orphan_owner == NULL)) {
+			goto alloc_owner_failed;
+		}
+	}
+
+	e->rendered_value = render_value(value);
+	if (unlikely(e->rendered_value == NULL)) {
+		goto render_value_failed;
+	}
+
+	INIT_LIST_HEAD(&e->sort_nodes);
+	INIT_LIST_HEAD(&e->throttle_entries);
+	e->peer = p;
+	e->value = value;
+	e->flags = flags | ORPHANED_FLAG;
+	e->fetch_groups = fetch_groups;
+	e->set_groups = set_groups;
+	e->call_groups = call_groups;
+	e->timeout_nsec = convert_seconds_to_nsec(CONFIG_ROUTED_MESSAGES_TIMEOUT);
+
+	if (unlikely(find_fetchers_for_element(e) != 0)) {
+		goto find_fetchers_failed;
+	}
+
+	if (unlikely(element_table_put(e->path, e) != HASHTABLE_SUCCESS)) {
+		goto find_fetchers_failed;
+	}
+
+	e->path_index_entry.path = e->path;
+	if (unlikely(path_index_insert(&e->path_index_entry) != 0)) {
+		element_table_remove(e->path);
+		goto find_fetchers_failed;
+	}
+
+	element_directory_add(&p->elements, e);
+	count_state_change();
+	return 0;
+
+find_fetchers_failed:
+	cJSON_Delete(e->rendered_value);
+	e->value = NULL;
 	free_element(e);
+	return -1;
+
+render_value_failed:
+	if (e->orphan_owner != NULL) {
+		cjet_free(e->orphan_owner);
+	}
+alloc_owner_failed:
+	cjet_free(e->path);
+alloc_path_failed:
+	cjet_free(e);
+	return -1;
 }
 
 cJSON *remove_element_from_peer(const struct peer *p, const cJSON *request)
@@ -435,25 +862,296 @@ cJSON *remove_element_from_peer(const struct peer *p, const cJSON *request)
 		return response;
 	}
 
-	struct list_head *item;
-	struct list_head *tmp;
-	list_for_each_safe (item, tmp, &p->element_list) {
-		struct element *e = list_entry(item, struct element, element_list);
-		if (strcmp(e->path, path) == 0) {
+	struct element *e = element_table_get(path);
+	if ((e == NULL) || (e->peer != p)) {
+		return create_error_response_from_request(p, request, INVALID_PARAMS, "not exists", path);
+	}
+
+	struct element_directory *dir = &e->peer->elements;
+	remove_element(e);
+	element_directory_compact(dir);
+	return create_success_response_from_request(p, request);
+}
+
+/*
+ * Sorted fetches get a single notification of their new window instead
+ * of one per removed element. The "remove" notifications of all other
+ * fetches are queued into the notification batch of each fetching peer.
+ */
+void remove_all_elements_from_peer(struct peer *p)
+{
+	fetch_sort_defer_window_notifications();
+
+	struct element_directory *dir = &p->elements;
+	for (unsigned int i = 0; i < dir->size; i++) {
+		struct element *e = dir->elements[i];
+		if (e != NULL) {
 			remove_element(e);
-			return create_success_response_from_request(p, request);
 		}
 	}
+	element_directory_compact(dir);
 
-	return create_error_response_from_request(p, request, INVALID_PARAMS, "not exists", path);
+	if (unlikely(fetch_sort_notify_deferred_windows() != 0)) {
+		log_peer_err(p, "Could not notify sorted fetches about removed states!\n");
+	}
 }
 
-void remove_all_elements_from_peer(struct peer *p)
+/*
+ * The batch variants of add, remove and change carry the params of the
+ * single requests in an "elements" array. All entries are checked before
+ * the first one is applied, so an invalid entry leaves all states
+ * untouched. Sorted fetches get a single window notification per batch,
+ * all other notifications go into the notification batch of each
+ * fetching peer.
+ */
+static const cJSON *get_batch_from_params(const struct peer *p, const cJSON *request, const cJSON *params, unsigned int *number_of_entries, cJSON **response)
+{
+	const cJSON *elements = cJSON_GetObjectItem(params, "elements");
+	if (unlikely(elements == NULL)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "no elements given");
+		return NULL;
+	}
+
+	if (unlikely(elements->type != cJSON_Array)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "elements is not an array");
+		return NULL;
+	}
+
+	*number_of_entries = cJSON_GetArraySize(elements);
+	return elements;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+	const char *const *path_a = (const char *const *)a;
+	const char *const *path_b = (const char *const *)b;
+	return strcmp(*path_a, *path_b);
+}
+
+static const char *find_duplicate_path(const char **paths, unsigned int number_of_paths)
+{
+	qsort(paths, number_of_paths, sizeof(*paths), compare_paths);
+	for (unsigned int i = 1; i < number_of_paths; i++) {
+		if (strcmp(paths[i - 1], paths[i]) == 0) {
+			return paths[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void free_unpublished_elements(struct element **elements, unsigned int number_of_elements)
+{
+	for (unsigned int i = 0; i < number_of_elements; i++) {
+		free_element(elements[i]);
+	}
+}
+
+static cJSON *publish_elements(struct peer *p, const cJSON *request, struct element **elements, unsigned int number_of_elements)
 {
-	struct list_head *item;
-	struct list_head *tmp;
-	list_for_each_safe (item, tmp, &p->element_list) {
-		struct element *e = list_entry(item, struct element, element_list);
-		remove_element(e);
+	const char *reason = NULL;
+	unsigned int i;
+
+	fetch_sort_defer_window_notifications();
+	for (i = 0; i < number_of_elements; i++) {
+		reason = publish_element(p, &elements[i]);
+		if (unlikely(reason != NULL)) {
+			break;
+		}
+	}
+
+	if (unlikely(reason != NULL)) {
+		for (unsigned int j = 0; j < i; j++) {
+			remove_element(elements[j]);
+		}
+		free_unpublished_elements(&elements[i + 1], number_of_elements - i - 1);
+	}
+
+	if (unlikely(fetch_sort_notify_deferred_windows() != 0)) {
+		log_peer_err(p, "Could not notify sorted fetches about added states!\n");
+	}
+
+	if (unlikely(reason != NULL)) {
+		return create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", reason);
+	}
+
+	return create_success_response_from_request(p, request);
+}
+
+cJSON *add_elements_to_peer(struct peer *p, cJSON *request)
+{
+	if (CONFIG_ALLOW_ADD_ONLY_FROM_LOCALHOST) {
+		if (!p->is_local_connection) {
+			return create_error_response_from_request(p, request, INVALID_REQUEST, "reason", "add only allowed from localhost");
+		}
+	}
+
+	cJSON *response = NULL;
+	const cJSON *params = get_params(p, request, &response);
+	if (unlikely(params == NULL)) {
+		return response;
+	}
+
+	unsigned int number_of_elements;
+	const cJSON *batch = get_batch_from_params(p, request, params, &number_of_elements, &response);
+	if (unlikely(batch == NULL)) {
+		return response;
+	}
+
+	if (number_of_elements == 0) {
+		return create_success_response_from_request(p, request);
 	}
+
+	struct element **elements = cjet_malloc(number_of_elements * sizeof(*elements));
+	const char **paths = cjet_malloc(number_of_elements * sizeof(*paths));
+	if (unlikely((elements == NULL) || (paths == NULL))) {
+		response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate batch");
+		goto alloc_failed;
+	}
+
+	unsigned int i = 0;
+	for (cJSON *entry = batch->child; entry != NULL; entry = entry->next) {
+		elements[i] = create_element(p, request, entry, &response);
+		if (unlikely(elements[i] == NULL)) {
+			free_unpublished_elements(elements, i);
+			goto out;
+		}
+		paths[i] = elements[i]->path;
+		i++;
+	}
+
+	const char *duplicate = find_duplicate_path(paths, number_of_elements);
+	if (unlikely(duplicate != NULL)) {
+		response = create_error_response_from_request(p, request, INVALID_PARAMS, "exists", duplicate);
+		free_unpublished_elements(elements, number_of_elements);
+		goto out;
+	}
+
+	response = publish_elements(p, request, elements, number_of_elements);
+
+out:
+alloc_failed:
+	if (paths != NULL) {
+		cjet_free(paths);
+	}
+	if (elements != NULL) {
+		cjet_free(elements);
+	}
+	return response;
+}
+
+cJSON *remove_elements_from_peer(const struct peer *p, const cJSON *request)
+{
+	cJSON *response = NULL;
+	const cJSON *params = get_params(p, request, &response);
+	if (unlikely(params == NULL)) {
+		return response;
+	}
+
+	unsigned int number_of_elements;
+	const cJSON *batch = get_batch_from_params(p, request, params, &number_of_elements, &response);
+	if (unlikely(batch == NULL)) {
+		return response;
+	}
+
+	for (const cJSON *entry = batch->child; entry != NULL; entry = entry->next) {
+		const char *path = get_path_from_params(p, request, entry, &response);
+		if (unlikely(path == NULL)) {
+			return response;
+		}
+
+		const struct element *e = element_table_get(path);
+		if ((e == NULL) || (e->peer != p)) {
+			return create_error_response_from_request(p, request, INVALID_PARAMS, "not exists", path);
+		}
+	}
+
+	fetch_sort_defer_window_notifications();
+	struct element_directory *dir = NULL;
+	for (const cJSON *entry = batch->child; entry != NULL; entry = entry->next) {
+		const cJSON *path = cJSON_GetObjectItem(entry, "path");
+		struct element *e = element_table_get(path->valuestring);
+		if (e != NULL) {
+			dir = &e->peer->elements;
+			remove_element(e);
+		}
+	}
+	if (dir != NULL) {
+		element_directory_compact(dir);
+	}
+
+	if (unlikely(fetch_sort_notify_deferred_windows() != 0)) {
+		log_peer_err(p, "Could not notify sorted fetches about removed states!\n");
+	}
+
+	return create_success_response_from_request(p, request);
+}
+
+cJSON *change_states(const struct peer *p, cJSON *request)
+{
+	cJSON *response = NULL;
+	const cJSON *params = get_params(p, request, &response);
+	if (unlikely(params == NULL)) {
+		return response;
+	}
+
+	unsigned int number_of_changes;
+	const cJSON *batch = get_batch_from_params(p, request, params, &number_of_changes, &response);
+	if (unlikely(batch == NULL)) {
+		return response;
+	}
+
+	if (number_of_changes == 0) {
+		return create_success_response_from_request(p, request);
+	}
+
+	struct state_change *changes = cjet_malloc(number_of_changes * sizeof(*changes));
+	const char **paths = cjet_malloc(number_of_changes * sizeof(*paths));
+	if (unlikely((changes == NULL) || (paths == NULL))) {
+		response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate batch");
+		goto alloc_failed;
+	}
+
+	unsigned int i = 0;
+	for (cJSON *entry = batch->child; entry != NULL; entry = entry->next) {
+		if (unlikely(prepare_change(p, request, entry, &changes[i], &response) < 0)) {
+			goto prepare_failed;
+		}
+		paths[i] = changes[i].e->path;
+		i++;
+	}
+
+	const char *duplicate = find_duplicate_path(paths, number_of_changes);
+	if (unlikely(duplicate != NULL)) {
+		response = create_error_response_from_request(p, request, INVALID_PARAMS, "duplicate path", duplicate);
+		goto prepare_failed;
+	}
+
+	int ret = 0;
+	fetch_sort_defer_window_notifications();
+	for (i = 0; i < number_of_changes; i++) {
+		ret |= apply_change(&changes[i]);
+	}
+	ret |= fetch_sort_notify_deferred_windows();
+
+	if (unlikely(ret != 0)) {
+		response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not notify fetching peer");
+	} else {
+		response = create_success_response_from_request(p, request);
+	}
+	goto out;
+
+prepare_failed:
+	for (unsigned int j = 0; j < i; j++) {
+		discard_change(&changes[j]);
+	}
+out:
+alloc_failed:
+	if (paths != NULL) {
+		cjet_free(paths);
+	}
+	if (changes != NULL) {
+		cjet_free(changes);
+	}
+	return response;
 }
@@ -28,11 +28,15 @@
 #define CJET_HANDLE_STATE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "compiler.h"
 #include "fetch.h"
+#include "fetcher_set.h"
 #include "groups.h"
+#include "json_index.h"
 #include "list.h"
+#include "path_index.h"
 #include "peer.h"
 #include "json/cJSON.h"
 
@@ -42,32 +46,86 @@ extern "C" {
 
 /*
  * A struct element represent either a state or a method.
+ *
+ * The fields needed to notify fetchers come first. Full scans only look
+ * at the element directory of the peer, the fields used by set, call
+ * and orphaned states are at the end.
  */
 struct element {
-	struct list_head element_list;
 	char *path;
-	struct peer *peer; /*The peer the state belongs to */
+	size_t path_length;
+	struct fetcher_set *fetchers; /* NULL if no fetch expression is attached */
+	cJSON *rendered_value; /* Raw JSON text of value, referenced by responses and notifications */
 	cJSON *value;      /* NULL if method */
-	const struct fetch **fetcher_table;
+	struct peer *peer; /*The peer the state belongs to */
 	group_t fetch_groups;
+	int flags;
+	unsigned int directory_index; /* Slot in the element directory of the peer */
+	char *lowercase_path; /* Created on first use by a case insensitive fetch */
+	struct list_head next_in_fetcher_set;
+	struct list_head sort_nodes; /* Positions of the element in sorted fetches */
+	struct list_head throttle_entries; /* Coalesced notifications of throttled fetches */
+	struct path_index_entry path_index_entry;
 	group_t set_groups;
 	group_t call_groups;
-	int flags;
 	uint64_t timeout_nsec;
-	unsigned int fetch_table_size;
+	char *orphan_owner; /* Name of the owner that added an orphaned state before the restart */
 };
 
 enum type { STATE, METHOD };
 
 static const int FETCH_ONLY_FLAG = 0x01;
+static const int ORPHANED_FLAG = 0x02;
 
 bool element_is_fetch_only(const struct element *e);
-cJSON *change_state(const struct peer *p, const cJSON *request);
+bool element_is_orphaned(const struct element *e);
+
+/*
+ * Counts every add, change and removal of a state and every change of
+ * the name of its owner, so a snapshot is only written if anything
+ * changed since the last one.
+ */
+void count_state_change(void);
+uint64_t get_state_changes(void);
+const char *get_lowercase_path(struct element *e);
+
+/*
+ * change_state() and add_element_to_peer() take over the value of the
+ * request instead of copying it. The request only keeps a reference, so
+ * it must be deleted before the state is changed again.
+ */
+cJSON *change_state(const struct peer *p, cJSON *request);
 cJSON *set_or_call(const struct peer *p, const cJSON *request, enum type what);
-cJSON *add_element_to_peer(struct peer *p, const cJSON *request);
+cJSON *add_element_to_peer(struct peer *p, cJSON *request);
 cJSON *remove_element_from_peer(const struct peer *p, const cJSON *request);
 void remove_all_elements_from_peer(struct peer *p);
 
+/*
+ * Variants of change_state() and set_or_call() working on the index of
+ * a request without a cJSON tree. request only has to hold the id.
+ * Requests these variants can't handle are declined before anything is
+ * changed, they have to be handled by the full parse then.
+ */
+static const int INDEXED_REQUEST_DECLINED = 1;
+int change_state_indexed(const struct peer *p, const cJSON *request, const struct json_index *index, unsigned int params, cJSON **response);
+int set_or_call_indexed(const struct peer *p, const cJSON *request, const struct json_index *index, unsigned int params, enum type what, cJSON **response);
+
+/*
+ * Batch variants of add, remove and change. The "elements" array of the
+ * params holds the params of the single requests. Either all entries are
+ * applied or none.
+ */
+cJSON *add_elements_to_peer(struct peer *p, cJSON *request);
+cJSON *remove_elements_from_peer(const struct peer *p, const cJSON *request);
+cJSON *change_states(const struct peer *p, cJSON *request);
+
+/*
+ * Adds a state restored from a snapshot. It is served to fetchers but
+ * cannot be set until a peer named owner_name (or any peer if the name
+ * is NULL) adds it again. The value is owned by the element on success.
+ */
+int add_orphaned_element(struct peer *p, const char *path, const char *owner_name, cJSON *value, int flags, group_t fetch_groups, group_t set_groups, group_t call_groups);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,173 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "element.h"
+#include "element_directory.h"
+#include "groups.h"
+
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+enum { INITIAL_DIRECTORY_CAPACITY = 16 };
+enum { INITIAL_PATH_BUFFER_CAPACITY = 512 };
+
+static const size_t slot_size = sizeof(struct element *) + sizeof(size_t) + sizeof(size_t) + sizeof(group_t);
+
+/*
+ * All arrays live in a single block, ordered by decreasing alignment.
+ */
+static void set_arrays(struct element_directory *dir, void *block, unsigned int capacity)
+{
+	dir->elements = (struct element **)block;
+	dir->path_offsets = (size_t *)(dir->elements + capacity);
+	dir->path_lengths = dir->path_offsets + capacity;
+	dir->fetch_groups = (group_t *)(dir->path_lengths + capacity);
+	dir->capacity = capacity;
+}
+
+void element_directory_init(struct element_directory *dir)
+{
+	dir->elements = NULL;
+	dir->path_offsets = NULL;
+	dir->path_lengths = NULL;
+	dir->fetch_groups = NULL;
+	dir->path_buffer = NULL;
+	dir->path_buffer_size = 0;
+	dir->path_buffer_capacity = 0;
+	dir->path_bytes = 0;
+	dir->size = 0;
+	dir->capacity = 0;
+	dir->number_of_elements = 0;
+}
+
+void element_directory_free(struct element_directory *dir)
+{
+	if (dir->elements != NULL) {
+		cjet_free(dir->elements);
+	}
+	if (dir->path_buffer != NULL) {
+		cjet_free(dir->path_buffer);
+	}
+	element_directory_init(dir);
+}
+
+static void set_slot(struct element_directory *dir, unsigned int index, struct element *e)
+{
+	size_t length = e->path_length + 1;
+	memcpy(dir->path_buffer + dir->path_buffer_size, e->path, length);
+	dir->elements[index] = e;
+	dir->path_offsets[index] = dir->path_buffer_size;
+	dir->path_lengths[index] = e->path_length;
+	dir->fetch_groups[index] = e->fetch_groups;
+	dir->path_buffer_size += length;
+	e->directory_index = index;
+}
+
+/*
+ * The elements are copied in their order into new arrays without the
+ * holes. The new arrays are at most half full afterwards, even if room
+ * for number_of_elements more elements is left.
+ */
+static int reorganize(struct element_directory *dir, unsigned int number_of_elements, size_t path_bytes)
+{
+	unsigned int capacity = MAX(INITIAL_DIRECTORY_CAPACITY, (dir->number_of_elements + number_of_elements) * 2);
+	size_t path_buffer_capacity = MAX(INITIAL_PATH_BUFFER_CAPACITY, (dir->path_bytes + path_bytes) * 2);
+	void *block = cjet_malloc(capacity * slot_size);
+	if (unlikely(block == NULL)) {
+		return -1;
+	}
+	char *path_buffer = cjet_malloc(path_buffer_capacity);
+	if (unlikely(path_buffer == NULL)) {
+		cjet_free(block);
+		return -1;
+	}
+
+	struct element_directory reorganized;
+	element_directory_init(&reorganized);
+	set_arrays(&reorganized, block, capacity);
+	reorganized.path_buffer = path_buffer;
+	reorganized.path_buffer_capacity = path_buffer_capacity;
+	for (unsigned int i = 0; i < dir->size; i++) {
+		struct element *e = dir->elements[i];
+		if (e != NULL) {
+			set_slot(&reorganized, reorganized.size, e);
+			reorganized.size++;
+		}
+	}
+	reorganized.number_of_elements = dir->number_of_elements;
+	reorganized.path_bytes = dir->path_bytes;
+
+	element_directory_free(dir);
+	*dir = reorganized;
+	return 0;
+}
+
+int element_directory_reserve(struct element_directory *dir, unsigned int number_of_elements, size_t path_length)
+{
+	size_t path_bytes = path_length + number_of_elements;
+	if ((dir->size + number_of_elements <= dir->capacity) && (dir->path_buffer_size + path_bytes <= dir->path_buffer_capacity)) {
+		return 0;
+	}
+
+	return reorganize(dir, number_of_elements, path_bytes);
+}
+
+void element_directory_add(struct element_directory *dir, struct element *e)
+{
+	set_slot(dir, dir->size, e);
+	dir->size++;
+	dir->number_of_elements++;
+	dir->path_bytes += e->path_length + 1;
+}
+
+void element_directory_remove(struct element_directory *dir, const struct element *e)
+{
+	dir->elements[e->directory_index] = NULL;
+	dir->number_of_elements--;
+	dir->path_bytes -= e->path_length + 1;
+	if (dir->number_of_elements == 0) {
+		dir->size = 0;
+		dir->path_buffer_size = 0;
+	}
+}
+
+void element_directory_compact(struct element_directory *dir)
+{
+	if (dir->number_of_elements == 0) {
+		element_directory_free(dir);
+		return;
+	}
+
+	unsigned int holes = dir->size - dir->number_of_elements;
+	if (holes * 2 > dir->size) {
+		/* If there is no memory for the new arrays the holes just stay */
+		reorganize(dir, 0, 0);
+	}
+}
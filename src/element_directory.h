@@ -0,0 +1,93 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_ELEMENT_DIRECTORY_H
+#define CJET_ELEMENT_DIRECTORY_H
+
+#include <stddef.h>
+
+#include "groups.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct element;
+
+/*
+ * The elements of a peer in the order they were added. The fields
+ * needed to decide if a full scan has to look at an element are kept
+ * in parallel arrays, and the directory keeps its own copy of all paths
+ * packed in one buffer. So a scan reads contiguous memory and only
+ * touches the elements that pass the path and access checks.
+ *
+ * Removed elements leave a hole (NULL element) so a scan may remove the
+ * visited element. The holes are closed when room for new elements is
+ * reserved or the directory is compacted.
+ */
+struct element_directory {
+	struct element **elements;
+	size_t *path_offsets; /* Position of the path copy in path_buffer */
+	size_t *path_lengths;
+	group_t *fetch_groups;
+	char *path_buffer;
+	size_t path_buffer_size; /* Used bytes including the paths of holes */
+	size_t path_buffer_capacity;
+	size_t path_bytes; /* Bytes used by the paths of the elements */
+	unsigned int size; /* Used slots including holes */
+	unsigned int capacity;
+	unsigned int number_of_elements;
+};
+
+void element_directory_init(struct element_directory *dir);
+void element_directory_free(struct element_directory *dir);
+
+/*
+ * Makes sure that element_directory_add() can be called for
+ * number_of_elements elements with paths of path_length bytes in total
+ * without allocating memory. Might move the elements to other slots,
+ * so it must not be called during a scan.
+ */
+int element_directory_reserve(struct element_directory *dir, unsigned int number_of_elements, size_t path_length);
+void element_directory_add(struct element_directory *dir, struct element *e);
+void element_directory_remove(struct element_directory *dir, const struct element *e);
+
+/*
+ * Closes the holes and shrinks the arrays once more than half of the
+ * used slots are holes. Must not be called during a scan.
+ */
+void element_directory_compact(struct element_directory *dir);
+
+static inline const char *element_directory_path(const struct element_directory *dir, unsigned int index)
+{
+	return dir->path_buffer + dir->path_offsets[index];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -25,20 +25,33 @@
  */
 
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "alloc.h"
 #include "compiler.h"
+#include "element_directory.h"
 #include "fetch.h"
+#include "fetch_index.h"
+#include "fetch_sort.h"
+#include "fetch_throttle.h"
+#include "fetcher_set.h"
 #include "generated/cjet_config.h"
 #include "groups.h"
+#include "hashtable.h"
+#include "jet_regex.h"
 #include "jet_string.h"
+#include "json_patch.h"
 #include "linux/linux_io.h"
 #include "list.h"
 #include "log.h"
+#include "path_index.h"
 #include "peer.h"
 #include "request.h"
 #include "response.h"
+#include "util.h"
+#include "value_matcher.h"
 #include "json/cJSON.h"
 
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
@@ -51,9 +64,9 @@ static const char case_insensitive[] = "caseInsensitive";
 
 struct supported_matcher {
 	const char *matcher_name;
-	match_func case_sensitive;
-	match_func case_insensitive;
+	match_func match_function;
 	bool has_multiple_path_elements;
+	enum fetch_index_type index_type;
 };
 
 static const cJSON *get_fetch_id(const struct peer *p, const cJSON *request, const cJSON *params, cJSON **response)
@@ -76,97 +89,65 @@ static const cJSON *get_case_insensitive(const cJSON *path)
 	return cJSON_GetObjectItem(path, case_insensitive);
 }
 
-static int equals_match(const struct path_matcher *pm, const char *state_path)
-{
-	return !strcmp(pm->path_elements[0], state_path);
-}
-
-static int equals_match_ignore_case(const struct path_matcher *pm, const char *state_path)
-{
-	return !jet_strcasecmp(pm->path_elements[0], state_path);
-}
-
-static int contains_match(const struct path_matcher *pm,
-                          const char *state_path)
-{
-	return strstr(state_path, pm->path_elements[0]) != NULL;
-}
-
-static int contains_match_ignore_case(const struct path_matcher *pm,
-                                      const char *state_path)
-{
-	return jet_strcasestr(state_path, pm->path_elements[0]) != NULL;
-}
-
-static int startswith_match(const struct path_matcher *pm,
-                            const char *state_path)
-{
-	size_t fetch_path_length = strlen(pm->path_elements[0]);
-	return !strncmp(pm->path_elements[0], state_path, fetch_path_length);
-}
-
-static int startswith_match_ignore_case(const struct path_matcher *pm,
-                                        const char *state_path)
+/*
+ * All matchers work on the lowercase path of the element if the fetch is
+ * case insensitive. The path elements of such a fetch were already
+ * converted to lowercase when the fetch was created.
+ */
+static int equals_match(const struct path_matcher *pm, const char *state_path, size_t state_path_length)
 {
-	size_t fetch_path_length = strlen(pm->path_elements[0]);
-	return !jet_strncasecmp(pm->path_elements[0], state_path, fetch_path_length);
+	const struct path_element *pe = &pm->path_elements[0];
+	return (state_path_length == pe->length) && (memcmp(pe->string, state_path, state_path_length) == 0);
 }
 
-static int endswith_match(const struct path_matcher *pm,
-                          const char *state_path)
+static int contains_match(const struct path_matcher *pm, const char *state_path, size_t state_path_length)
 {
-	size_t fetch_path_length = strlen(pm->path_elements[0]);
-	size_t state_path_length = strlen(state_path);
-	return (state_path_length >= fetch_path_length) &&
-	       (strcmp(state_path + state_path_length - fetch_path_length, pm->path_elements[0]) == 0);
+	const struct path_element *pe = &pm->path_elements[0];
+	return jet_memmem(state_path, state_path_length, pe->string, pe->length) != NULL;
 }
 
-static int endswith_match_ignore_case(const struct path_matcher *pm,
-                                      const char *state_path)
+static int startswith_match(const struct path_matcher *pm, const char *state_path, size_t state_path_length)
 {
-	size_t fetch_path_length = strlen(pm->path_elements[0]);
-	size_t state_path_length = strlen(state_path);
-	return (state_path_length >= fetch_path_length) &&
-	       (jet_strcasecmp(state_path + state_path_length - fetch_path_length, pm->path_elements[0]) == 0);
+	const struct path_element *pe = &pm->path_elements[0];
+	return (state_path_length >= pe->length) && (memcmp(pe->string, state_path, pe->length) == 0);
 }
 
-static int equalsnot_match(const struct path_matcher *pm, const char *state_path)
+static int endswith_match(const struct path_matcher *pm, const char *state_path, size_t state_path_length)
 {
-	return strcmp(pm->path_elements[0], state_path);
+	const struct path_element *pe = &pm->path_elements[0];
+	return (state_path_length >= pe->length) &&
+	       (memcmp(state_path + state_path_length - pe->length, pe->string, pe->length) == 0);
 }
 
-static int equalsnot_match_ignore_case(const struct path_matcher *pm, const char *state_path)
+static int equalsnot_match(const struct path_matcher *pm, const char *state_path, size_t state_path_length)
 {
-	return jet_strcasecmp(pm->path_elements[0], state_path);
+	return !equals_match(pm, state_path, state_path_length);
 }
 
-static int containsallof_match(const struct path_matcher *pm, const char *state_path)
+static int containsallof_match(const struct path_matcher *pm, const char *state_path, size_t state_path_length)
 {
 	for (unsigned int i = 0; i < pm->number_of_path_elements; i++) {
-		if (strstr(state_path, pm->path_elements[i]) == NULL) {
+		const struct path_element *pe = &pm->path_elements[i];
+		if (jet_memmem(state_path, state_path_length, pe->string, pe->length) == NULL) {
 			return 0;
 		}
 	}
 	return 1;
 }
 
-static int containsallof_match_ignore_case(const struct path_matcher *pm, const char *state_path)
+static int regex_match(const struct path_matcher *pm, const char *state_path, size_t state_path_length)
 {
-	for (unsigned int i = 0; i < pm->number_of_path_elements; i++) {
-		if (jet_strcasestr(state_path, pm->path_elements[i]) == NULL) {
-			return 0;
-		}
-	}
-	return 1;
+	return jet_regex_match(pm->regex, state_path, state_path_length);
 }
 
 static const struct supported_matcher matchers[] = {
-    {.matcher_name = "equals", .case_sensitive = equals_match, .case_insensitive = equals_match_ignore_case, .has_multiple_path_elements = false},
-    {.matcher_name = "contains", .case_sensitive = contains_match, .case_insensitive = contains_match_ignore_case, .has_multiple_path_elements = false},
-    {.matcher_name = "startsWith", .case_sensitive = startswith_match, .case_insensitive = startswith_match_ignore_case, .has_multiple_path_elements = false},
-    {.matcher_name = "endsWith", .case_sensitive = endswith_match, .case_insensitive = endswith_match_ignore_case, .has_multiple_path_elements = false},
-    {.matcher_name = "equalsNot", .case_sensitive = equalsnot_match, .case_insensitive = equalsnot_match_ignore_case, .has_multiple_path_elements = false},
-    {.matcher_name = "containsAllOf", .case_sensitive = containsallof_match, .case_insensitive = containsallof_match_ignore_case, .has_multiple_path_elements = true}};
+    {.matcher_name = "equals", .match_function = equals_match, .has_multiple_path_elements = false, .index_type = FETCH_INDEX_EQUALS},
+    {.matcher_name = "contains", .match_function = contains_match, .has_multiple_path_elements = false, .index_type = FETCH_INDEX_CONTAINS},
+    {.matcher_name = "startsWith", .match_function = startswith_match, .has_multiple_path_elements = false, .index_type = FETCH_INDEX_STARTS_WITH},
+    {.matcher_name = "endsWith", .match_function = endswith_match, .has_multiple_path_elements = false, .index_type = FETCH_INDEX_ENDS_WITH},
+    {.matcher_name = "equalsNot", .match_function = equalsnot_match, .has_multiple_path_elements = false, .index_type = FETCH_INDEX_NONE},
+    {.matcher_name = "containsAllOf", .match_function = containsallof_match, .has_multiple_path_elements = true, .index_type = FETCH_INDEX_CONTAINS},
+    {.matcher_name = "regex", .match_function = regex_match, .has_multiple_path_elements = false, .index_type = FETCH_INDEX_NONE}};
 
 static struct path_matcher *create_path_matcher(unsigned int number_of_path_elements)
 {
@@ -182,20 +163,30 @@ static struct path_matcher *create_path_matcher(unsigned int number_of_path_elem
 static void free_path_elements(const struct path_matcher *pm)
 {
 	for (unsigned int i = 0; i < pm->number_of_path_elements; i++) {
-		if (pm->path_elements[i] != NULL) {
-			cjet_free(pm->path_elements[i]);
+		if (pm->path_elements[i].string != NULL) {
+			cjet_free(pm->path_elements[i].string);
 		}
 	}
 }
 
-static int fill_path_elements(struct path_matcher *pm, const cJSON *matcher, bool has_multiple_path_elements, unsigned int number_of_path_elements)
+static int fill_path_element(struct path_element *pe, const char *string, bool ignore_case)
+{
+	if (ignore_case) {
+		pe->string = duplicate_string_lowercase(string);
+	} else {
+		pe->string = duplicate_string(string);
+	}
+	if (unlikely(pe->string == NULL)) {
+		return -1;
+	}
+	pe->length = strlen(pe->string);
+	return 0;
+}
+
+static int fill_path_elements(struct path_matcher *pm, const cJSON *matcher, bool has_multiple_path_elements, unsigned int number_of_path_elements, bool ignore_case)
 {
 	if (!has_multiple_path_elements) {
-		pm->path_elements[0] = duplicate_string(matcher->valuestring);
-		if (unlikely(pm->path_elements[0] == NULL)) {
-			return -1;
-		}
-		return 0;
+		return fill_path_element(&pm->path_elements[0], matcher->valuestring, ignore_case);
 	}
 
 	const cJSON *element = matcher->child;
@@ -203,8 +194,7 @@ static int fill_path_elements(struct path_matcher *pm, const cJSON *matcher, boo
 		if (element->type != cJSON_String) {
 			goto error;
 		}
-		pm->path_elements[i] = duplicate_string(element->valuestring);
-		if (unlikely(pm->path_elements[i] == NULL)) {
+		if (unlikely(fill_path_element(&pm->path_elements[i], element->valuestring, ignore_case) < 0)) {
 			goto error;
 		}
 		element = element->next;
@@ -216,17 +206,12 @@ error:
 	return -1;
 }
 
-static int create_matcher(struct fetch *f, const cJSON *matcher, unsigned int match_index, bool ignore_case)
+static int create_matcher(struct fetch_expression *expr, const cJSON *matcher, unsigned int match_index, bool ignore_case)
 {
 
 	for (unsigned int i = 0; i < ARRAY_SIZE(matchers); i++) {
 		if (strcmp(matcher->string, matchers[i].matcher_name) == 0) {
-			match_func match_function;
-			if (ignore_case) {
-				match_function = matchers[i].case_insensitive;
-			} else {
-				match_function = matchers[i].case_sensitive;
-			}
+			match_func match_function = matchers[i].match_function;
 			bool has_multiple_path_elements = matchers[i].has_multiple_path_elements;
 
 			unsigned int number_of_path_elements;
@@ -252,78 +237,89 @@ static int create_matcher(struct fetch *f, const cJSON *matcher, unsigned int ma
 			if (unlikely(pm == NULL)) {
 				return -1;
 			}
-			if (unlikely(fill_path_elements(pm, matcher, has_multiple_path_elements, number_of_path_elements))) {
+			/*
+			 * Lowercasing a regex would change the meaning of escapes
+			 * like \D, so its case insensitivity is compiled into the
+			 * automaton instead.
+			 */
+			bool is_regex = (match_function == regex_match);
+			if (unlikely(fill_path_elements(pm, matcher, has_multiple_path_elements, number_of_path_elements, ignore_case && !is_regex))) {
 				cjet_free(pm);
 				return -1;
 			}
+			if (is_regex) {
+				pm->regex = jet_regex_compile(matcher->valuestring, ignore_case);
+				if (unlikely(pm->regex == NULL)) {
+					log_err("Could not compile regex %s!\n", matcher->valuestring);
+					free_path_elements(pm);
+					cjet_free(pm);
+					return -1;
+				}
+			}
 			pm->match_function = match_function;
-			f->matcher[match_index] = pm;
+			pm->index_type = matchers[i].index_type;
+			pm->type = i;
+			expr->matcher[match_index] = pm;
 			return 0;
 		}
 	}
 	return -1;
 }
 
-static void free_matcher(struct fetch *f)
+static void free_matcher(struct fetch_expression *expr)
 {
-	for (unsigned int i = 0; i < f->number_of_matchers; i++) {
-		if (f->matcher[i] != NULL) {
-			free_path_elements(f->matcher[i]);
-			cjet_free(f->matcher[i]);
+	for (unsigned int i = 0; i < expr->number_of_matchers; i++) {
+		if (expr->matcher[i] != NULL) {
+			if (expr->matcher[i]->regex != NULL) {
+				jet_regex_free(expr->matcher[i]->regex);
+			}
+			free_path_elements(expr->matcher[i]);
+			cjet_free(expr->matcher[i]);
 		}
 	}
 }
 
-static int add_matchers(struct fetch *f, const cJSON *path, bool ignore_case)
+static int add_matchers(struct fetch_expression *expr, const cJSON *path, bool ignore_case)
 {
 	unsigned int match_index = 0;
 	const cJSON *matcher = path->child;
 	while (matcher) {
 		if (strncmp(matcher->string, case_insensitive, sizeof(case_insensitive)) != 0) {
-			if (unlikely(create_matcher(f, matcher, match_index, ignore_case) < 0)) {
+			if (unlikely(create_matcher(expr, matcher, match_index, ignore_case) < 0)) {
 				goto error;
 			}
+			match_index++;
 		}
-		match_index++;
 		matcher = matcher->next;
 	}
 	return 0;
 error:
-	free_matcher(f);
+	free_matcher(expr);
 	return -1;
 }
 
-static struct fetch *alloc_fetch(const struct peer *p, const cJSON *id, unsigned int number_of_matchers, const cJSON *request, cJSON **response)
+static struct fetch_expression *alloc_expression(const struct peer *p, unsigned int number_of_matchers, const cJSON *request, cJSON **response)
 {
-	struct fetch *f;
-	size_t matcher_size = sizeof(f->matcher);
+	struct fetch_expression *expr;
+	size_t matcher_size = sizeof(expr->matcher);
 
-	f = cjet_calloc(1, sizeof(*f) + (matcher_size * (number_of_matchers - 1)));
-	if (unlikely(f == NULL)) {
-		log_peer_err(p, "Could not allocate memory for %s object!\n", "fetch");
-		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "Could not allocated memory for fetch object!");
+	expr = cjet_calloc(1, sizeof(*expr) + (matcher_size * (number_of_matchers - 1)));
+	if (unlikely(expr == NULL)) {
+		log_peer_err(p, "Could not allocate memory for %s object!\n", "fetch expression");
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate fetch");
 		return NULL;
 	}
-	INIT_LIST_HEAD(&f->next_fetch);
-	f->peer = p;
-	f->number_of_matchers = number_of_matchers;
-	if (id != NULL) {
-		f->fetch_id = cJSON_Duplicate(id, 1);
-		if (unlikely(f->fetch_id == NULL)) {
-			*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "Could not allocated memory for fetch ID object!");
-			log_peer_err(p, "Could not allocate memory for %s object!\n", "fetch ID");
-			cjet_free(f);
-			return NULL;
-		}
-	}
-	return f;
+	INIT_LIST_HEAD(&expr->fetchers);
+	INIT_LIST_HEAD(&expr->set_entries);
+	expr->number_of_matchers = number_of_matchers;
+	return expr;
 }
 
-static struct fetch *create_fetch(const struct peer *p, const cJSON *request, const cJSON *id, const cJSON *params, cJSON **response)
+static struct fetch_expression *create_path_expression(const struct peer *p, const cJSON *request, const cJSON *params, cJSON **response)
 {
 	const cJSON *path = cJSON_GetObjectItem(params, "path");
 	if (path == NULL) {
-		return alloc_fetch(p, id, 1, request, response);
+		return alloc_expression(p, 1, request, response);
 	}
 
 	if (unlikely(path->type != cJSON_Object)) {
@@ -355,25 +351,83 @@ static struct fetch *create_fetch(const struct peer *p, const cJSON *request, co
 		return NULL;
 	}
 
-	struct fetch *f = alloc_fetch(p, id, number_of_matchers, request, response);
-	if (unlikely(f == NULL)) {
-		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate fetch");
+	struct fetch_expression *expr = alloc_expression(p, number_of_matchers, request, response);
+	if (unlikely(expr == NULL)) {
 		return NULL;
 	}
 
-	if (unlikely(add_matchers(f, path, ignore_case) < 0)) {
+	expr->ignore_case = ignore_case;
+	if (unlikely(add_matchers(expr, path, ignore_case) < 0)) {
 		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not add matchers to fetch");
-		cJSON_Delete(f->fetch_id);
-		cjet_free(f);
+		cjet_free(expr);
+		return NULL;
+	}
+
+	return expr;
+}
+
+static void free_expression(struct fetch_expression *expr)
+{
+	if (expr->key != NULL) {
+		cjet_free(expr->key);
+	}
+	if (expr->value_matcher != NULL) {
+		free_value_matcher(expr->value_matcher);
+	}
+	free_matcher(expr);
+	cjet_free(expr);
+}
+
+static struct fetch_expression *create_expression(const struct peer *p, const cJSON *request, const cJSON *params, cJSON **response)
+{
+	struct value_matcher *vm;
+	if (unlikely(create_value_matcher(p, request, params, &vm, response) < 0)) {
 		return NULL;
 	}
 
+	struct fetch_expression *expr = create_path_expression(p, request, params, response);
+	if (unlikely(expr == NULL)) {
+		if (vm != NULL) {
+			free_value_matcher(vm);
+		}
+		return NULL;
+	}
+	expr->value_matcher = vm;
+	return expr;
+}
+
+static struct fetch *alloc_fetch(const struct peer *p, const cJSON *id, const cJSON *request, cJSON **response)
+{
+	struct fetch *f = cjet_calloc(1, sizeof(*f));
+	if (unlikely(f == NULL)) {
+		log_peer_err(p, "Could not allocate memory for %s object!\n", "fetch");
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "Could not allocated memory for fetch object!");
+		return NULL;
+	}
+	INIT_LIST_HEAD(&f->next_fetch);
+	INIT_LIST_HEAD(&f->next_fetcher);
+	f->peer = p;
+	f->fetch_id = cJSON_Duplicate(id, 1);
+	if (unlikely(f->fetch_id == NULL)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "Could not allocated memory for fetch ID object!");
+		log_peer_err(p, "Could not allocate memory for %s object!\n", "fetch ID");
+		cjet_free(f);
+		return NULL;
+	}
 	return f;
 }
 
 static void free_fetch(struct fetch *f)
 {
-	free_matcher(f);
+	if (f->sort != NULL) {
+		free_fetch_sort(f->sort);
+	}
+	if (f->throttle != NULL) {
+		free_fetch_throttle(f->throttle);
+	}
+	if (f->notification_prefix != NULL) {
+		cjet_free(f->notification_prefix);
+	}
 	cJSON_Delete(f->fetch_id);
 	cjet_free(f);
 }
@@ -405,9 +459,14 @@ static struct fetch *find_fetch(const struct peer *p, const cJSON *id)
 	return NULL;
 }
 
-static int state_matches(const struct element *e, const struct fetch *f)
+/*
+ * Returns 1 if the state matches the expression, 0 if not and -1 if the
+ * lowercase path of the state could not be created.
+ */
+static int path_matches(const struct fetch_expression *expr, const char *path, size_t path_length)
 {
-	if (f->matcher[0] == NULL) {
+	const struct path_matcher *pm = expr->matcher[0];
+	if (pm == NULL) {
 		/*
 		 * no match function given, so it was a fetch all
 		 * command
@@ -415,10 +474,14 @@ static int state_matches(const struct element *e, const struct fetch *f)
 		return 1;
 	}
 
-	unsigned int match_array_size = f->number_of_matchers;
+	if (expr->number_of_matchers == 1) {
+		return pm->match_function(pm, path, path_length) != 0;
+	}
+
+	unsigned int match_array_size = expr->number_of_matchers;
 	for (unsigned int i = 0; i < match_array_size; ++i) {
-		const struct path_matcher *pm = f->matcher[i];
-		int ret = pm->match_function(pm, e->path);
+		pm = expr->matcher[i];
+		int ret = pm->match_function(pm, path, path_length);
 		if (ret == 0) {
 			return 0;
 		}
@@ -426,46 +489,89 @@ static int state_matches(const struct element *e, const struct fetch *f)
 	return 1;
 }
 
-static int add_fetch_to_state(struct element *e, const struct fetch *f)
+static int state_matches(struct element *e, const struct fetch_expression *expr)
 {
-	for (unsigned int i = 0; i < e->fetch_table_size; i++) {
-		if (e->fetcher_table[i] == NULL) {
-			e->fetcher_table[i] = f;
-			return 0;
+	const char *path = e->path;
+	if (expr->ignore_case && (expr->matcher[0] != NULL)) {
+		path = get_lowercase_path(e);
+		if (unlikely(path == NULL)) {
+			return -1;
 		}
 	}
+	return path_matches(expr, path, e->path_length);
+}
 
-	unsigned int new_size = MAX(CONFIG_INITIAL_FETCH_TABLE_SIZE, e->fetch_table_size * 2);
-	void *new_fetch_table = cjet_calloc(new_size, sizeof(struct fetch *));
-	if (new_fetch_table == NULL) {
-		return -1;
+/*
+ * Like state_matches(), but takes the path from the directory, so the
+ * element itself is only read by case insensitive expressions.
+ */
+static int directory_entry_matches(const struct element_directory *dir, unsigned int index, const struct fetch_expression *expr)
+{
+	if (expr->ignore_case) {
+		return state_matches(dir->elements[index], expr);
 	}
+	return path_matches(expr, element_directory_path(dir, index), dir->path_lengths[index]);
+}
 
-	memcpy(new_fetch_table, e->fetcher_table, e->fetch_table_size * sizeof(struct fetch *));
-	e->fetch_table_size = new_size;
-	cjet_free(e->fetcher_table);
-	e->fetcher_table = new_fetch_table;
-	return add_fetch_to_state(e, f);
+static bool value_matches(const struct fetch_expression *expr, const struct element *e)
+{
+	return (expr->value_matcher == NULL) || value_matcher_matches(expr->value_matcher, e->value);
 }
 
-static int notify_fetching_peer(const struct element *e, const struct fetch *f,
-                                const char *event_name)
+static int add_expression_to_state(struct element *e, struct fetch_expression *expr)
 {
-	cJSON *root = cJSON_CreateObject();
-	if (unlikely(root == NULL)) {
+	return fetcher_set_add_expression(e, expr, value_matches(expr, e));
+}
+
+static bool expression_is_linked_to_state(const struct element *e, const struct fetch_expression *expr)
+{
+	return fetcher_set_contains(e->fetchers, expr);
+}
+
+/*
+ * A notification is rendered as {"method":<fetch id>,"params":{...}}.
+ * The params part is the same for all fetchers of an element, so it is
+ * rendered only once per event into a buffer with enough headroom to
+ * place the pre-rendered method prefix of each fetch in front of it.
+ */
+static const char notification_prefix_start[] = "{\"method\":";
+static const char notification_prefix_end[] = ",\"params\":";
+
+static int render_notification_prefix(struct fetch *f)
+{
+	char *rendered_id = cJSON_PrintUnformatted(f->fetch_id);
+	if (unlikely(rendered_id == NULL)) {
 		return -1;
 	}
-	cJSON *fetch_id = cJSON_Duplicate(f->fetch_id, 1);
-	if (unlikely(fetch_id == NULL)) {
-		goto error;
+
+	size_t id_length = strlen(rendered_id);
+	size_t prefix_length = sizeof(notification_prefix_start) - 1 + id_length + sizeof(notification_prefix_end) - 1;
+	char *prefix = cjet_malloc(prefix_length);
+	if (unlikely(prefix == NULL)) {
+		cjet_free(rendered_id);
+		return -1;
 	}
-	cJSON_AddItemToObject(root, "method", fetch_id);
 
+	char *ptr = prefix;
+	memcpy(ptr, notification_prefix_start, sizeof(notification_prefix_start) - 1);
+	ptr += sizeof(notification_prefix_start) - 1;
+	memcpy(ptr, rendered_id, id_length);
+	ptr += id_length;
+	memcpy(ptr, notification_prefix_end, sizeof(notification_prefix_end) - 1);
+	cjet_free(rendered_id);
+
+	f->notification_prefix = prefix;
+	f->notification_prefix_length = prefix_length;
+	return 0;
+}
+
+static char *render_params_with_value(const struct element *e, const char *event_name, const char *value_name, const cJSON *value, size_t headroom, size_t *params_length)
+{
+	char *buffer = NULL;
 	cJSON *param = cJSON_CreateObject();
 	if (unlikely(param == NULL)) {
-		goto error;
+		return NULL;
 	}
-	cJSON_AddItemToObject(root, "params", param);
 
 	if (element_is_fetch_only(e)) {
 		cJSON_AddTrueToObject(param, "fetchOnly");
@@ -473,71 +579,93 @@ static int notify_fetching_peer(const struct element *e, const struct fetch *f,
 
 	cJSON *path = cJSON_CreateString(e->path);
 	if (unlikely(path == NULL)) {
-		goto error;
+		goto out;
 	}
 	cJSON_AddItemToObject(param, "path", path);
 
 	cJSON *event = cJSON_CreateString(event_name);
 	if (unlikely(event == NULL)) {
-		goto error;
+		goto out;
 	}
 	cJSON_AddItemToObject(param, "event", event);
 
-	if (e->value != NULL) {
-		cJSON *value = cJSON_Duplicate(e->value, 1);
-		if (unlikely(value == NULL)) {
-			goto error;
+	if (value != NULL) {
+		cJSON_AddItemReferenceToObject(param, value_name, value);
+		if (unlikely(cJSON_GetObjectItem(param, value_name) == NULL)) {
+			goto out;
 		}
-		cJSON_AddItemToObject(param, "value", value);
 	}
 
-	char *rendered_message = cJSON_PrintUnformatted(root);
-	if (unlikely(rendered_message == NULL)) {
-		goto error;
+	char *rendered_params = cJSON_PrintUnformatted(param);
+	if (unlikely(rendered_params == NULL)) {
+		goto out;
 	}
 
-	const struct peer *p = f->peer;
-	if (unlikely(p->send_message(p, rendered_message,
-	                             strlen(rendered_message)) != 0)) {
-		cjet_free(rendered_message);
-		goto error;
+	size_t length = strlen(rendered_params);
+	buffer = cjet_malloc(headroom + length + 2);
+	if (likely(buffer != NULL)) {
+		memcpy(buffer + headroom, rendered_params, length);
+		buffer[headroom + length] = '}';
+		buffer[headroom + length + 1] = '\0';
+		*params_length = length + 1;
 	}
+	cjet_free(rendered_params);
+
+out:
+	cJSON_Delete(param);
+	return buffer;
+}
 
-	cJSON_Delete(root);
-	cjet_free(rendered_message);
+static char *render_notification_params(const struct element *e, const char *event_name, size_t headroom, size_t *params_length)
+{
+	return render_params_with_value(e, event_name, "value", e->rendered_value, headroom, params_length);
+}
 
-	return 0;
-error:
-	cJSON_Delete(root);
-	return -1;
+static int send_notification(const struct fetch *f, char *params, size_t params_length)
+{
+	char *message = params - f->notification_prefix_length;
+	memcpy(message, f->notification_prefix, f->notification_prefix_length);
+
+	const struct peer *p = f->peer;
+	return queue_notification(p, message, f->notification_prefix_length + params_length);
 }
 
-static int add_fetch_to_state_and_notify(const struct peer *p, struct element *e, const struct fetch *f)
+int notify_fetching_peer(const struct element *e, const struct fetch *f, const char *event_name)
 {
-	if (!has_access(e->fetch_groups, f->peer->fetch_groups)) {
-		return 0;
+	size_t params_length;
+	char *buffer = render_notification_params(e, event_name, f->notification_prefix_length, &params_length);
+	if (unlikely(buffer == NULL)) {
+		return -1;
 	}
 
-	if (state_matches(e, f)) {
-		if (unlikely(add_fetch_to_state(e, f) != 0)) {
-			log_peer_err(p, "Can't add fetch to state %s owned by %s", e->path, get_peer_name(e->peer));
-			return -1;
-		}
-		if (unlikely(notify_fetching_peer(e, f, "add") != 0)) {
-			log_peer_err(p, "Can't notify fetching peer for state %s owned by %s", e->path, get_peer_name(e->peer));
+	int ret = send_notification(f, buffer + f->notification_prefix_length, params_length);
+	cjet_free(buffer);
+	return ret;
+}
+
+static int attach_expression_to_state(struct element *e, struct fetch_expression *expr)
+{
+	int ret = state_matches(e, expr);
+	if (ret > 0) {
+		if (unlikely(add_expression_to_state(e, expr) != 0)) {
+			log_err("Can't add fetch to state %s owned by %s", e->path, get_peer_name(e->peer));
 			return -1;
 		}
+		return 1;
 	}
-	return 0;
+	if (unlikely(ret < 0)) {
+		log_err("Can't match fetch against state %s owned by %s", e->path, get_peer_name(e->peer));
+	}
+	return ret;
 }
 
-static int get_element(const struct peer *p, const struct cJSON *request, const struct element *e, const struct fetch *f, cJSON *states, cJSON **response)
+static int add_matched_element(const struct peer *p, const struct cJSON *request, const struct element *e, const struct fetch_expression *expr, int match, cJSON *states, cJSON **response)
 {
-	if (!has_access(e->fetch_groups, f->peer->fetch_groups)) {
-		return 0;
+	if (unlikely(match < 0)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not allocate memory for lowercase path");
+		return -1;
 	}
-
-	if (state_matches(e, f)) {
+	if ((match > 0) && value_matches(expr, e)) {
 		if (e->value != NULL) {
 			cJSON *root = cJSON_CreateObject();
 			if (unlikely(root == NULL)) {
@@ -553,15 +681,13 @@ static int get_element(const struct peer *p, const struct cJSON *request, const
 			}
 			cJSON_AddItemToObject(root, "path", path);
 
-			cJSON *value = cJSON_Duplicate(e->value, 1);
-			if (unlikely(value == NULL)) {
+			cJSON_AddItemReferenceToObject(root, "value", e->rendered_value);
+			if (unlikely(cJSON_GetObjectItem(root, "value") == NULL)) {
 				cJSON_Delete(root);
 				*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not allocate memory for value");
 				return -1;
 			}
 
-			cJSON_AddItemToObject(root, "value", value);
-
 			cJSON_AddItemToArray(states, root);
 		}
 	}
@@ -569,13 +695,43 @@ static int get_element(const struct peer *p, const struct cJSON *request, const
 	return 0;
 }
 
-static int add_fetch_to_states_in_peer(const struct peer *p, const struct fetch *f)
+static int get_element(const struct peer *p, const struct cJSON *request, struct element *e, const struct fetch_expression *expr, cJSON *states, cJSON **response)
 {
-	struct list_head *item;
-	struct list_head *tmp;
-	list_for_each_safe (item, tmp, &p->element_list) {
-		struct element *e = list_entry(item, struct element, element_list);
-		if (unlikely(add_fetch_to_state_and_notify(p, e, f) != 0)) {
+	if (!has_access(e->fetch_groups, p->fetch_groups)) {
+		return 0;
+	}
+	return add_matched_element(p, request, e, expr, state_matches(e, expr), states, response);
+}
+
+static int add_expression_to_element(struct element *e, struct fetch_expression *expr)
+{
+	if (expression_is_linked_to_state(e, expr)) {
+		return 0;
+	}
+	return (attach_expression_to_state(e, expr) < 0) ? -1 : 0;
+}
+
+static int add_expression_to_indexed_element(struct path_index_entry *entry, void *context)
+{
+	struct element *e = container_of(entry, struct element, path_index_entry);
+	return add_expression_to_element(e, (struct fetch_expression *)context);
+}
+
+static int add_expression_to_states_in_peer(const struct peer *p, struct fetch_expression *expr)
+{
+	const struct element_directory *dir = &p->elements;
+	for (unsigned int i = 0; i < dir->size; i++) {
+		struct element *e = dir->elements[i];
+		if (e == NULL) {
+			continue;
+		}
+		int ret = directory_entry_matches(dir, i, expr);
+		if (unlikely(ret < 0)) {
+			log_err("Can't match fetch against state %s owned by %s", e->path, get_peer_name(e->peer));
+			return -1;
+		}
+		if ((ret > 0) && !expression_is_linked_to_state(e, expr) && unlikely(add_expression_to_state(e, expr) != 0)) {
+			log_err("Can't add fetch to state %s owned by %s", e->path, get_peer_name(e->peer));
 			return -1;
 		}
 	}
@@ -583,13 +739,30 @@ static int add_fetch_to_states_in_peer(const struct peer *p, const struct fetch
 	return 0;
 }
 
-static int get_elements_in_peer(const struct peer *p, const cJSON *request, const struct fetch *f, cJSON *states, cJSON **response)
+struct get_context {
+	const struct peer *request_peer;
+	const cJSON *request;
+	const struct fetch_expression *expr;
+	cJSON *states;
+	cJSON **response;
+};
+
+static int get_indexed_element(struct path_index_entry *entry, void *context)
 {
-	struct list_head *item;
-	struct list_head *tmp;
-	list_for_each_safe (item, tmp, &p->element_list) {
-		struct element *e = list_entry(item, struct element, element_list);
-		if (unlikely(get_element(p, request, e, f, states, response) < 0)) {
+	struct element *e = container_of(entry, struct element, path_index_entry);
+	const struct get_context *ctx = (const struct get_context *)context;
+	return get_element(ctx->request_peer, ctx->request, e, ctx->expr, ctx->states, ctx->response);
+}
+
+static int get_elements_in_peer(const struct peer *p, const struct peer *request_peer, const cJSON *request, const struct fetch_expression *expr, cJSON *states, cJSON **response)
+{
+	const struct element_directory *dir = &p->elements;
+	for (unsigned int i = 0; i < dir->size; i++) {
+		if ((dir->elements[i] == NULL) || !has_access(dir->fetch_groups[i], request_peer->fetch_groups)) {
+			continue;
+		}
+		int match = directory_entry_matches(dir, i, expr);
+		if ((match != 0) && unlikely(add_matched_element(request_peer, request, dir->elements[i], expr, match, states, response) < 0)) {
 			return -1;
 		}
 	}
@@ -597,95 +770,628 @@ static int get_elements_in_peer(const struct peer *p, const cJSON *request, cons
 	return 0;
 }
 
-int notify_fetchers(const struct element *e, const char *event_name)
+/*
+ * Returns the prefix all paths matched by expr start with, or NULL if
+ * the expression has no "equals" or "startsWith" matcher. The path
+ * index is ordered by the original paths, so case insensitive
+ * expressions have no prefix.
+ */
+static const char *get_path_prefix(const struct fetch_expression *expr)
 {
-	for (unsigned int i = 0; i < e->fetch_table_size; i++) {
-		const struct fetch *f = e->fetcher_table[i];
-		if ((f != NULL) &&
-		    (unlikely(notify_fetching_peer(e, f, event_name) != 0))) {
-			return -1;
+	if (expr->ignore_case) {
+		return NULL;
+	}
+
+	const struct path_matcher *prefix_matcher = NULL;
+	for (unsigned int i = 0; i < expr->number_of_matchers; i++) {
+		const struct path_matcher *pm = expr->matcher[i];
+		if ((pm == NULL) || ((pm->index_type != FETCH_INDEX_EQUALS) && (pm->index_type != FETCH_INDEX_STARTS_WITH))) {
+			continue;
+		}
+		if ((prefix_matcher == NULL) || (pm->path_elements[0].length > prefix_matcher->path_elements[0].length)) {
+			prefix_matcher = pm;
 		}
 	}
-	return 0;
+	return (prefix_matcher != NULL) ? prefix_matcher->path_elements[0].string : NULL;
 }
 
-cJSON *add_fetch_to_states(const struct peer *request_peer, const cJSON *request, const struct fetch *f)
+static bool fetch_has_access(const struct element *e, const struct fetch *f)
 {
-	struct list_head *item;
-	struct list_head *tmp;
-	const struct list_head *peer_list = get_peer_list();
-	list_for_each_safe (item, tmp, peer_list) {
-		const struct peer *p = list_entry(item, struct peer, next_peer);
-		int ret = add_fetch_to_states_in_peer(p, f);
-		if (unlikely(ret != 0)) {
-			return create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not add fetch to state");
+	return has_access(e->fetch_groups, f->peer->fetch_groups);
+}
+
+/*
+ * Expressions with a value matcher see a change of the value as "add"
+ * or "remove" if the element enters or leaves the matched values.
+ * Returns NULL if the fetchers of the expression are not notified.
+ */
+static const char *get_entry_event(const struct fetcher_set_entry *entry, struct element *e, unsigned int index, const char *event_name, int *ret)
+{
+	const struct fetch_expression *expr = entry->expression;
+	if (expr->value_matcher == NULL) {
+		return event_name;
+	}
+
+	bool matched = entry->value_matches;
+	if (strcmp(event_name, "change") != 0) {
+		return matched ? event_name : NULL;
+	}
+
+	bool matches = value_matcher_matches(expr->value_matcher, e->value);
+	if (unlikely(fetcher_set_update_value_matches(e, index, matches) != 0)) {
+		log_err("Can't update fetchers of state %s owned by %s", e->path, get_peer_name(e->peer));
+		*ret = -1;
+	}
+	if (matched && matches) {
+		return "change";
+	}
+	if (matches) {
+		return "add";
+	}
+	return matched ? "remove" : NULL;
+}
+
+/*
+ * The notification of an event is the same for all unsorted fetches,
+ * so each event is rendered only once. Sorted fetches send the changes
+ * of their window instead.
+ */
+struct rendered_event {
+	const char *event_name;
+	char *buffer; /* NULL for a delta that is not smaller than the full value */
+	size_t params_length;
+	bool delta;
+};
+
+/*
+ * The merge patch of a change, created on first use by a fetch that
+ * requested delta notifications unless the owner sent a patch.
+ */
+struct change_delta {
+	const cJSON *old_value;
+	const cJSON *patch;
+	cJSON *created_patch;
+	bool patch_created;
+};
+
+static struct rendered_event *find_rendered_event(struct rendered_event *rendered, const char *event_name, bool delta, unsigned int *free_slot)
+{
+	unsigned int i;
+	for (i = 0; rendered[i].event_name != NULL; i++) {
+		if ((rendered[i].delta == delta) && (strcmp(rendered[i].event_name, event_name) == 0)) {
+			return &rendered[i];
 		}
 	}
+	*free_slot = i;
+	return NULL;
+}
 
-	return create_success_response_from_request(request_peer, request);
+static const struct rendered_event *get_rendered_event(struct rendered_event *rendered, const struct element *e, const char *event_name, size_t headroom)
+{
+	unsigned int i;
+	struct rendered_event *event = find_rendered_event(rendered, event_name, false, &i);
+	if (event != NULL) {
+		return event;
+	}
+
+	rendered[i].buffer = render_notification_params(e, event_name, headroom, &rendered[i].params_length);
+	if (unlikely(rendered[i].buffer == NULL)) {
+		return NULL;
+	}
+	rendered[i].event_name = event_name;
+	return &rendered[i];
 }
 
-static void remove_fetch_from_state(const struct element *e, const struct fetch *f)
+static const cJSON *get_patch(struct change_delta *delta, const struct element *e)
 {
-	for (unsigned int i = 0; i < e->fetch_table_size; ++i) {
-		if (e->fetcher_table[i] == f) {
-			e->fetcher_table[i] = NULL;
+	if ((delta->patch == NULL) && !delta->patch_created) {
+		delta->created_patch = create_merge_patch(delta->old_value, e->value);
+		delta->patch = delta->created_patch;
+		delta->patch_created = true;
+	}
+	return delta->patch;
+}
+
+/*
+ * A patch is only sent if it is smaller than the full value, otherwise
+ * delta fetches get the same notification as all other fetches.
+ */
+static const struct rendered_event *get_rendered_delta(struct rendered_event *rendered, const struct element *e, struct change_delta *delta, size_t headroom)
+{
+	static const char change[] = "change";
+	const struct rendered_event *full = get_rendered_event(rendered, e, change, headroom);
+	if (unlikely(full == NULL)) {
+		return NULL;
+	}
+
+	unsigned int i;
+	const struct rendered_event *event = find_rendered_event(rendered, change, true, &i);
+	if (event == NULL) {
+		const cJSON *patch = get_patch(delta, e);
+		if (patch != NULL) {
+			rendered[i].buffer = render_params_with_value(e, change, "patch", patch, headroom, &rendered[i].params_length);
+			if ((rendered[i].buffer != NULL) && (rendered[i].params_length >= full->params_length)) {
+				cjet_free(rendered[i].buffer);
+				rendered[i].buffer = NULL;
+			}
 		}
+		rendered[i].event_name = change;
+		rendered[i].delta = true;
+		event = &rendered[i];
 	}
+
+	return (event->buffer != NULL) ? event : full;
 }
 
-static void remove_fetch_from_states_in_peer(const struct peer *p, const struct fetch *f)
+static int notify_fetchers_of_entry(struct element *e, const struct fetcher_set_entry *entry, unsigned int index, const char *event_name, struct rendered_event *rendered, struct change_delta *delta, size_t headroom)
 {
+	int ret = 0;
+	const char *link_event = get_entry_event(entry, e, index, event_name, &ret);
+	if (link_event == NULL) {
+		return ret;
+	}
+
 	struct list_head *item;
 	struct list_head *tmp;
-	list_for_each_safe (item, tmp, &p->element_list) {
-		struct element *e = list_entry(item, struct element, element_list);
-		remove_fetch_from_state(e, f);
+	list_for_each_safe (item, tmp, &entry->expression->fetchers) {
+		struct fetch *f = list_entry(item, struct fetch, next_fetcher);
+		if (!fetch_has_access(e, f)) {
+			continue;
+		}
+		if (f->sort != NULL) {
+			if (unlikely(fetch_sort_notify(f, e, link_event) != 0)) {
+				ret = -1;
+			}
+			continue;
+		}
+		if (f->throttle != NULL) {
+			int send_now = fetch_throttle_event(f, e, link_event);
+			if (unlikely(send_now < 0)) {
+				ret = -1;
+			}
+			if (send_now <= 0) {
+				continue;
+			}
+		}
+
+		const struct rendered_event *event;
+		if (f->delta && (delta != NULL) && (strcmp(link_event, "change") == 0)) {
+			event = get_rendered_delta(rendered, e, delta, headroom);
+		} else {
+			event = get_rendered_event(rendered, e, link_event, headroom);
+		}
+		if (unlikely((event == NULL) || (send_notification(f, event->buffer + headroom, event->params_length) != 0))) {
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+/*
+ * A change of the value might move the element to another fetcher set,
+ * so the entries of the set at the beginning of the notification are
+ * used throughout.
+ */
+static int notify_fetchers_with_delta(struct element *e, const char *event_name, struct change_delta *delta)
+{
+	struct fetcher_set *set = e->fetchers;
+	if (set == NULL) {
+		return 0;
+	}
+
+	size_t headroom = 0;
+	for (unsigned int i = 0; i < set->number_of_entries; i++) {
+		const struct fetch_expression *expr = set->entries[i].expression;
+		struct list_head *item;
+		struct list_head *tmp;
+		list_for_each_safe (item, tmp, &expr->fetchers) {
+			const struct fetch *f = list_entry(item, struct fetch, next_fetcher);
+			if (f->sort == NULL) {
+				headroom = MAX(headroom, f->notification_prefix_length);
+			}
+		}
+	}
+
+	/*
+	 * At most "add", "change", "remove" and the delta of a change are
+	 * rendered, plus the end marker.
+	 */
+	struct rendered_event rendered[5];
+	memset(rendered, 0, sizeof(rendered));
+
+	int ret = 0;
+	fetcher_set_hold(set);
+	for (unsigned int i = 0; i < set->number_of_entries; i++) {
+		if (unlikely(notify_fetchers_of_entry(e, &set->entries[i], i, event_name, rendered, delta, headroom) != 0)) {
+			ret = -1;
+		}
+	}
+	fetcher_set_release(set);
+
+	for (unsigned int i = 0; rendered[i].event_name != NULL; i++) {
+		if (rendered[i].buffer != NULL) {
+			cjet_free(rendered[i].buffer);
+		}
+	}
+	return ret;
+}
+
+int notify_fetchers(struct element *e, const char *event_name)
+{
+	return notify_fetchers_with_delta(e, event_name, NULL);
+}
+
+int notify_fetchers_of_change(struct element *e, const cJSON *old_value, const cJSON *patch)
+{
+	struct change_delta delta = {
+	    .old_value = old_value,
+	    .patch = patch,
+	    .created_patch = NULL,
+	    .patch_created = false,
+	};
+
+	int ret = notify_fetchers_with_delta(e, "change", &delta);
+	if (delta.created_patch != NULL) {
+		cJSON_Delete(delta.created_patch);
 	}
+	return ret;
 }
 
-static void remove_fetch_from_states(const struct fetch *f)
+static int add_expression_to_states(struct fetch_expression *expr)
 {
+	const char *prefix = get_path_prefix(expr);
+	if (prefix != NULL) {
+		if (unlikely(path_index_visit_prefix(prefix, add_expression_to_indexed_element, expr) != 0)) {
+			return -1;
+		}
+		expr->states_added = true;
+		return 0;
+	}
+
 	struct list_head *item;
 	struct list_head *tmp;
 	const struct list_head *peer_list = get_peer_list();
 	list_for_each_safe (item, tmp, peer_list) {
-		struct peer *p = list_entry(item, struct peer, next_peer);
-		remove_fetch_from_states_in_peer(p, f);
+		const struct peer *p = list_entry(item, struct peer, next_peer);
+		if (unlikely(add_expression_to_states_in_peer(p, expr) != 0)) {
+			return -1;
+		}
 	}
+	expr->states_added = true;
+	return 0;
 }
 
-static int find_fetchers_for_element_in_peer(const struct peer *p,
-                                             struct element *e)
+/*
+ * The expression of a fetch might be shared with fetches that were added
+ * before. In that case the matching states are already known and only
+ * the new fetch has to be notified.
+ */
+cJSON *add_fetch_to_states(const struct peer *request_peer, const cJSON *request, struct fetch *f)
 {
+	struct fetch_expression *expr = f->expression;
+	if (!expr->states_added) {
+		if (unlikely(add_expression_to_states(expr) != 0)) {
+			return create_error_response_from_request(request_peer, request, INTERNAL_ERROR, "reason", "could not add fetch to state");
+		}
+	}
 
 	struct list_head *item;
 	struct list_head *tmp;
-	list_for_each_safe (item, tmp, &p->fetch_list) {
-		struct fetch *f = list_entry(item, struct fetch, next_fetch);
-		if (unlikely(add_fetch_to_state_and_notify(p, e, f) != 0)) {
-			return -1;
+	list_for_each_safe (item, tmp, &expr->set_entries) {
+		const struct fetcher_set_entry *entry = list_entry(item, struct fetcher_set_entry, next_entry);
+		if (!entry->value_matches) {
+			continue;
+		}
+		struct list_head *element_item;
+		struct list_head *element_tmp;
+		list_for_each_safe (element_item, element_tmp, &entry->set->elements) {
+			struct element *e = list_entry(element_item, struct element, next_in_fetcher_set);
+			if (!fetch_has_access(e, f)) {
+				continue;
+			}
+			if (f->sort != NULL) {
+				if (unlikely(fetch_sort_add_element(f->sort, e) != 0)) {
+					return create_error_response_from_request(request_peer, request, INTERNAL_ERROR, "reason", "could not add state to sorted fetch");
+				}
+			} else if (unlikely(notify_fetching_peer(e, f, "add") != 0)) {
+				log_peer_err(request_peer, "Can't notify fetching peer for state %s owned by %s", e->path, get_peer_name(e->peer));
+				return create_error_response_from_request(request_peer, request, INTERNAL_ERROR, "reason", "could not add fetch to state");
+			}
 		}
 	}
-	return 0;
+
+	if ((f->sort != NULL) && unlikely(fetch_sort_notify_window(f) != 0)) {
+		return create_error_response_from_request(request_peer, request, INTERNAL_ERROR, "reason", "could not notify sorted fetch");
+	}
+
+	return create_success_response_from_request(request_peer, request);
+}
+
+void remove_all_fetchers_from_element(struct element *e)
+{
+	remove_element_from_fetch_sorts(e);
+	remove_element_from_fetch_throttles(e);
+	fetcher_set_remove_element(e);
+}
+
+static int add_candidate_expression_to_state(struct fetch_index_entry *entry, void *context)
+{
+	struct element *e = (struct element *)context;
+	struct fetch_expression *expr = list_entry(entry, struct fetch_expression, index_entry);
+	int ret = attach_expression_to_state(e, expr);
+	return (ret < 0) ? ret : 0;
 }
 
 int find_fetchers_for_element(struct element *e)
 {
-	int ret = 0;
-	struct list_head *item;
-	struct list_head *tmp;
-	const struct list_head *peer_list = get_peer_list();
-	list_for_each_safe (item, tmp, peer_list) {
-		struct peer *p = list_entry(item, struct peer, next_peer);
-		ret = find_fetchers_for_element_in_peer(p, e);
-		if (unlikely(ret != 0)) {
-			return ret;
+	int ret = fetch_index_visit_candidates(e->path, add_candidate_expression_to_state, e);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+	return notify_fetchers(e, "add");
+}
+
+static const struct path_matcher *get_index_matcher(const struct fetch_expression *expr)
+{
+	const struct path_matcher *index_matcher = NULL;
+	for (unsigned int i = 0; i < expr->number_of_matchers; i++) {
+		const struct path_matcher *pm = expr->matcher[i];
+		if ((pm == NULL) || (pm->index_type == FETCH_INDEX_NONE) || (pm->index_type == FETCH_INDEX_CONTAINS)) {
+			continue;
+		}
+		if (pm->index_type == FETCH_INDEX_EQUALS) {
+			return pm;
+		}
+
+		/*
+		 * The longer the prefix or suffix, the less fetches share
+		 * the same trie node.
+		 */
+		if ((index_matcher == NULL) || (pm->path_elements[0].length > index_matcher->path_elements[0].length)) {
+			index_matcher = pm;
+		}
+	}
+	return index_matcher;
+}
+
+static int add_expression_to_contains_index(struct fetch_expression *expr)
+{
+	unsigned int number_of_patterns = 0;
+	for (unsigned int i = 0; i < expr->number_of_matchers; i++) {
+		const struct path_matcher *pm = expr->matcher[i];
+		if ((pm != NULL) && (pm->index_type == FETCH_INDEX_CONTAINS)) {
+			number_of_patterns += pm->number_of_path_elements;
+		}
+	}
+	if (number_of_patterns == 0) {
+		return fetch_index_add(&expr->index_entry, FETCH_INDEX_NONE, NULL, false);
+	}
+
+	const char **patterns = cjet_malloc(number_of_patterns * sizeof(*patterns));
+	if (unlikely(patterns == NULL)) {
+		return -1;
+	}
+	unsigned int pattern_index = 0;
+	for (unsigned int i = 0; i < expr->number_of_matchers; i++) {
+		const struct path_matcher *pm = expr->matcher[i];
+		if ((pm != NULL) && (pm->index_type == FETCH_INDEX_CONTAINS)) {
+			for (unsigned int j = 0; j < pm->number_of_path_elements; j++) {
+				patterns[pattern_index++] = pm->path_elements[j].string;
+			}
 		}
 	}
+
+	int ret = fetch_index_add_contains(&expr->index_entry, patterns, number_of_patterns, expr->ignore_case);
+	cjet_free(patterns);
 	return ret;
 }
 
+static int add_expression_to_index(struct fetch_expression *expr)
+{
+	const struct path_matcher *pm = get_index_matcher(expr);
+	if (pm == NULL) {
+		return add_expression_to_contains_index(expr);
+	}
+	return fetch_index_add(&expr->index_entry, pm->index_type, pm->path_elements[0].string, expr->ignore_case);
+}
+
+DECLARE_HASHTABLE_STRING(fetch_expression_table, CONFIG_FETCH_EXPRESSION_TABLE_ORDER, 1U)
+
+static struct hashtable_fetch_expression_table *expression_table = NULL;
+static unsigned int number_of_shared_expressions = 0;
+
+static int compare_path_elements(const struct path_element *pe1, const struct path_element *pe2)
+{
+	if (pe1->length != pe2->length) {
+		return (pe1->length < pe2->length) ? -1 : 1;
+	}
+	return memcmp(pe1->string, pe2->string, pe1->length);
+}
+
+static int compare_matchers(const void *a, const void *b)
+{
+	const struct path_matcher *pm1 = *(const struct path_matcher *const *)a;
+	const struct path_matcher *pm2 = *(const struct path_matcher *const *)b;
+	if (pm1->type != pm2->type) {
+		return (pm1->type < pm2->type) ? -1 : 1;
+	}
+	if (pm1->number_of_path_elements != pm2->number_of_path_elements) {
+		return (pm1->number_of_path_elements < pm2->number_of_path_elements) ? -1 : 1;
+	}
+	for (unsigned int i = 0; i < pm1->number_of_path_elements; i++) {
+		int ret = compare_path_elements(&pm1->path_elements[i], &pm2->path_elements[i]);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The canonical key of an expression does not depend on the order of
+ * the matchers in the path object. It consists of the case flag and, for
+ * each matcher sorted by type and pattern, the matcher type followed by
+ * the length prefixed path elements.
+ */
+static char *create_path_key(struct fetch_expression *expr)
+{
+	if (expr->matcher[0] == NULL) {
+		return duplicate_string("*");
+	}
+
+	qsort(expr->matcher, expr->number_of_matchers, sizeof(expr->matcher[0]), compare_matchers);
+
+	enum { MAX_NUMBER_LENGTH = 12 };
+	size_t key_length = 2;
+	for (unsigned int i = 0; i < expr->number_of_matchers; i++) {
+		const struct path_matcher *pm = expr->matcher[i];
+		key_length += MAX_NUMBER_LENGTH + 1;
+		for (unsigned int j = 0; j < pm->number_of_path_elements; j++) {
+			key_length += MAX_NUMBER_LENGTH + 1 + pm->path_elements[j].length;
+		}
+	}
+
+	char *key = cjet_malloc(key_length);
+	if (unlikely(key == NULL)) {
+		return NULL;
+	}
+
+	char *ptr = key;
+	*ptr++ = expr->ignore_case ? 'i' : 's';
+	for (unsigned int i = 0; i < expr->number_of_matchers; i++) {
+		const struct path_matcher *pm = expr->matcher[i];
+		ptr += sprintf(ptr, "%u;", pm->type);
+		for (unsigned int j = 0; j < pm->number_of_path_elements; j++) {
+			const struct path_element *pe = &pm->path_elements[j];
+			ptr += sprintf(ptr, "%zu:", pe->length);
+			memcpy(ptr, pe->string, pe->length);
+			ptr += pe->length;
+		}
+	}
+	*ptr = '\0';
+	return key;
+}
+
+static char *create_expression_key(struct fetch_expression *expr)
+{
+	char *path_key = create_path_key(expr);
+	if ((path_key == NULL) || (expr->value_matcher == NULL)) {
+		return path_key;
+	}
+
+	const char *value_key = get_value_matcher_key(expr->value_matcher);
+	size_t path_key_length = strlen(path_key);
+	size_t value_key_length = strlen(value_key);
+	char *key = cjet_malloc(path_key_length + value_key_length + 2);
+	if (likely(key != NULL)) {
+		memcpy(key, path_key, path_key_length);
+		key[path_key_length] = '|';
+		memcpy(key + path_key_length + 1, value_key, value_key_length + 1);
+	}
+	cjet_free(path_key);
+	return key;
+}
+
+static struct fetch_expression *find_shared_expression(const char *key)
+{
+	if (expression_table == NULL) {
+		return NULL;
+	}
+
+	struct value_fetch_expression_table val;
+	if (HASHTABLE_GET(fetch_expression_table, expression_table, key, &val) == HASHTABLE_SUCCESS) {
+		return val.vals[0];
+	}
+	return NULL;
+}
+
+static void share_expression(struct fetch_expression *expr)
+{
+	if (expression_table == NULL) {
+		expression_table = HASHTABLE_CREATE(fetch_expression_table);
+		if (unlikely(expression_table == NULL)) {
+			return;
+		}
+	}
+
+	struct value_fetch_expression_table new_val;
+	new_val.vals[0] = expr;
+	if (HASHTABLE_PUT(fetch_expression_table, expression_table, expr->key, new_val, NULL) == HASHTABLE_SUCCESS) {
+		number_of_shared_expressions++;
+	} else {
+		/*
+		 * If the table is full, the expression is just not shared
+		 * with fetches added later.
+		 */
+		cjet_free(expr->key);
+		expr->key = NULL;
+		if (number_of_shared_expressions == 0) {
+			HASHTABLE_DELETE(fetch_expression_table, expression_table);
+		}
+	}
+}
+
+static void unshare_expression(struct fetch_expression *expr)
+{
+	if (expr->key == NULL) {
+		return;
+	}
+
+	HASHTABLE_REMOVE(fetch_expression_table, expression_table, expr->key, NULL);
+	number_of_shared_expressions--;
+	if (number_of_shared_expressions == 0) {
+		HASHTABLE_DELETE(fetch_expression_table, expression_table);
+	}
+}
+
+/*
+ * Returns the shared expression equal to expr and frees expr, or
+ * registers expr to be shared by following fetches.
+ */
+static struct fetch_expression *intern_expression(struct fetch_expression *expr)
+{
+	expr->key = create_expression_key(expr);
+	if (unlikely(expr->key == NULL)) {
+		free_expression(expr);
+		return NULL;
+	}
+
+	struct fetch_expression *shared = find_shared_expression(expr->key);
+	if (shared != NULL) {
+		free_expression(expr);
+		return shared;
+	}
+
+	if (unlikely(add_expression_to_index(expr) < 0)) {
+		free_expression(expr);
+		return NULL;
+	}
+
+	share_expression(expr);
+	return expr;
+}
+
+static void release_expression(struct fetch_expression *expr)
+{
+	if (!list_empty(&expr->fetchers)) {
+		return;
+	}
+
+	fetcher_set_remove_expression(expr);
+	fetch_index_remove(&expr->index_entry);
+	unshare_expression(expr);
+	free_expression(expr);
+}
+
+static void remove_fetch(struct fetch *f)
+{
+	struct fetch_expression *expr = f->expression;
+	list_del(&f->next_fetch);
+	list_del(&f->next_fetcher);
+	free_fetch(f);
+	release_expression(expr);
+}
+
 int add_fetch_to_peer(struct peer *p, const cJSON *request, struct fetch **fetch_return, cJSON **response)
 {
 	const cJSON *params = get_params(p, request, response);
@@ -712,14 +1418,69 @@ int add_fetch_to_peer(struct peer *p, const cJSON *request, struct fetch **fetch
 		return -1;
 	}
 
-	f = create_fetch(p, request, id, params, response);
+	const cJSON *delta = cJSON_GetObjectItem(params, "delta");
+	if (unlikely((delta != NULL) && (delta->type != cJSON_True) && (delta->type != cJSON_False))) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "delta is not a bool");
+		return -1;
+	}
+
+	struct fetch_sort *sort;
+	if (unlikely(create_fetch_sort(p, request, params, &sort, response) < 0)) {
+		return -1;
+	}
+
+	struct fetch_throttle *throttle;
+	if (unlikely(create_fetch_throttle(p, request, params, &throttle, response) < 0)) {
+		goto create_throttle_failed;
+	}
+	if (unlikely((throttle != NULL) && (sort != NULL))) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "minInterval is not supported for sorted fetches");
+		goto create_expression_failed;
+	}
+
+	struct fetch_expression *expr = create_expression(p, request, params, response);
+	if (unlikely(expr == NULL)) {
+		goto create_expression_failed;
+	}
+
+	f = alloc_fetch(p, id, request, response);
 	if (unlikely(f == NULL)) {
+		free_expression(expr);
+		goto create_expression_failed;
+	}
+	f->sort = sort;
+	f->throttle = throttle;
+	f->delta = (delta != NULL) && (delta->type == cJSON_True);
+
+	if (unlikely(render_notification_prefix(f) < 0)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not render fetch id");
+		free_expression(expr);
+		free_fetch(f);
+		return -1;
+	}
+
+	expr = intern_expression(expr);
+	if (unlikely(expr == NULL)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not add fetch to fetch index");
+		free_fetch(f);
 		return -1;
 	}
 
+	f->expression = expr;
+	list_add_tail(&f->next_fetcher, &expr->fetchers);
 	list_add_tail(&f->next_fetch, &p->fetch_list);
 	*fetch_return = f;
 	return 0;
+
+create_expression_failed:
+	if (throttle != NULL) {
+		free_fetch_throttle(throttle);
+	}
+create_throttle_failed:
+	if (sort != NULL) {
+		free_fetch_sort(sort);
+	}
+	return -1;
 }
 
 cJSON *remove_fetch_from_peer(const struct peer *p, const cJSON *request)
@@ -740,9 +1501,7 @@ cJSON *remove_fetch_from_peer(const struct peer *p, const cJSON *request)
 		return create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "fetch id not found for unfetch");
 	}
 
-	remove_fetch_from_states(f);
-	list_del(&f->next_fetch);
-	free_fetch(f);
+	remove_fetch(f);
 	return create_success_response_from_request(p, request);
 }
 
@@ -752,12 +1511,25 @@ void remove_all_fetchers_from_peer(struct peer *p)
 	struct list_head *tmp;
 	list_for_each_safe (item, tmp, &p->fetch_list) {
 		struct fetch *f = list_entry(item, struct fetch, next_fetch);
-		remove_fetch_from_states(f);
-		list_del(&f->next_fetch);
-		free_fetch(f);
+		remove_fetch(f);
 	}
 }
 
+static int get_elements_in_all_peers(const struct peer *request_peer, const cJSON *request, const struct fetch_expression *expr, cJSON *states, cJSON **response)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	const struct list_head *peer_list = get_peer_list();
+	list_for_each_safe (item, tmp, peer_list) {
+		const struct peer *p = list_entry(item, struct peer, next_peer);
+		if (unlikely(get_elements_in_peer(p, request_peer, request, expr, states, response) < 0)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 cJSON *get_elements(const cJSON *request, const struct peer *request_peer)
 {
 	cJSON *response;
@@ -766,26 +1538,34 @@ cJSON *get_elements(const cJSON *request, const struct peer *request_peer)
 		return response;
 	}
 
-	struct fetch *f = create_fetch(request_peer, request, NULL, params, &response);
-	if (unlikely(f == NULL)) {
+	struct fetch_expression *expr = create_expression(request_peer, request, params, &response);
+	if (unlikely(expr == NULL)) {
 		return response;
 	}
 
 	cJSON *states = cJSON_CreateArray();
 
-	struct list_head *item;
-	struct list_head *tmp;
-	const struct list_head *peer_list = get_peer_list();
-	list_for_each_safe (item, tmp, peer_list) {
-		const struct peer *p = list_entry(item, struct peer, next_peer);
-		if (unlikely(get_elements_in_peer(p, request, f, states, &response) < 0)) {
-			cJSON_Delete(states);
-			goto out;
-		}
+	int ret;
+	const char *prefix = get_path_prefix(expr);
+	if (prefix != NULL) {
+		struct get_context context = {
+		    .request_peer = request_peer,
+		    .request = request,
+		    .expr = expr,
+		    .states = states,
+		    .response = &response,
+		};
+		ret = path_index_visit_prefix(prefix, get_indexed_element, &context);
+	} else {
+		ret = get_elements_in_all_peers(request_peer, request, expr, states, &response);
 	}
 
-	response = create_result_response_from_request(request_peer, request, states, "result");
-out:
-	free_fetch(f);
+	if (unlikely(ret != 0)) {
+		cJSON_Delete(states);
+	} else {
+		response = create_result_response_from_request(request_peer, request, states, "result");
+	}
+
+	free_expression(expr);
 	return response;
 }
@@ -28,6 +28,7 @@
 #define CJET_HANDLE_FETCH_H
 
 #include "element.h"
+#include "fetch_index.h"
 #include "list.h"
 #include "peer.h"
 #include "json/cJSON.h"
@@ -38,31 +39,79 @@ extern "C" {
 
 struct path_matcher;
 struct element;
+struct jet_regex;
+struct fetch_sort;
+struct fetch_throttle;
+struct value_matcher;
 
-typedef int (*match_func)(const struct path_matcher *pm, const char *state_path);
+typedef int (*match_func)(const struct path_matcher *pm, const char *state_path, size_t state_path_length);
+
+struct path_element {
+	char *string; /* Already lowercase if the fetch is case insensitive */
+	size_t length;
+};
 
 struct path_matcher {
 	match_func match_function;
+	enum fetch_index_type index_type;
+	unsigned int type; /* Index into the table of supported matchers */
+	struct jet_regex *regex; /* Compiled pattern of a regex matcher */
 	unsigned int number_of_path_elements;
-	char *path_elements[1];
+	struct path_element path_elements[1];
+};
+
+/*
+ * A fetch expression is the compiled path object of a fetch. Identical
+ * expressions are shared by all fetches using them, so matching and the
+ * links to the matched elements exist only once per expression.
+ */
+struct fetch_expression {
+	char *key; /* Canonical form of the expression, NULL if not shared */
+	struct list_head fetchers; /* All fetches using this expression */
+	struct list_head set_entries; /* The entries of all fetcher sets containing this expression */
+	struct fetch_index_entry index_entry;
+	struct value_matcher *value_matcher; /* NULL if the values are not filtered */
+	bool ignore_case;
+	bool states_added;
+	unsigned int number_of_matchers;
+	struct path_matcher *matcher[1];
 };
 
 struct fetch {
 	cJSON *fetch_id;
+	char *notification_prefix; /* Pre-rendered {"method":<fetch_id>,"params": */
+	size_t notification_prefix_length;
 	const struct peer *peer;
-	unsigned int number_of_matchers;
+	struct fetch_expression *expression;
+	struct fetch_sort *sort; /* NULL if the fetch is not sorted */
+	struct fetch_throttle *throttle; /* NULL if the fetch has no minInterval */
+	bool delta; /* Changes are sent as merge patch if that is smaller than the value */
 	struct list_head next_fetch;
-	struct path_matcher *matcher[1];
+	struct list_head next_fetcher; /* Entry in the fetchers list of the expression */
 };
 
 int add_fetch_to_peer(struct peer *p, const cJSON *request, struct fetch **fetch_return, cJSON **response);
+
+/*
+ * The values in the returned response reference the rendered values of
+ * the states, so it has to be sent before any state is changed.
+ */
 cJSON *get_elements(const cJSON *request, const struct peer *request_peer);
 cJSON *remove_fetch_from_peer(const struct peer *p, const cJSON *request);
 void remove_all_fetchers_from_peer(struct peer *p);
-cJSON *add_fetch_to_states(const struct peer *request_peer, const cJSON *request, const struct fetch *f);
+cJSON *add_fetch_to_states(const struct peer *request_peer, const cJSON *request, struct fetch *f);
 int find_fetchers_for_element(struct element *e);
+void remove_all_fetchers_from_element(struct element *e);
+
+int notify_fetchers(struct element *e, const char *event_name);
 
-int notify_fetchers(const struct element *e, const char *event_name);
+/*
+ * Notifies a "change" of the value. Fetches with "delta" get the merge
+ * patch between old_value and the new value instead of the full value.
+ * patch might be NULL, then it is created on first use.
+ */
+int notify_fetchers_of_change(struct element *e, const cJSON *old_value, const cJSON *patch);
+int notify_fetching_peer(const struct element *e, const struct fetch *f, const char *event_name);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,479 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "fetch_index.h"
+#include "list.h"
+
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+enum { INITIAL_NUMBER_OF_CHILDREN = 2 };
+
+struct path_trie_node {
+	struct path_trie_node *parent;
+	struct path_trie_node **children;
+	struct path_trie_node *fail;
+	struct path_trie_node *output;
+	struct path_trie_node *next_in_queue;
+	struct list_head exact_entries;
+	struct list_head prefix_entries;
+	unsigned int number_of_children;
+	unsigned int children_size;
+	char c;
+};
+
+#define PATH_TRIE_ROOT_INIT(name)                                  \
+	{                                                          \
+		.exact_entries = LIST_HEAD_INIT(name.exact_entries),   \
+		.prefix_entries = LIST_HEAD_INIT(name.prefix_entries), \
+	}
+
+static struct path_trie_node path_trie = PATH_TRIE_ROOT_INIT(path_trie);
+static struct path_trie_node path_trie_ignore_case = PATH_TRIE_ROOT_INIT(path_trie_ignore_case);
+static struct path_trie_node reversed_path_trie = PATH_TRIE_ROOT_INIT(reversed_path_trie);
+static struct path_trie_node reversed_path_trie_ignore_case = PATH_TRIE_ROOT_INIT(reversed_path_trie_ignore_case);
+
+struct fetch_index_pattern {
+	struct list_head list;
+	struct fetch_index_entry *entry;
+	struct path_trie_node *node;
+	unsigned int epoch;
+};
+
+/*
+ * Aho-Corasick automaton over all substrings of "contains" and
+ * "containsAllOf" fetches. The goto function is the trie of the
+ * patterns, the pattern entries live in the exact_entries list of the
+ * node where the pattern ends. Failure and output links are recomputed
+ * lazily before the next search whenever the set of patterns changed.
+ */
+struct substring_automaton {
+	struct path_trie_node root;
+	bool ignore_case;
+	bool dirty;
+};
+
+#define SUBSTRING_AUTOMATON_INIT(name, case_insensitive) \
+	{                                                \
+		.root = PATH_TRIE_ROOT_INIT(name.root),      \
+		.ignore_case = (case_insensitive),           \
+		.dirty = false,                              \
+	}
+
+static struct substring_automaton substring_automaton = SUBSTRING_AUTOMATON_INIT(substring_automaton, false);
+static struct substring_automaton substring_automaton_ignore_case = SUBSTRING_AUTOMATON_INIT(substring_automaton_ignore_case, true);
+
+static unsigned int search_epoch;
+
+static LIST_HEAD(unindexed_entries);
+
+static inline char fold_char(char c)
+{
+	if ((c >= 'A') && (c <= 'Z')) {
+		return c + ('a' - 'A');
+	}
+	return c;
+}
+
+static inline char get_key_char(const char *key, size_t length, size_t i, bool reversed, bool ignore_case)
+{
+	char c = reversed ? key[length - 1 - i] : key[i];
+	return ignore_case ? fold_char(c) : c;
+}
+
+static struct path_trie_node *get_root(enum fetch_index_type type, bool ignore_case)
+{
+	if (type == FETCH_INDEX_ENDS_WITH) {
+		return ignore_case ? &reversed_path_trie_ignore_case : &reversed_path_trie;
+	} else {
+		return ignore_case ? &path_trie_ignore_case : &path_trie;
+	}
+}
+
+static struct path_trie_node *find_child(const struct path_trie_node *node, char c)
+{
+	for (unsigned int i = 0; i < node->number_of_children; i++) {
+		if (node->children[i]->c == c) {
+			return node->children[i];
+		}
+	}
+	return NULL;
+}
+
+static struct path_trie_node *add_child(struct path_trie_node *node, char c)
+{
+	if (node->number_of_children == node->children_size) {
+		unsigned int new_size = MAX(INITIAL_NUMBER_OF_CHILDREN, node->children_size * 2);
+		struct path_trie_node **new_children = cjet_malloc(new_size * sizeof(*new_children));
+		if (unlikely(new_children == NULL)) {
+			return NULL;
+		}
+		if (node->children != NULL) {
+			memcpy(new_children, node->children, node->number_of_children * sizeof(*new_children));
+			cjet_free(node->children);
+		}
+		node->children = new_children;
+		node->children_size = new_size;
+	}
+
+	struct path_trie_node *child = cjet_calloc(1, sizeof(*child));
+	if (unlikely(child == NULL)) {
+		return NULL;
+	}
+	INIT_LIST_HEAD(&child->exact_entries);
+	INIT_LIST_HEAD(&child->prefix_entries);
+	child->parent = node;
+	child->c = c;
+	node->children[node->number_of_children] = child;
+	node->number_of_children++;
+	return child;
+}
+
+static void remove_child(struct path_trie_node *node, const struct path_trie_node *child)
+{
+	for (unsigned int i = 0; i < node->number_of_children; i++) {
+		if (node->children[i] == child) {
+			node->number_of_children--;
+			node->children[i] = node->children[node->number_of_children];
+			break;
+		}
+	}
+
+	if (node->number_of_children == 0) {
+		cjet_free(node->children);
+		node->children = NULL;
+		node->children_size = 0;
+	}
+}
+
+static bool node_is_unused(const struct path_trie_node *node)
+{
+	return (node->number_of_children == 0) && list_empty(&node->exact_entries) && list_empty(&node->prefix_entries);
+}
+
+static void prune_node(struct path_trie_node *node)
+{
+	while ((node->parent != NULL) && node_is_unused(node)) {
+		struct path_trie_node *parent = node->parent;
+		remove_child(parent, node);
+		cjet_free(node);
+		node = parent;
+	}
+}
+
+static struct path_trie_node *get_node(struct path_trie_node *root, const char *key, bool reversed, bool ignore_case)
+{
+	size_t length = strlen(key);
+	struct path_trie_node *node = root;
+	for (size_t i = 0; i < length; i++) {
+		char c = get_key_char(key, length, i, reversed, ignore_case);
+		struct path_trie_node *child = find_child(node, c);
+		if (child == NULL) {
+			child = add_child(node, c);
+			if (unlikely(child == NULL)) {
+				prune_node(node);
+				return NULL;
+			}
+		}
+		node = child;
+	}
+	return node;
+}
+
+int fetch_index_add(struct fetch_index_entry *entry, enum fetch_index_type type, const char *key, bool ignore_case)
+{
+	entry->patterns = NULL;
+	entry->number_of_patterns = 0;
+	if (type == FETCH_INDEX_NONE) {
+		entry->node = NULL;
+		list_add_tail(&entry->list, &unindexed_entries);
+		return 0;
+	}
+
+	struct path_trie_node *root = get_root(type, ignore_case);
+	struct path_trie_node *node = get_node(root, key, type == FETCH_INDEX_ENDS_WITH, ignore_case);
+	if (unlikely(node == NULL)) {
+		return -1;
+	}
+
+	entry->node = node;
+	if (type == FETCH_INDEX_EQUALS) {
+		list_add_tail(&entry->list, &node->exact_entries);
+	} else {
+		list_add_tail(&entry->list, &node->prefix_entries);
+	}
+	return 0;
+}
+
+static void remove_patterns(struct fetch_index_entry *entry, unsigned int number_of_patterns)
+{
+	for (unsigned int i = 0; i < number_of_patterns; i++) {
+		struct fetch_index_pattern *pattern = &entry->patterns[i];
+		list_del(&pattern->list);
+		prune_node(pattern->node);
+	}
+	cjet_free(entry->patterns);
+	entry->patterns = NULL;
+	entry->number_of_patterns = 0;
+}
+
+int fetch_index_add_contains(struct fetch_index_entry *entry, const char **patterns, unsigned int number_of_patterns, bool ignore_case)
+{
+	unsigned int number_of_non_empty_patterns = 0;
+	for (unsigned int i = 0; i < number_of_patterns; i++) {
+		if (patterns[i][0] != '\0') {
+			number_of_non_empty_patterns++;
+		}
+	}
+
+	if (number_of_non_empty_patterns == 0) {
+		return fetch_index_add(entry, FETCH_INDEX_NONE, NULL, ignore_case);
+	}
+
+	entry->patterns = cjet_malloc(number_of_non_empty_patterns * sizeof(*entry->patterns));
+	if (unlikely(entry->patterns == NULL)) {
+		return -1;
+	}
+	entry->number_of_patterns = 0;
+	entry->node = NULL;
+	entry->hits = 0;
+	entry->epoch = search_epoch;
+	INIT_LIST_HEAD(&entry->list);
+
+	struct substring_automaton *automaton = ignore_case ? &substring_automaton_ignore_case : &substring_automaton;
+	automaton->dirty = true;
+	for (unsigned int i = 0; i < number_of_patterns; i++) {
+		if (patterns[i][0] == '\0') {
+			continue;
+		}
+		struct path_trie_node *node = get_node(&automaton->root, patterns[i], false, ignore_case);
+		if (unlikely(node == NULL)) {
+			remove_patterns(entry, entry->number_of_patterns);
+			return -1;
+		}
+		struct fetch_index_pattern *pattern = &entry->patterns[entry->number_of_patterns];
+		pattern->entry = entry;
+		pattern->node = node;
+		pattern->epoch = search_epoch;
+		list_add_tail(&pattern->list, &node->exact_entries);
+		entry->number_of_patterns++;
+	}
+	return 0;
+}
+
+void fetch_index_remove(struct fetch_index_entry *entry)
+{
+	if (entry->patterns != NULL) {
+		substring_automaton.dirty = true;
+		substring_automaton_ignore_case.dirty = true;
+		remove_patterns(entry, entry->number_of_patterns);
+		return;
+	}
+
+	list_del(&entry->list);
+	if (entry->node != NULL) {
+		prune_node(entry->node);
+		entry->node = NULL;
+	}
+}
+
+static int visit_entries(struct list_head *entries, fetch_index_visitor visitor, void *context)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, entries) {
+		struct fetch_index_entry *entry = list_entry(item, struct fetch_index_entry, list);
+		int ret = visitor(entry, context);
+		if (unlikely(ret != 0)) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static int walk_trie(struct path_trie_node *root, const char *path, size_t length, bool reversed, bool ignore_case, fetch_index_visitor visitor, void *context)
+{
+	struct path_trie_node *node = root;
+	int ret = visit_entries(&node->prefix_entries, visitor, context);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+
+	for (size_t i = 0; i < length; i++) {
+		node = find_child(node, get_key_char(path, length, i, reversed, ignore_case));
+		if (node == NULL) {
+			return 0;
+		}
+		ret = visit_entries(&node->prefix_entries, visitor, context);
+		if (unlikely(ret != 0)) {
+			return ret;
+		}
+	}
+
+	return visit_entries(&node->exact_entries, visitor, context);
+}
+
+static void build_failure_links(struct substring_automaton *automaton)
+{
+	struct path_trie_node *root = &automaton->root;
+	struct path_trie_node *head = root;
+	struct path_trie_node *tail = root;
+	root->fail = NULL;
+	root->output = NULL;
+	root->next_in_queue = NULL;
+
+	while (head != NULL) {
+		struct path_trie_node *node = head;
+		head = node->next_in_queue;
+		if (head == NULL) {
+			tail = NULL;
+		}
+
+		for (unsigned int i = 0; i < node->number_of_children; i++) {
+			struct path_trie_node *child = node->children[i];
+			struct path_trie_node *fail = node->fail;
+			struct path_trie_node *next = NULL;
+			while (fail != NULL) {
+				next = find_child(fail, child->c);
+				if (next != NULL) {
+					break;
+				}
+				fail = fail->fail;
+			}
+			child->fail = (next != NULL) ? next : root;
+			child->output = list_empty(&child->fail->exact_entries) ? child->fail->output : child->fail;
+
+			child->next_in_queue = NULL;
+			if (tail == NULL) {
+				head = child;
+			} else {
+				tail->next_in_queue = child;
+			}
+			tail = child;
+		}
+	}
+	automaton->dirty = false;
+}
+
+static int visit_patterns(struct path_trie_node *node, fetch_index_visitor visitor, void *context)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &node->exact_entries) {
+		struct fetch_index_pattern *pattern = list_entry(item, struct fetch_index_pattern, list);
+		if (pattern->epoch == search_epoch) {
+			continue;
+		}
+		pattern->epoch = search_epoch;
+
+		struct fetch_index_entry *entry = pattern->entry;
+		if (entry->epoch != search_epoch) {
+			entry->epoch = search_epoch;
+			entry->hits = 0;
+		}
+		entry->hits++;
+		if (entry->hits == entry->number_of_patterns) {
+			int ret = visitor(entry, context);
+			if (unlikely(ret != 0)) {
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+static int search_automaton(struct substring_automaton *automaton, const char *path, size_t length, fetch_index_visitor visitor, void *context)
+{
+	struct path_trie_node *root = &automaton->root;
+	if (root->number_of_children == 0) {
+		return 0;
+	}
+	if (automaton->dirty) {
+		build_failure_links(automaton);
+	}
+
+	search_epoch++;
+	struct path_trie_node *node = root;
+	for (size_t i = 0; i < length; i++) {
+		char c = automaton->ignore_case ? fold_char(path[i]) : path[i];
+		struct path_trie_node *next = find_child(node, c);
+		while ((next == NULL) && (node != root)) {
+			node = node->fail;
+			next = find_child(node, c);
+		}
+		if (next == NULL) {
+			continue;
+		}
+		node = next;
+
+		struct path_trie_node *output = list_empty(&node->exact_entries) ? node->output : node;
+		while (output != NULL) {
+			int ret = visit_patterns(output, visitor, context);
+			if (unlikely(ret != 0)) {
+				return ret;
+			}
+			output = output->output;
+		}
+	}
+	return 0;
+}
+
+int fetch_index_visit_candidates(const char *path, fetch_index_visitor visitor, void *context)
+{
+	size_t length = strlen(path);
+
+	int ret = walk_trie(&path_trie, path, length, false, false, visitor, context);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+	ret = walk_trie(&path_trie_ignore_case, path, length, false, true, visitor, context);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+	ret = walk_trie(&reversed_path_trie, path, length, true, false, visitor, context);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+	ret = walk_trie(&reversed_path_trie_ignore_case, path, length, true, true, visitor, context);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+	ret = search_automaton(&substring_automaton, path, length, visitor, context);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+	ret = search_automaton(&substring_automaton_ignore_case, path, length, visitor, context);
+	if (unlikely(ret != 0)) {
+		return ret;
+	}
+
+	return visit_entries(&unindexed_entries, visitor, context);
+}
@@ -0,0 +1,79 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_FETCH_INDEX_H
+#define CJET_FETCH_INDEX_H
+
+#include <stdbool.h>
+
+#include "list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The fetch index keeps all active fetches in a way that adding an
+ * element only has to evaluate fetches that might match the path of
+ * the element. Fetches with an "equals" or "startsWith" matcher are
+ * sorted into a trie over the path, fetches with an "endsWith" matcher
+ * into a trie over the reversed path. Fetches with only "contains" or
+ * "containsAllOf" matchers are found by a single Aho-Corasick pass over
+ * the path and become candidates only if all of their substrings were
+ * found. All other fetches are always candidates.
+ */
+enum fetch_index_type {
+	FETCH_INDEX_NONE,
+	FETCH_INDEX_EQUALS,
+	FETCH_INDEX_STARTS_WITH,
+	FETCH_INDEX_ENDS_WITH,
+	FETCH_INDEX_CONTAINS
+};
+
+struct path_trie_node;
+struct fetch_index_pattern;
+
+struct fetch_index_entry {
+	struct list_head list;
+	struct path_trie_node *node;
+	struct fetch_index_pattern *patterns;
+	unsigned int number_of_patterns;
+	unsigned int hits;
+	unsigned int epoch;
+};
+
+typedef int (*fetch_index_visitor)(struct fetch_index_entry *entry, void *context);
+
+int fetch_index_add(struct fetch_index_entry *entry, enum fetch_index_type type, const char *key, bool ignore_case);
+int fetch_index_add_contains(struct fetch_index_entry *entry, const char **patterns, unsigned int number_of_patterns, bool ignore_case);
+void fetch_index_remove(struct fetch_index_entry *entry);
+int fetch_index_visit_candidates(const char *path, fetch_index_visitor visitor, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,560 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "element.h"
+#include "fetch.h"
+#include "fetch_sort.h"
+#include "jet_string.h"
+#include "list.h"
+#include "order_tree.h"
+#include "peer.h"
+#include "response.h"
+#include "util.h"
+#include "value_matcher.h"
+#include "json/cJSON.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+enum { DEFAULT_SORT_FROM = 1, DEFAULT_SORT_TO = 10 };
+
+static LIST_HEAD(deferred_sorts);
+static bool defer_window_notifications = false;
+
+enum sort_key_type {
+	SORT_BY_PATH,
+	SORT_BY_NUMBER,
+	SORT_BY_STRING,
+};
+
+/*
+ * The matched elements of a sorted fetch are kept in an order statistic
+ * tree, so the rank of an element and the elements at the positions
+ * from..to of the window are found in O(log n).
+ */
+struct fetch_sort {
+	struct order_tree tree;
+	enum sort_key_type key_type;
+	char *field; /* Dot separated path into the value for byValueField, NULL otherwise */
+	bool descending;
+	unsigned int from;
+	unsigned int to;
+	const struct fetch *deferred_fetch; /* The fetch whose window notification is deferred */
+	struct list_head next_deferred_sort;
+};
+
+/*
+ * The sort key is copied into the node, because the tree must stay
+ * ordered while the value of the element is already changed.
+ */
+struct sort_node {
+	struct order_tree_node tree_node;
+	struct list_head next_sort_node; /* Entry in the sort_nodes list of the element */
+	struct fetch_sort *sort;
+	struct element *element;
+	double number;
+	char *string;
+};
+
+static const struct sort_node *get_sort_node(const struct order_tree_node *tree_node)
+{
+	return const_container_of(tree_node, struct sort_node, tree_node);
+}
+
+static int compare_numbers(double a, double b)
+{
+	if (a < b) {
+		return -1;
+	}
+	return (a > b) ? 1 : 0;
+}
+
+static int compare_sort_nodes(const struct order_tree_node *a, const struct order_tree_node *b)
+{
+	const struct sort_node *node_a = get_sort_node(a);
+	const struct sort_node *node_b = get_sort_node(b);
+	const struct fetch_sort *sort = node_a->sort;
+
+	int ret;
+	switch (sort->key_type) {
+	case SORT_BY_NUMBER:
+		ret = compare_numbers(node_a->number, node_b->number);
+		break;
+	case SORT_BY_STRING:
+		ret = strcmp(node_a->string, node_b->string);
+		break;
+	default:
+		ret = strcmp(node_a->element->path, node_b->element->path);
+		break;
+	}
+
+	if (sort->descending) {
+		ret = -ret;
+	}
+	if (ret == 0) {
+		ret = strcmp(node_a->element->path, node_b->element->path);
+	}
+	return ret;
+}
+
+static int get_key_type(const cJSON *type, enum sort_key_type *key_type)
+{
+	if ((type == NULL) || (type->type != cJSON_String)) {
+		return -1;
+	}
+	if (strcmp(type->valuestring, "number") == 0) {
+		*key_type = SORT_BY_NUMBER;
+		return 0;
+	}
+	if (strcmp(type->valuestring, "string") == 0) {
+		*key_type = SORT_BY_STRING;
+		return 0;
+	}
+	return -1;
+}
+
+static int get_window_bound(const cJSON *sort_object, const char *name, unsigned int *bound)
+{
+	const cJSON *item = cJSON_GetObjectItem(sort_object, name);
+	if (item == NULL) {
+		return 0;
+	}
+	if ((item->type != cJSON_Number) || (item->valuedouble < 1) || (item->valuedouble > UINT_MAX)) {
+		return -1;
+	}
+	*bound = (unsigned int)item->valuedouble;
+	return 0;
+}
+
+static const char *fill_sort(struct fetch_sort *sort, const cJSON *sort_object)
+{
+	if (unlikely(get_window_bound(sort_object, "from", &sort->from) < 0)) {
+		return "sort from is not a positive number";
+	}
+	sort->to = sort->from + DEFAULT_SORT_TO - DEFAULT_SORT_FROM;
+	if (unlikely(get_window_bound(sort_object, "to", &sort->to) < 0) || unlikely(sort->to < sort->from)) {
+		return "sort to is not a number greater or equal to from";
+	}
+
+	const cJSON *descending = cJSON_GetObjectItem(sort_object, "descending");
+	if (descending != NULL) {
+		if (unlikely((descending->type != cJSON_True) && (descending->type != cJSON_False))) {
+			return "sort descending is not a boolean";
+		}
+		sort->descending = (descending->type == cJSON_True);
+	}
+
+	const cJSON *by_value_field = cJSON_GetObjectItem(sort_object, "byValueField");
+	if (by_value_field != NULL) {
+		if (unlikely((by_value_field->type != cJSON_Object) || (cJSON_GetArraySize(by_value_field) != 1))) {
+			return "sort byValueField is not an object with a single field";
+		}
+		if (unlikely(get_key_type(by_value_field->child, &sort->key_type) < 0)) {
+			return "unsupported type in sort byValueField";
+		}
+		sort->field = duplicate_string(by_value_field->child->string);
+		if (unlikely(sort->field == NULL)) {
+			return "could not allocate memory for sort field";
+		}
+		return NULL;
+	}
+
+	const cJSON *by_value = cJSON_GetObjectItem(sort_object, "byValue");
+	if (by_value != NULL) {
+		if (unlikely(get_key_type(by_value, &sort->key_type) < 0)) {
+			return "unsupported type in sort byValue";
+		}
+		return NULL;
+	}
+
+	sort->key_type = SORT_BY_PATH;
+	return NULL;
+}
+
+int create_fetch_sort(const struct peer *p, const cJSON *request, const cJSON *params, struct fetch_sort **sort_return, cJSON **response)
+{
+	*sort_return = NULL;
+	const cJSON *sort_object = cJSON_GetObjectItem(params, "sort");
+	if (sort_object == NULL) {
+		return 0;
+	}
+	if (unlikely(sort_object->type != cJSON_Object)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "sort is not an object");
+		return -1;
+	}
+
+	struct fetch_sort *sort = cjet_calloc(1, sizeof(*sort));
+	if (unlikely(sort == NULL)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate sort");
+		return -1;
+	}
+	order_tree_init(&sort->tree, compare_sort_nodes);
+	INIT_LIST_HEAD(&sort->next_deferred_sort);
+	sort->from = DEFAULT_SORT_FROM;
+
+	const char *error = fill_sort(sort, sort_object);
+	if (unlikely(error != NULL)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", error);
+		free_fetch_sort(sort);
+		return -1;
+	}
+
+	*sort_return = sort;
+	return 0;
+}
+
+static void free_sort_node(struct sort_node *node)
+{
+	list_del(&node->next_sort_node);
+	if (node->string != NULL) {
+		cjet_free(node->string);
+	}
+	cjet_free(node);
+}
+
+void free_fetch_sort(struct fetch_sort *sort)
+{
+	list_del(&sort->next_deferred_sort);
+	while (sort->tree.root != NULL) {
+		struct sort_node *node = container_of(sort->tree.root, struct sort_node, tree_node);
+		order_tree_remove(&sort->tree, &node->tree_node);
+		free_sort_node(node);
+	}
+	if (sort->field != NULL) {
+		cjet_free(sort->field);
+	}
+	cjet_free(sort);
+}
+
+/*
+ * Returns 1 if the element has a sort key, 0 if it can not be sorted by
+ * this fetch and -1 on allocation failures.
+ */
+static int fill_sort_key(struct sort_node *node, const struct element *e)
+{
+	const struct fetch_sort *sort = node->sort;
+	if (sort->key_type == SORT_BY_PATH) {
+		return 1;
+	}
+
+	const cJSON *value = get_value_field(e->value, sort->field);
+	if (value == NULL) {
+		return 0;
+	}
+	if (sort->key_type == SORT_BY_NUMBER) {
+		if (value->type != cJSON_Number) {
+			return 0;
+		}
+		node->number = value->valuedouble;
+		return 1;
+	}
+
+	if (value->type != cJSON_String) {
+		return 0;
+	}
+	node->string = duplicate_string(value->valuestring);
+	if (unlikely(node->string == NULL)) {
+		return -1;
+	}
+	return 1;
+}
+
+static struct sort_node *find_sort_node(const struct fetch_sort *sort, const struct element *e)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &e->sort_nodes) {
+		struct sort_node *node = list_entry(item, struct sort_node, next_sort_node);
+		if (node->sort == sort) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+static struct sort_node *alloc_sort_node(struct fetch_sort *sort, struct element *e)
+{
+	struct sort_node *node = cjet_calloc(1, sizeof(*node));
+	if (unlikely(node == NULL)) {
+		return NULL;
+	}
+	node->sort = sort;
+	node->element = e;
+	list_add_tail(&node->next_sort_node, &e->sort_nodes);
+	return node;
+}
+
+/*
+ * Returns the rank of the inserted element or 0 if it has no sort key.
+ */
+static int insert_sort_node(struct fetch_sort *sort, struct sort_node *node)
+{
+	int ret = fill_sort_key(node, node->element);
+	if (ret <= 0) {
+		free_sort_node(node);
+		return ret;
+	}
+	return (int)order_tree_insert(&sort->tree, &node->tree_node);
+}
+
+int fetch_sort_add_element(struct fetch_sort *sort, struct element *e)
+{
+	if (find_sort_node(sort, e) != NULL) {
+		return 0;
+	}
+
+	struct sort_node *node = alloc_sort_node(sort, e);
+	if (unlikely(node == NULL)) {
+		return -1;
+	}
+	return (insert_sort_node(sort, node) < 0) ? -1 : 0;
+}
+
+void remove_element_from_fetch_sorts(struct element *e)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &e->sort_nodes) {
+		struct sort_node *node = list_entry(item, struct sort_node, next_sort_node);
+		order_tree_remove(&node->sort->tree, &node->tree_node);
+		free_sort_node(node);
+	}
+}
+
+static unsigned int window_size(const struct fetch_sort *sort)
+{
+	unsigned int size = order_tree_size(&sort->tree);
+	if (size < sort->from) {
+		return 0;
+	}
+	return MIN(size, sort->to) - sort->from + 1;
+}
+
+static cJSON *create_change(const struct element *e, unsigned int index)
+{
+	cJSON *change = cJSON_CreateObject();
+	if (unlikely(change == NULL)) {
+		return NULL;
+	}
+
+	cJSON *path = cJSON_CreateString(e->path);
+	if (unlikely(path == NULL)) {
+		goto error;
+	}
+	cJSON_AddItemToObject(change, "path", path);
+
+	if (e->value != NULL) {
+		cJSON_AddItemReferenceToObject(change, "value", e->rendered_value);
+		if (unlikely(cJSON_GetObjectItem(change, "value") == NULL)) {
+			goto error;
+		}
+	}
+
+	cJSON *rank = cJSON_CreateNumber(index);
+	if (unlikely(rank == NULL)) {
+		goto error;
+	}
+	cJSON_AddItemToObject(change, "index", rank);
+	return change;
+
+error:
+	cJSON_Delete(change);
+	return NULL;
+}
+
+static int send_sort_notification(const struct fetch *f, const cJSON *params)
+{
+	char *rendered_params = cJSON_PrintUnformatted(params);
+	if (unlikely(rendered_params == NULL)) {
+		return -1;
+	}
+
+	size_t params_length = strlen(rendered_params);
+	size_t length = f->notification_prefix_length + params_length + 1;
+	char *message = cjet_malloc(length + 1);
+	if (unlikely(message == NULL)) {
+		cjet_free(rendered_params);
+		return -1;
+	}
+	memcpy(message, f->notification_prefix, f->notification_prefix_length);
+	memcpy(message + f->notification_prefix_length, rendered_params, params_length);
+	message[length - 1] = '}';
+	message[length] = '\0';
+	cjet_free(rendered_params);
+
+	const struct peer *p = f->peer;
+	int ret = queue_notification(p, message, length);
+	cjet_free(message);
+	return ret;
+}
+
+/*
+ * Sends the elements at the window positions first..last, which are
+ * already clipped to the window, and the number of elements in the
+ * window.
+ */
+static int send_window_changes(const struct fetch *f, unsigned int first, unsigned int last)
+{
+	int ret = -1;
+	const struct fetch_sort *sort = f->sort;
+	cJSON *params = cJSON_CreateObject();
+	if (unlikely(params == NULL)) {
+		return -1;
+	}
+
+	cJSON *changes = cJSON_CreateArray();
+	if (unlikely(changes == NULL)) {
+		goto out;
+	}
+	cJSON_AddItemToObject(params, "changes", changes);
+
+	struct order_tree_node *tree_node = (first <= last) ? order_tree_select(&sort->tree, first) : NULL;
+	for (unsigned int index = first; (index <= last) && (tree_node != NULL); index++) {
+		cJSON *change = create_change(get_sort_node(tree_node)->element, index);
+		if (unlikely(change == NULL)) {
+			goto out;
+		}
+		cJSON_AddItemToArray(changes, change);
+		tree_node = order_tree_next(tree_node);
+	}
+
+	cJSON *n = cJSON_CreateNumber(window_size(sort));
+	if (unlikely(n == NULL)) {
+		goto out;
+	}
+	cJSON_AddItemToObject(params, "n", n);
+
+	ret = send_sort_notification(f, params);
+
+out:
+	cJSON_Delete(params);
+	return ret;
+}
+
+int fetch_sort_notify_window(const struct fetch *f)
+{
+	const struct fetch_sort *sort = f->sort;
+	return send_window_changes(f, sort->from, MIN(sort->to, order_tree_size(&sort->tree)));
+}
+
+int fetch_sort_notify(const struct fetch *f, struct element *e, const char *event_name)
+{
+	struct fetch_sort *sort = f->sort;
+	unsigned int old_window_size = window_size(sort);
+	unsigned int old_size = order_tree_size(&sort->tree);
+	unsigned int old_rank = 0;
+	unsigned int new_rank = 0;
+
+	struct sort_node *node = find_sort_node(sort, e);
+	if (node != NULL) {
+		old_rank = order_tree_rank(&node->tree_node);
+		order_tree_remove(&sort->tree, &node->tree_node);
+		if (node->string != NULL) {
+			cjet_free(node->string);
+			node->string = NULL;
+		}
+	}
+
+	if (strcmp(event_name, "remove") == 0) {
+		if (node != NULL) {
+			free_sort_node(node);
+		}
+	} else {
+		if (node == NULL) {
+			node = alloc_sort_node(sort, e);
+			if (unlikely(node == NULL)) {
+				return -1;
+			}
+		}
+		int ret = insert_sort_node(sort, node);
+		if (unlikely(ret < 0)) {
+			return -1;
+		}
+		new_rank = (unsigned int)ret;
+	}
+
+	if ((old_rank == 0) && (new_rank == 0)) {
+		return 0;
+	}
+
+	/*
+	 * All positions between the old and the new rank shift by one. If the
+	 * element was added or removed, all positions behind it shift.
+	 */
+	unsigned int first;
+	unsigned int last;
+	if (old_rank == 0) {
+		first = new_rank;
+		last = order_tree_size(&sort->tree);
+	} else if (new_rank == 0) {
+		first = old_rank;
+		last = old_size;
+	} else {
+		first = MIN(old_rank, new_rank);
+		last = MAX(old_rank, new_rank);
+	}
+	first = MAX(first, sort->from);
+	last = MIN(last, MIN(sort->to, order_tree_size(&sort->tree)));
+
+	if ((first > last) && (window_size(sort) == old_window_size)) {
+		return 0;
+	}
+	if (defer_window_notifications) {
+		if (list_empty(&sort->next_deferred_sort)) {
+			sort->deferred_fetch = f;
+			list_add_tail(&sort->next_deferred_sort, &deferred_sorts);
+		}
+		return 0;
+	}
+	return send_window_changes(f, first, last);
+}
+
+void fetch_sort_defer_window_notifications(void)
+{
+	defer_window_notifications = true;
+}
+
+int fetch_sort_notify_deferred_windows(void)
+{
+	int ret = 0;
+	defer_window_notifications = false;
+	while (!list_empty(&deferred_sorts)) {
+		struct fetch_sort *sort = list_entry(deferred_sorts.next, struct fetch_sort, next_deferred_sort);
+		list_del(&sort->next_deferred_sort);
+		INIT_LIST_HEAD(&sort->next_deferred_sort);
+		if (unlikely(fetch_sort_notify_window(sort->deferred_fetch) != 0)) {
+			ret = -1;
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,80 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_FETCH_SORT_H
+#define CJET_FETCH_SORT_H
+
+#include "json/cJSON.h"
+#include "peer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct element;
+struct fetch;
+struct fetch_sort;
+
+/*
+ * Parses the optional "sort" object of fetch params. *sort_return is
+ * NULL if the fetch is not sorted.
+ */
+int create_fetch_sort(const struct peer *p, const cJSON *request, const cJSON *params, struct fetch_sort **sort_return, cJSON **response);
+void free_fetch_sort(struct fetch_sort *sort);
+
+/*
+ * Inserts an element into the order of a sorted fetch without notifying
+ * the fetching peer. Used to fill the order when the fetch is added.
+ */
+int fetch_sort_add_element(struct fetch_sort *sort, struct element *e);
+
+/*
+ * Sends the complete window of a sorted fetch.
+ */
+int fetch_sort_notify_window(const struct fetch *f);
+
+/*
+ * Updates the position of an element after an "add", "change" or
+ * "remove" event and sends only the window positions that changed.
+ */
+int fetch_sort_notify(const struct fetch *f, struct element *e, const char *event_name);
+
+void remove_element_from_fetch_sorts(struct element *e);
+
+/*
+ * While deferred, fetch_sort_notify() only updates the sort order and
+ * remembers the fetches whose window changed.
+ * fetch_sort_notify_deferred_windows() sends their complete windows
+ * once and ends the deferral.
+ */
+void fetch_sort_defer_window_notifications(void);
+int fetch_sort_notify_deferred_windows(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "element.h"
+#include "fetch.h"
+#include "fetch_throttle.h"
+#include "list.h"
+#include "log.h"
+#include "peer.h"
+#include "response.h"
+#include "timer.h"
+#include "json/cJSON.h"
+
+static const double MIN_INTERVAL_IN_MS = 1.0;
+
+/*
+ * The first event of a throttled fetch is sent immediately and starts
+ * the interval timer. Events arriving while the timer runs only mark the
+ * pending entry of the (fetch, element) pair, the latest value of the
+ * element is rendered when the timer fires. Entries are kept after
+ * flushing, so steady state updates do not allocate.
+ */
+struct fetch_throttle {
+	struct cjet_timer timer;
+	struct list_head entries; /* All entries of this fetch */
+	struct list_head pending; /* Entries with an event to send */
+	uint64_t interval_ns;
+	bool timer_running;
+};
+
+struct throttle_entry {
+	struct list_head next_in_throttle;
+	struct list_head next_in_element; /* Entry in the throttle_entries list of the element */
+	struct list_head next_pending;
+	struct fetch_throttle *throttle;
+	struct element *element;
+	const char *event_name; /* NULL if nothing is pending */
+};
+
+int create_fetch_throttle(const struct peer *p, const cJSON *request, const cJSON *params, struct fetch_throttle **throttle_return, cJSON **response)
+{
+	*throttle_return = NULL;
+	const cJSON *min_interval = cJSON_GetObjectItem(params, "minInterval");
+	if (min_interval == NULL) {
+		return 0;
+	}
+	if (unlikely(min_interval->type != cJSON_Number)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "minInterval is not a number");
+		return -1;
+	}
+	if (unlikely(!(min_interval->valuedouble >= MIN_INTERVAL_IN_MS))) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "minInterval is too small");
+		return -1;
+	}
+
+	struct fetch_throttle *throttle = cjet_calloc(1, sizeof(*throttle));
+	if (unlikely(throttle == NULL)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate throttle");
+		return -1;
+	}
+	INIT_LIST_HEAD(&throttle->entries);
+	INIT_LIST_HEAD(&throttle->pending);
+	throttle->interval_ns = convert_seconds_to_nsec(min_interval->valuedouble / 1000.0);
+
+	if (unlikely(cjet_timer_init(&throttle->timer, p->loop) < 0)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "could not init timer for throttled fetch");
+		cjet_free(throttle);
+		return -1;
+	}
+
+	*throttle_return = throttle;
+	return 0;
+}
+
+static void clear_pending(struct throttle_entry *entry)
+{
+	if (entry->event_name != NULL) {
+		list_del(&entry->next_pending);
+		entry->event_name = NULL;
+	}
+}
+
+static void free_throttle_entry(struct throttle_entry *entry)
+{
+	clear_pending(entry);
+	list_del(&entry->next_in_throttle);
+	list_del(&entry->next_in_element);
+	cjet_free(entry);
+}
+
+void free_fetch_throttle(struct fetch_throttle *throttle)
+{
+	if (throttle->timer_running) {
+		throttle->timer.cancel(&throttle->timer);
+	}
+	cjet_timer_destroy(&throttle->timer);
+
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &throttle->entries) {
+		struct throttle_entry *entry = list_entry(item, struct throttle_entry, next_in_throttle);
+		free_throttle_entry(entry);
+	}
+	cjet_free(throttle);
+}
+
+void remove_element_from_fetch_throttles(struct element *e)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &e->throttle_entries) {
+		struct throttle_entry *entry = list_entry(item, struct throttle_entry, next_in_element);
+		free_throttle_entry(entry);
+	}
+}
+
+static struct throttle_entry *find_entry(const struct fetch_throttle *throttle, const struct element *e)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &e->throttle_entries) {
+		struct throttle_entry *entry = list_entry(item, struct throttle_entry, next_in_element);
+		if (entry->throttle == throttle) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static struct throttle_entry *get_entry(struct fetch_throttle *throttle, struct element *e)
+{
+	struct throttle_entry *entry = find_entry(throttle, e);
+	if (entry != NULL) {
+		return entry;
+	}
+
+	entry = cjet_calloc(1, sizeof(*entry));
+	if (unlikely(entry == NULL)) {
+		log_err("Could not allocate memory for %s object!\n", "throttle entry");
+		return NULL;
+	}
+	entry->throttle = throttle;
+	entry->element = e;
+	list_add_tail(&entry->next_in_throttle, &throttle->entries);
+	list_add_tail(&entry->next_in_element, &e->throttle_entries);
+	return entry;
+}
+
+static void throttle_timer_handler(void *context, bool cancelled);
+
+static int start_timer(struct fetch *f)
+{
+	struct fetch_throttle *throttle = f->throttle;
+	if (unlikely(throttle->timer.start(&throttle->timer, throttle->interval_ns, throttle_timer_handler, f) < 0)) {
+		log_peer_err(f->peer, "Could not start timer for throttled fetch\n");
+		return -1;
+	}
+	throttle->timer_running = true;
+	return 0;
+}
+
+static void throttle_timer_handler(void *context, bool cancelled)
+{
+	struct fetch *f = (struct fetch *)context;
+	struct fetch_throttle *throttle = f->throttle;
+	throttle->timer_running = false;
+	if (cancelled || list_empty(&throttle->pending)) {
+		return;
+	}
+
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &throttle->pending) {
+		struct throttle_entry *entry = list_entry(item, struct throttle_entry, next_pending);
+		const char *event_name = entry->event_name;
+		clear_pending(entry);
+		if (unlikely(notify_fetching_peer(entry->element, f, event_name) != 0)) {
+			log_peer_err(f->peer, "Can't notify throttled fetch for state %s\n", entry->element->path);
+		}
+	}
+
+	start_timer(f);
+}
+
+int fetch_throttle_event(struct fetch *f, struct element *e, const char *event_name)
+{
+	struct fetch_throttle *throttle = f->throttle;
+	if (strcmp(event_name, "remove") == 0) {
+		/*
+		 * Removes are never delayed, the element might be gone when
+		 * the timer fires. An "add" the peer never saw is dropped
+		 * together with the remove.
+		 */
+		struct throttle_entry *entry = find_entry(throttle, e);
+		if (entry != NULL) {
+			bool add_pending = (entry->event_name != NULL) && (strcmp(entry->event_name, "add") == 0);
+			clear_pending(entry);
+			if (add_pending) {
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	if (!throttle->timer_running) {
+		if (unlikely(start_timer(f) < 0)) {
+			return -1;
+		}
+		return 1;
+	}
+
+	struct throttle_entry *entry = get_entry(throttle, e);
+	if (unlikely(entry == NULL)) {
+		return -1;
+	}
+	if (entry->event_name == NULL) {
+		entry->event_name = event_name;
+		list_add_tail(&entry->next_pending, &throttle->pending);
+	}
+	return 0;
+}
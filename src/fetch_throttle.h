@@ -0,0 +1,61 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_FETCH_THROTTLE_H
+#define CJET_FETCH_THROTTLE_H
+
+#include "json/cJSON.h"
+#include "peer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct element;
+struct fetch;
+struct fetch_throttle;
+
+/*
+ * Parses the optional "minInterval" (in milliseconds) of fetch params.
+ * *throttle_return is NULL if the fetch is not throttled.
+ */
+int create_fetch_throttle(const struct peer *p, const cJSON *request, const cJSON *params, struct fetch_throttle **throttle_return, cJSON **response);
+void free_fetch_throttle(struct fetch_throttle *throttle);
+
+/*
+ * Returns 1 if the event must be sent right now, 0 if it was coalesced
+ * into a pending notification that is sent when the interval elapsed
+ * and -1 on error.
+ */
+int fetch_throttle_event(struct fetch *f, struct element *e, const char *event_name);
+
+void remove_element_from_fetch_throttles(struct element *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,446 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "element.h"
+#include "fetch.h"
+#include "fetcher_set.h"
+#include "generated/cjet_config.h"
+#include "hashtable.h"
+#include "list.h"
+
+DECLARE_HASHTABLE_UINT64(fetcher_set_table, CONFIG_FETCHER_SET_TABLE_ORDER, 1U)
+
+static struct hashtable_fetcher_set_table *set_table = NULL;
+static unsigned int number_of_interned_sets = 0;
+
+enum set_change_type { ADD_ENTRY, REMOVE_ENTRY, TOGGLE_ENTRY };
+
+/*
+ * Describes the set that results from a change of an existing set, so
+ * an interned set can be looked up without creating the new set first.
+ */
+struct set_change {
+	const struct fetcher_set *base; /* NULL for the empty set */
+	enum set_change_type type;
+	unsigned int index;
+	struct fetch_expression *expression; /* The added expression */
+	bool value_matches;
+};
+
+static unsigned int changed_size(const struct set_change *change)
+{
+	unsigned int size = (change->base == NULL) ? 0 : change->base->number_of_entries;
+	switch (change->type) {
+	case ADD_ENTRY:
+		return size + 1;
+	case REMOVE_ENTRY:
+		return size - 1;
+	case TOGGLE_ENTRY:
+	default:
+		return size;
+	}
+}
+
+static void get_changed_entry(const struct set_change *change, unsigned int i, struct fetch_expression **expr, bool *value_matches)
+{
+	unsigned int base_index = i;
+	switch (change->type) {
+	case ADD_ENTRY:
+		if (i == change->index) {
+			*expr = change->expression;
+			*value_matches = change->value_matches;
+			return;
+		}
+		if (i > change->index) {
+			base_index = i - 1;
+		}
+		break;
+	case REMOVE_ENTRY:
+		if (i >= change->index) {
+			base_index = i + 1;
+		}
+		break;
+	case TOGGLE_ENTRY:
+	default:
+		break;
+	}
+
+	const struct fetcher_set_entry *entry = &change->base->entries[base_index];
+	*expr = entry->expression;
+	*value_matches = entry->value_matches;
+	if ((change->type == TOGGLE_ENTRY) && (i == change->index)) {
+		*value_matches = !*value_matches;
+	}
+}
+
+static uint64_t hash_entry(uint64_t hash, const struct fetch_expression *expr, bool value_matches)
+{
+	uint64_t key = (uint64_t)(uintptr_t)expr ^ (value_matches ? 1U : 0U);
+	hash = (hash ^ key) * hash64_magic;
+	return hash ^ (hash >> 29);
+}
+
+static uint64_t finish_hash(uint64_t hash)
+{
+	/*
+	 * The hash is the key of the intern table, which doesn't accept
+	 * HASHTABLE_INVALIDENTRY.
+	 */
+	return (hash == (uint64_t)HASHTABLE_INVALIDENTRY) ? 0 : hash;
+}
+
+static uint64_t hash_change(const struct set_change *change)
+{
+	uint64_t hash = 0;
+	unsigned int size = changed_size(change);
+	for (unsigned int i = 0; i < size; i++) {
+		struct fetch_expression *expr;
+		bool value_matches;
+		get_changed_entry(change, i, &expr, &value_matches);
+		hash = hash_entry(hash, expr, value_matches);
+	}
+	return finish_hash(hash);
+}
+
+static bool set_equals_change(const struct fetcher_set *set, const struct set_change *change)
+{
+	if (set->number_of_entries != changed_size(change)) {
+		return false;
+	}
+	for (unsigned int i = 0; i < set->number_of_entries; i++) {
+		struct fetch_expression *expr;
+		bool value_matches;
+		get_changed_entry(change, i, &expr, &value_matches);
+		if ((set->entries[i].expression != expr) || (set->entries[i].value_matches != value_matches)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static struct fetcher_set *get_sets_with_hash(uint64_t hash)
+{
+	if (set_table == NULL) {
+		return NULL;
+	}
+
+	struct value_fetcher_set_table val;
+	if (HASHTABLE_GET(fetcher_set_table, set_table, hash, &val) == HASHTABLE_SUCCESS) {
+		return val.vals[0];
+	}
+	return NULL;
+}
+
+static struct fetcher_set *find_set(const struct set_change *change, uint64_t hash)
+{
+	struct fetcher_set *set = get_sets_with_hash(hash);
+	while (set != NULL) {
+		if (set_equals_change(set, change)) {
+			return set;
+		}
+		set = set->next_with_hash;
+	}
+	return NULL;
+}
+
+static void intern_set(struct fetcher_set *set)
+{
+	struct fetcher_set *first = get_sets_with_hash(set->hash);
+	if (first != NULL) {
+		set->next_with_hash = first->next_with_hash;
+		first->next_with_hash = set;
+		set->interned = true;
+		number_of_interned_sets++;
+		return;
+	}
+
+	if (set_table == NULL) {
+		set_table = HASHTABLE_CREATE(fetcher_set_table);
+		if (unlikely(set_table == NULL)) {
+			return;
+		}
+	}
+
+	struct value_fetcher_set_table new_val;
+	new_val.vals[0] = set;
+	if (HASHTABLE_PUT(fetcher_set_table, set_table, set->hash, new_val, NULL) == HASHTABLE_SUCCESS) {
+		set->next_with_hash = NULL;
+		set->interned = true;
+		number_of_interned_sets++;
+	} else if (number_of_interned_sets == 0) {
+		/*
+		 * If the table can't grow, the set is just not shared with
+		 * elements moving to an equal set later.
+		 */
+		HASHTABLE_DELETE(fetcher_set_table, set_table);
+	}
+}
+
+static void unintern_set(struct fetcher_set *set)
+{
+	if (!set->interned) {
+		return;
+	}
+
+	struct fetcher_set *first = get_sets_with_hash(set->hash);
+	if (first == set) {
+		if (set->next_with_hash != NULL) {
+			struct value_fetcher_set_table new_val;
+			new_val.vals[0] = set->next_with_hash;
+			HASHTABLE_PUT(fetcher_set_table, set_table, set->hash, new_val, NULL);
+		} else {
+			HASHTABLE_REMOVE(fetcher_set_table, set_table, set->hash, NULL);
+		}
+	} else {
+		while (first->next_with_hash != set) {
+			first = first->next_with_hash;
+		}
+		first->next_with_hash = set->next_with_hash;
+	}
+
+	set->interned = false;
+	number_of_interned_sets--;
+	if (number_of_interned_sets == 0) {
+		HASHTABLE_DELETE(fetcher_set_table, set_table);
+	}
+}
+
+static struct fetcher_set *create_set(const struct set_change *change, uint64_t hash)
+{
+	unsigned int size = changed_size(change);
+	struct fetcher_set *set = cjet_malloc(sizeof(*set) + ((size - 1) * sizeof(set->entries[0])));
+	if (unlikely(set == NULL)) {
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&set->elements);
+	set->next_with_hash = NULL;
+	set->hash = hash;
+	set->references = 0;
+	set->number_of_entries = size;
+	set->interned = false;
+	for (unsigned int i = 0; i < size; i++) {
+		struct fetcher_set_entry *entry = &set->entries[i];
+		get_changed_entry(change, i, &entry->expression, &entry->value_matches);
+		entry->set = set;
+		list_add_tail(&entry->next_entry, &entry->expression->set_entries);
+	}
+
+	intern_set(set);
+	return set;
+}
+
+static void free_set(struct fetcher_set *set)
+{
+	unintern_set(set);
+	for (unsigned int i = 0; i < set->number_of_entries; i++) {
+		list_del(&set->entries[i].next_entry);
+	}
+	cjet_free(set);
+}
+
+void fetcher_set_hold(struct fetcher_set *set)
+{
+	set->references++;
+}
+
+void fetcher_set_release(struct fetcher_set *set)
+{
+	set->references--;
+	if (set->references == 0) {
+		free_set(set);
+	}
+}
+
+static void move_element(struct element *e, struct fetcher_set *set)
+{
+	struct fetcher_set *old_set = e->fetchers;
+	if (old_set != NULL) {
+		list_del(&e->next_in_fetcher_set);
+	}
+
+	e->fetchers = set;
+	if (set != NULL) {
+		list_add_tail(&e->next_in_fetcher_set, &set->elements);
+		fetcher_set_hold(set);
+	}
+
+	if (old_set != NULL) {
+		fetcher_set_release(old_set);
+	}
+}
+
+static struct fetcher_set *get_changed_set(const struct set_change *change)
+{
+	if (changed_size(change) == 0) {
+		return NULL;
+	}
+
+	uint64_t hash = hash_change(change);
+	struct fetcher_set *set = find_set(change, hash);
+	if (set != NULL) {
+		return set;
+	}
+	return create_set(change, hash);
+}
+
+static unsigned int find_insert_position(const struct fetcher_set *set, const struct fetch_expression *expr)
+{
+	unsigned int low = 0;
+	unsigned int high = (set == NULL) ? 0 : set->number_of_entries;
+	while (low < high) {
+		unsigned int middle = low + ((high - low) / 2);
+		if ((uintptr_t)set->entries[middle].expression < (uintptr_t)expr) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+/*
+ * The element must not be linked to the expression already.
+ */
+int fetcher_set_add_expression(struct element *e, struct fetch_expression *expr, bool value_matches)
+{
+	struct set_change change = {
+	    .base = e->fetchers,
+	    .type = ADD_ENTRY,
+	    .index = find_insert_position(e->fetchers, expr),
+	    .expression = expr,
+	    .value_matches = value_matches,
+	};
+
+	struct fetcher_set *set = get_changed_set(&change);
+	if (unlikely(set == NULL)) {
+		return -1;
+	}
+	move_element(e, set);
+	return 0;
+}
+
+int fetcher_set_update_value_matches(struct element *e, unsigned int index, bool value_matches)
+{
+	if (e->fetchers->entries[index].value_matches == value_matches) {
+		return 0;
+	}
+
+	struct set_change change = {
+	    .base = e->fetchers,
+	    .type = TOGGLE_ENTRY,
+	    .index = index,
+	    .expression = NULL,
+	    .value_matches = value_matches,
+	};
+
+	struct fetcher_set *set = get_changed_set(&change);
+	if (unlikely(set == NULL)) {
+		return -1;
+	}
+	move_element(e, set);
+	return 0;
+}
+
+bool fetcher_set_contains(const struct fetcher_set *set, const struct fetch_expression *expr)
+{
+	unsigned int index = find_insert_position(set, expr);
+	return (set != NULL) && (index < set->number_of_entries) && (set->entries[index].expression == expr);
+}
+
+/*
+ * All elements of the set move to the same smaller set. If that set
+ * doesn't exist yet, the set itself is shrunk instead, so removing an
+ * expression never needs memory. An expression is linked at most once
+ * to a set, so the neighbours of the moved entries in the set_entries
+ * lists are never part of the set.
+ */
+static void shrink_set(struct fetcher_set *set, unsigned int index, uint64_t hash)
+{
+	unintern_set(set);
+	list_del(&set->entries[index].next_entry);
+	for (unsigned int i = index + 1; i < set->number_of_entries; i++) {
+		struct fetcher_set_entry *entry = &set->entries[i - 1];
+		*entry = set->entries[i];
+		entry->next_entry.next->prev = &entry->next_entry;
+		entry->next_entry.prev->next = &entry->next_entry;
+	}
+	set->number_of_entries--;
+	set->hash = hash;
+	intern_set(set);
+}
+
+static void remove_entry(struct fetcher_set_entry *entry)
+{
+	struct fetcher_set *set = entry->set;
+	struct set_change change = {
+	    .base = set,
+	    .type = REMOVE_ENTRY,
+	    .index = (unsigned int)(entry - set->entries),
+	    .expression = NULL,
+	    .value_matches = false,
+	};
+
+	struct fetcher_set *smaller_set = NULL;
+	if (changed_size(&change) > 0) {
+		uint64_t hash = hash_change(&change);
+		smaller_set = find_set(&change, hash);
+		if (smaller_set == NULL) {
+			shrink_set(set, change.index, hash);
+			return;
+		}
+	}
+
+	fetcher_set_hold(set);
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &set->elements) {
+		struct element *e = list_entry(item, struct element, next_in_fetcher_set);
+		move_element(e, smaller_set);
+	}
+	fetcher_set_release(set);
+}
+
+void fetcher_set_remove_expression(struct fetch_expression *expr)
+{
+	struct list_head *item;
+	struct list_head *tmp;
+	list_for_each_safe (item, tmp, &expr->set_entries) {
+		struct fetcher_set_entry *entry = list_entry(item, struct fetcher_set_entry, next_entry);
+		remove_entry(entry);
+	}
+}
+
+void fetcher_set_remove_element(struct element *e)
+{
+	move_element(e, NULL);
+}
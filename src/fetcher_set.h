@@ -0,0 +1,83 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_FETCHER_SET_H
+#define CJET_FETCHER_SET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct element;
+struct fetch_expression;
+
+struct fetcher_set_entry {
+	struct list_head next_entry; /* Entry in the set_entries list of the expression */
+	struct fetcher_set *set;
+	struct fetch_expression *expression;
+	bool value_matches; /* The value matcher of the expression accepts the values of the elements */
+};
+
+/*
+ * The fetch expressions attached to an element. All elements with the
+ * same expressions and value matches share one interned set, so a set
+ * is never changed while elements use it. Attaching an expression to an
+ * element moves the element to another set instead. The entries are
+ * sorted by the address of the expression.
+ */
+struct fetcher_set {
+	struct list_head elements; /* All elements using this set */
+	struct fetcher_set *next_with_hash; /* Other interned sets with the same hash */
+	uint64_t hash;
+	unsigned int references; /* The elements using the set plus temporary holds */
+	unsigned int number_of_entries;
+	bool interned;
+	struct fetcher_set_entry entries[1];
+};
+
+int fetcher_set_add_expression(struct element *e, struct fetch_expression *expr, bool value_matches);
+int fetcher_set_update_value_matches(struct element *e, unsigned int index, bool value_matches);
+bool fetcher_set_contains(const struct fetcher_set *set, const struct fetch_expression *expr);
+void fetcher_set_remove_expression(struct fetch_expression *expr);
+void fetcher_set_remove_element(struct element *e);
+
+/*
+ * Keeps a set alive while the fetchers of an element are notified,
+ * even if the element moves to another set in the meantime.
+ */
+void fetcher_set_hold(struct fetcher_set *set);
+void fetcher_set_release(struct fetcher_set *set);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
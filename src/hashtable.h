@@ -33,6 +33,13 @@
  * tries to reorder hash table entries that each entry is in the maximum
  * distance the bitmap can contain. (hop_range in this implementation).
  *
+ * The table grows without a stop-the-world rehash. When it is filled
+ * to 3/4 (or an insertion fails), a table of twice the size is
+ * allocated. Each following insertion of a new key moves
+ * HASHTABLE_MIGRATE_BUCKETS buckets of the old generation into the new
+ * one, gets and removes consult both generations until the old one is
+ * empty and freed.
+ *
  * This implementation is lock free but only ensure the following
  * condition. Every HASHTABLE_REMOVE or HASHTABLE_PUT call can be
  * interrupted at any time by a call to HASHTABLE_GET. Because
@@ -41,11 +48,13 @@
  *
  * Please be aware that concurrent calls to HASHTABLE_REMOVE or
  * HASHTABLE_PUT are not allowed and must be synchronized elsewhere.
+ * While the table grows, HASHTABLE_PUT also moves entries between the
+ * generations, so HASHTABLE_GET must not run concurrently to it.
  *
  * Please use only the macros DECLARE_HASHTABLE_STRING,
  * DECLARE_HASHTABLE_UINT32, DECLARE_HASHTABLE_UINT64,
  * HASHTABLE_CREATE, HASHTABLE_DELETE, HASHTABLE_GET,
- * HASHTABLE_REMOVE and HASHTABLE_PUT.
+ * HASHTABLE_REMOVE, HASHTABLE_PUT and HASHTABLE_VISIT.
  * Do not call the other functions directly.
  *
  * Please note that HASHTABLE_CREATE shall only called from Linux
@@ -78,11 +87,18 @@
 #define HASHTABLE_KEYINVAL -2
 #define HASHTABLE_INVALIDENTRY -1
 
+/*
+ * Number of buckets of the previous generation moved into the grown
+ * table with each insertion of a new key.
+ */
+#define HASHTABLE_MIGRATE_BUCKETS 8
+#define HASHTABLE_MAX_ORDER 30
+
 static const uint32_t hash32_magic = 2654435769U;
 static const uint64_t hash64_magic = 0xd43ece626aa9260aULL;
 
 /*
- * Declares a hash table of name "name" and size 2^order. This macro is
+ * Declares a hash table of name "name" and initial size 2^order. This macro is
  * just for internal use. Do not use it to declare a hash table, use
  * DECLARE_HASHTABLE_STRING, DECLARE_HASHTABLE_UINT32 or
  * DECLARE_HASHTABLE_UINT64 instead.
@@ -97,79 +113,120 @@ static const uint64_t hash64_magic = 0xd43ece626aa9260aULL;
  */
 #define DECLARE_HASHTABLE(name, order, type_name, type, value_entries)                                                                                                            \
                                                                                                                                                                                   \
-	static const uint32_t add_range_##name = (1 << (order - 1));                                                                                                              \
-	static const uint32_t table_size_##name = (1 << (order));                                                                                                                 \
+	struct hashtable_##name {                                                                                                                                                 \
+		struct hashtable_##type_name *entries;                                                                                                                            \
+		struct hashtable_##type_name *old_entries; /* Generation that is migrated into entries, NULL if not growing */                                                    \
+		uint32_t entries_order;                                                                                                                                           \
+		uint32_t old_entries_order;                                                                                                                                       \
+		uint32_t migrate_position; /* All buckets of old_entries below this position are migrated */                                                                      \
+		uint32_t number_of_entries;                                                                                                                                       \
+	};                                                                                                                                                                        \
                                                                                                                                                                                   \
-	static inline uint32_t wrap_pos##name(uint32_t pos)                                                                                                                       \
+	static inline uint32_t wrap_pos##name(uint32_t pos, uint32_t table_order)                                                                                                 \
 	{                                                                                                                                                                         \
-		return pos & (table_size_##name - 1);                                                                                                                             \
+		return pos & ((1U << table_order) - 1);                                                                                                                           \
 	}                                                                                                                                                                         \
                                                                                                                                                                                   \
-	static inline struct hashtable_##type_name *hashtable_create_##name(void)                                                                                                 \
+	static inline struct hashtable_##type_name *hashtable_alloc_entries_##name(uint32_t table_order)                                                                          \
 	{                                                                                                                                                                         \
-		struct hashtable_##type_name *table = (struct hashtable_##type_name *)kmalloc(table_size_##name * sizeof(struct hashtable_##type_name), GFP_KERNEL);              \
-		if (table != NULL) {                                                                                                                                              \
+		uint32_t table_size = 1U << table_order;                                                                                                                          \
+		struct hashtable_##type_name *entries = (struct hashtable_##type_name *)kmalloc(table_size * sizeof(struct hashtable_##type_name), GFP_KERNEL);                   \
+		if (entries != NULL) {                                                                                                                                            \
 			size_t i;                                                                                                                                                 \
-			for (i = 0; i < table_size_##name; ++i) {                                                                                                                 \
-				memset(&table[i], 0, sizeof(table[0]));                                                                                                           \
-				table[i].key = (type)HASHTABLE_INVALIDENTRY;                                                                                                      \
+			for (i = 0; i < table_size; ++i) {                                                                                                                        \
+				memset(&entries[i], 0, sizeof(entries[0]));                                                                                                       \
+				entries[i].key = (type)HASHTABLE_INVALIDENTRY;                                                                                                    \
 			}                                                                                                                                                         \
 		}                                                                                                                                                                 \
+		return entries;                                                                                                                                                   \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline struct hashtable_##name *hashtable_create_##name(void)                                                                                                      \
+	{                                                                                                                                                                         \
+		struct hashtable_##name *table = (struct hashtable_##name *)kmalloc(sizeof(*table), GFP_KERNEL);                                                                  \
+		if (table == NULL) {                                                                                                                                              \
+			return NULL;                                                                                                                                              \
+		}                                                                                                                                                                 \
+		table->entries = hashtable_alloc_entries_##name(order);                                                                                                           \
+		if (table->entries == NULL) {                                                                                                                                     \
+			kfree(table);                                                                                                                                             \
+			return NULL;                                                                                                                                              \
+		}                                                                                                                                                                 \
+		table->old_entries = NULL;                                                                                                                                        \
+		table->entries_order = order;                                                                                                                                     \
+		table->old_entries_order = 0;                                                                                                                                     \
+		table->migrate_position = 0;                                                                                                                                      \
+		table->number_of_entries = 0;                                                                                                                                     \
 		return table;                                                                                                                                                     \
 	}                                                                                                                                                                         \
                                                                                                                                                                                   \
-	static inline void hashtable_delete_##name(struct hashtable_##type_name *table)                                                                                           \
+	static inline void hashtable_delete_##name(struct hashtable_##name *table)                                                                                                \
 	{                                                                                                                                                                         \
+		if (table->old_entries != NULL) {                                                                                                                                 \
+			kfree(table->old_entries);                                                                                                                                \
+		}                                                                                                                                                                 \
+		kfree(table->entries);                                                                                                                                            \
 		kfree(table);                                                                                                                                                     \
 		return;                                                                                                                                                           \
 	}                                                                                                                                                                         \
                                                                                                                                                                                   \
-	_Pragma("GCC diagnostic ignored \"-Wunused-function\"") static inline int hashtable_get_##name(struct hashtable_##type_name *table, type key, struct value_##name *value) \
+	_Pragma("GCC diagnostic ignored \"-Wunused-function\"") static inline int hashtable_get_entries_##name(const struct hashtable_##type_name *entries, uint32_t table_order, type key, struct value_##name *value) \
 	{                                                                                                                                                                         \
-		uint32_t hash_pos = hash_func_##name##_##type_name(key);                                                                                                          \
+		uint32_t hash_pos = hash_func_##name##_##type_name(key, table_order);                                                                                             \
 		uint32_t pos = hash_pos;                                                                                                                                          \
-		uint32_t hop_info = table[hash_pos].hop_info;                                                                                                                     \
+		uint32_t hop_info = entries[hash_pos].hop_info;                                                                                                                   \
 		while (hop_info != 0) {                                                                                                                                           \
-			if (((hop_info & 0x1) == 1) && (is_equal_##type_name(table[pos].key, key))) {                                                                             \
-				*value = table[pos].value;                                                                                                                        \
+			if (((hop_info & 0x1) == 1) && (is_equal_##type_name(entries[pos].key, key))) {                                                                           \
+				*value = entries[pos].value;                                                                                                                      \
 				return HASHTABLE_SUCCESS;                                                                                                                         \
 			}                                                                                                                                                         \
 			hop_info = hop_info >> 1;                                                                                                                                 \
-			pos = wrap_pos##name(pos + 1);                                                                                                                            \
+			pos = wrap_pos##name(pos + 1, table_order);                                                                                                               \
+		}                                                                                                                                                                 \
+		return HASHTABLE_INVALIDENTRY;                                                                                                                                    \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_get_##name(const struct hashtable_##name *table, type key, struct value_##name *value)                                                        \
+	{                                                                                                                                                                         \
+		if (hashtable_get_entries_##name(table->entries, table->entries_order, key, value) == HASHTABLE_SUCCESS) {                                                        \
+			return HASHTABLE_SUCCESS;                                                                                                                                 \
+		}                                                                                                                                                                 \
+		if (table->old_entries != NULL) {                                                                                                                                 \
+			return hashtable_get_entries_##name(table->old_entries, table->old_entries_order, key, value);                                                            \
 		}                                                                                                                                                                 \
 		return HASHTABLE_INVALIDENTRY;                                                                                                                                    \
 	}                                                                                                                                                                         \
 	_Pragma("GCC diagnostic error \"-Wunused-function\"")                                                                                                                     \
                                                                                                                                                                                   \
-	    static inline uint32_t hop_range_##name(void)                                                                                                                         \
+	static inline uint32_t hop_range_##name(void)                                                                                                                             \
 	{                                                                                                                                                                         \
 		return sizeof(((struct hashtable_##type_name *)0)->hop_info) * 8;                                                                                                 \
 	}                                                                                                                                                                         \
                                                                                                                                                                                   \
-	static inline uint32_t find_closer_entry_##name(struct hashtable_##type_name *table, uint32_t free_position)                                                              \
+	static inline uint32_t find_closer_entry_##name(struct hashtable_##type_name *entries, uint32_t table_order, uint32_t free_position)                                      \
 	{                                                                                                                                                                         \
 		uint32_t check_distance = (hop_range_##name() - 1);                                                                                                               \
 		while (check_distance > 0) {                                                                                                                                      \
 			unsigned int i;                                                                                                                                           \
-			uint32_t check_position = wrap_pos##name(free_position - check_distance);                                                                                 \
-			uint32_t check_hop_info = table[check_position].hop_info;                                                                                                 \
+			uint32_t check_position = wrap_pos##name(free_position - check_distance, table_order);                                                                    \
+			uint32_t check_hop_info = entries[check_position].hop_info;                                                                                               \
 			uint32_t mask = 1;                                                                                                                                        \
 			uint32_t hop_position = 0xffffffff;                                                                                                                       \
 			for (i = 0; i < check_distance; ++i) {                                                                                                                    \
 				if ((mask & check_hop_info) != 0) {                                                                                                               \
-					hop_position = wrap_pos##name(check_position + i);                                                                                        \
+					hop_position = wrap_pos##name(check_position + i, table_order);                                                                           \
 					break;                                                                                                                                    \
 				}                                                                                                                                                 \
 				mask = mask << 1;                                                                                                                                 \
 			}                                                                                                                                                         \
 			if (hop_position != 0xffffffff) {                                                                                                                         \
 				/* We found a table entry to swap the free entry with. */                                                                                         \
-				table[free_position].key = table[hop_position].key;                                                                                               \
-				table[free_position].value = table[hop_position].value;                                                                                           \
+				entries[free_position].key = entries[hop_position].key;                                                                                           \
+				entries[free_position].value = entries[hop_position].value;                                                                                       \
 				wmb();                                                                                                                                            \
 				check_hop_info = check_hop_info & ~(mask);                                                                                                        \
 				check_hop_info = check_hop_info | (1 << check_distance);                                                                                          \
-				table[check_position].hop_info = check_hop_info;                                                                                                  \
+				entries[check_position].hop_info = check_hop_info;                                                                                                \
 				return hop_position;                                                                                                                              \
 			}                                                                                                                                                         \
 			--check_distance;                                                                                                                                         \
@@ -177,161 +234,260 @@ static const uint64_t hash64_magic = 0xd43ece626aa9260aULL;
 		return 0xffffffff;                                                                                                                                                \
 	}                                                                                                                                                                         \
                                                                                                                                                                                   \
-	static inline int hashtable_put_##name(struct hashtable_##type_name *table, type key, struct value_##name value, struct value_##name *prev_value)                         \
+	static inline int hashtable_update_entries_##name(struct hashtable_##type_name *entries, uint32_t table_order, type key, struct value_##name value, struct value_##name *prev_value) \
 	{                                                                                                                                                                         \
-		uint32_t hash_pos;                                                                                                                                                \
-		uint32_t pos;                                                                                                                                                     \
-		uint32_t hop_info;                                                                                                                                                \
-		uint32_t free_distance;                                                                                                                                           \
-		uint32_t free_pos;                                                                                                                                                \
-		if (prev_value != NULL) {                                                                                                                                         \
-			memset(prev_value, 0, sizeof(*prev_value));                                                                                                               \
-		}                                                                                                                                                                 \
-		if (key == (type)HASHTABLE_INVALIDENTRY) {                                                                                                                        \
-			return HASHTABLE_KEYINVAL;                                                                                                                                \
-		}                                                                                                                                                                 \
-                                                                                                                                                                                  \
-		/* Look if the key is already in the table. */                                                                                                                    \
-		hash_pos = hash_func_##name##_##type_name(key);                                                                                                                   \
-		pos = hash_pos;                                                                                                                                                   \
-		hop_info = table[hash_pos].hop_info;                                                                                                                              \
+		uint32_t hash_pos = hash_func_##name##_##type_name(key, table_order);                                                                                             \
+		uint32_t pos = hash_pos;                                                                                                                                          \
+		uint32_t hop_info = entries[hash_pos].hop_info;                                                                                                                   \
 		while (hop_info != 0) {                                                                                                                                           \
-			if (((hop_info & 0x1) == 1) && (is_equal_##type_name(table[pos].key, key))) {                                                                             \
+			if (((hop_info & 0x1) == 1) && (is_equal_##type_name(entries[pos].key, key))) {                                                                           \
 				if (prev_value != NULL) {                                                                                                                         \
-					*prev_value = table[pos].value;                                                                                                           \
+					*prev_value = entries[pos].value;                                                                                                         \
 				}                                                                                                                                                 \
-				table[pos].value = value;                                                                                                                         \
+				entries[pos].value = value;                                                                                                                       \
 				return HASHTABLE_SUCCESS;                                                                                                                         \
 			}                                                                                                                                                         \
 			hop_info = hop_info >> 1;                                                                                                                                 \
-			pos = wrap_pos##name(pos + 1);                                                                                                                            \
+			pos = wrap_pos##name(pos + 1, table_order);                                                                                                               \
 		}                                                                                                                                                                 \
+		return HASHTABLE_INVALIDENTRY;                                                                                                                                    \
+	}                                                                                                                                                                         \
                                                                                                                                                                                   \
-		/* The key wasn't found, so let's insert. */                                                                                                                      \
-		/* Make linear search from hash_pos to add_range_##name to find an empty table entry. */                                                                          \
-		free_distance = 0;                                                                                                                                                \
-		pos = hash_pos;                                                                                                                                                   \
-		while (free_distance < add_range_##name) {                                                                                                                        \
-			if (table[pos].key == (type)HASHTABLE_INVALIDENTRY) {                                                                                                     \
+	static inline int hashtable_insert_entries_##name(struct hashtable_##type_name *entries, uint32_t table_order, type key, struct value_##name value)                       \
+	{                                                                                                                                                                         \
+		uint32_t add_range = 1U << (table_order - 1);                                                                                                                     \
+		uint32_t hash_pos = hash_func_##name##_##type_name(key, table_order);                                                                                             \
+		uint32_t hop_info;                                                                                                                                                \
+		uint32_t free_pos;                                                                                                                                                \
+		/* Make linear search from hash_pos to add_range to find an empty table entry. */                                                                                 \
+		uint32_t free_distance = 0;                                                                                                                                       \
+		uint32_t pos = hash_pos;                                                                                                                                          \
+		while (free_distance < add_range) {                                                                                                                               \
+			if (entries[pos].key == (type)HASHTABLE_INVALIDENTRY) {                                                                                                   \
 				break;                                                                                                                                            \
 			}                                                                                                                                                         \
 			++free_distance;                                                                                                                                          \
-			pos = wrap_pos##name(pos + 1);                                                                                                                            \
+			pos = wrap_pos##name(pos + 1, table_order);                                                                                                               \
 		}                                                                                                                                                                 \
 		free_pos = pos;                                                                                                                                                   \
-		if (free_distance < add_range_##name) {                                                                                                                           \
+		if (free_distance < add_range) {                                                                                                                                  \
 			do {                                                                                                                                                      \
 				if (free_distance < hop_range_##name()) {                                                                                                         \
-					table[free_pos].value = value;                                                                                                            \
-					table[free_pos].key = key;                                                                                                                \
+					entries[free_pos].value = value;                                                                                                          \
+					entries[free_pos].key = key;                                                                                                              \
 					wmb();                                                                                                                                    \
-					hop_info = table[hash_pos].hop_info;                                                                                                      \
+					hop_info = entries[hash_pos].hop_info;                                                                                                    \
 					hop_info = hop_info | (1 << free_distance);                                                                                               \
-					table[hash_pos].hop_info = hop_info;                                                                                                      \
+					entries[hash_pos].hop_info = hop_info;                                                                                                    \
 					return HASHTABLE_SUCCESS;                                                                                                                 \
 				} else {                                                                                                                                          \
 					/* Now we must try to swap some entries */                                                                                                \
-					free_pos = find_closer_entry_##name(table, free_pos);                                                                                     \
-					free_distance = wrap_pos##name(free_pos - hash_pos);                                                                                      \
+					free_pos = find_closer_entry_##name(entries, table_order, free_pos);                                                                      \
+					free_distance = wrap_pos##name(free_pos - hash_pos, table_order);                                                                         \
 				}                                                                                                                                                 \
 			} while (free_pos != 0xffffffff);                                                                                                                         \
 		}                                                                                                                                                                 \
 		return HASHTABLE_FULL;                                                                                                                                            \
 	}                                                                                                                                                                         \
                                                                                                                                                                                   \
-	static inline int hashtable_remove_##name(struct hashtable_##type_name *table, type key, struct value_##name *value)                                                      \
+	static inline int hashtable_remove_entries_##name(struct hashtable_##type_name *entries, uint32_t table_order, type key, struct value_##name *value)                      \
 	{                                                                                                                                                                         \
-		uint32_t hash_pos = hash_func_##name##_##type_name(key);                                                                                                          \
+		uint32_t hash_pos = hash_func_##name##_##type_name(key, table_order);                                                                                             \
 		uint32_t pos = hash_pos;                                                                                                                                          \
-		uint32_t hop_info = table[hash_pos].hop_info;                                                                                                                     \
+		uint32_t hop_info = entries[hash_pos].hop_info;                                                                                                                   \
 		uint32_t check_hop_info = hop_info;                                                                                                                               \
 		while (check_hop_info != 0) {                                                                                                                                     \
-			if (((check_hop_info & 0x1) == 1) && (is_equal_##type_name(table[pos].key, key))) {                                                                       \
+			if (((check_hop_info & 0x1) == 1) && (is_equal_##type_name(entries[pos].key, key))) {                                                                     \
 				uint32_t distance;                                                                                                                                \
 				if (value != NULL) {                                                                                                                              \
-					*value = table[pos].value;                                                                                                                \
+					*value = entries[pos].value;                                                                                                              \
 				}                                                                                                                                                 \
-				table[pos].key = (type)HASHTABLE_INVALIDENTRY;                                                                                                    \
+				entries[pos].key = (type)HASHTABLE_INVALIDENTRY;                                                                                                  \
 				wmb();                                                                                                                                            \
-				memset(&table[pos].value, 0, sizeof(table[pos].value));                                                                                           \
-				distance = wrap_pos##name(pos - hash_pos);                                                                                                        \
-				table[hash_pos].hop_info = hop_info & ~(1 << distance);                                                                                           \
+				memset(&entries[pos].value, 0, sizeof(entries[pos].value));                                                                                       \
+				distance = wrap_pos##name(pos - hash_pos, table_order);                                                                                           \
+				entries[hash_pos].hop_info = hop_info & ~(1 << distance);                                                                                         \
 				return HASHTABLE_SUCCESS;                                                                                                                         \
 			}                                                                                                                                                         \
 			check_hop_info = check_hop_info >> 1;                                                                                                                     \
-			pos = wrap_pos##name(pos + 1);                                                                                                                            \
+			pos = wrap_pos##name(pos + 1, table_order);                                                                                                               \
 		}                                                                                                                                                                 \
 		return HASHTABLE_INVALIDENTRY;                                                                                                                                    \
-	}
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_start_growth_##name(struct hashtable_##name *table)                                                                                           \
+	{                                                                                                                                                                         \
+		if (table->entries_order >= HASHTABLE_MAX_ORDER) {                                                                                                                \
+			return HASHTABLE_FULL;                                                                                                                                    \
+		}                                                                                                                                                                 \
+		struct hashtable_##type_name *entries = hashtable_alloc_entries_##name(table->entries_order + 1);                                                                 \
+		if (entries == NULL) {                                                                                                                                            \
+			return HASHTABLE_FULL;                                                                                                                                    \
+		}                                                                                                                                                                 \
+		table->old_entries = table->entries;                                                                                                                              \
+		table->old_entries_order = table->entries_order;                                                                                                                  \
+		table->entries = entries;                                                                                                                                         \
+		table->entries_order++;                                                                                                                                           \
+		table->migrate_position = 0;                                                                                                                                      \
+		return HASHTABLE_SUCCESS;                                                                                                                                         \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_migrate_##name(struct hashtable_##name *table, uint32_t buckets)                                                                              \
+	{                                                                                                                                                                         \
+		uint32_t old_table_size = 1U << table->old_entries_order;                                                                                                         \
+		while ((buckets > 0) && (table->migrate_position < old_table_size)) {                                                                                             \
+			const struct hashtable_##type_name *entry = &table->old_entries[table->migrate_position];                                                                 \
+			if (entry->key != (type)HASHTABLE_INVALIDENTRY) {                                                                                                         \
+				type key = entry->key;                                                                                                                            \
+				struct value_##name value = entry->value;                                                                                                         \
+				if (hashtable_insert_entries_##name(table->entries, table->entries_order, key, value) != HASHTABLE_SUCCESS) {                                     \
+					return HASHTABLE_FULL;                                                                                                                    \
+				}                                                                                                                                                 \
+				hashtable_remove_entries_##name(table->old_entries, table->old_entries_order, key, NULL);                                                         \
+			}                                                                                                                                                         \
+			table->migrate_position++;                                                                                                                                \
+			buckets--;                                                                                                                                                \
+		}                                                                                                                                                                 \
+		if (table->migrate_position == old_table_size) {                                                                                                                  \
+			kfree(table->old_entries);                                                                                                                                \
+			table->old_entries = NULL;                                                                                                                                \
+		}                                                                                                                                                                 \
+		return HASHTABLE_SUCCESS;                                                                                                                                         \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_put_##name(struct hashtable_##name *table, type key, struct value_##name value, struct value_##name *prev_value)                              \
+	{                                                                                                                                                                         \
+		int ret;                                                                                                                                                          \
+		if (prev_value != NULL) {                                                                                                                                         \
+			memset(prev_value, 0, sizeof(*prev_value));                                                                                                               \
+		}                                                                                                                                                                 \
+		if (key == (type)HASHTABLE_INVALIDENTRY) {                                                                                                                        \
+			return HASHTABLE_KEYINVAL;                                                                                                                                \
+		}                                                                                                                                                                 \
+                                                                                                                                                                                  \
+		/* Look if the key is already in the table. */                                                                                                                    \
+		if (hashtable_update_entries_##name(table->entries, table->entries_order, key, value, prev_value) == HASHTABLE_SUCCESS) {                                         \
+			return HASHTABLE_SUCCESS;                                                                                                                                 \
+		}                                                                                                                                                                 \
+		if ((table->old_entries != NULL) && (hashtable_update_entries_##name(table->old_entries, table->old_entries_order, key, value, prev_value) == HASHTABLE_SUCCESS)) { \
+			return HASHTABLE_SUCCESS;                                                                                                                                 \
+		}                                                                                                                                                                 \
+                                                                                                                                                                                  \
+		/* The key wasn't found, so let's insert. */                                                                                                                      \
+		if (table->old_entries != NULL) {                                                                                                                                 \
+			if (hashtable_migrate_##name(table, HASHTABLE_MIGRATE_BUCKETS) != HASHTABLE_SUCCESS) {                                                                    \
+				return HASHTABLE_FULL;                                                                                                                            \
+			}                                                                                                                                                         \
+		} else if (table->number_of_entries >= (((1U << table->entries_order) / 4) * 3)) {                                                                                \
+			hashtable_start_growth_##name(table);                                                                                                                     \
+		}                                                                                                                                                                 \
+		ret = hashtable_insert_entries_##name(table->entries, table->entries_order, key, value);                                                                          \
+		if ((ret == HASHTABLE_FULL) && (table->old_entries == NULL) && (hashtable_start_growth_##name(table) == HASHTABLE_SUCCESS)) {                                     \
+			ret = hashtable_insert_entries_##name(table->entries, table->entries_order, key, value);                                                                  \
+		}                                                                                                                                                                 \
+		if (ret == HASHTABLE_SUCCESS) {                                                                                                                                   \
+			table->number_of_entries++;                                                                                                                               \
+		}                                                                                                                                                                 \
+		return ret;                                                                                                                                                       \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_remove_##name(struct hashtable_##name *table, type key, struct value_##name *value)                                                           \
+	{                                                                                                                                                                         \
+		if ((hashtable_remove_entries_##name(table->entries, table->entries_order, key, value) == HASHTABLE_SUCCESS) ||                                                   \
+		    ((table->old_entries != NULL) && (hashtable_remove_entries_##name(table->old_entries, table->old_entries_order, key, value) == HASHTABLE_SUCCESS))) {         \
+			table->number_of_entries--;                                                                                                                               \
+			return HASHTABLE_SUCCESS;                                                                                                                                 \
+		}                                                                                                                                                                 \
+		return HASHTABLE_INVALIDENTRY;                                                                                                                                    \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	_Pragma("GCC diagnostic ignored \"-Wunused-function\"") static inline void hashtable_visit_entries_##name(const struct hashtable_##type_name *entries, uint32_t table_order, void (*visit)(type key, void *context), void *context) \
+	{                                                                                                                                                                         \
+		uint32_t i;                                                                                                                                                       \
+		for (i = 0; i < (1U << table_order); ++i) {                                                                                                                       \
+			if (entries[i].key != (type)HASHTABLE_INVALIDENTRY) {                                                                                                     \
+				visit(entries[i].key, context);                                                                                                                   \
+			}                                                                                                                                                         \
+		}                                                                                                                                                                 \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline void hashtable_visit_##name(const struct hashtable_##name *table, void (*visit)(type key, void *context), void *context)                                    \
+	{                                                                                                                                                                         \
+		hashtable_visit_entries_##name(table->entries, table->entries_order, visit, context);                                                                             \
+		if (table->old_entries != NULL) {                                                                                                                                 \
+			hashtable_visit_entries_##name(table->old_entries, table->old_entries_order, visit, context);                                                             \
+		}                                                                                                                                                                 \
+	}                                                                                                                                                                         \
+	_Pragma("GCC diagnostic error \"-Wunused-function\"")
 
-#define DECLARE_HASHTABLE_STRING(name, order, value_entries)                \
-	struct value_##name {                                               \
-		void *vals[value_entries];                                  \
-	};                                                                  \
-	struct hashtable_string {                                           \
-		uint32_t hop_info;                                          \
-		const char *key;                                            \
-		struct value_##name value;                                  \
-	};                                                                  \
-	static inline uint32_t hash_func_##name##_string(const char *key)   \
-	{                                                                   \
-		uint32_t hash = 0;                                          \
-		uint32_t c = *key;                                          \
-		++key;                                                      \
-		while (c != 0) {                                            \
-			hash = ((c + (hash << 6U)) + (hash << 16U)) - hash; \
-			c = *key;                                           \
-			++key;                                              \
-		}                                                           \
-		hash = (hash * (hash32_magic)) >> (32U - (order));          \
-		return hash;                                                \
-	}                                                                   \
-	static inline int is_equal_string(const char *s1, const char *s2)   \
-	{                                                                   \
-		return !strcmp(s1, s2);                                     \
-	}                                                                   \
+#define DECLARE_HASHTABLE_STRING(name, order, value_entries)                                    \
+	struct value_##name {                                                                   \
+		void *vals[value_entries];                                                      \
+	};                                                                                      \
+	struct hashtable_string {                                                               \
+		uint32_t hop_info;                                                              \
+		const char *key;                                                                \
+		struct value_##name value;                                                      \
+	};                                                                                      \
+	static inline uint32_t hash_func_##name##_string(const char *key, uint32_t table_order) \
+	{                                                                                       \
+		uint32_t hash = 0;                                                              \
+		uint32_t c = *key;                                                              \
+		++key;                                                                          \
+		while (c != 0) {                                                                \
+			hash = ((c + (hash << 6U)) + (hash << 16U)) - hash;                     \
+			c = *key;                                                               \
+			++key;                                                                  \
+		}                                                                               \
+		hash = (hash * (hash32_magic)) >> (32U - table_order);                          \
+		return hash;                                                                    \
+	}                                                                                       \
+	static inline int is_equal_string(const char *s1, const char *s2)                       \
+	{                                                                                       \
+		return !strcmp(s1, s2);                                                         \
+	}                                                                                       \
 	DECLARE_HASHTABLE(name, order, string, const char *, value_entries)
 
-#define DECLARE_HASHTABLE_UINT32(name, order, value_entries)             \
-	struct value_##name {                                            \
-		void *vals[value_entries];                               \
-	};                                                               \
-	struct hashtable_uint32_t {                                      \
-		uint32_t hop_info;                                       \
-		uint32_t key;                                            \
-		struct value_##name value;                               \
-	};                                                               \
-	static inline uint32_t hash_func_##name##_uint32_t(uint32_t key) \
-	{                                                                \
-		return ((key * (hash32_magic)) >> (32U - (order)));      \
-	}                                                                \
-                                                                         \
-	static inline int is_equal_uint32_t(uint32_t a, uint32_t b)      \
-	{                                                                \
-		return a == b;                                           \
-	}                                                                \
-                                                                         \
+#define DECLARE_HASHTABLE_UINT32(name, order, value_entries)                                   \
+	struct value_##name {                                                                  \
+		void *vals[value_entries];                                                     \
+	};                                                                                     \
+	struct hashtable_uint32_t {                                                            \
+		uint32_t hop_info;                                                             \
+		uint32_t key;                                                                  \
+		struct value_##name value;                                                     \
+	};                                                                                     \
+	static inline uint32_t hash_func_##name##_uint32_t(uint32_t key, uint32_t table_order) \
+	{                                                                                      \
+		return ((key * (hash32_magic)) >> (32U - table_order));                        \
+	}                                                                                      \
+                                                                                               \
+	static inline int is_equal_uint32_t(uint32_t a, uint32_t b)                            \
+	{                                                                                      \
+		return a == b;                                                                 \
+	}                                                                                      \
+                                                                                               \
 	DECLARE_HASHTABLE(name, order, uint32_t, uint32_t, value_entries)
 
-#define DECLARE_HASHTABLE_UINT64(name, order, value_entries)                 \
-	struct value_##name {                                                \
-		void *vals[value_entries];                                   \
-	};                                                                   \
-	struct hashtable_uint64_t {                                          \
-		uint32_t hop_info;                                           \
-		uint64_t key;                                                \
-		struct value_##name value;                                   \
-	};                                                                   \
-	static inline uint32_t hash_func_##name##_uint64_t(uint64_t key)     \
-	{                                                                    \
-		return (uint32_t)((key * (hash64_magic)) >> (64 - (order))); \
-	}                                                                    \
-                                                                             \
-	static inline int is_equal_uint64_t(uint64_t a, uint64_t b)          \
-	{                                                                    \
-		return a == b;                                               \
-	}                                                                    \
-                                                                             \
+#define DECLARE_HASHTABLE_UINT64(name, order, value_entries)                                   \
+	struct value_##name {                                                                  \
+		void *vals[value_entries];                                                     \
+	};                                                                                     \
+	struct hashtable_uint64_t {                                                            \
+		uint32_t hop_info;                                                             \
+		uint64_t key;                                                                  \
+		struct value_##name value;                                                     \
+	};                                                                                     \
+	static inline uint32_t hash_func_##name##_uint64_t(uint64_t key, uint32_t table_order) \
+	{                                                                                      \
+		return (uint32_t)((key * (hash64_magic)) >> (64 - table_order));               \
+	}                                                                                      \
+                                                                                               \
+	static inline int is_equal_uint64_t(uint64_t a, uint64_t b)                            \
+	{                                                                                      \
+		return a == b;                                                                 \
+	}                                                                                      \
+                                                                                               \
 	DECLARE_HASHTABLE(name, order, uint64_t, uint64_t, value_entries)
 
 /*
@@ -349,7 +505,7 @@ static const uint64_t hash64_magic = 0xd43ece626aa9260aULL;
 
 /*
  * Maps the key to the value in table. Return values:
- * HASHTABLE_FULL: no space left in hash_table
+ * HASHTABLE_FULL: no space left in hash_table and growing failed
  * HASHTABLE_KEYINVAL: invalid key (HASHTABLE_INVALIDENTRY)
  * HASHTABLE_SUCCESS: everything o.k.
  *
@@ -373,4 +529,11 @@ static const uint64_t hash64_magic = 0xd43ece626aa9260aULL;
 #define HASHTABLE_REMOVE(name, table, key, value) \
 	hashtable_remove_##name((table), (key), (value))
 
+/*
+ * Calls visit(key, context) for each key in table. visit might remove
+ * the visited key, but must not put keys into table.
+ */
+#define HASHTABLE_VISIT(name, table, visit, context) \
+	hashtable_visit_##name((table), (visit), (context))
+
 #endif
@@ -71,6 +71,12 @@ static cJSON *create_info(void)
 	}
 	cJSON_AddItemToObject(features, "batches", batches);
 
+	cJSON *element_batches = cJSON_CreateTrue();
+	if (unlikely(element_batches == NULL)) {
+		goto error;
+	}
+	cJSON_AddItemToObject(features, "elementBatches", element_batches);
+
 	cJSON *authentication = cJSON_CreateTrue();
 	if (unlikely(authentication == NULL)) {
 		goto error;
@@ -0,0 +1,821 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "generated/cjet_config.h"
+#include "jet_regex.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#define NUMBER_OF_BYTES 256
+#define MAX_GROUP_DEPTH 64
+
+#define DEAD_STATE 0
+#define START_STATE 1
+
+#define STATE_ACCEPTING 0x01
+#define STATE_ALWAYS_ACCEPTING 0x02
+
+struct byte_set {
+	uint32_t bits[NUMBER_OF_BYTES / 32];
+};
+
+enum nfa_state_type {
+	NFA_EPSILON,
+	NFA_BYTE_SET,
+};
+
+struct nfa_state {
+	enum nfa_state_type type;
+	int out;
+	int out1; /* Second epsilon transition, only used by epsilon states */
+	struct byte_set set;
+};
+
+/*
+ * A piece of the non-deterministic automaton with a single entry and a
+ * single exit. The exit is always an epsilon state without transitions.
+ */
+struct nfa_fragment {
+	int start;
+	int end;
+};
+
+struct regex_parser {
+	const char *pos;
+	const char *end;
+	bool ignore_case;
+	unsigned int depth;
+	struct nfa_state *states;
+	unsigned int number_of_states;
+	unsigned int max_states;
+};
+
+/*
+ * The deterministic automaton does not distinguish bytes that behave
+ * identically in all byte sets of the pattern, so the transition table
+ * only has one column per class of bytes.
+ */
+struct jet_regex {
+	uint8_t byte_class[NUMBER_OF_BYTES];
+	unsigned int number_of_classes;
+	unsigned int number_of_states;
+	const uint8_t *state_flags;
+	uint16_t transitions[];
+};
+
+static void set_add(struct byte_set *set, unsigned int c)
+{
+	set->bits[c / 32] |= 1U << (c % 32);
+}
+
+static bool set_contains(const struct byte_set *set, unsigned int c)
+{
+	return (set->bits[c / 32] & (1U << (c % 32))) != 0;
+}
+
+static void set_add_range(struct byte_set *set, unsigned int from, unsigned int to)
+{
+	for (unsigned int c = from; c <= to; c++) {
+		set_add(set, c);
+	}
+}
+
+static void set_add_set(struct byte_set *set, const struct byte_set *other)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(set->bits); i++) {
+		set->bits[i] |= other->bits[i];
+	}
+}
+
+static void set_negate(struct byte_set *set)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(set->bits); i++) {
+		set->bits[i] = ~set->bits[i];
+	}
+}
+
+static void set_fold_case(struct byte_set *set)
+{
+	for (unsigned int c = 'A'; c <= 'Z'; c++) {
+		unsigned int lower = c - 'A' + 'a';
+		if (set_contains(set, c) || set_contains(set, lower)) {
+			set_add(set, c);
+			set_add(set, lower);
+		}
+	}
+}
+
+static int new_state(struct regex_parser *p, enum nfa_state_type type)
+{
+	if (unlikely(p->number_of_states >= p->max_states)) {
+		return -1;
+	}
+	struct nfa_state *state = &p->states[p->number_of_states];
+	state->type = type;
+	state->out = -1;
+	state->out1 = -1;
+	return (int)p->number_of_states++;
+}
+
+static int byte_set_fragment(struct regex_parser *p, const struct byte_set *set, struct nfa_fragment *frag)
+{
+	int start = new_state(p, NFA_BYTE_SET);
+	int end = new_state(p, NFA_EPSILON);
+	if (unlikely((start < 0) || (end < 0))) {
+		return -1;
+	}
+	p->states[start].set = *set;
+	p->states[start].out = end;
+	frag->start = start;
+	frag->end = end;
+	return 0;
+}
+
+static int empty_fragment(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	int state = new_state(p, NFA_EPSILON);
+	if (unlikely(state < 0)) {
+		return -1;
+	}
+	frag->start = state;
+	frag->end = state;
+	return 0;
+}
+
+static void concatenate(struct regex_parser *p, struct nfa_fragment *frag, const struct nfa_fragment *next)
+{
+	p->states[frag->end].out = next->start;
+	frag->end = next->end;
+}
+
+static int alternate(struct regex_parser *p, struct nfa_fragment *frag, const struct nfa_fragment *other)
+{
+	int start = new_state(p, NFA_EPSILON);
+	int end = new_state(p, NFA_EPSILON);
+	if (unlikely((start < 0) || (end < 0))) {
+		return -1;
+	}
+	p->states[start].out = frag->start;
+	p->states[start].out1 = other->start;
+	p->states[frag->end].out = end;
+	p->states[other->end].out = end;
+	frag->start = start;
+	frag->end = end;
+	return 0;
+}
+
+static int repeat(struct regex_parser *p, struct nfa_fragment *frag, char quantifier)
+{
+	int start = new_state(p, NFA_EPSILON);
+	int end = new_state(p, NFA_EPSILON);
+	if (unlikely((start < 0) || (end < 0))) {
+		return -1;
+	}
+	p->states[start].out = frag->start;
+	if (quantifier != '+') {
+		p->states[start].out1 = end;
+	}
+	p->states[frag->end].out = end;
+	if (quantifier != '?') {
+		p->states[frag->end].out1 = frag->start;
+	}
+	frag->start = start;
+	frag->end = end;
+	return 0;
+}
+
+static bool is_alphanumeric(char c)
+{
+	return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9'));
+}
+
+static void add_class_escape(struct byte_set *set, char escape)
+{
+	struct byte_set class_set;
+	memset(&class_set, 0, sizeof(class_set));
+
+	switch (escape) {
+	case 'd':
+	case 'D':
+		set_add_range(&class_set, '0', '9');
+		break;
+	case 'w':
+	case 'W':
+		set_add_range(&class_set, 'a', 'z');
+		set_add_range(&class_set, 'A', 'Z');
+		set_add_range(&class_set, '0', '9');
+		set_add(&class_set, '_');
+		break;
+	default:
+		set_add(&class_set, ' ');
+		set_add_range(&class_set, '\t', '\r');
+		break;
+	}
+
+	if ((escape == 'D') || (escape == 'W') || (escape == 'S')) {
+		set_negate(&class_set);
+	}
+	set_add_set(set, &class_set);
+}
+
+/*
+ * Parses the escape sequence after a backslash. Returns the escaped byte,
+ * CLASS_ESCAPE if the sequence denotes a set of bytes that was added to
+ * set, or -1 if the sequence is not supported.
+ */
+enum { CLASS_ESCAPE = -2 };
+
+static int parse_escape(struct regex_parser *p, struct byte_set *set)
+{
+	if (unlikely(p->pos >= p->end)) {
+		return -1;
+	}
+
+	char c = *p->pos++;
+	switch (c) {
+	case 'd':
+	case 'D':
+	case 'w':
+	case 'W':
+	case 's':
+	case 'S':
+		add_class_escape(set, c);
+		return CLASS_ESCAPE;
+	case 'f':
+		return '\f';
+	case 'n':
+		return '\n';
+	case 'r':
+		return '\r';
+	case 't':
+		return '\t';
+	case 'v':
+		return '\v';
+	default:
+		if (unlikely(is_alphanumeric(c))) {
+			return -1;
+		}
+		return (unsigned char)c;
+	}
+}
+
+static int parse_class_atom(struct regex_parser *p, struct byte_set *set)
+{
+	if (unlikely(p->pos >= p->end)) {
+		return -1;
+	}
+	if (*p->pos == '\\') {
+		p->pos++;
+		return parse_escape(p, set);
+	}
+	return (unsigned char)*p->pos++;
+}
+
+static int parse_class(struct regex_parser *p, struct byte_set *set)
+{
+	bool negate = false;
+	if ((p->pos < p->end) && (*p->pos == '^')) {
+		negate = true;
+		p->pos++;
+	}
+
+	while ((p->pos < p->end) && (*p->pos != ']')) {
+		int from = parse_class_atom(p, set);
+		if (unlikely(from == -1)) {
+			return -1;
+		}
+		if ((p->pos + 1 < p->end) && (p->pos[0] == '-') && (p->pos[1] != ']')) {
+			p->pos++;
+			int to = parse_class_atom(p, set);
+			if (unlikely((from < 0) || (to < 0) || (from > to))) {
+				return -1;
+			}
+			set_add_range(set, (unsigned int)from, (unsigned int)to);
+		} else if (from >= 0) {
+			set_add(set, (unsigned int)from);
+		}
+	}
+
+	if (unlikely(p->pos >= p->end)) {
+		return -1;
+	}
+	p->pos++;
+
+	if (p->ignore_case) {
+		set_fold_case(set);
+	}
+	if (negate) {
+		set_negate(set);
+	}
+	return 0;
+}
+
+static int parse_alternation(struct regex_parser *p, struct nfa_fragment *frag);
+
+static int parse_group(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	if (unlikely(++p->depth > MAX_GROUP_DEPTH)) {
+		return -1;
+	}
+	if ((p->end - p->pos >= 2) && (p->pos[0] == '?') && (p->pos[1] == ':')) {
+		p->pos += 2;
+	}
+	if (unlikely(parse_alternation(p, frag) < 0)) {
+		return -1;
+	}
+	if (unlikely((p->pos >= p->end) || (*p->pos != ')'))) {
+		return -1;
+	}
+	p->pos++;
+	p->depth--;
+	return 0;
+}
+
+static int parse_atom(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	struct byte_set set;
+	memset(&set, 0, sizeof(set));
+
+	char c = *p->pos++;
+	switch (c) {
+	case '(':
+		return parse_group(p, frag);
+	case '[':
+		if (unlikely(parse_class(p, &set) < 0)) {
+			return -1;
+		}
+		return byte_set_fragment(p, &set, frag);
+	case '.':
+		set_negate(&set);
+		set.bits['\n' / 32] &= ~(1U << ('\n' % 32));
+		set.bits['\r' / 32] &= ~(1U << ('\r' % 32));
+		return byte_set_fragment(p, &set, frag);
+	case '\\': {
+		int escaped = parse_escape(p, &set);
+		if (unlikely(escaped == -1)) {
+			return -1;
+		}
+		if (escaped >= 0) {
+			set_add(&set, (unsigned int)escaped);
+		}
+		break;
+	}
+	case ')':
+	case '*':
+	case '+':
+	case '?':
+	case '{':
+	case '}':
+	case '^':
+	case '$':
+		return -1;
+	default:
+		set_add(&set, (unsigned char)c);
+		break;
+	}
+
+	if (p->ignore_case) {
+		set_fold_case(&set);
+	}
+	return byte_set_fragment(p, &set, frag);
+}
+
+static bool is_quantifier(char c)
+{
+	return (c == '*') || (c == '+') || (c == '?');
+}
+
+static int parse_repetition(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	if (unlikely(parse_atom(p, frag) < 0)) {
+		return -1;
+	}
+	while ((p->pos < p->end) && is_quantifier(*p->pos)) {
+		if (unlikely(repeat(p, frag, *p->pos) < 0)) {
+			return -1;
+		}
+		p->pos++;
+	}
+	return 0;
+}
+
+/*
+ * "$" ends a branch of the pattern if it is followed by "|" or the end
+ * of the pattern.
+ */
+static bool at_end_anchor(const struct regex_parser *p)
+{
+	return (p->depth == 0) && (*p->pos == '$') && ((p->pos + 1 == p->end) || (p->pos[1] == '|'));
+}
+
+static int parse_concatenation(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	bool empty = true;
+	while ((p->pos < p->end) && (*p->pos != '|') && (*p->pos != ')') && !at_end_anchor(p)) {
+		struct nfa_fragment next;
+		if (unlikely(parse_repetition(p, &next) < 0)) {
+			return -1;
+		}
+		if (empty) {
+			*frag = next;
+			empty = false;
+		} else {
+			concatenate(p, frag, &next);
+		}
+	}
+	if (empty) {
+		return empty_fragment(p, frag);
+	}
+	return 0;
+}
+
+static int parse_alternation(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	if (unlikely(parse_concatenation(p, frag) < 0)) {
+		return -1;
+	}
+	while ((p->pos < p->end) && (*p->pos == '|')) {
+		p->pos++;
+		struct nfa_fragment other;
+		if (unlikely(parse_concatenation(p, &other) < 0)) {
+			return -1;
+		}
+		if (unlikely(alternate(p, frag, &other) < 0)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int any_string_fragment(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	struct byte_set set;
+	memset(&set, 0, sizeof(set));
+	set_negate(&set);
+	if (unlikely(byte_set_fragment(p, &set, frag) < 0)) {
+		return -1;
+	}
+	return repeat(p, frag, '*');
+}
+
+/*
+ * As in JavaScript, "^" and "$" anchor the branch of the top level
+ * alternation they belong to. Unanchored branches are embedded in ".*".
+ */
+static int parse_branch(struct regex_parser *p, struct nfa_fragment *frag)
+{
+	bool anchored_start = false;
+	if ((p->pos < p->end) && (*p->pos == '^')) {
+		anchored_start = true;
+		p->pos++;
+	}
+
+	if (unlikely(parse_concatenation(p, frag) < 0)) {
+		return -1;
+	}
+
+	bool anchored_end = false;
+	if ((p->pos < p->end) && (*p->pos == '$')) {
+		anchored_end = true;
+		p->pos++;
+	}
+
+	struct nfa_fragment any;
+	if (!anchored_start) {
+		if (unlikely(any_string_fragment(p, &any) < 0)) {
+			return -1;
+		}
+		concatenate(p, &any, frag);
+		*frag = any;
+	}
+	if (!anchored_end) {
+		if (unlikely(any_string_fragment(p, &any) < 0)) {
+			return -1;
+		}
+		concatenate(p, frag, &any);
+	}
+	return 0;
+}
+
+/*
+ * Builds a non-deterministic automaton that accepts exactly the strings
+ * matched by the pattern.
+ */
+static int build_nfa(struct regex_parser *p, const char *pattern, struct nfa_fragment *frag)
+{
+	size_t length = strlen(pattern);
+	unsigned int number_of_branches = 1;
+	for (size_t i = 0; i < length; i++) {
+		if (pattern[i] == '|') {
+			number_of_branches++;
+		}
+	}
+
+	p->pos = pattern;
+	p->end = pattern + length;
+	p->max_states = 4 * length + 8 * number_of_branches + 16;
+	p->states = cjet_calloc(p->max_states, sizeof(*p->states));
+	if (unlikely(p->states == NULL)) {
+		return -1;
+	}
+
+	if (unlikely(parse_branch(p, frag) < 0)) {
+		return -1;
+	}
+	while ((p->pos < p->end) && (*p->pos == '|')) {
+		p->pos++;
+		struct nfa_fragment other;
+		if (unlikely(parse_branch(p, &other) < 0) || unlikely(alternate(p, frag, &other) < 0)) {
+			return -1;
+		}
+	}
+	if (unlikely(p->pos != p->end)) {
+		return -1;
+	}
+	return 0;
+}
+
+struct dfa_builder {
+	const struct nfa_state *nfa;
+	unsigned int accept;
+	unsigned int words_per_set;
+	uint32_t *sets;
+	uint32_t *hashes;
+	unsigned int *stack;
+	unsigned int number_of_states;
+	uint8_t byte_class[NUMBER_OF_BYTES];
+	uint8_t class_representative[NUMBER_OF_BYTES];
+	unsigned int number_of_classes;
+	uint16_t *transitions;
+};
+
+static void compute_byte_classes(struct dfa_builder *b, const struct regex_parser *p)
+{
+	memset(b->byte_class, 0, sizeof(b->byte_class));
+	b->number_of_classes = 1;
+
+	for (unsigned int i = 0; i < p->number_of_states; i++) {
+		const struct nfa_state *state = &p->states[i];
+		if (state->type != NFA_BYTE_SET) {
+			continue;
+		}
+
+		int16_t refined_class[NUMBER_OF_BYTES][2];
+		memset(refined_class, 0xff, sizeof(refined_class));
+		unsigned int number_of_classes = 0;
+		for (unsigned int c = 0; c < NUMBER_OF_BYTES; c++) {
+			unsigned int in_set = set_contains(&state->set, c) ? 1 : 0;
+			int16_t *refined = &refined_class[b->byte_class[c]][in_set];
+			if (*refined < 0) {
+				*refined = (int16_t)number_of_classes++;
+			}
+			b->byte_class[c] = (uint8_t)*refined;
+		}
+		b->number_of_classes = number_of_classes;
+	}
+
+	for (unsigned int c = NUMBER_OF_BYTES; c-- > 0;) {
+		b->class_representative[b->byte_class[c]] = (uint8_t)c;
+	}
+}
+
+static uint32_t *get_set(const struct dfa_builder *b, unsigned int state)
+{
+	return &b->sets[state * b->words_per_set];
+}
+
+static void add_closure(struct dfa_builder *b, uint32_t *set, int nfa_state)
+{
+	unsigned int stack_size = 0;
+	b->stack[stack_size++] = (unsigned int)nfa_state;
+	set[nfa_state / 32] |= 1U << (nfa_state % 32);
+
+	while (stack_size > 0) {
+		const struct nfa_state *state = &b->nfa[b->stack[--stack_size]];
+		if (state->type != NFA_EPSILON) {
+			continue;
+		}
+		int outs[2] = {state->out, state->out1};
+		for (unsigned int i = 0; i < ARRAY_SIZE(outs); i++) {
+			int out = outs[i];
+			if ((out >= 0) && ((set[out / 32] & (1U << (out % 32))) == 0)) {
+				set[out / 32] |= 1U << (out % 32);
+				b->stack[stack_size++] = (unsigned int)out;
+			}
+		}
+	}
+}
+
+static uint32_t hash_set(const struct dfa_builder *b, const uint32_t *set)
+{
+	uint32_t hash = 2166136261U;
+	for (unsigned int i = 0; i < b->words_per_set; i++) {
+		hash = (hash ^ set[i]) * 16777619U;
+	}
+	return hash;
+}
+
+/*
+ * Returns the automaton state for the set of nfa states stored in the
+ * slot behind the last state, adding it if it is new. Returns -1 if the
+ * automaton would get too large.
+ */
+static int find_or_add_state(struct dfa_builder *b)
+{
+	const uint32_t *set = get_set(b, b->number_of_states);
+	uint32_t hash = hash_set(b, set);
+	for (unsigned int i = 0; i < b->number_of_states; i++) {
+		if ((b->hashes[i] == hash) && (memcmp(get_set(b, i), set, b->words_per_set * sizeof(*set)) == 0)) {
+			return (int)i;
+		}
+	}
+
+	if (unlikely(b->number_of_states + 1 >= CONFIG_MAX_DFA_STATES_IN_REGEX)) {
+		return -1;
+	}
+	b->hashes[b->number_of_states] = hash;
+	return (int)b->number_of_states++;
+}
+
+static int build_dfa_states(struct dfa_builder *b, int nfa_start)
+{
+	/* The dead state has the empty set of nfa states. */
+	if (unlikely(find_or_add_state(b) != DEAD_STATE)) {
+		return -1;
+	}
+
+	add_closure(b, get_set(b, b->number_of_states), nfa_start);
+	if (unlikely(find_or_add_state(b) != START_STATE)) {
+		return -1;
+	}
+
+	for (unsigned int state = START_STATE; state < b->number_of_states; state++) {
+		for (unsigned int c = 0; c < b->number_of_classes; c++) {
+			uint32_t *next = get_set(b, b->number_of_states);
+			memset(next, 0, b->words_per_set * sizeof(*next));
+
+			const uint32_t *current = get_set(b, state);
+			for (unsigned int i = 0; i < b->words_per_set * 32; i++) {
+				if ((current[i / 32] & (1U << (i % 32))) == 0) {
+					continue;
+				}
+				const struct nfa_state *nfa_state = &b->nfa[i];
+				if ((nfa_state->type == NFA_BYTE_SET) && set_contains(&nfa_state->set, b->class_representative[c])) {
+					add_closure(b, next, nfa_state->out);
+				}
+			}
+
+			int next_state = find_or_add_state(b);
+			if (unlikely(next_state < 0)) {
+				return -1;
+			}
+			b->transitions[state * b->number_of_classes + c] = (uint16_t)next_state;
+		}
+	}
+	return 0;
+}
+
+static struct jet_regex *create_regex(const struct dfa_builder *b)
+{
+	size_t transitions_size = b->number_of_states * b->number_of_classes * sizeof(b->transitions[0]);
+	struct jet_regex *re = cjet_malloc(sizeof(*re) + transitions_size + b->number_of_states);
+	if (unlikely(re == NULL)) {
+		return NULL;
+	}
+
+	memcpy(re->byte_class, b->byte_class, sizeof(re->byte_class));
+	re->number_of_classes = b->number_of_classes;
+	re->number_of_states = b->number_of_states;
+	memcpy(re->transitions, b->transitions, transitions_size);
+
+	uint8_t *state_flags = (uint8_t *)re->transitions + transitions_size;
+	for (unsigned int state = 0; state < b->number_of_states; state++) {
+		uint8_t flags = 0;
+		const uint32_t *set = get_set(b, state);
+		if ((set[b->accept / 32] & (1U << (b->accept % 32))) != 0) {
+			flags |= STATE_ACCEPTING;
+			bool stays = true;
+			for (unsigned int c = 0; c < b->number_of_classes; c++) {
+				if (b->transitions[state * b->number_of_classes + c] != state) {
+					stays = false;
+					break;
+				}
+			}
+			if (stays) {
+				flags |= STATE_ALWAYS_ACCEPTING;
+			}
+		}
+		state_flags[state] = flags;
+	}
+	re->state_flags = state_flags;
+	return re;
+}
+
+static struct jet_regex *build_dfa(const struct regex_parser *p, const struct nfa_fragment *frag)
+{
+	struct jet_regex *re = NULL;
+	struct dfa_builder b;
+	memset(&b, 0, sizeof(b));
+	b.nfa = p->states;
+	b.accept = (unsigned int)frag->end;
+	b.words_per_set = (p->number_of_states + 31) / 32;
+	compute_byte_classes(&b, p);
+
+	/* The set behind the last state is the scratch space for the next state. */
+	b.sets = cjet_calloc((size_t)CONFIG_MAX_DFA_STATES_IN_REGEX * b.words_per_set, sizeof(*b.sets));
+	b.hashes = cjet_calloc(CONFIG_MAX_DFA_STATES_IN_REGEX, sizeof(*b.hashes));
+	b.stack = cjet_calloc(p->number_of_states, sizeof(*b.stack));
+	b.transitions = cjet_calloc((size_t)CONFIG_MAX_DFA_STATES_IN_REGEX * b.number_of_classes, sizeof(*b.transitions));
+	if (unlikely((b.sets == NULL) || (b.hashes == NULL) || (b.stack == NULL) || (b.transitions == NULL))) {
+		goto out;
+	}
+
+	if (likely(build_dfa_states(&b, frag->start) == 0)) {
+		re = create_regex(&b);
+	}
+
+out:
+	if (b.sets != NULL) {
+		cjet_free(b.sets);
+	}
+	if (b.hashes != NULL) {
+		cjet_free(b.hashes);
+	}
+	if (b.stack != NULL) {
+		cjet_free(b.stack);
+	}
+	if (b.transitions != NULL) {
+		cjet_free(b.transitions);
+	}
+	return re;
+}
+
+struct jet_regex *jet_regex_compile(const char *pattern, bool ignore_case)
+{
+	struct regex_parser p;
+	memset(&p, 0, sizeof(p));
+	p.ignore_case = ignore_case;
+
+	struct jet_regex *re = NULL;
+	struct nfa_fragment frag;
+	if (likely(build_nfa(&p, pattern, &frag) == 0)) {
+		re = build_dfa(&p, &frag);
+	}
+
+	if (p.states != NULL) {
+		cjet_free(p.states);
+	}
+	return re;
+}
+
+void jet_regex_free(struct jet_regex *re)
+{
+	cjet_free(re);
+}
+
+bool jet_regex_match(const struct jet_regex *re, const char *s, size_t length)
+{
+	unsigned int state = START_STATE;
+	for (size_t i = 0; i < length; i++) {
+		if ((re->state_flags[state] & STATE_ALWAYS_ACCEPTING) != 0) {
+			return true;
+		}
+		state = re->transitions[state * re->number_of_classes + re->byte_class[(unsigned char)s[i]]];
+		if (state == DEAD_STATE) {
+			return false;
+		}
+	}
+	return (re->state_flags[state] & STATE_ACCEPTING) != 0;
+}
@@ -0,0 +1,63 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_JET_REGEX_H
+#define CJET_JET_REGEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Regular expressions compiled into a deterministic finite automaton.
+ * Matching never backtracks and never allocates, it is linear in the
+ * length of the input. Supported are literals, ".", character classes
+ * including ranges and negation, the escapes \d \w \s \D \W \S,
+ * grouping with "(...)" or "(?:...)", alternation and the quantifiers
+ * "*", "+" and "?". "^" and "$" are only allowed at the start or the end
+ * of a branch of the top level alternation and anchor that branch, so
+ * "^a|b" matches "xb". Without them, a branch matches anywhere in the
+ * input. Patterns are matched byte-wise.
+ */
+struct jet_regex;
+
+/*
+ * Returns NULL if the pattern is invalid, uses unsupported constructs or
+ * needs more than CONFIG_MAX_DFA_STATES_IN_REGEX automaton states. If
+ * ignore_case is set, the compiled regex expects lowercase input.
+ */
+struct jet_regex *jet_regex_compile(const char *pattern, bool ignore_case);
+void jet_regex_free(struct jet_regex *re);
+bool jet_regex_match(const struct jet_regex *re, const char *s, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
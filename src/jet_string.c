@@ -41,3 +41,21 @@ char *duplicate_string(const char *s)
 	strcpy(ptr, s);
 	return ptr;
 }
+
+char *duplicate_string_lowercase(const char *s)
+{
+	size_t length = strlen(s);
+	char *ptr = cjet_malloc(length + 1);
+	if (unlikely(ptr == NULL)) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i <= length; i++) {
+		char c = s[i];
+		if ((c >= 'A') && (c <= 'Z')) {
+			c = c + ('a' - 'A');
+		}
+		ptr[i] = c;
+	}
+	return ptr;
+}
@@ -34,6 +34,7 @@ extern "C" {
 #include <stddef.h>
 
 char *duplicate_string(const char *s);
+char *duplicate_string_lowercase(const char *s);
 const char *jet_strcasestr(const char *haystack, const char *needle);
 int jet_strcasecmp(const char *s1, const char *s2);
 int jet_strncasecmp(const char *s1, const char *s2, size_t n);
@@ -527,6 +527,9 @@ static char *print_value(const cJSON *item, unsigned int depth, int fmt)
 	case cJSON_Object:
 		out = print_object(item, depth, fmt);
 		break;
+	case cJSON_Raw:
+		out = cJSON_strdup(item->valuestring);
+		break;
 	}
 	return out;
 }
@@ -1005,6 +1008,30 @@ cJSON *cJSON_CreateString(const char *string)
 	}
 	return item;
 }
+cJSON *cJSON_CreateRaw(const char *raw)
+{
+	cJSON *item = cJSON_New_Item();
+	if (item) {
+		item->type = cJSON_Raw;
+		item->valuestring = cJSON_strdup(raw);
+	}
+	return item;
+}
+cJSON *cJSON_CreateRawWithLength(const char *raw, size_t length)
+{
+	cJSON *item = cJSON_New_Item();
+	if (item) {
+		item->type = cJSON_Raw;
+		item->valuestring = (char *)cJSON_malloc(length + 1);
+		if (!item->valuestring) {
+			cJSON_Delete(item);
+			return 0;
+		}
+		memcpy(item->valuestring, raw, length);
+		item->valuestring[length] = '\0';
+	}
+	return item;
+}
 cJSON *cJSON_CreateArray(void)
 {
 	cJSON *item = cJSON_New_Item();
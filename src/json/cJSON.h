@@ -38,6 +38,7 @@ extern "C"
 #define cJSON_String 4
 #define cJSON_Array 5
 #define cJSON_Object 6
+#define cJSON_Raw 7 /* Preformatted JSON text, printed as is */
 
 #define cJSON_IsReference 256
 
@@ -91,6 +92,8 @@ extern cJSON *cJSON_CreateFalse(void);
 extern cJSON *cJSON_CreateBool(int b);
 extern cJSON *cJSON_CreateNumber(double num);
 extern cJSON *cJSON_CreateString(const char *string);
+extern cJSON *cJSON_CreateRaw(const char *raw);
+extern cJSON *cJSON_CreateRawWithLength(const char *raw, size_t length);
 extern cJSON *cJSON_CreateArray(void);
 extern cJSON *cJSON_CreateObject(void);
 
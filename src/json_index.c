@@ -0,0 +1,510 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "compiler.h"
+#include "json_index.h"
+
+static bool is_whitespace(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+static bool is_digit(char c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+static bool is_hex_digit(char c)
+{
+	return is_digit(c) || ((c >= 'a') && (c <= 'f')) || ((c >= 'A') && (c <= 'F'));
+}
+
+static char to_lower(char c)
+{
+	if ((c >= 'A') && (c <= 'Z')) {
+		return c - 'A' + 'a';
+	}
+	return c;
+}
+
+static size_t skip_whitespace(const char *json, size_t length, size_t pos)
+{
+	while ((pos < length) && is_whitespace(json[pos])) {
+		pos++;
+	}
+	return pos;
+}
+
+/*
+ * Values nested deeper than the indexed depth are only validated, their
+ * tokens are written to a scratch token.
+ */
+static struct json_token *add_token(struct json_index *index, bool indexed, size_t pos, enum json_token_type type)
+{
+	struct json_token *token;
+	if (indexed) {
+		if (unlikely(index->number_of_tokens == index->capacity)) {
+			return NULL;
+		}
+		token = &index->tokens[index->number_of_tokens++];
+	} else {
+		token = &index->skipped_token;
+	}
+
+	token->start = (uint32_t)pos;
+	token->type = (uint8_t)type;
+	token->escaped = false;
+	return token;
+}
+
+static void close_token(struct json_index *index, struct json_token *token, size_t end)
+{
+	token->length = (uint32_t)end - token->start;
+	token->next = index->number_of_tokens;
+}
+
+/*
+ * Returns the position of the first quote, backslash, control character
+ * or non ASCII byte at or after pos. Plain string content is skipped 16
+ * bytes at a time if SSE2 is available.
+ */
+static size_t skip_plain_string_bytes(const char *json, size_t length, size_t pos)
+{
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i space = _mm_set1_epi8(' ');
+	while (length - pos >= 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(const void *)(json + pos));
+		/* Non ASCII bytes are negative, so the signed compare catches them with the control characters. */
+		__m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+		                               _mm_cmplt_epi8(chunk, space));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+		if (mask != 0) {
+			return pos + (size_t)__builtin_ctz(mask);
+		}
+		pos += 16;
+	}
+#endif
+	while (pos < length) {
+		unsigned char c = (unsigned char)json[pos];
+		if ((c == '"') || (c == '\\') || (c < 0x20) || (c >= 0x80)) {
+			break;
+		}
+		pos++;
+	}
+	return pos;
+}
+
+static bool is_continuation(const char *json, size_t pos)
+{
+	return ((unsigned char)json[pos] & 0xc0) == 0x80;
+}
+
+/*
+ * Validates the UTF-8 sequence starting at *pos, rejecting overlong
+ * forms, surrogates and code points above U+10FFFF.
+ */
+static int parse_utf8_sequence(const char *json, size_t length, size_t *pos)
+{
+	size_t i = *pos;
+	unsigned char lead = (unsigned char)json[i];
+	unsigned char min = 0x80;
+	unsigned char max = 0xbf;
+	size_t continuation_bytes;
+
+	if ((lead >= 0xc2) && (lead <= 0xdf)) {
+		continuation_bytes = 1;
+	} else if ((lead >= 0xe0) && (lead <= 0xef)) {
+		continuation_bytes = 2;
+		if (lead == 0xe0) {
+			min = 0xa0;
+		} else if (lead == 0xed) {
+			max = 0x9f;
+		}
+	} else if ((lead >= 0xf0) && (lead <= 0xf4)) {
+		continuation_bytes = 3;
+		if (lead == 0xf0) {
+			min = 0x90;
+		} else if (lead == 0xf4) {
+			max = 0x8f;
+		}
+	} else {
+		return -1;
+	}
+
+	if (unlikely(length - i <= continuation_bytes)) {
+		return -1;
+	}
+	unsigned char second = (unsigned char)json[i + 1];
+	if (unlikely((second < min) || (second > max))) {
+		return -1;
+	}
+	for (size_t j = 2; j <= continuation_bytes; j++) {
+		if (unlikely(!is_continuation(json, i + j))) {
+			return -1;
+		}
+	}
+
+	*pos = i + continuation_bytes + 1;
+	return 0;
+}
+
+static int parse_string(const char *json, size_t length, size_t *pos, bool *escaped)
+{
+	size_t i = *pos + 1;
+	for (;;) {
+		i = skip_plain_string_bytes(json, length, i);
+		if (unlikely(i >= length)) {
+			return -1;
+		}
+
+		unsigned char c = (unsigned char)json[i];
+		if (c == '"') {
+			*pos = i + 1;
+			return 0;
+		}
+		if (unlikely(c < 0x20)) {
+			return -1;
+		}
+		if (c >= 0x80) {
+			if (unlikely(parse_utf8_sequence(json, length, &i) < 0)) {
+				return -1;
+			}
+			continue;
+		}
+
+		*escaped = true;
+		if (unlikely(++i >= length)) {
+			return -1;
+		}
+		switch (json[i]) {
+		case '"':
+		case '\\':
+		case '/':
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+			i++;
+			break;
+
+		case 'u':
+			if (unlikely(i + 4 >= length)) {
+				return -1;
+			}
+			for (unsigned int j = 1; j <= 4; j++) {
+				if (unlikely(!is_hex_digit(json[i + j]))) {
+					return -1;
+				}
+			}
+			i += 5;
+			break;
+
+		default:
+			return -1;
+		}
+	}
+}
+
+static size_t skip_digits(const char *json, size_t length, size_t pos)
+{
+	while ((pos < length) && is_digit(json[pos])) {
+		pos++;
+	}
+	return pos;
+}
+
+static int parse_number(const char *json, size_t length, size_t *pos)
+{
+	size_t i = *pos;
+	if (json[i] == '-') {
+		i++;
+	}
+
+	if ((i < length) && (json[i] == '0')) {
+		i++;
+	} else if ((i < length) && is_digit(json[i])) {
+		i = skip_digits(json, length, i);
+	} else {
+		return -1;
+	}
+
+	if ((i < length) && (json[i] == '.')) {
+		size_t fraction = i + 1;
+		i = skip_digits(json, length, fraction);
+		if (unlikely(i == fraction)) {
+			return -1;
+		}
+	}
+
+	if ((i < length) && ((json[i] == 'e') || (json[i] == 'E'))) {
+		i++;
+		if ((i < length) && ((json[i] == '+') || (json[i] == '-'))) {
+			i++;
+		}
+		size_t exponent = i;
+		i = skip_digits(json, length, exponent);
+		if (unlikely(i == exponent)) {
+			return -1;
+		}
+	}
+
+	*pos = i;
+	return 0;
+}
+
+static int parse_literal(const char *json, size_t length, size_t *pos, const char *literal)
+{
+	size_t literal_length = strlen(literal);
+	if (unlikely((length - *pos < literal_length) || (memcmp(json + *pos, literal, literal_length) != 0))) {
+		return -1;
+	}
+	*pos += literal_length;
+	return 0;
+}
+
+static int parse_key(struct json_index *index, bool indexed, const char *json, size_t length, size_t *pos)
+{
+	size_t i = skip_whitespace(json, length, *pos);
+	if (unlikely((i >= length) || (json[i] != '"'))) {
+		return -1;
+	}
+
+	struct json_token *key = add_token(index, indexed, i, JSON_TOKEN_STRING);
+	if (unlikely((key == NULL) || (parse_string(json, length, &i, &key->escaped) < 0))) {
+		return -1;
+	}
+	close_token(index, key, i);
+	if (indexed) {
+		index->escaped_keys |= key->escaped;
+	}
+
+	i = skip_whitespace(json, length, i);
+	if (unlikely((i >= length) || (json[i] != ':'))) {
+		return -1;
+	}
+	*pos = i + 1;
+	return 0;
+}
+
+static int parse_scalar(struct json_index *index, bool indexed, const char *json, size_t length, size_t *pos)
+{
+	size_t i = *pos;
+	struct json_token *token;
+	int ret;
+
+	switch (json[i]) {
+	case '"':
+		token = add_token(index, indexed, i, JSON_TOKEN_STRING);
+		ret = (token == NULL) ? -1 : parse_string(json, length, &i, &token->escaped);
+		break;
+	case 't':
+		token = add_token(index, indexed, i, JSON_TOKEN_TRUE);
+		ret = parse_literal(json, length, &i, "true");
+		break;
+	case 'f':
+		token = add_token(index, indexed, i, JSON_TOKEN_FALSE);
+		ret = parse_literal(json, length, &i, "false");
+		break;
+	case 'n':
+		token = add_token(index, indexed, i, JSON_TOKEN_NULL);
+		ret = parse_literal(json, length, &i, "null");
+		break;
+	default:
+		token = add_token(index, indexed, i, JSON_TOKEN_NUMBER);
+		ret = parse_number(json, length, &i);
+		break;
+	}
+
+	if (unlikely((token == NULL) || (ret < 0))) {
+		return -1;
+	}
+	close_token(index, token, i);
+	*pos = i;
+	return 0;
+}
+
+void json_index_init(struct json_index *index, struct json_token *tokens, unsigned int capacity, unsigned int indexed_depth)
+{
+	index->json = NULL;
+	index->tokens = tokens;
+	index->capacity = capacity;
+	index->number_of_tokens = 0;
+	index->indexed_depth = indexed_depth;
+	index->escaped_keys = false;
+}
+
+struct open_container {
+	unsigned int token;
+	bool indexed;
+	bool object;
+};
+
+/*
+ * Containers are tracked on a small stack instead of recursing, so a
+ * message can't exhaust the call stack.
+ */
+int json_index_parse(struct json_index *index, const char *json, size_t length)
+{
+	struct open_container containers[JSON_INDEX_MAX_DEPTH];
+	unsigned int depth = 0;
+	size_t pos = 0;
+
+	index->json = json;
+	index->number_of_tokens = 0;
+	index->escaped_keys = false;
+	if (unlikely(length >= UINT32_MAX)) {
+		return -1;
+	}
+
+	for (;;) {
+		pos = skip_whitespace(json, length, pos);
+		if (unlikely(pos >= length)) {
+			return -1;
+		}
+
+		bool indexed = (depth <= index->indexed_depth);
+		char c = json[pos];
+		if ((c == '{') || (c == '[')) {
+			bool object = (c == '{');
+			unsigned int container = index->number_of_tokens;
+			struct json_token *token = add_token(index, indexed, pos, object ? JSON_TOKEN_OBJECT : JSON_TOKEN_ARRAY);
+			if (unlikely((token == NULL) || (depth == JSON_INDEX_MAX_DEPTH))) {
+				return -1;
+			}
+
+			pos = skip_whitespace(json, length, pos + 1);
+			if ((pos < length) && (json[pos] == (object ? '}' : ']'))) {
+				close_token(index, token, ++pos);
+			} else {
+				containers[depth].token = container;
+				containers[depth].indexed = indexed;
+				containers[depth].object = object;
+				depth++;
+				if (object && unlikely(parse_key(index, depth <= index->indexed_depth, json, length, &pos) < 0)) {
+					return -1;
+				}
+				continue;
+			}
+		} else if (unlikely(parse_scalar(index, indexed, json, length, &pos) < 0)) {
+			return -1;
+		}
+
+		/*
+		 * A value is complete, close all containers ending here and
+		 * move on to the next member or element.
+		 */
+		for (;;) {
+			if (depth == 0) {
+				return (pos == length) ? 0 : -1;
+			}
+
+			pos = skip_whitespace(json, length, pos);
+			if (unlikely(pos >= length)) {
+				return -1;
+			}
+
+			const struct open_container *container = &containers[depth - 1];
+			if (json[pos] == ',') {
+				pos++;
+				if (container->object && unlikely(parse_key(index, depth <= index->indexed_depth, json, length, &pos) < 0)) {
+					return -1;
+				}
+				break;
+			}
+
+			if (unlikely(json[pos] != (container->object ? '}' : ']'))) {
+				return -1;
+			}
+			pos++;
+			if (container->indexed) {
+				close_token(index, &index->tokens[container->token], pos);
+			}
+			depth--;
+		}
+	}
+}
+
+unsigned int json_index_get_member(const struct json_index *index, unsigned int object, const char *key)
+{
+	const struct json_token *tokens = index->tokens;
+	size_t key_length = strlen(key);
+
+	unsigned int member = object + 1;
+	while (member < tokens[object].next) {
+		const struct json_token *name = &tokens[member];
+		if (!name->escaped && (name->length - 2 == key_length)) {
+			const char *text = index->json + name->start + 1;
+			size_t i = 0;
+			while ((i < key_length) && (to_lower(text[i]) == to_lower(key[i]))) {
+				i++;
+			}
+			if (i == key_length) {
+				return member + 1;
+			}
+		}
+		member = tokens[member + 1].next;
+	}
+	return JSON_INDEX_NO_TOKEN;
+}
+
+bool json_index_string_equals(const struct json_index *index, unsigned int token, const char *s)
+{
+	const struct json_token *t = &index->tokens[token];
+	if ((t->type != JSON_TOKEN_STRING) || t->escaped) {
+		return false;
+	}
+
+	size_t length = t->length - 2;
+	return (strlen(s) == length) && (memcmp(index->json + t->start + 1, s, length) == 0);
+}
+
+int json_index_copy_string(const struct json_index *index, unsigned int token, char *buffer, size_t buffer_size)
+{
+	const struct json_token *t = &index->tokens[token];
+	if ((t->type != JSON_TOKEN_STRING) || t->escaped) {
+		return -1;
+	}
+
+	size_t length = t->length - 2;
+	if (length >= buffer_size) {
+		return -1;
+	}
+	memcpy(buffer, index->json + t->start + 1, length);
+	buffer[length] = '\0';
+	return 0;
+}
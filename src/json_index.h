@@ -0,0 +1,130 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_JSON_INDEX_H
+#define CJET_JSON_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum json_token_type {
+	JSON_TOKEN_OBJECT,
+	JSON_TOKEN_ARRAY,
+	JSON_TOKEN_STRING,
+	JSON_TOKEN_NUMBER,
+	JSON_TOKEN_TRUE,
+	JSON_TOKEN_FALSE,
+	JSON_TOKEN_NULL
+};
+
+/*
+ * A token covers the raw text of a value, strings including their
+ * quotes. The members of an object are stored as key token followed by
+ * the tokens of the value, so a subtree occupies the tokens up to next.
+ */
+struct json_token {
+	uint32_t start;
+	uint32_t length;
+	uint32_t next; /* Token following the subtree of this token */
+	uint8_t type;
+	bool escaped; /* String contains escape sequences */
+};
+
+/*
+ * Index of a JSON message built in place. Nothing is copied or
+ * allocated, the tokens are written to the array handed to
+ * json_index_init() and refer to the message by offset.
+ *
+ * Containers nested deeper than indexed_depth (the root has depth 0)
+ * are validated but kept as a single token, so large values that are
+ * only forwarded don't need a token per element.
+ */
+struct json_index {
+	const char *json;
+	struct json_token *tokens;
+	unsigned int capacity;
+	unsigned int number_of_tokens;
+	unsigned int indexed_depth;
+	bool escaped_keys; /* At least one indexed key contains escape sequences */
+	struct json_token skipped_token; /* Scratch token for values below indexed_depth */
+};
+
+/*
+ * The root is always token 0, so it can't be the value of a member.
+ */
+#define JSON_INDEX_NO_TOKEN 0U
+
+enum { JSON_INDEX_MAX_DEPTH = 32 };
+
+void json_index_init(struct json_index *index, struct json_token *tokens, unsigned int capacity, unsigned int indexed_depth);
+
+/*
+ * Indexes exactly one JSON value spanning the whole message. Fails on
+ * invalid JSON including malformed UTF-8 in strings, trailing
+ * whitespace, nesting deeper than JSON_INDEX_MAX_DEPTH and if the
+ * token array is too small.
+ */
+int json_index_parse(struct json_index *index, const char *json, size_t length);
+
+/*
+ * Returns the value of the first member named key, compared without
+ * case like cJSON_GetObjectItem() does. Keys with escape sequences
+ * never match.
+ */
+unsigned int json_index_get_member(const struct json_index *index, unsigned int object, const char *key);
+
+/*
+ * Compares a string token without escape sequences with s.
+ */
+bool json_index_string_equals(const struct json_index *index, unsigned int token, const char *s);
+
+/*
+ * Copies the content of a string token without escape sequences into a
+ * zero terminated buffer. Fails if the string is escaped or does not
+ * fit.
+ */
+int json_index_copy_string(const struct json_index *index, unsigned int token, char *buffer, size_t buffer_size);
+
+static inline const char *json_index_token_text(const struct json_index *index, unsigned int token)
+{
+	return index->json + index->tokens[token].start;
+}
+
+static inline size_t json_index_token_length(const struct json_index *index, unsigned int token)
+{
+	return index->tokens[token].length;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
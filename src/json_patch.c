@@ -0,0 +1,216 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "json/cJSON.h"
+#include "json_patch.h"
+
+static int get_type(const cJSON *item)
+{
+	return item->type & 0xff;
+}
+
+static cJSON *find_member(const cJSON *object, const char *name, unsigned int *index)
+{
+	unsigned int i = 0;
+	for (cJSON *item = object->child; item != NULL; item = item->next) {
+		if (strcmp(item->string, name) == 0) {
+			if (index != NULL) {
+				*index = i;
+			}
+			return item;
+		}
+		i++;
+	}
+	return NULL;
+}
+
+static bool objects_equal(const cJSON *a, const cJSON *b)
+{
+	if (cJSON_GetArraySize(a) != cJSON_GetArraySize(b)) {
+		return false;
+	}
+	for (const cJSON *item = a->child; item != NULL; item = item->next) {
+		const cJSON *other = find_member(b, item->string, NULL);
+		if ((other == NULL) || !json_equal(item, other)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool arrays_equal(const cJSON *a, const cJSON *b)
+{
+	const cJSON *item_b = b->child;
+	for (const cJSON *item_a = a->child; item_a != NULL; item_a = item_a->next) {
+		if ((item_b == NULL) || !json_equal(item_a, item_b)) {
+			return false;
+		}
+		item_b = item_b->next;
+	}
+	return item_b == NULL;
+}
+
+bool json_equal(const cJSON *a, const cJSON *b)
+{
+	int type = get_type(a);
+	if (type != get_type(b)) {
+		return false;
+	}
+
+	switch (type) {
+	case cJSON_Number:
+		return a->valuedouble == b->valuedouble;
+	case cJSON_String:
+		return strcmp(a->valuestring, b->valuestring) == 0;
+	case cJSON_Array:
+		return arrays_equal(a, b);
+	case cJSON_Object:
+		return objects_equal(a, b);
+	default:
+		return true;
+	}
+}
+
+/*
+ * Applying a patch removes all null members of objects, so those values
+ * can't be transported. Nulls inside arrays are fine.
+ */
+static bool has_null_member(const cJSON *value)
+{
+	if (get_type(value) == cJSON_NULL) {
+		return true;
+	}
+	if (get_type(value) == cJSON_Object) {
+		for (const cJSON *item = value->child; item != NULL; item = item->next) {
+			if (has_null_member(item)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static cJSON *diff_objects(const cJSON *from, const cJSON *to)
+{
+	cJSON *patch = cJSON_CreateObject();
+	if (unlikely(patch == NULL)) {
+		return NULL;
+	}
+
+	for (const cJSON *item = to->child; item != NULL; item = item->next) {
+		const cJSON *old = find_member(from, item->string, NULL);
+		if ((old != NULL) && json_equal(old, item)) {
+			continue;
+		}
+
+		cJSON *member;
+		if ((old != NULL) && (get_type(old) == cJSON_Object) && (get_type(item) == cJSON_Object)) {
+			member = diff_objects(old, item);
+		} else if (has_null_member(item)) {
+			member = NULL;
+		} else {
+			member = cJSON_Duplicate(item, 1);
+		}
+		if (unlikely(member == NULL)) {
+			goto error;
+		}
+		cJSON_AddItemToObject(patch, item->string, member);
+	}
+
+	for (const cJSON *item = from->child; item != NULL; item = item->next) {
+		if (find_member(to, item->string, NULL) == NULL) {
+			cJSON *null = cJSON_CreateNull();
+			if (unlikely(null == NULL)) {
+				goto error;
+			}
+			cJSON_AddItemToObject(patch, item->string, null);
+		}
+	}
+	return patch;
+
+error:
+	cJSON_Delete(patch);
+	return NULL;
+}
+
+cJSON *create_merge_patch(const cJSON *from, const cJSON *to)
+{
+	if ((get_type(from) != cJSON_Object) || (get_type(to) != cJSON_Object)) {
+		return NULL;
+	}
+	return diff_objects(from, to);
+}
+
+cJSON *apply_merge_patch(const cJSON *target, const cJSON *patch)
+{
+	if (get_type(patch) != cJSON_Object) {
+		return cJSON_Duplicate(patch, 1);
+	}
+
+	cJSON *result;
+	if ((target != NULL) && (get_type(target) == cJSON_Object)) {
+		result = cJSON_Duplicate(target, 1);
+	} else {
+		result = cJSON_CreateObject();
+	}
+	if (unlikely(result == NULL)) {
+		return NULL;
+	}
+
+	for (const cJSON *item = patch->child; item != NULL; item = item->next) {
+		unsigned int index;
+		cJSON *old = find_member(result, item->string, &index);
+		if (get_type(item) == cJSON_NULL) {
+			if (old != NULL) {
+				cJSON_DeleteItemFromArray(result, index);
+			}
+			continue;
+		}
+
+		cJSON *value = apply_merge_patch(old, item);
+		if (unlikely(value == NULL)) {
+			cJSON_Delete(result);
+			return NULL;
+		}
+		if (old != NULL) {
+			/* Keep the position and reuse the name of the replaced member. */
+			if (value->string != NULL) {
+				cJSON_free(value->string);
+			}
+			value->string = old->string;
+			old->string = NULL;
+			cJSON_ReplaceItemInArray(result, index, value);
+		} else {
+			cJSON_AddItemToObject(result, item->string, value);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,62 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_JSON_PATCH_H
+#define CJET_JSON_PATCH_H
+
+#include <stdbool.h>
+
+#include "json/cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Helpers for JSON merge patches (RFC 7386). Object members are compared
+ * case sensitive, arrays are always replaced as a whole.
+ */
+
+bool json_equal(const cJSON *a, const cJSON *b);
+
+/*
+ * Creates the merge patch transforming "from" into "to". Returns NULL if
+ * both are not objects, if "to" contains a null member (which a merge
+ * patch can't express) or on memory exhaustion.
+ */
+cJSON *create_merge_patch(const cJSON *from, const cJSON *to);
+
+/*
+ * Returns a new document with patch applied to target or NULL on memory
+ * exhaustion. target might be NULL.
+ */
+cJSON *apply_merge_patch(const cJSON *target, const cJSON *patch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -108,6 +108,9 @@ int eventloop_epoll_run(const void *this_ptr, const int *go_ahead)
 			return -1;
 			break;
 		}
+		if (loop->events_handled != NULL) {
+			loop->events_handled();
+		}
 	}
 	return 0;
 }
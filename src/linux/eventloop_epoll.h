@@ -36,6 +36,7 @@ extern "C" {
 struct eventloop_epoll {
 	int epoll_fd;
 	struct eventloop loop;
+	void (*events_handled)(void); /* Called after all events of an epoll_wait() are handled, might be NULL */
 };
 
 int eventloop_epoll_init(void *this_ptr);
@@ -49,6 +49,7 @@
 #include "jet_server.h"
 #include "linux/linux_io.h"
 #include "log.h"
+#include "snapshot.h"
 #include "socket_peer.h"
 #include "util.h"
 #include "websocket.h"
@@ -462,21 +463,28 @@ static int drop_privileges(const char *user_name)
 	return 0;
 }
 
-static int run_jet(const struct eventloop *loop, const struct cmdline_config *config)
+static int run_jet(struct eventloop *loop, const struct cmdline_config *config)
 {
 	if ((config->user_name != NULL) && drop_privileges(config->user_name) < 0) {
 		log_err("Can't drop privileges of cjet!\n");
 		return -1;
 	}
 
+	if ((config->snapshot_file != NULL) && (snapshot_start(config->snapshot_file, loop) < 0)) {
+		log_err("Can't start snapshots of states!\n");
+		return -1;
+	}
+
 	if (!config->run_foreground) {
 		if (daemon(0, 0) != 0) {
 			log_err("Can't daemonize cjet!\n");
+			snapshot_stop();
 			return -1;
 		}
 	}
 
 	int ret = loop->run(loop->this_ptr, &go_ahead);
+	snapshot_stop();
 	destroy_all_peers();
 	return ret;
 }
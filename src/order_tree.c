@@ -0,0 +1,201 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "order_tree.h"
+
+static unsigned int subtree_size(const struct order_tree_node *node)
+{
+	return (node == NULL) ? 0 : node->size;
+}
+
+static void update_size(struct order_tree_node *node)
+{
+	node->size = subtree_size(node->left) + subtree_size(node->right) + 1;
+}
+
+static uint32_t next_priority(struct order_tree *tree)
+{
+	/* xorshift32 */
+	uint32_t x = tree->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	tree->seed = x;
+	return x;
+}
+
+static void replace_child(struct order_tree *tree, struct order_tree_node *parent, struct order_tree_node *old_child, struct order_tree_node *new_child)
+{
+	if (parent == NULL) {
+		tree->root = new_child;
+	} else if (parent->left == old_child) {
+		parent->left = new_child;
+	} else {
+		parent->right = new_child;
+	}
+}
+
+/*
+ * Rotates node above its parent, keeping the in-order sequence intact.
+ */
+static void rotate_up(struct order_tree *tree, struct order_tree_node *node)
+{
+	struct order_tree_node *parent = node->parent;
+	struct order_tree_node *grandparent = parent->parent;
+
+	if (parent->left == node) {
+		parent->left = node->right;
+		if (node->right != NULL) {
+			node->right->parent = parent;
+		}
+		node->right = parent;
+	} else {
+		parent->right = node->left;
+		if (node->left != NULL) {
+			node->left->parent = parent;
+		}
+		node->left = parent;
+	}
+
+	parent->parent = node;
+	node->parent = grandparent;
+	replace_child(tree, grandparent, parent, node);
+
+	update_size(parent);
+	update_size(node);
+}
+
+void order_tree_init(struct order_tree *tree, order_tree_compare compare)
+{
+	tree->root = NULL;
+	tree->compare = compare;
+	tree->seed = 2463534242U;
+}
+
+unsigned int order_tree_insert(struct order_tree *tree, struct order_tree_node *node)
+{
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = NULL;
+	node->size = 1;
+	node->priority = next_priority(tree);
+
+	struct order_tree_node *parent = NULL;
+	struct order_tree_node **link = &tree->root;
+	while (*link != NULL) {
+		parent = *link;
+		parent->size++;
+		if (tree->compare(node, parent) < 0) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+		}
+	}
+	node->parent = parent;
+	*link = node;
+
+	while ((node->parent != NULL) && (node->parent->priority < node->priority)) {
+		rotate_up(tree, node);
+	}
+
+	return order_tree_rank(node);
+}
+
+void order_tree_remove(struct order_tree *tree, struct order_tree_node *node)
+{
+	while ((node->left != NULL) || (node->right != NULL)) {
+		struct order_tree_node *child;
+		if (node->left == NULL) {
+			child = node->right;
+		} else if (node->right == NULL) {
+			child = node->left;
+		} else {
+			child = (node->left->priority > node->right->priority) ? node->left : node->right;
+		}
+		rotate_up(tree, child);
+	}
+
+	struct order_tree_node *parent = node->parent;
+	replace_child(tree, parent, node, NULL);
+	while (parent != NULL) {
+		parent->size--;
+		parent = parent->parent;
+	}
+	node->parent = NULL;
+}
+
+unsigned int order_tree_rank(const struct order_tree_node *node)
+{
+	unsigned int rank = subtree_size(node->left) + 1;
+	while (node->parent != NULL) {
+		if (node->parent->right == node) {
+			rank += subtree_size(node->parent->left) + 1;
+		}
+		node = node->parent;
+	}
+	return rank;
+}
+
+struct order_tree_node *order_tree_select(const struct order_tree *tree, unsigned int rank)
+{
+	struct order_tree_node *node = tree->root;
+	while (node != NULL) {
+		unsigned int left_size = subtree_size(node->left);
+		if (rank <= left_size) {
+			node = node->left;
+		} else if (rank == left_size + 1) {
+			return node;
+		} else {
+			rank -= left_size + 1;
+			node = node->right;
+		}
+	}
+	return NULL;
+}
+
+struct order_tree_node *order_tree_next(struct order_tree_node *node)
+{
+	if (node->right != NULL) {
+		node = node->right;
+		while (node->left != NULL) {
+			node = node->left;
+		}
+		return node;
+	}
+
+	while ((node->parent != NULL) && (node->parent->right == node)) {
+		node = node->parent;
+	}
+	return node->parent;
+}
+
+unsigned int order_tree_size(const struct order_tree *tree)
+{
+	return subtree_size(tree->root);
+}
@@ -0,0 +1,71 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_ORDER_TREE_H
+#define CJET_ORDER_TREE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An order statistic tree: a balanced binary search tree (a treap) where
+ * every node knows the size of its subtree. Besides inserting and
+ * removing, this allows to get the rank of a node and the node at a
+ * given rank in O(log n). Nodes are embedded in the user's structure,
+ * ranks start at 1.
+ */
+struct order_tree_node {
+	struct order_tree_node *parent;
+	struct order_tree_node *left;
+	struct order_tree_node *right;
+	uint32_t priority;
+	unsigned int size;
+};
+
+typedef int (*order_tree_compare)(const struct order_tree_node *a, const struct order_tree_node *b);
+
+struct order_tree {
+	struct order_tree_node *root;
+	order_tree_compare compare;
+	uint32_t seed;
+};
+
+void order_tree_init(struct order_tree *tree, order_tree_compare compare);
+unsigned int order_tree_insert(struct order_tree *tree, struct order_tree_node *node);
+void order_tree_remove(struct order_tree *tree, struct order_tree_node *node);
+unsigned int order_tree_rank(const struct order_tree_node *node);
+struct order_tree_node *order_tree_select(const struct order_tree *tree, unsigned int rank);
+struct order_tree_node *order_tree_next(struct order_tree_node *node);
+unsigned int order_tree_size(const struct order_tree *tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
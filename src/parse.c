@@ -24,11 +24,13 @@
  * SOFTWARE.
  */
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "alloc.h"
+#include "arena.h"
 #include "authenticate.h"
 #include "compiler.h"
 #include "config.h"
@@ -36,6 +38,7 @@
 #include "fetch.h"
 #include "generated/cjet_config.h"
 #include "info.h"
+#include "json_index.h"
 #include "linux/linux_io.h"
 #include "parse.h"
 #include "peer.h"
@@ -43,6 +46,44 @@
 #include "router.h"
 #include "json/cJSON.h"
 
+/*
+ * The parsed request and the rendered response live in an arena that is
+ * released after each message, so they are never deleted. cJSON_free()
+ * ignores memory of the arena anyway.
+ */
+static bool use_message_arena = false;
+
+static void *message_malloc(size_t size)
+{
+	if (use_message_arena) {
+		return message_arena_alloc(size);
+	}
+	return cjet_malloc(size);
+}
+
+static void message_free(void *ptr)
+{
+	if (!message_arena_owns(ptr)) {
+		cjet_free(ptr);
+	}
+}
+
+static char *render_in_message_arena(const cJSON *json)
+{
+	use_message_arena = true;
+	char *rendered = cJSON_PrintUnformatted(json);
+	use_message_arena = false;
+	return rendered;
+}
+
+static cJSON *parse_in_message_arena(const char *json, const char **end_parse)
+{
+	use_message_arena = true;
+	cJSON *parsed = cJSON_ParseWithOpts(json, end_parse, 0);
+	use_message_arena = false;
+	return parsed;
+}
+
 static int send_response(cJSON *response, const struct peer *p)
 {
 	if (response == NULL) {
@@ -50,15 +91,17 @@ static int send_response(cJSON *response, const struct peer *p)
 	}
 
 	int ret;
-	char *rendered = cJSON_PrintUnformatted(response);
+	char *rendered = render_in_message_arena(response);
 	if (unlikely(rendered == NULL)) {
 		log_peer_err(p, "Could not render JSON into a string!\n");
 		ret = -1;
 		goto render_error;
 	}
 
-	ret = p->send_message(p, rendered, strlen(rendered));
-	cJSON_free(rendered);
+	ret = flush_notification_batch(p);
+	if (likely(ret == 0)) {
+		ret = p->send_message(p, rendered, strlen(rendered));
+	}
 
 render_error:
 	cJSON_Delete(response);
@@ -76,7 +119,7 @@ static cJSON *process_fetch(const cJSON *json_rpc, struct peer *p)
 	return add_fetch_to_states(p, json_rpc, f);
 }
 
-static cJSON *handle_method(const cJSON *request, const char *method_name,
+static cJSON *handle_method(cJSON *request, const char *method_name,
                             struct peer *p)
 {
 	if (strcmp(method_name, "change") == 0) {
@@ -89,6 +132,12 @@ static cJSON *handle_method(const cJSON *request, const char *method_name,
 		return add_element_to_peer(p, request);
 	} else if (strcmp(method_name, "remove") == 0) {
 		return remove_element_from_peer(p, request);
+	} else if (strcmp(method_name, "addBatch") == 0) {
+		return add_elements_to_peer(p, request);
+	} else if (strcmp(method_name, "removeBatch") == 0) {
+		return remove_elements_from_peer(p, request);
+	} else if (strcmp(method_name, "changeBatch") == 0) {
+		return change_states(p, request);
 	} else if (strcmp(method_name, "fetch") == 0) {
 		return process_fetch(request, p);
 	} else if (strcmp(method_name, "unfetch") == 0) {
@@ -108,7 +157,7 @@ static cJSON *handle_method(const cJSON *request, const char *method_name,
 	}
 }
 
-static int parse_json_rpc(const cJSON *request, struct peer *p)
+static int parse_json_rpc(cJSON *request, struct peer *p)
 {
 	cJSON *response;
 
@@ -159,12 +208,93 @@ static int parse_json_array(cJSON *root, struct peer *p)
 	return 0;
 }
 
-int parse_message(const char *msg, uint32_t length, struct peer *p)
+/*
+ * Messages are indexed in place first. change, set and call are handled
+ * on the index without a cJSON tree of the request. Everything else,
+ * messages with more tokens and all requests the indexed handlers
+ * decline are parsed completely.
+ *
+ * Only the request, its params and their members get tokens, values
+ * are validated but not indexed.
+ */
+enum { MAX_INDEXED_TOKENS = 64 };
+enum { INDEXED_DEPTH = 2 };
+
+static cJSON *create_request_from_index(const struct json_index *index)
+{
+	use_message_arena = true;
+	cJSON *request = cJSON_CreateObject();
+	use_message_arena = false;
+	if (unlikely(request == NULL)) {
+		return NULL;
+	}
+
+	unsigned int id = json_index_get_member(index, 0, "id");
+	if (id != JSON_INDEX_NO_TOKEN) {
+		cJSON *json_id = parse_in_message_arena(json_index_token_text(index, id), NULL);
+		if (unlikely(json_id == NULL)) {
+			return NULL;
+		}
+		use_message_arena = true;
+		cJSON_AddItemToObject(request, "id", json_id);
+		use_message_arena = false;
+	}
+	return request;
+}
+
+static int handle_indexed_request(const struct json_index *index, struct peer *p)
+{
+	if ((index->tokens[0].type != JSON_TOKEN_OBJECT) || index->escaped_keys) {
+		return INDEXED_REQUEST_DECLINED;
+	}
+
+	unsigned int method = json_index_get_member(index, 0, "method");
+	unsigned int params = json_index_get_member(index, 0, "params");
+	if ((method == JSON_INDEX_NO_TOKEN) || (params == JSON_INDEX_NO_TOKEN) ||
+	    (index->tokens[params].type != JSON_TOKEN_OBJECT)) {
+		return INDEXED_REQUEST_DECLINED;
+	}
+
+	bool is_change = json_index_string_equals(index, method, "change");
+	bool is_set = json_index_string_equals(index, method, "set");
+	if (!is_change && !is_set && !json_index_string_equals(index, method, "call")) {
+		return INDEXED_REQUEST_DECLINED;
+	}
+
+	cJSON *request = create_request_from_index(index);
+	if (unlikely(request == NULL)) {
+		return INDEXED_REQUEST_DECLINED;
+	}
+
+	cJSON *response = NULL;
+	int ret;
+	if (is_change) {
+		ret = change_state_indexed(p, request, index, params, &response);
+	} else {
+		ret = set_or_call_indexed(p, request, index, params, is_set ? STATE : METHOD, &response);
+	}
+	if (ret == 0) {
+		ret = send_response(response, p);
+	}
+	return ret;
+}
+
+static int handle_message(const char *msg, uint32_t length, struct peer *p)
 {
 	int ret = 0;
 
+	struct json_token tokens[MAX_INDEXED_TOKENS];
+	struct json_index index;
+	json_index_init(&index, tokens, MAX_INDEXED_TOKENS, INDEXED_DEPTH);
+	if (json_index_parse(&index, msg, length) == 0) {
+		int indexed_ret = handle_indexed_request(&index, p);
+		if (indexed_ret != INDEXED_REQUEST_DECLINED) {
+			return indexed_ret;
+		}
+	}
+
 	const char *end_parse;
-	cJSON *root = cJSON_ParseWithOpts(msg, &end_parse, 0);
+	cJSON *root = parse_in_message_arena(msg, &end_parse);
 	if (unlikely(root == NULL)) {
 		log_peer_err(p, "Could not parse JSON!\n");
 		return -1;
@@ -176,8 +306,7 @@ int parse_message(const char *msg, uint32_t length, struct peer *p)
 			log_peer_err(p, "length of parsed JSON (%td) does not "
 			                "match message length (%u)!\n",
 			             parsed_length, length);
-			ret = -1;
-			goto out;
+			return -1;
 		}
 	}
 
@@ -196,15 +325,20 @@ int parse_message(const char *msg, uint32_t length, struct peer *p)
 		break;
 	}
 
-out:
-	cJSON_Delete(root);
+	return ret;
+}
+
+int parse_message(const char *msg, uint32_t length, struct peer *p)
+{
+	int ret = handle_message(msg, length, p);
+	message_arena_reset();
 	return ret;
 }
 
 void init_parser(void)
 {
 	cJSON_Hooks hooks = {
-	    .malloc_fn = cjet_malloc,
-	    .free_fn = cjet_free};
+	    .malloc_fn = message_malloc,
+	    .free_fn = message_free};
 	cJSON_InitHooks(&hooks);
 }
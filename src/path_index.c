@@ -0,0 +1,635 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "path_index.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/*
+ * Up to MAX_PREFIX_LENGTH bytes of the compressed path part of a node
+ * are stored in the node. Longer parts are compared with the path of
+ * any leaf below the node.
+ */
+enum { MAX_PREFIX_LENGTH = 10 };
+
+enum node_type { NODE4, NODE16, NODE48, NODE256 };
+
+struct node {
+	uint8_t type;
+	uint16_t number_of_children;
+	uint32_t prefix_length;
+	unsigned char prefix[MAX_PREFIX_LENGTH];
+};
+
+struct node4 {
+	struct node n;
+	unsigned char keys[4];
+	struct node *children[4];
+};
+
+struct node16 {
+	struct node n;
+	unsigned char keys[16];
+	struct node *children[16];
+};
+
+struct node48 {
+	struct node n;
+	unsigned char child_index[256]; /* Index + 1 into children, 0 if there is no child */
+	struct node *children[48];
+};
+
+struct node256 {
+	struct node n;
+	struct node *children[256];
+};
+
+static struct node *root = NULL;
+
+/*
+ * Leaves are pointers to the entries with the lowest bit set. The
+ * terminating zero of a path is used as the last key byte, so no leaf
+ * is stored at the position of an inner node.
+ */
+static bool is_leaf(const struct node *n)
+{
+	return ((uintptr_t)n & 1U) != 0;
+}
+
+static struct node *make_leaf(const struct path_index_entry *entry)
+{
+	return (struct node *)((uintptr_t)entry | 1U);
+}
+
+static struct path_index_entry *get_leaf(const struct node *n)
+{
+	return (struct path_index_entry *)((uintptr_t)n & ~(uintptr_t)1U);
+}
+
+static struct node *alloc_node(enum node_type type)
+{
+	static const size_t sizes[] = {sizeof(struct node4), sizeof(struct node16), sizeof(struct node48), sizeof(struct node256)};
+	struct node *n = cjet_calloc(1, sizes[type]);
+	if (likely(n != NULL)) {
+		n->type = type;
+	}
+	return n;
+}
+
+static void copy_header(struct node *dest, const struct node *src)
+{
+	dest->number_of_children = src->number_of_children;
+	dest->prefix_length = src->prefix_length;
+	memcpy(dest->prefix, src->prefix, MIN(src->prefix_length, MAX_PREFIX_LENGTH));
+}
+
+static struct node **find_child(struct node *n, unsigned char c)
+{
+	switch (n->type) {
+	case NODE4: {
+		struct node4 *n4 = (struct node4 *)n;
+		for (unsigned int i = 0; i < n->number_of_children; i++) {
+			if (n4->keys[i] == c) {
+				return &n4->children[i];
+			}
+		}
+		return NULL;
+	}
+	case NODE16: {
+		struct node16 *n16 = (struct node16 *)n;
+		for (unsigned int i = 0; i < n->number_of_children; i++) {
+			if (n16->keys[i] == c) {
+				return &n16->children[i];
+			}
+		}
+		return NULL;
+	}
+	case NODE48: {
+		struct node48 *n48 = (struct node48 *)n;
+		unsigned int index = n48->child_index[c];
+		return (index != 0) ? &n48->children[index - 1] : NULL;
+	}
+	default: {
+		struct node256 *n256 = (struct node256 *)n;
+		return (n256->children[c] != NULL) ? &n256->children[c] : NULL;
+	}
+	}
+}
+
+static const struct path_index_entry *minimum(const struct node *n)
+{
+	while (!is_leaf(n)) {
+		switch (n->type) {
+		case NODE4:
+			n = ((const struct node4 *)n)->children[0];
+			break;
+		case NODE16:
+			n = ((const struct node16 *)n)->children[0];
+			break;
+		case NODE48: {
+			const struct node48 *n48 = (const struct node48 *)n;
+			unsigned int i = 0;
+			while (n48->child_index[i] == 0) {
+				i++;
+			}
+			n = n48->children[n48->child_index[i] - 1];
+			break;
+		}
+		default: {
+			const struct node256 *n256 = (const struct node256 *)n;
+			unsigned int i = 0;
+			while (n256->children[i] == NULL) {
+				i++;
+			}
+			n = n256->children[i];
+			break;
+		}
+		}
+	}
+	return get_leaf(n);
+}
+
+/*
+ * Returns the number of bytes of the compressed path of n that are
+ * equal to key, starting at depth.
+ */
+static size_t prefix_mismatch(const struct node *n, const char *key, size_t key_length, size_t depth)
+{
+	size_t max_compare = MIN(MIN(n->prefix_length, MAX_PREFIX_LENGTH), key_length - depth);
+	size_t i;
+	for (i = 0; i < max_compare; i++) {
+		if (n->prefix[i] != (unsigned char)key[depth + i]) {
+			return i;
+		}
+	}
+
+	if (n->prefix_length > MAX_PREFIX_LENGTH) {
+		const char *leaf_path = minimum(n)->path;
+		max_compare = MIN(n->prefix_length, key_length - depth);
+		for (; i < max_compare; i++) {
+			if (leaf_path[depth + i] != key[depth + i]) {
+				return i;
+			}
+		}
+	}
+	return i;
+}
+
+static void insert_key(unsigned char *keys, struct node **children, unsigned int number_of_children, unsigned char c, struct node *child)
+{
+	unsigned int pos = 0;
+	while ((pos < number_of_children) && (keys[pos] < c)) {
+		pos++;
+	}
+	memmove(&keys[pos + 1], &keys[pos], number_of_children - pos);
+	memmove(&children[pos + 1], &children[pos], (number_of_children - pos) * sizeof(*children));
+	keys[pos] = c;
+	children[pos] = child;
+}
+
+static int add_child(struct node *n, struct node **ref, unsigned char c, struct node *child);
+
+static int add_child4(struct node4 *n4, struct node **ref, unsigned char c, struct node *child)
+{
+	if (n4->n.number_of_children < 4) {
+		insert_key(n4->keys, n4->children, n4->n.number_of_children, c, child);
+		n4->n.number_of_children++;
+		return 0;
+	}
+
+	struct node16 *n16 = (struct node16 *)alloc_node(NODE16);
+	if (unlikely(n16 == NULL)) {
+		return -1;
+	}
+	copy_header(&n16->n, &n4->n);
+	memcpy(n16->keys, n4->keys, sizeof(n4->keys));
+	memcpy(n16->children, n4->children, sizeof(n4->children));
+	*ref = &n16->n;
+	cjet_free(n4);
+	return add_child(&n16->n, ref, c, child);
+}
+
+static int add_child16(struct node16 *n16, struct node **ref, unsigned char c, struct node *child)
+{
+	if (n16->n.number_of_children < 16) {
+		insert_key(n16->keys, n16->children, n16->n.number_of_children, c, child);
+		n16->n.number_of_children++;
+		return 0;
+	}
+
+	struct node48 *n48 = (struct node48 *)alloc_node(NODE48);
+	if (unlikely(n48 == NULL)) {
+		return -1;
+	}
+	copy_header(&n48->n, &n16->n);
+	memcpy(n48->children, n16->children, sizeof(n16->children));
+	for (unsigned int i = 0; i < 16; i++) {
+		n48->child_index[n16->keys[i]] = i + 1;
+	}
+	*ref = &n48->n;
+	cjet_free(n16);
+	return add_child(&n48->n, ref, c, child);
+}
+
+static int add_child48(struct node48 *n48, struct node **ref, unsigned char c, struct node *child)
+{
+	if (n48->n.number_of_children < 48) {
+		unsigned int pos = 0;
+		while (n48->children[pos] != NULL) {
+			pos++;
+		}
+		n48->children[pos] = child;
+		n48->child_index[c] = pos + 1;
+		n48->n.number_of_children++;
+		return 0;
+	}
+
+	struct node256 *n256 = (struct node256 *)alloc_node(NODE256);
+	if (unlikely(n256 == NULL)) {
+		return -1;
+	}
+	copy_header(&n256->n, &n48->n);
+	for (unsigned int i = 0; i < 256; i++) {
+		if (n48->child_index[i] != 0) {
+			n256->children[i] = n48->children[n48->child_index[i] - 1];
+		}
+	}
+	*ref = &n256->n;
+	cjet_free(n48);
+	return add_child(&n256->n, ref, c, child);
+}
+
+static int add_child(struct node *n, struct node **ref, unsigned char c, struct node *child)
+{
+	switch (n->type) {
+	case NODE4:
+		return add_child4((struct node4 *)n, ref, c, child);
+	case NODE16:
+		return add_child16((struct node16 *)n, ref, c, child);
+	case NODE48:
+		return add_child48((struct node48 *)n, ref, c, child);
+	default: {
+		struct node256 *n256 = (struct node256 *)n;
+		n256->children[c] = child;
+		n256->n.number_of_children++;
+		return 0;
+	}
+	}
+}
+
+static int insert(struct node **ref, const struct path_index_entry *entry, size_t key_length, size_t depth)
+{
+	const char *key = entry->path;
+	struct node *n = *ref;
+	if (n == NULL) {
+		*ref = make_leaf(entry);
+		return 0;
+	}
+
+	if (is_leaf(n)) {
+		const char *leaf_path = get_leaf(n)->path;
+		size_t common = 0;
+		while (key[depth + common] == leaf_path[depth + common]) {
+			if (key[depth + common] == '\0') {
+				return -1;
+			}
+			common++;
+		}
+
+		struct node4 *n4 = (struct node4 *)alloc_node(NODE4);
+		if (unlikely(n4 == NULL)) {
+			return -1;
+		}
+		n4->n.prefix_length = common;
+		memcpy(n4->n.prefix, &key[depth], MIN(common, MAX_PREFIX_LENGTH));
+		add_child4(n4, ref, (unsigned char)leaf_path[depth + common], n);
+		add_child4(n4, ref, (unsigned char)key[depth + common], make_leaf(entry));
+		*ref = &n4->n;
+		return 0;
+	}
+
+	if (n->prefix_length > 0) {
+		size_t mismatch = prefix_mismatch(n, key, key_length, depth);
+		if (mismatch < n->prefix_length) {
+			struct node4 *n4 = (struct node4 *)alloc_node(NODE4);
+			if (unlikely(n4 == NULL)) {
+				return -1;
+			}
+			n4->n.prefix_length = mismatch;
+			memcpy(n4->n.prefix, n->prefix, MIN(mismatch, MAX_PREFIX_LENGTH));
+			if (n->prefix_length <= MAX_PREFIX_LENGTH) {
+				add_child4(n4, ref, n->prefix[mismatch], n);
+				n->prefix_length -= mismatch + 1;
+				memmove(n->prefix, &n->prefix[mismatch + 1], MIN(n->prefix_length, MAX_PREFIX_LENGTH));
+			} else {
+				const char *leaf_path = minimum(n)->path;
+				add_child4(n4, ref, (unsigned char)leaf_path[depth + mismatch], n);
+				n->prefix_length -= mismatch + 1;
+				memcpy(n->prefix, &leaf_path[depth + mismatch + 1], MIN(n->prefix_length, MAX_PREFIX_LENGTH));
+			}
+			add_child4(n4, ref, (unsigned char)key[depth + mismatch], make_leaf(entry));
+			*ref = &n4->n;
+			return 0;
+		}
+		depth += n->prefix_length;
+	}
+	if (unlikely(depth >= key_length)) {
+		return -1;
+	}
+
+	struct node **child = find_child(n, (unsigned char)key[depth]);
+	if (child != NULL) {
+		return insert(child, entry, key_length, depth + 1);
+	}
+	return add_child(n, ref, (unsigned char)key[depth], make_leaf(entry));
+}
+
+int path_index_insert(struct path_index_entry *entry)
+{
+	return insert(&root, entry, strlen(entry->path) + 1, 0);
+}
+
+static void remove_child4(struct node4 *n4, struct node **ref, struct node **child_ref)
+{
+	unsigned int pos = (unsigned int)(child_ref - n4->children);
+	unsigned int number_to_move = n4->n.number_of_children - pos - 1;
+	memmove(&n4->keys[pos], &n4->keys[pos + 1], number_to_move);
+	memmove(&n4->children[pos], &n4->children[pos + 1], number_to_move * sizeof(*n4->children));
+	n4->n.number_of_children--;
+	if (n4->n.number_of_children > 1) {
+		return;
+	}
+
+	/*
+	 * A node with a single child is merged into the child, the
+	 * compressed path of the child becomes the path of the node, its
+	 * key byte and the former compressed path of the child.
+	 */
+	struct node *child = n4->children[0];
+	if (!is_leaf(child)) {
+		size_t prefix_length = n4->n.prefix_length;
+		if (prefix_length < MAX_PREFIX_LENGTH) {
+			n4->n.prefix[prefix_length] = n4->keys[0];
+			prefix_length++;
+		}
+		if (prefix_length < MAX_PREFIX_LENGTH) {
+			size_t length = MIN(child->prefix_length, MAX_PREFIX_LENGTH - prefix_length);
+			memcpy(&n4->n.prefix[prefix_length], child->prefix, length);
+			prefix_length += length;
+		}
+		memcpy(child->prefix, n4->n.prefix, MIN(prefix_length, MAX_PREFIX_LENGTH));
+		child->prefix_length += n4->n.prefix_length + 1;
+	}
+	*ref = child;
+	cjet_free(n4);
+}
+
+static void remove_child16(struct node16 *n16, struct node **ref, struct node **child_ref)
+{
+	unsigned int pos = (unsigned int)(child_ref - n16->children);
+	unsigned int number_to_move = n16->n.number_of_children - pos - 1;
+	memmove(&n16->keys[pos], &n16->keys[pos + 1], number_to_move);
+	memmove(&n16->children[pos], &n16->children[pos + 1], number_to_move * sizeof(*n16->children));
+	n16->n.number_of_children--;
+	if (n16->n.number_of_children > 3) {
+		return;
+	}
+
+	struct node4 *n4 = (struct node4 *)alloc_node(NODE4);
+	if (unlikely(n4 == NULL)) {
+		return;
+	}
+	copy_header(&n4->n, &n16->n);
+	memcpy(n4->keys, n16->keys, 3);
+	memcpy(n4->children, n16->children, 3 * sizeof(*n4->children));
+	*ref = &n4->n;
+	cjet_free(n16);
+}
+
+static void remove_child48(struct node48 *n48, struct node **ref, unsigned char c)
+{
+	n48->children[n48->child_index[c] - 1] = NULL;
+	n48->child_index[c] = 0;
+	n48->n.number_of_children--;
+	if (n48->n.number_of_children > 12) {
+		return;
+	}
+
+	struct node16 *n16 = (struct node16 *)alloc_node(NODE16);
+	if (unlikely(n16 == NULL)) {
+		return;
+	}
+	copy_header(&n16->n, &n48->n);
+	unsigned int pos = 0;
+	for (unsigned int i = 0; i < 256; i++) {
+		if (n48->child_index[i] != 0) {
+			n16->keys[pos] = (unsigned char)i;
+			n16->children[pos] = n48->children[n48->child_index[i] - 1];
+			pos++;
+		}
+	}
+	*ref = &n16->n;
+	cjet_free(n48);
+}
+
+static void remove_child256(struct node256 *n256, struct node **ref, unsigned char c)
+{
+	n256->children[c] = NULL;
+	n256->n.number_of_children--;
+	if (n256->n.number_of_children > 37) {
+		return;
+	}
+
+	struct node48 *n48 = (struct node48 *)alloc_node(NODE48);
+	if (unlikely(n48 == NULL)) {
+		return;
+	}
+	copy_header(&n48->n, &n256->n);
+	unsigned int pos = 0;
+	for (unsigned int i = 0; i < 256; i++) {
+		if (n256->children[i] != NULL) {
+			n48->children[pos] = n256->children[i];
+			n48->child_index[i] = pos + 1;
+			pos++;
+		}
+	}
+	*ref = &n48->n;
+	cjet_free(n256);
+}
+
+static void remove_child(struct node *n, struct node **ref, unsigned char c, struct node **child_ref)
+{
+	switch (n->type) {
+	case NODE4:
+		remove_child4((struct node4 *)n, ref, child_ref);
+		break;
+	case NODE16:
+		remove_child16((struct node16 *)n, ref, child_ref);
+		break;
+	case NODE48:
+		remove_child48((struct node48 *)n, ref, c);
+		break;
+	default:
+		remove_child256((struct node256 *)n, ref, c);
+		break;
+	}
+}
+
+static void remove_leaf(struct node **ref, const struct path_index_entry *entry, size_t key_length, size_t depth)
+{
+	struct node *n = *ref;
+	if (n == NULL) {
+		return;
+	}
+	if (is_leaf(n)) {
+		if (get_leaf(n) == entry) {
+			*ref = NULL;
+		}
+		return;
+	}
+
+	const char *key = entry->path;
+	if (n->prefix_length > 0) {
+		if (prefix_mismatch(n, key, key_length, depth) != n->prefix_length) {
+			return;
+		}
+		depth += n->prefix_length;
+	}
+	if (depth >= key_length) {
+		return;
+	}
+
+	unsigned char c = (unsigned char)key[depth];
+	struct node **child = find_child(n, c);
+	if (child == NULL) {
+		return;
+	}
+	if (is_leaf(*child)) {
+		if (get_leaf(*child) == entry) {
+			remove_child(n, ref, c, child);
+		}
+		return;
+	}
+	remove_leaf(child, entry, key_length, depth + 1);
+}
+
+void path_index_remove(struct path_index_entry *entry)
+{
+	remove_leaf(&root, entry, strlen(entry->path) + 1, 0);
+}
+
+static int visit_all(const struct node *n, path_index_visitor visitor, void *context)
+{
+	if (is_leaf(n)) {
+		return visitor(get_leaf(n), context);
+	}
+
+	int ret = 0;
+	switch (n->type) {
+	case NODE4: {
+		const struct node4 *n4 = (const struct node4 *)n;
+		for (unsigned int i = 0; (i < n->number_of_children) && (ret == 0); i++) {
+			ret = visit_all(n4->children[i], visitor, context);
+		}
+		break;
+	}
+	case NODE16: {
+		const struct node16 *n16 = (const struct node16 *)n;
+		for (unsigned int i = 0; (i < n->number_of_children) && (ret == 0); i++) {
+			ret = visit_all(n16->children[i], visitor, context);
+		}
+		break;
+	}
+	case NODE48: {
+		const struct node48 *n48 = (const struct node48 *)n;
+		for (unsigned int i = 0; (i < 256) && (ret == 0); i++) {
+			if (n48->child_index[i] != 0) {
+				ret = visit_all(n48->children[n48->child_index[i] - 1], visitor, context);
+			}
+		}
+		break;
+	}
+	default: {
+		const struct node256 *n256 = (const struct node256 *)n;
+		for (unsigned int i = 0; (i < 256) && (ret == 0); i++) {
+			if (n256->children[i] != NULL) {
+				ret = visit_all(n256->children[i], visitor, context);
+			}
+		}
+		break;
+	}
+	}
+	return ret;
+}
+
+/*
+ * All paths below n are equal up to the current depth, but bytes of
+ * compressed paths longer than MAX_PREFIX_LENGTH were not compared
+ * yet, so a single path is checked before visiting the subtree.
+ */
+static int visit_if_prefix_matches(const struct node *n, const char *prefix, size_t prefix_length, path_index_visitor visitor, void *context)
+{
+	if (strncmp(minimum(n)->path, prefix, prefix_length) != 0) {
+		return 0;
+	}
+	return visit_all(n, visitor, context);
+}
+
+int path_index_visit_prefix(const char *prefix, path_index_visitor visitor, void *context)
+{
+	size_t prefix_length = strlen(prefix);
+	struct node *n = root;
+	size_t depth = 0;
+
+	while (n != NULL) {
+		if (is_leaf(n) || (depth == prefix_length)) {
+			return visit_if_prefix_matches(n, prefix, prefix_length, visitor, context);
+		}
+
+		if (n->prefix_length > 0) {
+			size_t match = prefix_mismatch(n, prefix, prefix_length, depth);
+			if (depth + match == prefix_length) {
+				return visit_if_prefix_matches(n, prefix, prefix_length, visitor, context);
+			}
+			if (match < n->prefix_length) {
+				return 0;
+			}
+			depth += n->prefix_length;
+		}
+
+		struct node **child = find_child(n, (unsigned char)prefix[depth]);
+		n = (child != NULL) ? *child : NULL;
+		depth++;
+	}
+	return 0;
+}
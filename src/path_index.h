@@ -0,0 +1,62 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_PATH_INDEX_H
+#define CJET_PATH_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The path index keeps all elements ordered by their path in an
+ * adaptive radix tree. Inner nodes grow from 4 to 16, 48 and 256
+ * children and store common parts of the paths only once, the paths
+ * themselves are only referenced by the leaves. This allows to visit
+ * all elements whose path starts with a given prefix without looking
+ * at any other element.
+ */
+struct path_index_entry {
+	const char *path;
+};
+
+typedef int (*path_index_visitor)(struct path_index_entry *entry, void *context);
+
+int path_index_insert(struct path_index_entry *entry);
+void path_index_remove(struct path_index_entry *entry);
+
+/*
+ * Calls visitor for all entries whose path starts with prefix, in
+ * ascending order of the paths. Stops and returns the return value of
+ * visitor if that is not 0. visitor must not change the index.
+ */
+int path_index_visit_prefix(const char *prefix, path_index_visitor visitor, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
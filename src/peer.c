@@ -27,13 +27,17 @@
 #include <arpa/inet.h>
 
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "alloc.h"
 #include "compiler.h"
 #include "element.h"
+#include "element_directory.h"
 #include "fetch.h"
 #include "jet_string.h"
 #include "list.h"
@@ -44,6 +48,25 @@
 #include "json/cJSON.h"
 
 static LIST_HEAD(peer_list);
+static LIST_HEAD(pending_batches);
+
+static bool batch_notifications = false;
+
+enum { MIN_BATCH_SIZE = 512, MAX_BATCH_SIZE = 65536 };
+
+/*
+ * The buffer starts with '[' followed by the comma separated messages.
+ * It keeps its size between flushes, so a steady stream of notifications
+ * does not allocate.
+ */
+struct notification_batch {
+	struct list_head next_pending_batch;
+	const struct peer *peer;
+	char *buffer;
+	size_t length;
+	size_t size;
+	unsigned int number_of_messages;
+};
 
 static int number_of_peers = 0;
 
@@ -68,13 +91,35 @@ static void remove_peer_from_routes(const struct peer *peer_to_remove)
 	return;
 }
 
+static struct notification_batch *alloc_notification_batch(const struct peer *p)
+{
+	struct notification_batch *batch = cjet_calloc(1, sizeof(*batch));
+	if (unlikely(batch == NULL)) {
+		return NULL;
+	}
+	INIT_LIST_HEAD(&batch->next_pending_batch);
+	batch->peer = p;
+	return batch;
+}
+
+static void free_notification_batch(struct notification_batch *batch)
+{
+	list_del(&batch->next_pending_batch);
+	if (batch->buffer != NULL) {
+		cjet_free(batch->buffer);
+	}
+	cjet_free(batch);
+}
+
 void free_peer_resources(struct peer *p)
 {
 	remove_routing_info_from_peer(p);
 	remove_peer_from_routes(p);
 	remove_all_fetchers_from_peer(p);
 	remove_all_elements_from_peer(p);
+	element_directory_free(&p->elements);
 	delete_routing_table(p);
+	free_notification_batch(p->batch);
 	list_del(&p->next_peer);
 	if (p->name != NULL) {
 		cjet_free(p->name);
@@ -92,12 +137,17 @@ int init_peer(struct peer *p, bool is_local_connection, struct eventloop *loop)
 	if (unlikely(add_routing_table(p) != 0)) {
 		return -1;
 	}
+	p->batch = alloc_notification_batch(p);
+	if (unlikely(p->batch == NULL)) {
+		delete_routing_table(p);
+		return -1;
+	}
 	p->name = NULL;
 	p->user_name = NULL;
 	p->is_local_connection = is_local_connection;
 	p->loop = loop;
 	INIT_LIST_HEAD(&p->next_peer);
-	INIT_LIST_HEAD(&p->element_list);
+	element_directory_init(&p->elements);
 	INIT_LIST_HEAD(&p->fetch_list);
 
 	list_add_tail(&p->next_peer, &peer_list);
@@ -111,6 +161,9 @@ void set_peer_name(struct peer *peer, const char *name)
 		cjet_free(peer->name);
 	}
 	peer->name = duplicate_string(name);
+	if (peer->elements.number_of_elements > 0) {
+		count_state_change();
+	}
 }
 
 const char *get_peer_name(const struct peer *p)
@@ -132,6 +185,103 @@ void destroy_all_peers(void)
 	}
 }
 
+void set_notification_batching(bool enable)
+{
+	batch_notifications = enable;
+}
+
+static int reserve_batch(struct notification_batch *batch, size_t needed)
+{
+	if (needed <= batch->size) {
+		return 0;
+	}
+	size_t size = (batch->size == 0) ? MIN_BATCH_SIZE : batch->size;
+	while (size < needed) {
+		size *= 2;
+	}
+	char *buffer = cjet_malloc(size);
+	if (unlikely(buffer == NULL)) {
+		return -1;
+	}
+	if (batch->buffer != NULL) {
+		memcpy(buffer, batch->buffer, batch->length);
+		cjet_free(batch->buffer);
+	}
+	batch->buffer = buffer;
+	batch->size = size;
+	return 0;
+}
+
+int queue_notification(const struct peer *p, char *rendered, size_t len)
+{
+	if (!batch_notifications) {
+		return p->send_message(p, rendered, len);
+	}
+
+	struct notification_batch *batch = p->batch;
+	/*
+	 * Bursts like the removal of all states of a peer are sent in
+	 * several batches instead of one growing without limit.
+	 */
+	if ((batch->number_of_messages > 0) && (batch->length + len + 3 > MAX_BATCH_SIZE)) {
+		if (unlikely(flush_notification_batch(p) != 0)) {
+			return -1;
+		}
+	}
+
+	/* Room for the separator, the closing ']' and the terminating '\0'. */
+	if (unlikely(reserve_batch(batch, batch->length + len + 3) < 0)) {
+		log_peer_err(p, "Could not allocate memory for notification batch!\n");
+		return -1;
+	}
+
+	if (batch->number_of_messages == 0) {
+		batch->buffer[0] = '[';
+		batch->length = 1;
+		list_add_tail(&batch->next_pending_batch, &pending_batches);
+	} else {
+		batch->buffer[batch->length++] = ',';
+	}
+	memcpy(batch->buffer + batch->length, rendered, len);
+	batch->length += len;
+	batch->number_of_messages++;
+	return 0;
+}
+
+int flush_notification_batch(const struct peer *p)
+{
+	struct notification_batch *batch = p->batch;
+	if (batch->number_of_messages == 0) {
+		return 0;
+	}
+
+	list_del(&batch->next_pending_batch);
+	INIT_LIST_HEAD(&batch->next_pending_batch);
+	unsigned int number_of_messages = batch->number_of_messages;
+	size_t length = batch->length;
+	batch->number_of_messages = 0;
+	batch->length = 0;
+
+	if (number_of_messages == 1) {
+		batch->buffer[length] = '\0';
+		return p->send_message(p, batch->buffer + 1, length - 1);
+	}
+	batch->buffer[length++] = ']';
+	batch->buffer[length] = '\0';
+	return p->send_message(p, batch->buffer, length);
+}
+
+void flush_all_notification_batches(void)
+{
+	while (!list_empty(&pending_batches)) {
+		const struct notification_batch *batch = list_entry(pending_batches.next, struct notification_batch, next_pending_batch);
+		const struct peer *p = batch->peer;
+		if (unlikely(flush_notification_batch(p) != 0)) {
+			log_peer_err(p, "Could not send notification batch!\n");
+		}
+	}
+}
+
 #define LOG_BUFFER_SIZE 100
 __attribute__((format(printf, 2, 3)))
 void log_peer_err(const struct peer *p, const char *fmt, ...)
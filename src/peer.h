@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "element_directory.h"
 #include "eventloop.h"
 #include "groups.h"
 #include "list.h"
@@ -41,8 +42,10 @@
 extern "C" {
 #endif
 
+struct notification_batch;
+
 struct peer {
-	struct list_head element_list;
+	struct element_directory elements;
 	struct list_head next_peer;
 	struct list_head fetch_list;
 	void *routing_table;
@@ -50,6 +53,7 @@ struct peer {
 	int (*send_message)(const struct peer *p, char *rendered, size_t len);
 	void (*close)(struct peer *p);
 	struct eventloop *loop;
+	struct notification_batch *batch; /* Notifications queued during the current event loop iteration */
 	group_t fetch_groups;
 	group_t set_groups;
 	group_t call_groups;
@@ -67,6 +71,22 @@ void log_peer_info(const struct peer *p, const char *fmt, ...);
 void log_peer_err(const struct peer *p, const char *fmt, ...);
 void destroy_all_peers(void);
 
+/*
+ * If batching is enabled, notifications are queued per peer and sent as
+ * a single JSON-RPC array when flush_all_notification_batches() is
+ * called at the end of an event loop iteration. Otherwise they are sent
+ * immediately.
+ */
+void set_notification_batching(bool enable);
+int queue_notification(const struct peer *p, char *rendered, size_t len);
+
+/*
+ * Must be called before a message is sent directly to a peer to keep
+ * queued notifications in order.
+ */
+int flush_notification_batch(const struct peer *p);
+void flush_all_notification_batches(void);
+
 #ifdef __cplusplus
 }
 #endif
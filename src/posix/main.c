@@ -40,6 +40,7 @@
 #include "linux/linux_io.h"
 #include "log.h"
 #include "parse.h"
+#include "peer.h"
 #include "table.h"
 
 int main(int argc, char **argv)
@@ -50,6 +51,7 @@ int main(int argc, char **argv)
 	    .user_name = NULL,
 	    .passwd_file = NULL,
 	    .request_target = "/api/jet/",
+	    .snapshot_file = NULL,
 	};
 
 	if (init_random() < 0) {
@@ -63,7 +65,7 @@ int main(int argc, char **argv)
 
 	int c;
 
-	while ((c = getopt(argc, argv, "flp:r:u:")) != -1) {
+	while ((c = getopt(argc, argv, "flp:r:s:u:")) != -1) {
 		switch (c) {
 		case 'f':
 			config.run_foreground = true;
@@ -77,11 +79,14 @@ int main(int argc, char **argv)
 		case 'r':
 			config.request_target = optarg;
 			break;
+		case 's':
+			config.snapshot_file = optarg;
+			break;
 		case 'u':
 			config.user_name = optarg;
 			break;
 		case '?':
-			fprintf(stderr, "Usage: %s [-l] [-f] [-r <request target>] [-u <username>] [-p <password file>]\n", argv[0]);
+			fprintf(stderr, "Usage: %s [-l] [-f] [-r <request target>] [-s <snapshot file>] [-u <username>] [-p <password file>]\n", argv[0]);
 			ret = EXIT_FAILURE;
 			goto getopt_failed;
 			break;
@@ -112,7 +117,9 @@ int main(int argc, char **argv)
 	        .add = eventloop_epoll_add,
 	        .remove = eventloop_epoll_remove,
 	    },
+	    .events_handled = flush_all_notification_batches,
 	};
+	set_notification_batching(true);
 
 	log_info("%s version %s started", CJET_NAME, CJET_VERSION);
 	if (run_io(&eloop.loop, &config) < 0) {
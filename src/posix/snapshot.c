@@ -0,0 +1,580 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "element.h"
+#include "element_directory.h"
+#include "eventloop.h"
+#include "generated/cjet_config.h"
+#include "jet_string.h"
+#include "list.h"
+#include "log.h"
+#include "peer.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "json/cJSON.h"
+
+/*
+ * The file starts with a header followed by one record per state. Each
+ * record is followed by the path, the owner name and the rendered value,
+ * none of them NUL terminated. Numbers are stored in host byte order.
+ */
+static const char SNAPSHOT_MAGIC[8] = {'c', 'j', 'e', 't', 's', 'n', 'a', 'p'};
+enum { SNAPSHOT_VERSION = 1 };
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t number_of_states;
+	uint64_t body_length;
+	uint64_t checksum; /* FNV-1a of the body */
+};
+
+struct snapshot_record {
+	uint32_t path_length;
+	uint32_t owner_length;
+	uint32_t value_length;
+	uint32_t flags;
+	uint32_t fetch_groups;
+	uint32_t set_groups;
+	uint32_t call_groups;
+};
+
+struct snapshot_writer {
+	char *position;
+	uint64_t body_length;
+	uint32_t number_of_states;
+};
+
+typedef int (*state_visitor)(const struct element *e, const char *rendered_value, void *context);
+
+static struct peer orphan_peer;
+static bool orphan_peer_initialized = false;
+
+static struct cjet_timer snapshot_timer;
+static bool timer_running = false;
+static char *snapshot_file_name = NULL;
+static pid_t writer_pid = 0;
+static uint64_t writer_state_changes = 0; /* The state changes the running writer sees */
+static uint64_t written_state_changes = 0; /* The state changes in the snapshot file */
+
+static uint64_t checksum(const char *data, size_t length)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static const char *get_owner_name(const struct element *e)
+{
+	if (element_is_orphaned(e)) {
+		return e->orphan_owner;
+	}
+
+	return e->peer->name;
+}
+
+static size_t get_owner_length(const struct element *e)
+{
+	const char *owner = get_owner_name(e);
+	if (owner == NULL) {
+		return 0;
+	}
+
+	return strlen(owner);
+}
+
+static int visit_states(state_visitor visitor, void *context)
+{
+	struct list_head *peer_item;
+	struct list_head *peer_tmp;
+	list_for_each_safe (peer_item, peer_tmp, get_peer_list()) {
+		const struct peer *p = list_entry(peer_item, struct peer, next_peer);
+		const struct element_directory *dir = &p->elements;
+		for (unsigned int i = 0; i < dir->size; i++) {
+			const struct element *e = dir->elements[i];
+			if ((e == NULL) || (e->value == NULL)) {
+				continue;
+			}
+
+			if (unlikely(visitor(e, e->rendered_value->valuestring, context) != 0)) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int measure_state(const struct element *e, const char *rendered_value, void *context)
+{
+	struct snapshot_writer *writer = (struct snapshot_writer *)context;
+	writer->body_length += sizeof(struct snapshot_record) + e->path_length + get_owner_length(e) + strlen(rendered_value);
+	writer->number_of_states++;
+	return 0;
+}
+
+static int copy_state(const struct element *e, const char *rendered_value, void *context)
+{
+	struct snapshot_writer *writer = (struct snapshot_writer *)context;
+	struct snapshot_record record = {
+	    .path_length = (uint32_t)e->path_length,
+	    .owner_length = (uint32_t)get_owner_length(e),
+	    .value_length = (uint32_t)strlen(rendered_value),
+	    .flags = (uint32_t)(e->flags & FETCH_ONLY_FLAG),
+	    .fetch_groups = e->fetch_groups,
+	    .set_groups = e->set_groups,
+	    .call_groups = e->call_groups,
+	};
+
+	memcpy(writer->position, &record, sizeof(record));
+	writer->position += sizeof(record);
+	memcpy(writer->position, e->path, record.path_length);
+	writer->position += record.path_length;
+	if (record.owner_length > 0) {
+		memcpy(writer->position, get_owner_name(e), record.owner_length);
+		writer->position += record.owner_length;
+	}
+	memcpy(writer->position, rendered_value, record.value_length);
+	writer->position += record.value_length;
+	return 0;
+}
+
+static char *get_temporary_name(const char *file_name)
+{
+	static const char suffix[] = ".tmp";
+	size_t length = strlen(file_name);
+	char *name = cjet_malloc(length + sizeof(suffix));
+	if (unlikely(name == NULL)) {
+		return NULL;
+	}
+
+	memcpy(name, file_name, length);
+	memcpy(name + length, suffix, sizeof(suffix));
+	return name;
+}
+
+int snapshot_write(const char *file_name)
+{
+	struct snapshot_writer writer = {
+	    .position = NULL,
+	    .body_length = 0,
+	    .number_of_states = 0,
+	};
+	if (unlikely(visit_states(measure_state, &writer) != 0)) {
+		log_err("Could not copy states into snapshot!\n");
+		return -1;
+	}
+
+	char *temporary_name = get_temporary_name(file_name);
+	if (unlikely(temporary_name == NULL)) {
+		log_err("Could not allocate memory for snapshot file name!\n");
+		return -1;
+	}
+
+	int ret = -1;
+	int fd = open(temporary_name, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (unlikely(fd == -1)) {
+		log_err("Could not open snapshot file %s!\n", temporary_name);
+		goto open_failed;
+	}
+
+	size_t file_size = sizeof(struct snapshot_header) + writer.body_length;
+	if (unlikely(ftruncate(fd, (off_t)file_size) != 0)) {
+		log_err("Could not resize snapshot file %s!\n", temporary_name);
+		goto write_failed;
+	}
+
+	char *map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (unlikely(map == MAP_FAILED)) {
+		log_err("Could not map snapshot file %s!\n", temporary_name);
+		goto write_failed;
+	}
+
+	char *body = map + sizeof(struct snapshot_header);
+	writer.position = body;
+	if (unlikely(visit_states(copy_state, &writer) != 0)) {
+		log_err("Could not copy states into snapshot!\n");
+		goto copy_failed;
+	}
+
+	struct snapshot_header header = {
+	    .version = SNAPSHOT_VERSION,
+	    .number_of_states = writer.number_of_states,
+	    .body_length = writer.body_length,
+	    .checksum = checksum(body, writer.body_length),
+	};
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	memcpy(map, &header, sizeof(header));
+
+	if (unlikely((msync(map, file_size, MS_SYNC) != 0) || (fsync(fd) != 0))) {
+		log_err("Could not sync snapshot file %s!\n", temporary_name);
+		goto copy_failed;
+	}
+
+	if (unlikely(rename(temporary_name, file_name) != 0)) {
+		log_err("Could not rename snapshot file to %s!\n", file_name);
+		goto copy_failed;
+	}
+
+	ret = 0;
+
+copy_failed:
+	munmap(map, file_size);
+write_failed:
+	close(fd);
+	if (ret != 0) {
+		unlink(temporary_name);
+	}
+open_failed:
+	cjet_free(temporary_name);
+	return ret;
+}
+
+static int send_to_orphan(const struct peer *p, char *rendered, size_t len)
+{
+	(void)p;
+	(void)rendered;
+	(void)len;
+	return -1;
+}
+
+static void close_orphan_peer(struct peer *p)
+{
+	free_peer_resources(p);
+	orphan_peer_initialized = false;
+}
+
+static int init_orphan_peer(struct eventloop *loop)
+{
+	if (orphan_peer_initialized) {
+		return 0;
+	}
+
+	if (unlikely(init_peer(&orphan_peer, true, loop) < 0)) {
+		return -1;
+	}
+
+	orphan_peer.send_message = send_to_orphan;
+	orphan_peer.close = close_orphan_peer;
+	set_peer_name(&orphan_peer, "snapshot");
+	orphan_peer_initialized = true;
+	return 0;
+}
+
+static int restore_state(const struct snapshot_record *record, const char *data)
+{
+	size_t length = (size_t)record->path_length + record->owner_length + record->value_length;
+	char *strings = cjet_malloc(length + 3);
+	if (unlikely(strings == NULL)) {
+		return -1;
+	}
+
+	char *path = strings;
+	memcpy(path, data, record->path_length);
+	path[record->path_length] = '\0';
+	data += record->path_length;
+
+	char *owner = path + record->path_length + 1;
+	memcpy(owner, data, record->owner_length);
+	owner[record->owner_length] = '\0';
+	data += record->owner_length;
+
+	char *rendered_value = owner + record->owner_length + 1;
+	memcpy(rendered_value, data, record->value_length);
+	rendered_value[record->value_length] = '\0';
+
+	int ret = -1;
+	cJSON *value = cJSON_Parse(rendered_value);
+	if (unlikely(value == NULL)) {
+		log_err("Could not parse value of %s in snapshot!\n", path);
+		goto parse_failed;
+	}
+
+	const char *owner_name = (record->owner_length > 0) ? owner : NULL;
+	ret = add_orphaned_element(&orphan_peer, path, owner_name, value, (int)(record->flags & FETCH_ONLY_FLAG), record->fetch_groups, record->set_groups, record->call_groups);
+	if (unlikely(ret != 0)) {
+		log_err("Could not restore %s from snapshot!\n", path);
+		cJSON_Delete(value);
+	}
+
+parse_failed:
+	cjet_free(strings);
+	return ret;
+}
+
+static int restore_states(const char *map, size_t file_size)
+{
+	struct snapshot_header header;
+	if (file_size < sizeof(header)) {
+		return -1;
+	}
+
+	memcpy(&header, map, sizeof(header));
+	if ((memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) ||
+	    (header.version != SNAPSHOT_VERSION) ||
+	    (header.body_length != file_size - sizeof(header))) {
+		return -1;
+	}
+
+	const char *body = map + sizeof(header);
+	if (checksum(body, header.body_length) != header.checksum) {
+		return -1;
+	}
+
+	const char *end = body + header.body_length;
+	for (uint32_t i = 0; i < header.number_of_states; i++) {
+		struct snapshot_record record;
+		if ((size_t)(end - body) < sizeof(record)) {
+			return -1;
+		}
+
+		memcpy(&record, body, sizeof(record));
+		body += sizeof(record);
+		uint64_t data_length = (uint64_t)record.path_length + record.owner_length + record.value_length;
+		if ((uint64_t)(end - body) < data_length) {
+			return -1;
+		}
+
+		restore_state(&record, body);
+		body += data_length;
+	}
+
+	return 0;
+}
+
+int snapshot_load(const char *file_name, struct eventloop *loop)
+{
+	int fd = open(file_name, O_RDONLY);
+	if (fd == -1) {
+		if (errno == ENOENT) {
+			return 0;
+		}
+		log_err("Could not open snapshot file %s!\n", file_name);
+		return -1;
+	}
+
+	int ret = -1;
+	struct stat st;
+	if (unlikely(fstat(fd, &st) != 0)) {
+		log_err("Could not stat snapshot file %s!\n", file_name);
+		goto stat_failed;
+	}
+
+	size_t file_size = (size_t)st.st_size;
+	if (file_size == 0) {
+		log_err("Snapshot file %s is empty, starting without states\n", file_name);
+		ret = 0;
+		goto stat_failed;
+	}
+
+	char *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (unlikely(map == MAP_FAILED)) {
+		log_err("Could not map snapshot file %s!\n", file_name);
+		goto stat_failed;
+	}
+
+	if (unlikely(init_orphan_peer(loop) < 0)) {
+		log_err("Could not create peer for orphaned states!\n");
+		goto init_peer_failed;
+	}
+
+	if (restore_states(map, file_size) != 0) {
+		log_err("Snapshot file %s is corrupted, not all states were restored\n", file_name);
+	}
+	ret = 0;
+
+init_peer_failed:
+	munmap(map, file_size);
+stat_failed:
+	close(fd);
+	return ret;
+}
+
+static bool writer_finished(void)
+{
+	if (writer_pid == 0) {
+		return true;
+	}
+
+	int status;
+	pid_t ret = waitpid(writer_pid, &status, WNOHANG);
+	if (ret == 0) {
+		return false;
+	}
+
+	if (ret == writer_pid) {
+		if (WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS)) {
+			written_state_changes = writer_state_changes;
+		} else {
+			log_err("Snapshot writer failed!\n");
+		}
+	}
+	writer_pid = 0;
+	return true;
+}
+
+static void start_writer(void)
+{
+	pid_t pid = fork();
+	if (unlikely(pid == -1)) {
+		log_err("Could not fork snapshot writer!\n");
+		return;
+	}
+
+	if (pid == 0) {
+		int ret = snapshot_write(snapshot_file_name);
+		_exit((ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	writer_pid = pid;
+	writer_state_changes = get_state_changes();
+}
+
+static void snapshot_timer_handler(void *context, bool cancelled)
+{
+	(void)context;
+	if (cancelled) {
+		return;
+	}
+
+	/*
+	 * Forking copies the page tables of the whole heap, so nothing is
+	 * written if no state changed since the last snapshot.
+	 */
+	if (writer_finished() && (get_state_changes() != written_state_changes)) {
+		start_writer();
+	}
+
+	if (unlikely(snapshot_timer.start(&snapshot_timer, convert_seconds_to_nsec(CONFIG_SNAPSHOT_INTERVAL), snapshot_timer_handler, NULL) != 0)) {
+		log_err("Could not restart snapshot timer, no more snapshots will be written!\n");
+		timer_running = false;
+	}
+}
+
+static char *get_absolute_name(const char *file_name)
+{
+	if (file_name[0] == '/') {
+		return duplicate_string(file_name);
+	}
+
+	char cwd[PATH_MAX];
+	if (unlikely(getcwd(cwd, sizeof(cwd)) == NULL)) {
+		return NULL;
+	}
+
+	size_t length = strlen(cwd) + strlen(file_name) + 2;
+	char *name = cjet_malloc(length);
+	if (unlikely(name == NULL)) {
+		return NULL;
+	}
+
+	snprintf(name, length, "%s/%s", cwd, file_name);
+	return name;
+}
+
+int snapshot_start(const char *file_name, struct eventloop *loop)
+{
+	snapshot_file_name = get_absolute_name(file_name);
+	if (unlikely(snapshot_file_name == NULL)) {
+		log_err("Could not get absolute name of snapshot file %s!\n", file_name);
+		return -1;
+	}
+
+	if (unlikely(snapshot_load(snapshot_file_name, loop) < 0)) {
+		goto load_failed;
+	}
+	written_state_changes = get_state_changes();
+
+	if (unlikely(cjet_timer_init(&snapshot_timer, loop) < 0)) {
+		log_err("Could not create snapshot timer!\n");
+		goto timer_init_failed;
+	}
+
+	if (unlikely(snapshot_timer.start(&snapshot_timer, convert_seconds_to_nsec(CONFIG_SNAPSHOT_INTERVAL), snapshot_timer_handler, NULL) != 0)) {
+		log_err("Could not start snapshot timer!\n");
+		goto timer_start_failed;
+	}
+
+	timer_running = true;
+	return 0;
+
+timer_start_failed:
+	cjet_timer_destroy(&snapshot_timer);
+timer_init_failed:
+	if (orphan_peer_initialized) {
+		close_orphan_peer(&orphan_peer);
+	}
+load_failed:
+	cjet_free(snapshot_file_name);
+	snapshot_file_name = NULL;
+	return -1;
+}
+
+void snapshot_stop(void)
+{
+	if (timer_running) {
+		snapshot_timer.cancel(&snapshot_timer);
+		timer_running = false;
+	}
+
+	if (snapshot_file_name != NULL) {
+		cjet_timer_destroy(&snapshot_timer);
+		if (writer_pid != 0) {
+			waitpid(writer_pid, NULL, 0);
+			writer_pid = 0;
+		}
+
+		if (unlikely(snapshot_write(snapshot_file_name) != 0)) {
+			log_err("Could not write final snapshot!\n");
+		}
+		cjet_free(snapshot_file_name);
+		snapshot_file_name = NULL;
+	}
+
+	if (orphan_peer_initialized) {
+		close_orphan_peer(&orphan_peer);
+	}
+}
@@ -46,6 +46,20 @@ static inline const cJSON *get_params(const struct peer *p, const cJSON *request
 	return params;
 }
 
+/*
+ * For handlers that take over parts of the request, like the value of
+ * an added or changed state.
+ */
+static inline cJSON *get_mutable_params(const struct peer *p, cJSON *request, cJSON **response)
+{
+	cJSON *params = cJSON_GetObjectItem(request, "params");
+	if (unlikely(params == NULL)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", "no params found");
+	}
+
+	return params;
+}
+
 #ifdef __cplusplus
 }
 #endif
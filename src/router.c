@@ -30,11 +30,11 @@
 #include "alloc.h"
 #include "compiler.h"
 #include "generated/cjet_config.h"
-#include "hashtable.h"
 #include "linux/linux_io.h"
 #include "peer.h"
 #include "response.h"
 #include "router.h"
+#include "swisstable.h"
 #include "timer.h"
 #include "json/cJSON.h"
 
@@ -58,7 +58,7 @@ static void fill_routed_request_id(char *buf, size_t buf_size, const void *addre
 	}
 }
 
-DECLARE_HASHTABLE_STRING(route_table, CONFIG_ROUTING_TABLE_ORDER, 1)
+DECLARE_SWISSTABLE_STRING(route_table, CONFIG_ROUTING_TABLE_ORDER, 1)
 
 int add_routing_table(struct peer *p)
 {
@@ -95,25 +95,28 @@ cJSON *create_routed_message(const struct peer *p, const char *path, enum type w
 	}
 	cJSON_AddItemToObject(message, "method", method);
 
-	cJSON *value_copy;
-	if (value != NULL) {
-		value_copy = cJSON_Duplicate(value, 1);
-	} else {
-		value_copy = cJSON_CreateObject();
-	}
-	if (unlikely(value_copy == NULL)) {
-		goto error;
-	}
-
-	if (what == METHOD) {
-		cJSON_AddItemToObject(message, "params", value_copy);
-	} else {
-		cJSON *params = cJSON_CreateObject();
+	/*
+	 * The value is only referenced, the routed message has to be rendered
+	 * before the request it was taken from is deleted.
+	 */
+	cJSON *params = message;
+	const char *value_name = "params";
+	if (what == STATE) {
+		params = cJSON_CreateObject();
 		if (unlikely(params == NULL)) {
 			goto error;
 		}
 		cJSON_AddItemToObject(message, "params", params);
-		cJSON_AddItemToObject(params, "value", value_copy);
+		value_name = "value";
+	}
+
+	if (value != NULL) {
+		cJSON_AddItemReferenceToObject(params, value_name, value);
+	} else {
+		cJSON_AddItemToObject(params, value_name, cJSON_CreateObject());
+	}
+	if (unlikely(cJSON_GetObjectItem(params, value_name) == NULL)) {
+		goto error;
 	}
 
 	return message;
@@ -159,7 +162,10 @@ static int format_and_send_response(const struct peer *p, const cJSON *response)
 {
 	char *rendered = cJSON_PrintUnformatted(response);
 	if (likely(rendered != NULL)) {
-		int ret = p->send_message(p, rendered, strlen(rendered));
+		int ret = flush_notification_batch(p);
+		if (likely(ret == 0)) {
+			ret = p->send_message(p, rendered, strlen(rendered));
+		}
 		cJSON_free(rendered);
 		return ret;
 	} else {
@@ -301,37 +307,49 @@ static void clear_routing_entry(struct value_route_table *val)
 	cjet_free(request);
 }
 
+struct remove_peer_context {
+	const struct peer *p;
+	const struct peer *peer_to_remove;
+};
+
+static void remove_peer_from_routing_entry(const char *key, void *context)
+{
+	const struct remove_peer_context *ctx = (const struct remove_peer_context *)context;
+	struct value_route_table val;
+	int ret = HASHTABLE_REMOVE(route_table, ctx->p->routing_table, key, &val);
+	if (ret == HASHTABLE_SUCCESS) {
+		struct routing_request *request = val.vals[0];
+		if (likely(request->requesting_peer == ctx->peer_to_remove)) {
+			clear_routing_entry(&val);
+		}
+	}
+}
+
 void remove_peer_from_routing_table(const struct peer *p,
                                     const struct peer *peer_to_remove)
 {
-	struct hashtable_string *table = p->routing_table;
-	for (unsigned int i = 0; i < table_size_route_table; ++i) {
-		struct hashtable_string *entry = &(table[i]);
-		if (entry->key != (char *)HASHTABLE_INVALIDENTRY) {
-			struct value_route_table val;
-			int ret = HASHTABLE_REMOVE(route_table, p->routing_table, entry->key, &val);
-			if (ret == HASHTABLE_SUCCESS) {
-				struct routing_request *request = val.vals[0];
-				if (likely(request->requesting_peer == peer_to_remove)) {
-					clear_routing_entry(&val);
-				}
-			}
-		}
+	struct remove_peer_context context = {
+	    .p = p,
+	    .peer_to_remove = peer_to_remove,
+	};
+	HASHTABLE_VISIT(route_table, p->routing_table, remove_peer_from_routing_entry, &context);
+}
+
+static void remove_routing_entry(const char *key, void *context)
+{
+	const struct remove_peer_context *ctx = (const struct remove_peer_context *)context;
+	struct value_route_table val;
+	int ret = HASHTABLE_REMOVE(route_table, ctx->p->routing_table, key, &val);
+	if (ret == HASHTABLE_SUCCESS) {
+		clear_routing_entry(&val);
 	}
 }
 
 void remove_routing_info_from_peer(const struct peer *p)
 {
-	struct hashtable_string *table = p->routing_table;
-	for (unsigned int i = 0; i < table_size_route_table; ++i) {
-		struct hashtable_string *entry = &(table[i]);
-		if (entry->key != (char *)HASHTABLE_INVALIDENTRY) {
-			struct value_route_table val;
-			int ret = HASHTABLE_REMOVE(route_table,
-			                           p->routing_table, entry->key, &val);
-			if (ret == HASHTABLE_SUCCESS) {
-				clear_routing_entry(&val);
-			}
-		}
-	}
+	struct remove_peer_context context = {
+	    .p = p,
+	    .peer_to_remove = NULL,
+	};
+	HASHTABLE_VISIT(route_table, p->routing_table, remove_routing_entry, &context);
 }
@@ -0,0 +1,61 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_SNAPSHOT_H
+#define CJET_SNAPSHOT_H
+
+#include "eventloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A snapshot keeps the states of the daemon across a restart. It is
+ * written periodically by a forked child which works on a copy-on-write
+ * image of the element table, so the event loop never waits for copying
+ * states or disk I/O. The file is written under a temporary name and
+ * renamed, so a crash leaves either the old or the new snapshot behind.
+ *
+ * The states of a snapshot are restored as orphaned states. Fetchers see
+ * them immediately, set requests are rejected until the owner reconnects
+ * and reclaims the state by adding it again.
+ */
+int snapshot_start(const char *file_name, struct eventloop *loop);
+
+/*
+ * Writes a final snapshot synchronously and removes all orphaned states.
+ */
+void snapshot_stop(void);
+
+int snapshot_write(const char *file_name);
+int snapshot_load(const char *file_name, struct eventloop *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,464 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * An alternative to the hopscotch table of hashtable.h, organized like
+ * a Swiss table. Slots are grouped by SWISSTABLE_GROUP_WIDTH and every
+ * slot has a control byte that is either SWISSTABLE_EMPTY,
+ * SWISSTABLE_DELETED or the lower 7 bits of the key's hash. A lookup
+ * compares all control bytes of a group with one SSE2 instruction
+ * (or a portable loop without SSE2) and only looks at slots whose tag
+ * matches. Each slot also caches the full 32 bit hash, so most tag
+ * collisions are rejected without touching the key, and growing
+ * never has to hash a key again.
+ *
+ * Growing works like in hashtable.h: a new generation is allocated and
+ * each insertion of a new key moves SWISSTABLE_MIGRATE_GROUPS groups
+ * of the old generation. The same concurrency restrictions apply.
+ *
+ * Tables are declared with DECLARE_SWISSTABLE_STRING,
+ * DECLARE_SWISSTABLE_UINT32 or DECLARE_SWISSTABLE_UINT64 and then used
+ * with HASHTABLE_CREATE, HASHTABLE_DELETE, HASHTABLE_GET,
+ * HASHTABLE_REMOVE, HASHTABLE_PUT and HASHTABLE_VISIT, so switching a
+ * table between both implementations only changes its declaration.
+ * Unlike the hopscotch table, every key value can be stored.
+ */
+
+#ifndef SWISSTABLE_H
+#define SWISSTABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hashtable.h"
+
+#define SWISSTABLE_GROUP_ORDER 4
+#define SWISSTABLE_GROUP_WIDTH (1U << SWISSTABLE_GROUP_ORDER)
+#define SWISSTABLE_EMPTY ((int8_t)-128)
+#define SWISSTABLE_DELETED ((int8_t)-2)
+
+/*
+ * Number of groups of the previous generation moved into the grown
+ * table with each insertion of a new key.
+ */
+#define SWISSTABLE_MIGRATE_GROUPS 1
+
+/*
+ * Returns a bitmask with bit i set if the control byte i of the group
+ * equals tag.
+ */
+static inline uint32_t swisstable_match(const int8_t *group, int8_t tag)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)(const void *)group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+#else
+	uint32_t mask = 0;
+	unsigned int i;
+	for (i = 0; i < SWISSTABLE_GROUP_WIDTH; i++) {
+		if (group[i] == tag) {
+			mask |= 1U << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/*
+ * Returns a bitmask of all empty or deleted slots of the group. Both
+ * have the highest bit set, tags of used slots don't.
+ */
+static inline uint32_t swisstable_match_free(const int8_t *group)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)(const void *)group);
+	return (uint32_t)_mm_movemask_epi8(ctrl);
+#else
+	uint32_t mask = 0;
+	unsigned int i;
+	for (i = 0; i < SWISSTABLE_GROUP_WIDTH; i++) {
+		if (group[i] < 0) {
+			mask |= 1U << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+static inline uint32_t swisstable_mix(uint64_t hash)
+{
+	hash ^= hash >> 32U;
+	hash *= hash64_magic;
+	return (uint32_t)(hash >> 32U);
+}
+
+/*
+ * Hashes a string eight bytes at a time. The bytes are loaded with
+ * memcpy, so neither alignment nor reading beyond the terminating
+ * zero is an issue.
+ */
+static inline uint32_t swisstable_hash_string(const char *key)
+{
+	size_t length = strlen(key);
+	uint64_t hash = length * hash64_magic;
+	uint64_t word;
+
+	while (length >= sizeof(word)) {
+		memcpy(&word, key, sizeof(word));
+		hash = (hash ^ word) * hash64_magic;
+		hash ^= hash >> 29U;
+		key += sizeof(word);
+		length -= sizeof(word);
+	}
+	if (length > 0) {
+		word = 0;
+		memcpy(&word, key, length);
+		hash = (hash ^ word) * hash64_magic;
+		hash ^= hash >> 29U;
+	}
+	return swisstable_mix(hash);
+}
+
+#define DECLARE_SWISSTABLE(name, order, type, value_entries)                                                                                                                      \
+	struct value_##name {                                                                                                                                                     \
+		void *vals[value_entries];                                                                                                                                        \
+	};                                                                                                                                                                        \
+                                                                                                                                                                                  \
+	struct swisstable_slot_##name {                                                                                                                                           \
+		uint32_t hash;                                                                                                                                                    \
+		type key;                                                                                                                                                         \
+		struct value_##name value;                                                                                                                                        \
+	};                                                                                                                                                                        \
+                                                                                                                                                                                  \
+	struct swisstable_generation_##name {                                                                                                                                     \
+		struct swisstable_slot_##name *slots; /* NULL if this generation is not in use */                                                                                 \
+		int8_t *ctrl;                                                                                                                                                     \
+		uint32_t size_order;                                                                                                                                              \
+		uint32_t growth_left; /* Number of empty slots that might be used before the generation must grow */                                                              \
+	};                                                                                                                                                                        \
+                                                                                                                                                                                  \
+	struct hashtable_##name {                                                                                                                                                 \
+		struct swisstable_generation_##name entries;                                                                                                                      \
+		struct swisstable_generation_##name old_entries; /* Generation that is migrated into entries */                                                                   \
+		uint32_t migrate_position; /* All groups of old_entries below this position are migrated */                                                                       \
+		uint32_t number_of_entries;                                                                                                                                       \
+	};                                                                                                                                                                        \
+                                                                                                                                                                                  \
+	_Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wunused-function\"")                                                                                    \
+                                                                                                                                                                                  \
+	static inline int swisstable_alloc_generation_##name(struct swisstable_generation_##name *gen, uint32_t table_order)                                                      \
+	{                                                                                                                                                                         \
+		uint32_t table_size = 1U << table_order;                                                                                                                          \
+		gen->slots = (struct swisstable_slot_##name *)kmalloc(table_size * (sizeof(gen->slots[0]) + sizeof(gen->ctrl[0])), GFP_KERNEL);                                   \
+		if (gen->slots == NULL) {                                                                                                                                         \
+			return HASHTABLE_FULL;                                                                                                                                    \
+		}                                                                                                                                                                 \
+		gen->ctrl = (int8_t *)(void *)&gen->slots[table_size];                                                                                                            \
+		memset(gen->ctrl, SWISSTABLE_EMPTY, table_size);                                                                                                                  \
+		gen->size_order = table_order;                                                                                                                                    \
+		gen->growth_left = table_size - (table_size / 8);                                                                                                                 \
+		return HASHTABLE_SUCCESS;                                                                                                                                         \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline struct hashtable_##name *hashtable_create_##name(void)                                                                                                      \
+	{                                                                                                                                                                         \
+		struct hashtable_##name *table = (struct hashtable_##name *)kmalloc(sizeof(*table), GFP_KERNEL);                                                                  \
+		if (table == NULL) {                                                                                                                                              \
+			return NULL;                                                                                                                                              \
+		}                                                                                                                                                                 \
+		uint32_t table_order = ((order) < SWISSTABLE_GROUP_ORDER) ? SWISSTABLE_GROUP_ORDER : (order);                                                                     \
+		if (swisstable_alloc_generation_##name(&table->entries, table_order) != HASHTABLE_SUCCESS) {                                                                      \
+			kfree(table);                                                                                                                                             \
+			return NULL;                                                                                                                                              \
+		}                                                                                                                                                                 \
+		memset(&table->old_entries, 0, sizeof(table->old_entries));                                                                                                       \
+		table->migrate_position = 0;                                                                                                                                      \
+		table->number_of_entries = 0;                                                                                                                                     \
+		return table;                                                                                                                                                     \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline void hashtable_delete_##name(struct hashtable_##name *table)                                                                                                \
+	{                                                                                                                                                                         \
+		if (table->old_entries.slots != NULL) {                                                                                                                           \
+			kfree(table->old_entries.slots);                                                                                                                          \
+		}                                                                                                                                                                 \
+		kfree(table->entries.slots);                                                                                                                                      \
+		kfree(table);                                                                                                                                                     \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline struct swisstable_slot_##name *swisstable_find_##name(const struct swisstable_generation_##name *gen, type key, uint32_t hash)                              \
+	{                                                                                                                                                                         \
+		uint32_t group_mask = (1U << (gen->size_order - SWISSTABLE_GROUP_ORDER)) - 1;                                                                                     \
+		uint32_t group = (hash >> 7U) & group_mask;                                                                                                                       \
+		int8_t tag = (int8_t)(hash & 0x7fU);                                                                                                                              \
+		uint32_t step = 0;                                                                                                                                                \
+                                                                                                                                                                                  \
+		while (1) {                                                                                                                                                       \
+			uint32_t first = group * SWISSTABLE_GROUP_WIDTH;                                                                                                          \
+			uint32_t match = swisstable_match(&gen->ctrl[first], tag);                                                                                                \
+			while (match != 0) {                                                                                                                                      \
+				struct swisstable_slot_##name *slot = &gen->slots[first + (uint32_t)__builtin_ctz(match)];                                                        \
+				if ((slot->hash == hash) && swisstable_is_equal_##name(slot->key, key)) {                                                                         \
+					return slot;                                                                                                                              \
+				}                                                                                                                                                 \
+				match &= match - 1;                                                                                                                               \
+			}                                                                                                                                                         \
+			if (swisstable_match(&gen->ctrl[first], SWISSTABLE_EMPTY) != 0) {                                                                                         \
+				return NULL;                                                                                                                                      \
+			}                                                                                                                                                         \
+			/* Triangular probing visits every group once. */                                                                                                         \
+			step++;                                                                                                                                                   \
+			if (step > group_mask) {                                                                                                                                  \
+				return NULL;                                                                                                                                      \
+			}                                                                                                                                                         \
+			group = (group + step) & group_mask;                                                                                                                      \
+		}                                                                                                                                                                 \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int swisstable_insert_##name(struct swisstable_generation_##name *gen, type key, uint32_t hash, const struct value_##name *value)                           \
+	{                                                                                                                                                                         \
+		uint32_t group_mask = (1U << (gen->size_order - SWISSTABLE_GROUP_ORDER)) - 1;                                                                                     \
+		uint32_t group = (hash >> 7U) & group_mask;                                                                                                                       \
+		uint32_t step = 0;                                                                                                                                                \
+                                                                                                                                                                                  \
+		while (1) {                                                                                                                                                       \
+			uint32_t first = group * SWISSTABLE_GROUP_WIDTH;                                                                                                          \
+			uint32_t match = swisstable_match_free(&gen->ctrl[first]);                                                                                                \
+			if (match != 0) {                                                                                                                                         \
+				uint32_t pos = first + (uint32_t)__builtin_ctz(match);                                                                                            \
+				if (gen->ctrl[pos] == SWISSTABLE_EMPTY) {                                                                                                         \
+					if (gen->growth_left == 0) {                                                                                                              \
+						return HASHTABLE_FULL;                                                                                                            \
+					}                                                                                                                                         \
+					gen->growth_left--;                                                                                                                       \
+				}                                                                                                                                                 \
+				gen->slots[pos].hash = hash;                                                                                                                      \
+				gen->slots[pos].key = key;                                                                                                                        \
+				gen->slots[pos].value = *value;                                                                                                                   \
+				wmb();                                                                                                                                            \
+				gen->ctrl[pos] = (int8_t)(hash & 0x7fU);                                                                                                          \
+				return HASHTABLE_SUCCESS;                                                                                                                         \
+			}                                                                                                                                                         \
+			step++;                                                                                                                                                   \
+			if (step > group_mask) {                                                                                                                                  \
+				return HASHTABLE_FULL;                                                                                                                            \
+			}                                                                                                                                                         \
+			group = (group + step) & group_mask;                                                                                                                      \
+		}                                                                                                                                                                 \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline void swisstable_erase_##name(struct swisstable_generation_##name *gen, const struct swisstable_slot_##name *slot)                                           \
+	{                                                                                                                                                                         \
+		uint32_t pos = (uint32_t)(slot - gen->slots);                                                                                                                     \
+		/*                                                                                                                                                                \
+		 * If the group still has an empty slot, no probe sequence ever                                                                                                   \
+		 * went beyond it and the slot can be emptied. Otherwise a                                                                                                        \
+		 * tombstone keeps the probe sequences running.                                                                                                                   \
+		 */                                                                                                                                                               \
+		if (swisstable_match(&gen->ctrl[pos & ~(SWISSTABLE_GROUP_WIDTH - 1)], SWISSTABLE_EMPTY) != 0) {                                                                   \
+			gen->ctrl[pos] = SWISSTABLE_EMPTY;                                                                                                                        \
+			gen->growth_left++;                                                                                                                                       \
+		} else {                                                                                                                                                          \
+			gen->ctrl[pos] = SWISSTABLE_DELETED;                                                                                                                      \
+		}                                                                                                                                                                 \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int swisstable_start_growth_##name(struct hashtable_##name *table)                                                                                          \
+	{                                                                                                                                                                         \
+		uint32_t table_order = table->entries.size_order;                                                                                                                 \
+		/* A table full of tombstones is just rebuilt with the same size. */                                                                                              \
+		if (table->number_of_entries >= ((1U << table_order) / 16) * 7) {                                                                                                 \
+			if (table_order >= HASHTABLE_MAX_ORDER) {                                                                                                                 \
+				return HASHTABLE_FULL;                                                                                                                            \
+			}                                                                                                                                                         \
+			table_order++;                                                                                                                                            \
+		}                                                                                                                                                                 \
+		struct swisstable_generation_##name entries;                                                                                                                      \
+		if (swisstable_alloc_generation_##name(&entries, table_order) != HASHTABLE_SUCCESS) {                                                                             \
+			return HASHTABLE_FULL;                                                                                                                                    \
+		}                                                                                                                                                                 \
+		table->old_entries = table->entries;                                                                                                                              \
+		table->entries = entries;                                                                                                                                         \
+		table->migrate_position = 0;                                                                                                                                      \
+		return HASHTABLE_SUCCESS;                                                                                                                                         \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int swisstable_migrate_##name(struct hashtable_##name *table, uint32_t groups)                                                                              \
+	{                                                                                                                                                                         \
+		struct swisstable_generation_##name *old = &table->old_entries;                                                                                                   \
+		uint32_t number_of_groups = 1U << (old->size_order - SWISSTABLE_GROUP_ORDER);                                                                                     \
+		while ((groups > 0) && (table->migrate_position < number_of_groups)) {                                                                                            \
+			uint32_t first = table->migrate_position * SWISSTABLE_GROUP_WIDTH;                                                                                        \
+			uint32_t used = ~swisstable_match_free(&old->ctrl[first]) & ((1U << SWISSTABLE_GROUP_WIDTH) - 1);                                                         \
+			while (used != 0) {                                                                                                                                       \
+				uint32_t pos = first + (uint32_t)__builtin_ctz(used);                                                                                             \
+				const struct swisstable_slot_##name *slot = &old->slots[pos];                                                                                     \
+				if (swisstable_insert_##name(&table->entries, slot->key, slot->hash, &slot->value) != HASHTABLE_SUCCESS) {                                        \
+					return HASHTABLE_FULL;                                                                                                                    \
+				}                                                                                                                                                 \
+				old->ctrl[pos] = SWISSTABLE_DELETED;                                                                                                              \
+				used &= used - 1;                                                                                                                                 \
+			}                                                                                                                                                         \
+			table->migrate_position++;                                                                                                                                \
+			groups--;                                                                                                                                                 \
+		}                                                                                                                                                                 \
+		if (table->migrate_position == number_of_groups) {                                                                                                                \
+			kfree(old->slots);                                                                                                                                        \
+			memset(old, 0, sizeof(*old));                                                                                                                             \
+		}                                                                                                                                                                 \
+		return HASHTABLE_SUCCESS;                                                                                                                                         \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_get_##name(const struct hashtable_##name *table, type key, struct value_##name *value)                                                        \
+	{                                                                                                                                                                         \
+		uint32_t hash = swisstable_hash_##name(key);                                                                                                                      \
+		const struct swisstable_slot_##name *slot = swisstable_find_##name(&table->entries, key, hash);                                                                   \
+		if ((slot == NULL) && (table->old_entries.slots != NULL)) {                                                                                                       \
+			slot = swisstable_find_##name(&table->old_entries, key, hash);                                                                                            \
+		}                                                                                                                                                                 \
+		if (slot == NULL) {                                                                                                                                               \
+			return HASHTABLE_INVALIDENTRY;                                                                                                                            \
+		}                                                                                                                                                                 \
+		*value = slot->value;                                                                                                                                             \
+		return HASHTABLE_SUCCESS;                                                                                                                                         \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_put_##name(struct hashtable_##name *table, type key, struct value_##name value, struct value_##name *prev_value)                              \
+	{                                                                                                                                                                         \
+		int ret;                                                                                                                                                          \
+		uint32_t hash = swisstable_hash_##name(key);                                                                                                                      \
+		struct swisstable_slot_##name *slot = swisstable_find_##name(&table->entries, key, hash);                                                                         \
+		if ((slot == NULL) && (table->old_entries.slots != NULL)) {                                                                                                       \
+			slot = swisstable_find_##name(&table->old_entries, key, hash);                                                                                            \
+		}                                                                                                                                                                 \
+		if (slot != NULL) {                                                                                                                                               \
+			if (prev_value != NULL) {                                                                                                                                 \
+				*prev_value = slot->value;                                                                                                                        \
+			}                                                                                                                                                         \
+			slot->value = value;                                                                                                                                      \
+			return HASHTABLE_SUCCESS;                                                                                                                                 \
+		}                                                                                                                                                                 \
+		if (prev_value != NULL) {                                                                                                                                         \
+			memset(prev_value, 0, sizeof(*prev_value));                                                                                                               \
+		}                                                                                                                                                                 \
+                                                                                                                                                                                  \
+		if ((table->old_entries.slots != NULL) && (swisstable_migrate_##name(table, SWISSTABLE_MIGRATE_GROUPS) != HASHTABLE_SUCCESS)) {                                   \
+			return HASHTABLE_FULL;                                                                                                                                    \
+		}                                                                                                                                                                 \
+		ret = swisstable_insert_##name(&table->entries, key, hash, &value);                                                                                               \
+		if (ret == HASHTABLE_FULL) {                                                                                                                                      \
+			if ((table->old_entries.slots != NULL) && (swisstable_migrate_##name(table, UINT32_MAX) != HASHTABLE_SUCCESS)) {                                          \
+				return HASHTABLE_FULL;                                                                                                                            \
+			}                                                                                                                                                         \
+			if (swisstable_start_growth_##name(table) != HASHTABLE_SUCCESS) {                                                                                         \
+				return HASHTABLE_FULL;                                                                                                                            \
+			}                                                                                                                                                         \
+			ret = swisstable_insert_##name(&table->entries, key, hash, &value);                                                                                       \
+		}                                                                                                                                                                 \
+		if (ret == HASHTABLE_SUCCESS) {                                                                                                                                   \
+			table->number_of_entries++;                                                                                                                               \
+		}                                                                                                                                                                 \
+		return ret;                                                                                                                                                       \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline int hashtable_remove_##name(struct hashtable_##name *table, type key, struct value_##name *value)                                                           \
+	{                                                                                                                                                                         \
+		uint32_t hash = swisstable_hash_##name(key);                                                                                                                      \
+		struct swisstable_generation_##name *gen = &table->entries;                                                                                                       \
+		const struct swisstable_slot_##name *slot = swisstable_find_##name(gen, key, hash);                                                                               \
+		if ((slot == NULL) && (table->old_entries.slots != NULL)) {                                                                                                       \
+			gen = &table->old_entries;                                                                                                                                \
+			slot = swisstable_find_##name(gen, key, hash);                                                                                                            \
+		}                                                                                                                                                                 \
+		if (slot == NULL) {                                                                                                                                               \
+			return HASHTABLE_INVALIDENTRY;                                                                                                                            \
+		}                                                                                                                                                                 \
+		if (value != NULL) {                                                                                                                                              \
+			*value = slot->value;                                                                                                                                     \
+		}                                                                                                                                                                 \
+		swisstable_erase_##name(gen, slot);                                                                                                                               \
+		table->number_of_entries--;                                                                                                                                       \
+		return HASHTABLE_SUCCESS;                                                                                                                                         \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline void swisstable_visit_generation_##name(const struct swisstable_generation_##name *gen, void (*visit)(type key, void *context), void *context)              \
+	{                                                                                                                                                                         \
+		uint32_t i;                                                                                                                                                       \
+		for (i = 0; i < (1U << gen->size_order); ++i) {                                                                                                                   \
+			if (gen->ctrl[i] >= 0) {                                                                                                                                  \
+				visit(gen->slots[i].key, context);                                                                                                                \
+			}                                                                                                                                                         \
+		}                                                                                                                                                                 \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	static inline void hashtable_visit_##name(const struct hashtable_##name *table, void (*visit)(type key, void *context), void *context)                                    \
+	{                                                                                                                                                                         \
+		swisstable_visit_generation_##name(&table->entries, visit, context);                                                                                              \
+		if (table->old_entries.slots != NULL) {                                                                                                                           \
+			swisstable_visit_generation_##name(&table->old_entries, visit, context);                                                                                  \
+		}                                                                                                                                                                 \
+	}                                                                                                                                                                         \
+                                                                                                                                                                                  \
+	_Pragma("GCC diagnostic pop")
+
+#define DECLARE_SWISSTABLE_STRING(name, order, value_entries)                                                                                                                     \
+	static inline uint32_t swisstable_hash_##name(const char *key)                                                                                                            \
+	{                                                                                                                                                                         \
+		return swisstable_hash_string(key);                                                                                                                               \
+	}                                                                                                                                                                         \
+	static inline int swisstable_is_equal_##name(const char *s1, const char *s2)                                                                                              \
+	{                                                                                                                                                                         \
+		return !strcmp(s1, s2);                                                                                                                                           \
+	}                                                                                                                                                                         \
+	DECLARE_SWISSTABLE(name, order, const char *, value_entries)
+
+#define DECLARE_SWISSTABLE_UINT32(name, order, value_entries)                                                                                                                     \
+	static inline uint32_t swisstable_hash_##name(uint32_t key)                                                                                                               \
+	{                                                                                                                                                                         \
+		return swisstable_mix((uint64_t)key * hash64_magic);                                                                                                              \
+	}                                                                                                                                                                         \
+	static inline int swisstable_is_equal_##name(uint32_t a, uint32_t b)                                                                                                      \
+	{                                                                                                                                                                         \
+		return a == b;                                                                                                                                                    \
+	}                                                                                                                                                                         \
+	DECLARE_SWISSTABLE(name, order, uint32_t, value_entries)
+
+#define DECLARE_SWISSTABLE_UINT64(name, order, value_entries)                                                                                                                     \
+	static inline uint32_t swisstable_hash_##name(uint64_t key)                                                                                                               \
+	{                                                                                                                                                                         \
+		return swisstable_mix(key * hash64_magic);                                                                                                                        \
+	}                                                                                                                                                                         \
+	static inline int swisstable_is_equal_##name(uint64_t a, uint64_t b)                                                                                                      \
+	{                                                                                                                                                                         \
+		return a == b;                                                                                                                                                    \
+	}                                                                                                                                                                         \
+	DECLARE_SWISSTABLE(name, order, uint64_t, value_entries)
+
+#endif
@@ -28,12 +28,12 @@
 
 #include "compiler.h"
 #include "generated/cjet_config.h"
-#include "hashtable.h"
+#include "swisstable.h"
 #include "table.h"
 
-DECLARE_HASHTABLE_STRING(element_table, CONFIG_ELEMENT_TABLE_ORDER, 1U)
+DECLARE_SWISSTABLE_STRING(element_table, CONFIG_ELEMENT_TABLE_ORDER, 1U)
 
-static struct hashtable_string *element_hashtable = NULL;
+static struct hashtable_element_table *element_hashtable = NULL;
 
 int element_hashtable_create(void)
 {
@@ -0,0 +1,132 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE arena
+
+#include <boost/test/unit_test.hpp>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "arena.h"
+
+static const size_t block_size = 256;
+
+BOOST_AUTO_TEST_CASE(allocations_are_aligned_and_owned)
+{
+	struct arena arena;
+	arena_init(&arena, block_size);
+
+	for (size_t size = 1; size < 40; size++) {
+		char *ptr = (char *)arena_alloc(&arena, size);
+		BOOST_REQUIRE(ptr != NULL);
+		BOOST_CHECK_EQUAL((uintptr_t)ptr % 8, 0U);
+		BOOST_CHECK(arena_owns(&arena, ptr));
+		BOOST_CHECK(arena_owns(&arena, ptr + size - 1));
+		::memset(ptr, 0xaa, size);
+	}
+
+	int not_owned;
+	BOOST_CHECK(!arena_owns(&arena, &not_owned));
+
+	arena_destroy(&arena);
+	BOOST_CHECK_EQUAL(cjet_get_alloc_size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(large_allocation_keeps_current_block)
+{
+	struct arena arena;
+	arena_init(&arena, block_size);
+
+	char *first = (char *)arena_alloc(&arena, 8);
+	char *large = (char *)arena_alloc(&arena, block_size * 2);
+	BOOST_REQUIRE(large != NULL);
+	::memset(large, 0x55, block_size * 2);
+	BOOST_CHECK(arena_owns(&arena, large));
+	BOOST_CHECK(arena_owns(&arena, large + block_size * 2 - 1));
+
+	char *second = (char *)arena_alloc(&arena, 8);
+	BOOST_CHECK(second == first + 8);
+
+	arena_destroy(&arena);
+	BOOST_CHECK_EQUAL(cjet_get_alloc_size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(reset_keeps_one_block)
+{
+	struct arena arena;
+	arena_init(&arena, block_size);
+
+	char *first = (char *)arena_alloc(&arena, 16);
+	for (unsigned int i = 0; i < 100; i++) {
+		BOOST_REQUIRE(arena_alloc(&arena, 48) != NULL);
+	}
+	BOOST_REQUIRE(arena_alloc(&arena, block_size) != NULL);
+	size_t allocated = cjet_get_alloc_size();
+
+	arena_reset(&arena);
+	BOOST_CHECK(cjet_get_alloc_size() < allocated);
+	BOOST_CHECK(cjet_get_alloc_size() > 0);
+
+	char *after_reset = (char *)arena_alloc(&arena, 16);
+	BOOST_CHECK(after_reset != NULL);
+	BOOST_CHECK(arena_owns(&arena, after_reset));
+	BOOST_CHECK(!arena_owns(&arena, first) || (first == after_reset));
+
+	arena_destroy(&arena);
+	BOOST_CHECK_EQUAL(cjet_get_alloc_size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(reset_of_unused_arena)
+{
+	struct arena arena;
+	arena_init(&arena, block_size);
+	arena_reset(&arena);
+	BOOST_CHECK(arena_alloc(&arena, 1) != NULL);
+	arena_destroy(&arena);
+	arena_destroy(&arena);
+	BOOST_CHECK_EQUAL(cjet_get_alloc_size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(message_arena_owns_only_its_memory)
+{
+	char *heap = (char *)cjet_malloc(16);
+	BOOST_REQUIRE(heap != NULL);
+	BOOST_CHECK(!message_arena_owns(heap));
+
+	for (size_t size = 1; size < 2 * block_size; size += 13) {
+		char *ptr = (char *)message_arena_alloc(size);
+		BOOST_REQUIRE(ptr != NULL);
+		BOOST_CHECK_EQUAL((uintptr_t)ptr % 8, 0U);
+		BOOST_CHECK(message_arena_owns(ptr));
+		::memset(ptr, 0xff, size);
+	}
+
+	message_arena_reset();
+	cjet_free(heap);
+}
@@ -0,0 +1,225 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "alloc.h"
+#include "eventloop.h"
+#include "fetch.h"
+#include "json/cJSON.h"
+#include "parse.h"
+#include "peer.h"
+#include "element.h"
+#include "table.h"
+
+/*
+ * Measures full scans over all states of a peer, which are done by
+ * fetches and gets that can't use the path index. None of the states
+ * matches, so the time is spent on visiting the states.
+ */
+
+static const unsigned int NUMBER_OF_STATES = 1000000;
+static const unsigned int NUMBER_OF_SCANS = 10;
+
+extern "C" {
+
+	ssize_t socket_read(socket_type sock, void *buf, size_t count)
+	{
+		(void)sock;
+		(void)count;
+		uint64_t number_of_timeouts = 1;
+		::memcpy(buf, &number_of_timeouts, sizeof(number_of_timeouts));
+		return 8;
+	}
+
+	int socket_close(socket_type sock)
+	{
+		(void)sock;
+		return 0;
+	}
+
+	/*
+	 * The states don't fit into the configured maximum heap size, so
+	 * the allocator of the jet is replaced.
+	 */
+	void *cjet_malloc(size_t size)
+	{
+		return ::malloc(size);
+	}
+
+	void cjet_free(void *ptr)
+	{
+		::free(ptr);
+	}
+
+	void *cjet_calloc(size_t nmemb, size_t size)
+	{
+		return ::calloc(nmemb, size);
+	}
+
+	size_t cjet_get_alloc_size(void)
+	{
+		return 0;
+	}
+}
+
+static int send_message(const struct peer *p, char *rendered, size_t len)
+{
+	(void)p;
+	(void)rendered;
+	(void)len;
+	return 0;
+}
+
+static enum eventloop_return fake_add(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+	return EL_CONTINUE_LOOP;
+}
+
+static void fake_remove(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+}
+
+static struct eventloop loop;
+
+static struct peer *alloc_peer()
+{
+	struct peer *p = (struct peer *)::malloc(sizeof(*p));
+	init_peer(p, false, &loop);
+	p->send_message = send_message;
+	return p;
+}
+
+static void free_peer(struct peer *p)
+{
+	free_peer_resources(p);
+	::free(p);
+}
+
+static cJSON *create_request(const char *method, const char *matcher, const char *pattern)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "id", pattern);
+	cJSON *path = cJSON_CreateObject();
+	cJSON_AddItemToObject(params, "path", path);
+	cJSON_AddStringToObject(path, matcher, pattern);
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "request");
+	cJSON_AddStringToObject(root, "method", method);
+	return root;
+}
+
+static void add_states(struct peer *owner)
+{
+	char path[64];
+	for (unsigned int i = 0; i < NUMBER_OF_STATES; i++) {
+		snprintf(path, sizeof(path), "device_%u/channel_%u/value", i / 100, i % 100);
+		cJSON *params = cJSON_CreateObject();
+		cJSON_AddStringToObject(params, "path", path);
+		cJSON_AddNumberToObject(params, "value", i);
+		cJSON *request = cJSON_CreateObject();
+		cJSON_AddItemToObject(request, "params", params);
+		cJSON_AddStringToObject(request, "id", "request");
+		cJSON_AddStringToObject(request, "method", "add");
+		cJSON *response = add_element_to_peer(owner, request);
+		cJSON_Delete(response);
+		cJSON_Delete(request);
+	}
+}
+
+static double ns_per_state(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+	return (double)elapsed.count() / ((double)NUMBER_OF_STATES * NUMBER_OF_SCANS);
+}
+
+static double scan_with_get()
+{
+	struct peer *getter = alloc_peer();
+	cJSON *request = create_request("get", "endsWith", "/not_there");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < NUMBER_OF_SCANS; i++) {
+		cJSON *response = get_elements(request, getter);
+		cJSON_Delete(response);
+	}
+	double ns = ns_per_state(start);
+	cJSON_Delete(request);
+	free_peer(getter);
+	return ns;
+}
+
+static double scan_with_fetch()
+{
+	struct peer *fetcher = alloc_peer();
+	cJSON *request = create_request("fetch", "endsWith", "/not_there");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < NUMBER_OF_SCANS; i++) {
+		struct fetch *f = NULL;
+		cJSON *response = NULL;
+		if (add_fetch_to_peer(fetcher, request, &f, &response) != 0) {
+			fprintf(stderr, "could not add fetch!\n");
+			exit(EXIT_FAILURE);
+		}
+		response = add_fetch_to_states(fetcher, request, f);
+		cJSON_Delete(response);
+		remove_all_fetchers_from_peer(fetcher);
+	}
+	double ns = ns_per_state(start);
+	cJSON_Delete(request);
+	free_peer(fetcher);
+	return ns;
+}
+
+int main()
+{
+	loop.this_ptr = NULL;
+	loop.init = NULL;
+	loop.destroy = NULL;
+	loop.run = NULL;
+	loop.add = fake_add;
+	loop.remove = fake_remove;
+
+	init_parser();
+	element_hashtable_create();
+	struct peer *owner = alloc_peer();
+	add_states(owner);
+
+	printf("get:   %6.2f ns per state\n", scan_with_get());
+	printf("fetch: %6.2f ns per state\n", scan_with_fetch());
+
+	free_peer(owner);
+	element_hashtable_delete();
+	return EXIT_SUCCESS;
+}
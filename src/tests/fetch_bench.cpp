@@ -0,0 +1,205 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "eventloop.h"
+#include "fetch.h"
+#include "json/cJSON.h"
+#include "parse.h"
+#include "peer.h"
+#include "element.h"
+#include "table.h"
+
+/*
+ * Measures the cost of adding and removing states which are matched by
+ * none of the registered fetches. Without a fetch index this is linear
+ * in the number of fetches.
+ */
+
+static const unsigned int NUMBER_OF_STATES = 1000;
+
+extern "C" {
+
+	ssize_t socket_read(socket_type sock, void *buf, size_t count)
+	{
+		(void)sock;
+		(void)count;
+		uint64_t number_of_timeouts = 1;
+		::memcpy(buf, &number_of_timeouts, sizeof(number_of_timeouts));
+		return 8;
+	}
+
+	int socket_close(socket_type sock)
+	{
+		(void)sock;
+		return 0;
+	}
+}
+
+static int send_message(const struct peer *p, char *rendered, size_t len)
+{
+	(void)p;
+	(void)rendered;
+	(void)len;
+	return 0;
+}
+
+static enum eventloop_return fake_add(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+	return EL_CONTINUE_LOOP;
+}
+
+static void fake_remove(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+}
+
+static struct eventloop loop;
+
+static struct peer *alloc_peer()
+{
+	struct peer *p = (struct peer *)::malloc(sizeof(*p));
+	init_peer(p, false, &loop);
+	p->send_message = send_message;
+	return p;
+}
+
+static void free_peer(struct peer *p)
+{
+	free_peer_resources(p);
+	::free(p);
+}
+
+static cJSON *create_fetch(const char *matcher, const char *pattern)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "id", pattern);
+	cJSON *path = cJSON_CreateObject();
+	cJSON_AddItemToObject(params, "path", path);
+	cJSON_AddStringToObject(path, matcher, pattern);
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "fetch_request");
+	cJSON_AddStringToObject(root, "method", "fetch");
+	return root;
+}
+
+static cJSON *create_path_request(const char *method, const char *path)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "path", path);
+	if (strcmp(method, "add") == 0) {
+		cJSON_AddNumberToObject(params, "value", 42);
+	}
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "request");
+	cJSON_AddStringToObject(root, "method", method);
+	return root;
+}
+
+static void add_fetches(struct peer *p, unsigned int number_of_fetches)
+{
+	static const char *matchers[] = {"equals", "startsWith", "endsWith", "contains"};
+	char pattern[64];
+
+	for (unsigned int i = 0; i < number_of_fetches; i++) {
+		const char *matcher = matchers[i % 4];
+		if (i % 4 == 2) {
+			snprintf(pattern, sizeof(pattern), "/fetch_%u", i);
+		} else {
+			snprintf(pattern, sizeof(pattern), "fetch_%u/", i);
+		}
+		cJSON *request = create_fetch(matcher, pattern);
+		struct fetch *f = NULL;
+		cJSON *response = NULL;
+		if (add_fetch_to_peer(p, request, &f, &response) != 0) {
+			fprintf(stderr, "could not add fetch!\n");
+			exit(EXIT_FAILURE);
+		}
+		response = add_fetch_to_states(p, request, f);
+		cJSON_Delete(response);
+		cJSON_Delete(request);
+	}
+}
+
+static double add_and_remove_states(struct peer *owner)
+{
+	char path[64];
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < NUMBER_OF_STATES; i++) {
+		snprintf(path, sizeof(path), "state/%u", i);
+		cJSON *request = create_path_request("add", path);
+		cJSON *response = add_element_to_peer(owner, request);
+		cJSON_Delete(response);
+		cJSON_Delete(request);
+	}
+	for (unsigned int i = 0; i < NUMBER_OF_STATES; i++) {
+		snprintf(path, sizeof(path), "state/%u", i);
+		cJSON *request = create_path_request("remove", path);
+		cJSON *response = remove_element_from_peer(owner, request);
+		cJSON_Delete(response);
+		cJSON_Delete(request);
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+	return (double)elapsed.count() / NUMBER_OF_STATES;
+}
+
+int main()
+{
+	static const unsigned int fetch_counts[] = {100, 1000, 10000};
+
+	loop.this_ptr = NULL;
+	loop.init = NULL;
+	loop.destroy = NULL;
+	loop.run = NULL;
+	loop.add = fake_add;
+	loop.remove = fake_remove;
+
+	init_parser();
+	for (unsigned int i = 0; i < sizeof(fetch_counts) / sizeof(*fetch_counts); i++) {
+		element_hashtable_create();
+		struct peer *owner = alloc_peer();
+		struct peer *fetcher = alloc_peer();
+
+		add_fetches(fetcher, fetch_counts[i]);
+		double ns = add_and_remove_states(owner);
+		printf("%6u fetches: %10.1f ns per state add/remove\n", fetch_counts[i], ns);
+
+		free_peer(fetcher);
+		free_peer(owner);
+		element_hashtable_delete();
+	}
+	return EXIT_SUCCESS;
+}
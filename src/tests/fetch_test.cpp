@@ -30,10 +30,17 @@
 
 #include <boost/test/unit_test.hpp>
 #include <list>
+#include <algorithm>
+#include <map>
+#include <set>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "eventloop.h"
 #include "generated/cjet_config.h"
+#include "jet_regex.h"
+#include "json_patch.h"
 #include "json/cJSON.h"
 #include "parse.h"
 #include "peer.h"
@@ -41,6 +48,8 @@
 #include "element.h"
 #include "table.h"
 
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*(x)))
+
 enum event {
 	UNKNOWN_EVENT,
 	ADD_EVENT,
@@ -269,10 +278,12 @@ int send_message(const struct peer *p, char *rendered, size_t len)
 	return 0;
 }
 
+static struct io_event *last_added_event;
+
 static enum eventloop_return fake_add(const void *this_ptr, const struct io_event *ev)
 {
 	(void)this_ptr;
-	(void)ev;
+	last_added_event = const_cast<struct io_event *>(ev);
 	return EL_CONTINUE_LOOP;
 }
 
@@ -458,6 +469,48 @@ static cJSON *create_fetch_params(
 	return root;
 }
 
+static cJSON *create_fetch_with_matcher(const char *fetch_id, const char *matcher, const char *pattern, bool ignore_case)
+{
+	cJSON *params = cJSON_CreateObject();
+	BOOST_REQUIRE(params != NULL);
+	cJSON_AddStringToObject(params, "id", fetch_id);
+	cJSON *path = cJSON_CreateObject();
+	BOOST_REQUIRE(path != NULL);
+	cJSON_AddItemToObject(params, "path", path);
+	cJSON_AddStringToObject(path, matcher, pattern);
+	if (ignore_case) {
+		cJSON_AddTrueToObject(path, "caseInsensitive");
+	}
+
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "fetch_request_1");
+	cJSON_AddStringToObject(root, "method", "fetch");
+	return root;
+}
+
+static cJSON *create_fetch_with_containsallof(const char *fetch_id, const char *patterns, bool ignore_case)
+{
+	cJSON *params = cJSON_CreateObject();
+	BOOST_REQUIRE(params != NULL);
+	cJSON_AddStringToObject(params, "id", fetch_id);
+	cJSON *path = cJSON_CreateObject();
+	BOOST_REQUIRE(path != NULL);
+	cJSON_AddItemToObject(params, "path", path);
+	cJSON *array = cJSON_Parse(patterns);
+	BOOST_REQUIRE(array != NULL);
+	cJSON_AddItemToObject(path, "containsAllOf", array);
+	if (ignore_case) {
+		cJSON_AddTrueToObject(path, "caseInsensitive");
+	}
+
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "fetch_request_1");
+	cJSON_AddStringToObject(root, "method", "fetch");
+	return root;
+}
+
 static cJSON *create_remove(const char *path)
 {
 	cJSON *params = cJSON_CreateObject();
@@ -495,11 +548,11 @@ static cJSON *create_fetch_with_multiple_matchers(const char *path_contains, uns
 	return root;
 }
 
-static cJSON *create_unfetch_params()
+static cJSON *create_unfetch_params(const char *fetch_id = "fetch_id_1")
 {
 	cJSON *params = cJSON_CreateObject();
 	BOOST_REQUIRE(params != NULL);
-	cJSON_AddStringToObject(params, "id", "fetch_id_1");
+	cJSON_AddStringToObject(params, "id", fetch_id);
 
 	cJSON *root = cJSON_CreateObject();
 	cJSON_AddItemToObject(root, "params", params);
@@ -625,7 +678,7 @@ BOOST_FIXTURE_TEST_CASE(lots_of_fetches_to_single_state, F)
 	cJSON_Delete(response);
 
 	unsigned int i;
-	for (i = 0; i <= CONFIG_INITIAL_FETCH_TABLE_SIZE; i++) {
+	for (i = 0; i < 5; i++) {
 		struct fetch *f = NULL;
 		request = create_fetch_with_fetchid(i, path);
 		cJSON *response;
@@ -679,6 +732,1095 @@ BOOST_FIXTURE_TEST_CASE(multiple_fetches_before_state_add, F)
 	cJSON_Delete(response);
 }
 
+BOOST_FIXTURE_TEST_CASE(fetch_index_before_state_add, F)
+{
+	struct fetch_spec {
+		const char *fetch_id;
+		const char *matcher;
+		const char *pattern;
+		bool ignore_case;
+		bool matches;
+	};
+
+	static const struct fetch_spec specs[] = {
+		{"equals", "equals", "foo/bar", false, true},
+		{"startsWith", "startsWith", "foo", false, true},
+		{"startsWith_empty", "startsWith", "", false, true},
+		{"endsWith", "endsWith", "bar", false, true},
+		{"startsWith_ignore_case", "startsWith", "FOO/", true, true},
+		{"endsWith_ignore_case", "endsWith", "O/BAR", true, true},
+		{"equals_ignore_case", "equals", "Foo/Bar", true, true},
+		{"contains", "contains", "o/b", false, true},
+		{"equals_prefix", "equals", "foo", false, false},
+		{"equals_longer", "equals", "foo/bar/", false, false},
+		{"startsWith_no_match", "startsWith", "bar", false, false},
+		{"startsWith_longer", "startsWith", "foo/bar/baz", false, false},
+		{"endsWith_no_match", "endsWith", "foo", false, false},
+		{"endsWith_case", "endsWith", "BAR", false, false},
+	};
+
+	std::set<std::string> expected_ids;
+	for (unsigned int i = 0; i < ARRAY_SIZE(specs); i++) {
+		struct fetch *f = NULL;
+		cJSON *request = create_fetch_with_matcher(specs[i].fetch_id, specs[i].matcher, specs[i].pattern, specs[i].ignore_case);
+		cJSON *response;
+		int ret = add_fetch_to_peer(fetch_peer_1, request, &f, &response);
+		BOOST_REQUIRE_MESSAGE(ret == 0, "add_fetch_to_peer() failed!");
+		response = add_fetch_to_states(fetch_peer_1, request, f);
+		BOOST_REQUIRE_MESSAGE(response != NULL, "add_fetch_to_states() had no response!");
+		BOOST_CHECK_MESSAGE(!response_is_error(response), "add_fetch_to_states() failed!");
+		cJSON_Delete(request);
+		cJSON_Delete(response);
+		if (specs[i].matches) {
+			expected_ids.insert(specs[i].fetch_id);
+		}
+	}
+
+	cJSON *request = create_add("foo/bar");
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_REQUIRE_MESSAGE(response != NULL, "add_element_to_peer() had no response!");
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	std::set<std::string> notified_ids;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		BOOST_CHECK(get_event_from_json(json) == ADD_EVENT);
+		cJSON *method = cJSON_GetObjectItem(json, "method");
+		BOOST_REQUIRE(method != NULL && method->type == cJSON_String);
+		notified_ids.insert(method->valuestring);
+		cJSON_Delete(json);
+	}
+	BOOST_CHECK(notified_ids == expected_ids);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+
+	request = create_add("foo/bar/baz");
+	response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_CHECK(fetch_events.size() == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_index_with_multiple_matchers, F)
+{
+	struct fetch *f = NULL;
+	cJSON *request = create_fetch_params("", "", "f", "o/bar", "", "", 0);
+	cJSON *response;
+	int ret = add_fetch_to_peer(fetch_peer_1, request, &f, &response);
+	BOOST_REQUIRE_MESSAGE(ret == 0, "add_fetch_to_peer() failed!");
+	response = add_fetch_to_states(fetch_peer_1, request, f);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_fetch_to_states() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	request = create_add("xoo/bar");
+	response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_CHECK(fetch_events.size() == 0);
+
+	request = create_add("foo/bar");
+	response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_CHECK(fetch_events.size() == 1);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+static std::set<std::string> get_notified_fetch_ids()
+{
+	std::set<std::string> notified_ids;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		BOOST_CHECK(get_event_from_json(json) == ADD_EVENT);
+		cJSON *method = cJSON_GetObjectItem(json, "method");
+		BOOST_REQUIRE(method != NULL && method->type == cJSON_String);
+		notified_ids.insert(method->valuestring);
+		cJSON_Delete(json);
+	}
+	return notified_ids;
+}
+
+static void add_fetch_request(struct peer *p, cJSON *request)
+{
+	struct fetch *f = NULL;
+	cJSON *response;
+	int ret = add_fetch_to_peer(p, request, &f, &response);
+	BOOST_REQUIRE_MESSAGE(ret == 0, "add_fetch_to_peer() failed!");
+	response = add_fetch_to_states(p, request, f);
+	BOOST_REQUIRE_MESSAGE(response != NULL, "add_fetch_to_states() had no response!");
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_fetch_to_states() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_index_contains_before_state_add, F)
+{
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("contains_suffix", "contains", "bar", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("contains_overlap", "contains", "/bar", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("contains_no_match", "contains", "obaz", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("contains_empty", "contains", "", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("contains_ignore_case", "contains", "O/B", true));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("contains_case", "contains", "O/B", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_containsallof("allof", "[\"foo\", \"o/b\", \"ar\"]", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_containsallof("allof_duplicate", "[\"o\", \"o\"]", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_containsallof("allof_one_missing", "[\"foo\", \"baz\"]", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_containsallof("allof_ignore_case", "[\"FOO\", \"BAR\"]", true));
+
+	cJSON *request = create_add("foo/bar");
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	std::set<std::string> expected_ids = {
+		"contains_suffix",
+		"contains_overlap",
+		"contains_empty",
+		"contains_ignore_case",
+		"allof",
+		"allof_duplicate",
+		"allof_ignore_case",
+	};
+	BOOST_CHECK(get_notified_fetch_ids() == expected_ids);
+
+	request = create_remove("foo/bar");
+	response = remove_element_from_peer(owner_peer, request);
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	while (!fetch_events.empty()) {
+		cJSON_Delete(fetch_events.front());
+		fetch_events.pop_front();
+	}
+
+	request = create_unfetch_params("contains_suffix");
+	response = remove_fetch_from_peer(fetch_peer_1, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "remove_fetch_from_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	request = create_add("x/bar");
+	response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	expected_ids = {"contains_overlap", "contains_empty"};
+	BOOST_CHECK(get_notified_fetch_ids() == expected_ids);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+static unsigned int number_of_fetchers(const struct element *e)
+{
+	return (e->fetchers == NULL) ? 0 : e->fetchers->number_of_entries;
+}
+
+BOOST_FIXTURE_TEST_CASE(unfetch_detaches_fetch_from_states, F)
+{
+	const char *path = "foo/bar";
+	const char *other_path = "foo/baz";
+
+	cJSON *request = create_add(path);
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	request = create_add(other_path);
+	response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	struct fetch *f = NULL;
+	request = create_fetch_with_matcher("fetch_id_1", "startsWith", "foo", false);
+	int ret = add_fetch_to_peer(fetch_peer_1, request, &f, &response);
+	BOOST_REQUIRE_MESSAGE(ret == 0, "add_fetch_to_peer() failed!");
+	response = add_fetch_to_states(fetch_peer_1, request, f);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_fetch_to_states() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	struct element *e = get_state(path);
+	struct element *other_e = get_state(other_path);
+	BOOST_CHECK(number_of_fetchers(e) == 1);
+	BOOST_CHECK(number_of_fetchers(other_e) == 1);
+	BOOST_CHECK(e->fetchers == other_e->fetchers);
+	BOOST_CHECK(e->fetchers->references == 2);
+
+	request = create_remove(other_path);
+	response = remove_element_from_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "remove_element_from_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_CHECK(f->expression->set_entries.next->next == &f->expression->set_entries);
+	BOOST_CHECK(e->fetchers->references == 1);
+
+	request = create_unfetch_params();
+	response = remove_fetch_from_peer(fetch_peer_1, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "remove_fetch_from_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_CHECK(number_of_fetchers(e) == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(identical_fetches_share_expression, F)
+{
+	const char *path = "foo/bar";
+
+	cJSON *request = create_add(path);
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("shared_1", "startsWith", "foo", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("shared_2", "startsWith", "foo", false));
+
+	std::set<std::string> expected_ids = {"shared_1", "shared_2"};
+	BOOST_CHECK(get_notified_fetch_ids() == expected_ids);
+
+	struct element *e = get_state(path);
+	BOOST_CHECK(number_of_fetchers(e) == 1);
+
+	request = create_unfetch_params("shared_1");
+	response = remove_fetch_from_peer(fetch_peer_1, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "remove_fetch_from_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_CHECK(number_of_fetchers(e) == 1);
+
+	request = create_remove(path);
+	response = remove_element_from_peer(owner_peer, request);
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	while (!fetch_events.empty()) {
+		cJSON_Delete(fetch_events.front());
+		fetch_events.pop_front();
+	}
+
+	request = create_add(path);
+	response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	expected_ids = {"shared_2"};
+	BOOST_CHECK(get_notified_fetch_ids() == expected_ids);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_AUTO_TEST_CASE(regex_semantics)
+{
+	struct {
+		const char *pattern;
+		bool ignore_case;
+		const char *path;
+		bool matches;
+	} specs[] = {
+		{"bar", false, "foo/bar/baz", true},
+		{"^bar", false, "foo/bar", false},
+		{"^foo/", false, "foo/bar", true},
+		{"bar$", false, "foo/bar", true},
+		{"bar$", false, "foo/barz", false},
+		{"^foo/ba[rz]$", false, "foo/baz", true},
+		{"^foo/ba[^rz]$", false, "foo/baz", false},
+		{"^foo/ba[^rz]$", false, "foo/bat", true},
+		{"^(foo|bar)/\\d+$", false, "bar/123", true},
+		{"^(foo|bar)/\\d+$", false, "bar/12a", false},
+		{"^(?:foo)+$", false, "foofoofoo", true},
+		{"^a(bc)*d?$", false, "abcbc", true},
+		{"^a(bc)*d?$", false, "abcb", false},
+		{"^a.c$", false, "a/c", true},
+		{"^\\w+\\.\\w+$", false, "foo.bar", true},
+		{"^\\w+\\.\\w+$", false, "foo/bar", false},
+		{"^\\S+\\s\\D$", false, "foo x", true},
+		{"^[a-c\\-]+$", false, "ab-c", true},
+		{"^$", false, "", true},
+		{"a|", false, "xyz", true},
+		{"^a|b", false, "xb", true},
+		{"^a|b", false, "ax", true},
+		{"^a|b", false, "xa", false},
+		{"^a|^b", false, "bx", true},
+		{"^a|^b", false, "xb", false},
+		{"a$|b", false, "bx", true},
+		{"a$|b", false, "xa", true},
+		{"a$|b", false, "ax", false},
+		{"^a$|^b$", false, "ab", false},
+		{"a\\$|b", false, "xa$y", true},
+		{"^FOO/[B-D]AR$", true, "foo/bar", true},
+		{"^foo/[^b]ar$", true, "foo/bar", false},
+		{"^foo/\\D+$", true, "foo/bar", true},
+		{"^foo/\\W$", true, "foo/b", false},
+	};
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(specs); i++) {
+		struct jet_regex *re = jet_regex_compile(specs[i].pattern, specs[i].ignore_case);
+		BOOST_REQUIRE_MESSAGE(re != NULL, "Could not compile " << specs[i].pattern);
+		bool matches = jet_regex_match(re, specs[i].path, strlen(specs[i].path));
+		BOOST_CHECK_MESSAGE(matches == specs[i].matches, specs[i].pattern << " against " << specs[i].path);
+		jet_regex_free(re);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(regex_unsupported)
+{
+	static const char *patterns[] = {
+		"(foo",
+		"foo)",
+		"*foo",
+		"a{2}",
+		"foo\\b",
+		"[a-",
+		"[z-a]",
+		"foo^bar",
+		"foo$bar",
+		"(^a|b)",
+		"(a|b$)",
+		"a|b^",
+		"(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)",
+	};
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(patterns); i++) {
+		struct jet_regex *re = jet_regex_compile(patterns[i], false);
+		BOOST_CHECK_MESSAGE(re == NULL, patterns[i] << " was compiled");
+		if (re != NULL) {
+			jet_regex_free(re);
+		}
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_with_regex, F)
+{
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("regex", "regex", "^foo/bar_\\d+$", false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("regex_ignore_case", "regex", "^FOO/\\D+_17$", true));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("regex_no_match", "regex", "^bar", false));
+
+	cJSON *request = create_add("foo/bar_17");
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	std::set<std::string> expected_ids = {"regex", "regex_ignore_case"};
+	BOOST_CHECK(get_notified_fetch_ids() == expected_ids);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_with_invalid_regex, F)
+{
+	struct fetch *f = NULL;
+	cJSON *response;
+	cJSON *request = create_fetch_with_matcher("fetch_id_1", "regex", "(foo", false);
+	int ret = add_fetch_to_peer(fetch_peer_1, request, &f, &response);
+	BOOST_REQUIRE_MESSAGE((ret < 0) && (response != NULL), "add_fetch_to_peer() had no response!");
+	BOOST_CHECK_MESSAGE(response_is_error(response), "add_fetch_to_peer() did not fail!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+}
+
+static void add_state_with_value(const char *path, cJSON *value)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "path", path);
+	cJSON_AddItemToObject(params, "value", value);
+	cJSON *request = cJSON_CreateObject();
+	cJSON_AddItemToObject(request, "params", params);
+	cJSON_AddStringToObject(request, "id", "add_request_1");
+	cJSON_AddStringToObject(request, "method", "add");
+
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+}
+
+static void change_state_value(const char *path, cJSON *value, const char *name = "value")
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "path", path);
+	cJSON_AddItemToObject(params, name, value);
+	cJSON *request = cJSON_CreateObject();
+	cJSON_AddItemToObject(request, "params", params);
+	cJSON_AddStringToObject(request, "id", "change_request_1");
+	cJSON_AddStringToObject(request, "method", "change");
+
+	cJSON *response = change_state(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "change_state() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+}
+
+static void remove_state(const char *path)
+{
+	cJSON *request = create_remove(path);
+	cJSON *response = remove_element_from_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "remove_element_from_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+}
+
+static cJSON *create_sorted_fetch(const char *sort)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "id", "sorted_fetch");
+	cJSON_AddItemToObject(params, "sort", cJSON_Parse(sort));
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "fetch_request_1");
+	cJSON_AddStringToObject(root, "method", "fetch");
+	return root;
+}
+
+/*
+ * Applies all pending sorted fetch notifications to the window a client
+ * would display. Returns the number of applied notifications.
+ */
+static unsigned int apply_window_changes(std::vector<std::string> &window, unsigned int from)
+{
+	unsigned int number_of_notifications = 0;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		const cJSON *params = cJSON_GetObjectItem(json, "params");
+		const cJSON *changes = cJSON_GetObjectItem(params, "changes");
+		const cJSON *n = cJSON_GetObjectItem(params, "n");
+		BOOST_REQUIRE((changes != NULL) && (n != NULL));
+
+		for (const cJSON *change = changes->child; change != NULL; change = change->next) {
+			unsigned int index = cJSON_GetObjectItem(change, "index")->valueint;
+			BOOST_REQUIRE(index >= from);
+			if (window.size() <= index - from) {
+				window.resize(index - from + 1);
+			}
+			window[index - from] = cJSON_GetObjectItem(change, "path")->valuestring;
+		}
+		window.resize(n->valueint);
+		number_of_notifications++;
+		cJSON_Delete(json);
+	}
+	return number_of_notifications;
+}
+
+BOOST_FIXTURE_TEST_CASE(sorted_fetch_by_value, F)
+{
+	add_state_with_value("s1", cJSON_CreateNumber(50));
+	add_state_with_value("s2", cJSON_CreateNumber(10));
+	add_state_with_value("s3", cJSON_CreateNumber(40));
+	add_state_with_value("s4", cJSON_CreateNumber(20));
+	add_state_with_value("s5", cJSON_CreateNumber(30));
+	add_state_with_value("s6", cJSON_CreateString("not a number"));
+
+	add_fetch_request(fetch_peer_1, create_sorted_fetch("{\"from\": 1, \"to\": 3, \"byValue\": \"number\"}"));
+	std::vector<std::string> window;
+	BOOST_CHECK(apply_window_changes(window, 1) == 1);
+	std::vector<std::string> expected = {"s2", "s4", "s5"};
+	BOOST_CHECK(window == expected);
+
+	change_state_value("s1", cJSON_CreateNumber(5));
+	BOOST_CHECK(apply_window_changes(window, 1) == 1);
+	expected = {"s1", "s2", "s4"};
+	BOOST_CHECK(window == expected);
+
+	change_state_value("s3", cJSON_CreateNumber(45));
+	BOOST_CHECK_MESSAGE(apply_window_changes(window, 1) == 0, "change outside of the window was notified");
+
+	remove_state("s2");
+	BOOST_CHECK(apply_window_changes(window, 1) == 1);
+	expected = {"s1", "s4", "s5"};
+	BOOST_CHECK(window == expected);
+
+	change_state_value("s6", cJSON_CreateNumber(1));
+	BOOST_CHECK(apply_window_changes(window, 1) == 1);
+	expected = {"s6", "s1", "s4"};
+	BOOST_CHECK(window == expected);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(sorted_fetch_when_owner_disconnects, F)
+{
+	for (int i = 0; i < 20; i++) {
+		add_state_with_value(("s" + std::to_string(i)).c_str(), cJSON_CreateNumber(i));
+	}
+
+	add_fetch_request(fetch_peer_1, create_sorted_fetch("{\"from\": 1, \"to\": 5, \"byValue\": \"number\"}"));
+	std::vector<std::string> window;
+	BOOST_CHECK(apply_window_changes(window, 1) == 1);
+	BOOST_CHECK(window.size() == 5);
+
+	remove_all_elements_from_peer(owner_peer);
+	BOOST_CHECK_MESSAGE(apply_window_changes(window, 1) == 1, "removed states were not notified in a single window update");
+	BOOST_CHECK(window.empty());
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(sorted_fetch_by_value_field_descending, F)
+{
+	static const char *paths[] = {"a", "b", "c", "d"};
+	for (unsigned int i = 0; i < ARRAY_SIZE(paths); i++) {
+		cJSON *value = cJSON_CreateObject();
+		cJSON *alarm = cJSON_CreateObject();
+		cJSON_AddItemToObject(value, "alarm", alarm);
+		cJSON_AddNumberToObject(alarm, "priority", i);
+		add_state_with_value(paths[i], value);
+	}
+
+	add_fetch_request(fetch_peer_1, create_sorted_fetch("{\"from\": 2, \"to\": 3, \"descending\": true, \"byValueField\": {\"alarm.priority\": \"number\"}}"));
+	std::vector<std::string> window;
+	BOOST_CHECK(apply_window_changes(window, 2) == 1);
+	std::vector<std::string> expected = {"c", "b"};
+	BOOST_CHECK(window == expected);
+
+	remove_state("d");
+	remove_state("c");
+	apply_window_changes(window, 2);
+	expected = {"a"};
+	BOOST_CHECK(window == expected);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(sorted_fetch_random_operations, F)
+{
+	static const unsigned int number_of_states = 100;
+	static const unsigned int from = 5;
+	static const unsigned int to = 25;
+
+	unsigned int seed = 42;
+	std::map<std::string, int> values;
+	for (unsigned int i = 0; i < number_of_states; i++) {
+		std::string path = "state/" + std::to_string(i);
+		seed = seed * 1103515245 + 12345;
+		int value = (seed >> 16) % 50;
+		values[path] = value;
+		add_state_with_value(path.c_str(), cJSON_CreateNumber(value));
+	}
+
+	add_fetch_request(fetch_peer_1, create_sorted_fetch("{\"from\": 5, \"to\": 25, \"byValue\": \"number\"}"));
+	std::vector<std::string> window;
+
+	for (unsigned int i = 0; i < 500; i++) {
+		seed = seed * 1103515245 + 12345;
+		std::string path = "state/" + std::to_string((seed >> 16) % number_of_states);
+		seed = seed * 1103515245 + 12345;
+		int value = (seed >> 16) % 50;
+		if (values.find(path) == values.end()) {
+			add_state_with_value(path.c_str(), cJSON_CreateNumber(value));
+			values[path] = value;
+		} else if (value < 5) {
+			remove_state(path.c_str());
+			values.erase(path);
+		} else {
+			change_state_value(path.c_str(), cJSON_CreateNumber(value));
+			values[path] = value;
+		}
+
+		apply_window_changes(window, from);
+
+		std::vector<std::pair<int, std::string> > sorted;
+		for (std::map<std::string, int>::const_iterator it = values.begin(); it != values.end(); ++it) {
+			sorted.push_back(std::make_pair(it->second, it->first));
+		}
+		std::sort(sorted.begin(), sorted.end());
+		std::vector<std::string> expected;
+		for (unsigned int rank = from; (rank <= to) && (rank <= sorted.size()); rank++) {
+			expected.push_back(sorted[rank - 1].second);
+		}
+		BOOST_REQUIRE(window == expected);
+	}
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(sorted_fetch_with_illegal_window, F)
+{
+	struct fetch *f = NULL;
+	cJSON *response;
+	cJSON *request = create_sorted_fetch("{\"from\": 10, \"to\": 5}");
+	int ret = add_fetch_to_peer(fetch_peer_1, request, &f, &response);
+	BOOST_REQUIRE_MESSAGE((ret < 0) && (response != NULL), "add_fetch_to_peer() had no response!");
+	check_invalid_params(response);
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+}
+
+static cJSON *create_fetch_with_value_matcher(const char *fetch_id, const char *name, const char *conditions)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "id", fetch_id);
+	cJSON_AddItemToObject(params, name, cJSON_Parse(conditions));
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "fetch_request_1");
+	cJSON_AddStringToObject(root, "method", "fetch");
+	return root;
+}
+
+static std::vector<enum event> get_notified_events()
+{
+	std::vector<enum event> events;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		events.push_back(get_event_from_json(json));
+		cJSON_Delete(json);
+	}
+	return events;
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_with_value_field_transitions, F)
+{
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("alarms", "valueField", "{\"alarm.active\": {\"equals\": true}}"));
+
+	add_state_with_value("pump", cJSON_Parse("{\"alarm\": {\"active\": false, \"level\": 1}}"));
+	BOOST_CHECK(get_notified_events().empty());
+
+	change_state_value("pump", cJSON_Parse("{\"alarm\": {\"active\": true, \"level\": 1}}"));
+	std::vector<enum event> expected = {ADD_EVENT};
+	BOOST_CHECK(get_notified_events() == expected);
+
+	change_state_value("pump", cJSON_Parse("{\"alarm\": {\"active\": true, \"level\": 2}}"));
+	expected = {CHANGE_EVENT};
+	BOOST_CHECK(get_notified_events() == expected);
+
+	change_state_value("pump", cJSON_Parse("{\"alarm\": {\"active\": false, \"level\": 2}}"));
+	expected = {REMOVE_EVENT};
+	BOOST_CHECK(get_notified_events() == expected);
+
+	remove_state("pump");
+	BOOST_CHECK(get_notified_events().empty());
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_with_value_comparison, F)
+{
+	add_state_with_value("low", cJSON_CreateNumber(5));
+	add_state_with_value("high", cJSON_CreateNumber(15));
+	add_state_with_value("text", cJSON_CreateString("20"));
+
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("greater", "value", "{\"greaterThan\": 10}"));
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("strings", "value", "{\"isType\": \"string\"}"));
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("range", "value", "{\"greaterThan\": 1, \"lessThan\": 10}"));
+
+	std::multiset<std::string> notified;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		const cJSON *params = cJSON_GetObjectItem(json, "params");
+		notified.insert(std::string(cJSON_GetObjectItem(json, "method")->valuestring) + ":" + cJSON_GetObjectItem(params, "path")->valuestring);
+		cJSON_Delete(json);
+	}
+	std::multiset<std::string> expected = {"greater:high", "strings:text", "range:low"};
+	BOOST_CHECK(notified == expected);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(value_matches_split_fetcher_sets, F)
+{
+	add_state_with_value("low", cJSON_CreateNumber(5));
+	add_state_with_value("high", cJSON_CreateNumber(15));
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("greater", "value", "{\"greaterThan\": 10}"));
+	std::vector<enum event> expected = {ADD_EVENT};
+	BOOST_CHECK(get_notified_events() == expected);
+
+	struct element *low = get_state("low");
+	struct element *high = get_state("high");
+	BOOST_CHECK(low->fetchers != high->fetchers);
+	BOOST_CHECK(!low->fetchers->entries[0].value_matches);
+	BOOST_CHECK(high->fetchers->entries[0].value_matches);
+
+	change_state_value("low", cJSON_CreateNumber(20));
+	BOOST_CHECK(get_notified_events() == expected);
+	BOOST_CHECK(low->fetchers == high->fetchers);
+	BOOST_CHECK(high->fetchers->references == 2);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+	BOOST_CHECK(low->fetchers == NULL);
+	BOOST_CHECK(high->fetchers == NULL);
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_with_illegal_value_matcher, F)
+{
+	static const char *conditions[] = {
+		"{\"matches\": 1}",
+		"{\"lessThan\": true}",
+		"{\"isType\": \"integer\"}",
+		"{\"equals\": [1, 2]}",
+		"{}",
+		"42",
+	};
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(conditions); i++) {
+		struct fetch *f = NULL;
+		cJSON *response;
+		cJSON *request = create_fetch_with_value_matcher("fetch_id_1", "value", conditions[i]);
+		int ret = add_fetch_to_peer(fetch_peer_1, request, &f, &response);
+		BOOST_REQUIRE_MESSAGE((ret < 0) && (response != NULL), "add_fetch_to_peer() had no response!");
+		check_invalid_params(response);
+		cJSON_Delete(request);
+		cJSON_Delete(response);
+	}
+}
+
+static std::vector<std::pair<enum event, int> > get_notified_values()
+{
+	std::vector<std::pair<enum event, int> > values;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		cJSON *params = cJSON_GetObjectItem(json, "params");
+		BOOST_REQUIRE(params != NULL);
+		cJSON *value = cJSON_GetObjectItem(params, "value");
+		BOOST_REQUIRE(value != NULL);
+		values.push_back(std::make_pair(get_event_from_json(json), value->valueint));
+		cJSON_Delete(json);
+	}
+	return values;
+}
+
+static void fire_timer(struct io_event *ev)
+{
+	ev->read_function(ev);
+}
+
+BOOST_FIXTURE_TEST_CASE(throttled_fetch_coalesces_changes, F)
+{
+	add_state_with_value("foo", cJSON_CreateNumber(0));
+	add_state_with_value("bar", cJSON_CreateNumber(0));
+
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("throttled", "minInterval", "100"));
+	struct io_event *timer_event = last_added_event;
+	get_notified_values();
+
+	change_state_value("foo", cJSON_CreateNumber(1));
+	std::vector<std::pair<enum event, int> > expected = {{CHANGE_EVENT, 1}};
+	BOOST_CHECK(get_notified_values() == expected);
+
+	for (int i = 2; i <= 10; i++) {
+		change_state_value("foo", cJSON_CreateNumber(i));
+		change_state_value("bar", cJSON_CreateNumber(i * 10));
+	}
+	BOOST_CHECK(get_notified_values().empty());
+
+	fire_timer(timer_event);
+	expected = {{CHANGE_EVENT, 10}, {CHANGE_EVENT, 100}};
+	BOOST_CHECK(get_notified_values() == expected);
+
+	change_state_value("foo", cJSON_CreateNumber(11));
+	BOOST_CHECK(get_notified_values().empty());
+	fire_timer(timer_event);
+	expected = {{CHANGE_EVENT, 11}};
+	BOOST_CHECK(get_notified_values() == expected);
+
+	fire_timer(timer_event);
+	BOOST_CHECK(get_notified_values().empty());
+	change_state_value("bar", cJSON_CreateNumber(12));
+	expected = {{CHANGE_EVENT, 12}};
+	BOOST_CHECK(get_notified_values() == expected);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(throttled_fetch_add_and_remove, F)
+{
+	add_state_with_value("foo", cJSON_CreateNumber(0));
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("throttled", "minInterval", "100"));
+	struct io_event *timer_event = last_added_event;
+	get_notified_values();
+
+	change_state_value("foo", cJSON_CreateNumber(1));
+	change_state_value("foo", cJSON_CreateNumber(2));
+	BOOST_CHECK(get_notified_values().size() == 1);
+
+	remove_state("foo");
+	std::vector<enum event> expected = {REMOVE_EVENT};
+	BOOST_CHECK(get_notified_events() == expected);
+
+	add_state_with_value("bar", cJSON_CreateNumber(3));
+	remove_state("bar");
+	BOOST_CHECK(get_notified_events().empty());
+
+	add_state_with_value("baz", cJSON_CreateNumber(4));
+	change_state_value("baz", cJSON_CreateNumber(5));
+	BOOST_CHECK(get_notified_events().empty());
+	fire_timer(timer_event);
+	std::vector<std::pair<enum event, int> > values = {{ADD_EVENT, 5}};
+	BOOST_CHECK(get_notified_values() == values);
+
+	change_state_value("baz", cJSON_CreateNumber(6));
+	remove_all_fetchers_from_peer(fetch_peer_1);
+	BOOST_CHECK(get_notified_events().empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_with_illegal_min_interval, F)
+{
+	static const char *intervals[] = {"\"100\"", "0", "-5"};
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(intervals); i++) {
+		struct fetch *f = NULL;
+		cJSON *response;
+		cJSON *request = create_fetch_with_value_matcher("fetch_id_1", "minInterval", intervals[i]);
+		int ret = add_fetch_to_peer(fetch_peer_1, request, &f, &response);
+		BOOST_REQUIRE_MESSAGE((ret < 0) && (response != NULL), "add_fetch_to_peer() had no response!");
+		check_invalid_params(response);
+		cJSON_Delete(request);
+		cJSON_Delete(response);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(batched_notifications, F)
+{
+	add_state_with_value("foo", cJSON_CreateNumber(0));
+	add_state_with_value("bar", cJSON_CreateNumber(0));
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("all", "value", "{\"isType\": \"number\"}"));
+	get_notified_values();
+
+	set_notification_batching(true);
+	change_state_value("foo", cJSON_CreateNumber(1));
+	change_state_value("bar", cJSON_CreateNumber(2));
+	change_state_value("foo", cJSON_CreateNumber(3));
+	BOOST_CHECK(fetch_events.empty());
+
+	flush_all_notification_batches();
+	BOOST_REQUIRE(fetch_events.size() == 1);
+	cJSON *batch = fetch_events.front();
+	fetch_events.pop_front();
+	BOOST_REQUIRE(batch != NULL && batch->type == cJSON_Array);
+	BOOST_CHECK(cJSON_GetArraySize(batch) == 3);
+	while (cJSON_GetArraySize(batch) > 0) {
+		fetch_events.push_back(cJSON_DetachItemFromArray(batch, 0));
+	}
+	cJSON_Delete(batch);
+	std::vector<std::pair<enum event, int> > expected = {{CHANGE_EVENT, 1}, {CHANGE_EVENT, 2}, {CHANGE_EVENT, 3}};
+	BOOST_CHECK(get_notified_values() == expected);
+
+	change_state_value("bar", cJSON_CreateNumber(4));
+	flush_all_notification_batches();
+	flush_all_notification_batches();
+	expected = {{CHANGE_EVENT, 4}};
+	BOOST_CHECK(get_notified_values() == expected);
+
+	change_state_value("bar", cJSON_CreateNumber(5));
+	set_notification_batching(false);
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+static bool json_equals_text(const cJSON *json, const char *text)
+{
+	cJSON *expected = cJSON_Parse(text);
+	bool equal = (json != NULL) && (expected != NULL) && json_equal(json, expected);
+	cJSON_Delete(expected);
+	return equal;
+}
+
+BOOST_AUTO_TEST_CASE(merge_patch_semantics)
+{
+	static const struct {
+		const char *from;
+		const char *to;
+		const char *patch;
+	} tests[] = {
+	    {"{\"a\": 1, \"b\": 2}", "{\"a\": 1, \"b\": 3}", "{\"b\": 3}"},
+	    {"{\"a\": 1, \"b\": 2}", "{\"a\": 1}", "{\"b\": null}"},
+	    {"{\"a\": {\"x\": 1, \"y\": 2}}", "{\"a\": {\"x\": 1, \"y\": 5}}", "{\"a\": {\"y\": 5}}"},
+	    {"{\"a\": [1, 2]}", "{\"a\": [1, 2, null]}", "{\"a\": [1, 2, null]}"},
+	    {"{\"a\": 1}", "{\"a\": {\"b\": 1}, \"A\": 2}", "{\"a\": {\"b\": 1}, \"A\": 2}"},
+	    {"{\"a\": 1}", "{\"a\": 1}", "{}"},
+	};
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(tests); i++) {
+		cJSON *from = cJSON_Parse(tests[i].from);
+		cJSON *to = cJSON_Parse(tests[i].to);
+		cJSON *patch = create_merge_patch(from, to);
+		BOOST_CHECK_MESSAGE(json_equals_text(patch, tests[i].patch), "wrong patch for " << tests[i].to);
+		cJSON *patched = apply_merge_patch(from, patch);
+		BOOST_CHECK_MESSAGE((patched != NULL) && json_equal(patched, to), "patch does not reproduce " << tests[i].to);
+		cJSON_Delete(patched);
+		cJSON_Delete(patch);
+		cJSON_Delete(to);
+		cJSON_Delete(from);
+	}
+
+	cJSON *from = cJSON_Parse("{\"a\": 1}");
+	cJSON *to = cJSON_Parse("{\"a\": null}");
+	BOOST_CHECK(create_merge_patch(from, to) == NULL);
+	cJSON *number = cJSON_CreateNumber(1);
+	BOOST_CHECK(create_merge_patch(from, number) == NULL);
+	cJSON_Delete(number);
+	cJSON_Delete(to);
+	cJSON_Delete(from);
+}
+
+static std::map<std::string, cJSON *> get_notified_params()
+{
+	std::map<std::string, cJSON *> params;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		cJSON *method = cJSON_GetObjectItem(json, "method");
+		BOOST_REQUIRE(method != NULL && method->type == cJSON_String);
+		BOOST_REQUIRE(params.count(method->valuestring) == 0);
+		params[method->valuestring] = cJSON_DetachItemFromObject(json, "params");
+		cJSON_Delete(json);
+	}
+	return params;
+}
+
+static void delete_params(std::map<std::string, cJSON *> &params)
+{
+	for (auto &entry : params) {
+		cJSON_Delete(entry.second);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_with_delta_notifications, F)
+{
+	add_state_with_value("recipe", cJSON_Parse("{\"name\": \"bread\", \"description\": \"Mix flour, water, salt and yeast, then bake it.\", \"temp\": 180, \"meta\": {\"a\": 1, \"b\": 2}}"));
+	add_state_with_value("small", cJSON_Parse("{\"a\": 1}"));
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("delta", "delta", "true"));
+	add_fetch_request(fetch_peer_1, create_fetch_with_value_matcher("full", "delta", "false"));
+	while (!fetch_events.empty()) {
+		cJSON_Delete(fetch_events.front());
+		fetch_events.pop_front();
+	}
+
+	change_state_value("recipe", cJSON_Parse("{\"name\": \"bread\", \"description\": \"Mix flour, water, salt and yeast, then bake it.\", \"temp\": 200, \"meta\": {\"a\": 1, \"b\": 2}}"));
+	std::map<std::string, cJSON *> params = get_notified_params();
+	BOOST_REQUIRE(params.size() == 2);
+	BOOST_CHECK(json_equals_text(cJSON_GetObjectItem(params["delta"], "patch"), "{\"temp\": 200}"));
+	BOOST_CHECK(cJSON_GetObjectItem(params["delta"], "value") == NULL);
+	BOOST_CHECK(cJSON_GetObjectItem(params["full"], "patch") == NULL);
+	BOOST_CHECK(cJSON_GetObjectItem(cJSON_GetObjectItem(params["full"], "value"), "temp")->valueint == 200);
+	delete_params(params);
+
+	change_state_value("recipe", cJSON_Parse("{\"meta\": {\"b\": null}}"), "patch");
+	params = get_notified_params();
+	BOOST_REQUIRE(params.size() == 2);
+	BOOST_CHECK(json_equals_text(cJSON_GetObjectItem(params["delta"], "patch"), "{\"meta\": {\"b\": null}}"));
+	BOOST_CHECK(json_equals_text(cJSON_GetObjectItem(params["full"], "value"), "{\"name\": \"bread\", \"description\": \"Mix flour, water, salt and yeast, then bake it.\", \"temp\": 200, \"meta\": {\"a\": 1}}"));
+	BOOST_CHECK(json_equals_text(get_state("recipe")->value, "{\"name\": \"bread\", \"description\": \"Mix flour, water, salt and yeast, then bake it.\", \"temp\": 200, \"meta\": {\"a\": 1}}"));
+	delete_params(params);
+
+	change_state_value("small", cJSON_Parse("{\"b\": 2}"));
+	params = get_notified_params();
+	BOOST_REQUIRE(params.size() == 2);
+	BOOST_CHECK(json_equals_text(cJSON_GetObjectItem(params["delta"], "value"), "{\"b\": 2}"));
+	BOOST_CHECK(cJSON_GetObjectItem(params["delta"], "patch") == NULL);
+	delete_params(params);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(change_with_illegal_patch, F)
+{
+	add_state_with_value("foo", cJSON_Parse("{\"a\": 1}"));
+
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "path", "foo");
+	cJSON_AddItemToObject(params, "patch", cJSON_CreateNumber(1));
+	cJSON *request = cJSON_CreateObject();
+	cJSON_AddItemToObject(request, "params", params);
+	cJSON_AddStringToObject(request, "id", "change_request_1");
+	cJSON_AddStringToObject(request, "method", "change");
+
+	cJSON *response = change_state(owner_peer, request);
+	check_invalid_params(response);
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+}
+
+BOOST_FIXTURE_TEST_CASE(change_notification_for_fetch_ids_of_different_length, F)
+{
+	const char *path = "foo/bar";
+
+	add_fetch_request(fetch_peer_1, create_fetch_with_fetchid(7, path));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("a_much_longer_fetch_id", "equals", path, false));
+	add_fetch_request(fetch_peer_1, create_fetch_with_matcher("id", "startsWith", "foo", false));
+
+	cJSON *request = create_add(path);
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_REQUIRE(fetch_events.size() == 3);
+	while (!fetch_events.empty()) {
+		cJSON_Delete(fetch_events.front());
+		fetch_events.pop_front();
+	}
+
+	request = create_change(path);
+	response = change_state(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "change_state() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+
+	BOOST_REQUIRE(fetch_events.size() == 3);
+	std::set<std::string> notified_ids;
+	while (!fetch_events.empty()) {
+		cJSON *json = fetch_events.front();
+		fetch_events.pop_front();
+		BOOST_REQUIRE(json != NULL);
+		cJSON *method = cJSON_GetObjectItem(json, "method");
+		BOOST_REQUIRE(method != NULL);
+		if (method->type == cJSON_Number) {
+			notified_ids.insert(std::to_string(method->valueint));
+		} else {
+			BOOST_REQUIRE(method->type == cJSON_String);
+			notified_ids.insert(method->valuestring);
+		}
+		BOOST_CHECK(get_event_from_json(json) == CHANGE_EVENT);
+		cJSON *params = cJSON_GetObjectItem(json, "params");
+		cJSON *value = cJSON_GetObjectItem(params, "value");
+		BOOST_CHECK(value != NULL && value->valueint == 4321);
+		cJSON *path_item = cJSON_GetObjectItem(params, "path");
+		BOOST_CHECK(path_item != NULL && strcmp(path_item->valuestring, path) == 0);
+		cJSON_Delete(json);
+	}
+	std::set<std::string> expected_ids = {"7", "a_much_longer_fetch_id", "id"};
+	BOOST_CHECK(notified_ids == expected_ids);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
+BOOST_FIXTURE_TEST_CASE(case_insensitive_before_matchers, F)
+{
+	cJSON *request = cJSON_Parse("{\"id\": \"fetch_request_1\", \"method\": \"fetch\", \"params\": {\"id\": \"fetch_id_1\", \"path\": {\"caseInsensitive\": true, \"startsWith\": \"FOO/\", \"endsWith\": \"Bar\"}}}");
+	BOOST_REQUIRE(request != NULL);
+	add_fetch_request(fetch_peer_1, request);
+
+	request = create_add("foo/baz");
+	cJSON *response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	BOOST_CHECK(fetch_events.size() == 0);
+
+	request = create_add("Foo/bAr");
+	response = add_element_to_peer(owner_peer, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(request);
+	cJSON_Delete(response);
+	std::set<std::string> expected_ids = {"fetch_id_1"};
+	BOOST_CHECK(get_notified_fetch_ids() == expected_ids);
+
+	remove_all_fetchers_from_peer(fetch_peer_1);
+}
+
 BOOST_FIXTURE_TEST_CASE(get_with_no_states, F)
 {
 	const char *path = "foo/bar";
@@ -761,6 +1903,34 @@ BOOST_FIXTURE_TEST_CASE(get_with_one_state, F)
 	cJSON_Delete(response);
 }
 
+BOOST_FIXTURE_TEST_CASE(get_with_starts_with, F)
+{
+	static const char *paths[] = {"a/c", "ab", "a/b", "b/a", "a"};
+	for (unsigned int i = 0; i < sizeof(paths) / sizeof(*paths); i++) {
+		cJSON *request = create_add(paths[i]);
+		cJSON *response = add_element_to_peer(owner_peer, request);
+		BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+		cJSON_Delete(request);
+		cJSON_Delete(response);
+	}
+
+	cJSON *request = create_get("a");
+	cJSON *path = cJSON_GetObjectItem(cJSON_GetObjectItem(request, "params"), "path");
+	cJSON_DeleteItemFromObject(path, "equals");
+	cJSON_AddStringToObject(path, "startsWith", "a/");
+	cJSON *response = get_elements(request, fetch_peer_1);
+	BOOST_REQUIRE_MESSAGE(response != NULL, "get_elements() did not returned a response!");
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "get_elements() failed!");
+	cJSON_Delete(request);
+
+	const cJSON *result = cJSON_GetObjectItem(response, "result");
+	BOOST_REQUIRE(result != NULL && result->type == cJSON_Array);
+	BOOST_REQUIRE(cJSON_GetArraySize(result) == 2);
+	BOOST_CHECK(::strcmp(cJSON_GetObjectItem(cJSON_GetArrayItem(result, 0), "path")->valuestring, "a/b") == 0);
+	BOOST_CHECK(::strcmp(cJSON_GetObjectItem(cJSON_GetArrayItem(result, 1), "path")->valuestring, "a/c") == 0);
+	cJSON_Delete(response);
+}
+
 BOOST_FIXTURE_TEST_CASE(fetch_matchers, F)
 {
 	const char *path = "foo/bar";
@@ -0,0 +1,134 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "hashtable.h"
+#include "swisstable.h"
+
+/*
+ * Compares the hopscotch table of hashtable.h with the Swiss table of
+ * swisstable.h for the string keys cjet uses, state paths. Both tables
+ * start small, so the insert numbers include growing.
+ */
+
+DECLARE_HASHTABLE_STRING(hopscotch, 10, 1)
+DECLARE_SWISSTABLE_STRING(swiss, 10, 1)
+
+static const unsigned int NUMBER_OF_PATHS = 100000;
+static const unsigned int NUMBER_OF_ROUNDS = 10;
+
+static std::vector<std::string> create_paths(const char *prefix)
+{
+	static const char *devices[] = {"pump", "valve", "sensor", "motor"};
+	static const char *properties[] = {"temperature", "pressure", "state", "speed"};
+	char path[128];
+
+	std::vector<std::string> paths;
+	for (unsigned int i = 0; i < NUMBER_OF_PATHS; i++) {
+		snprintf(path, sizeof(path), "%s/line_%u/%s_%u/%s", prefix, i % 16, devices[i % 4], i, properties[(i / 4) % 4]);
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+static double ns_per_operation(std::chrono::steady_clock::time_point start, unsigned int operations)
+{
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+	return (double)elapsed.count() / operations;
+}
+
+#define BENCHMARK_TABLE(name)                                                                                                                                                     \
+	static bool benchmark_##name(const std::vector<std::string> &paths, const std::vector<std::string> &missing, double *insert_ns, double *hit_ns, double *miss_ns)          \
+	{                                                                                                                                                                         \
+		struct hashtable_##name *table = HASHTABLE_CREATE(name);                                                                                                          \
+		if (table == NULL) {                                                                                                                                              \
+			return false;                                                                                                                                             \
+		}                                                                                                                                                                 \
+		struct value_##name val;                                                                                                                                          \
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();                                                                                   \
+		for (const std::string &path : paths) {                                                                                                                           \
+			val.vals[0] = (void *)&path;                                                                                                                              \
+			if (HASHTABLE_PUT(name, table, path.c_str(), val, NULL) != HASHTABLE_SUCCESS) {                                                                           \
+				HASHTABLE_DELETE(name, table);                                                                                                                    \
+				return false;                                                                                                                                     \
+			}                                                                                                                                                         \
+		}                                                                                                                                                                 \
+		*insert_ns = ns_per_operation(start, NUMBER_OF_PATHS);                                                                                                            \
+                                                                                                                                                                                  \
+		unsigned int found = 0;                                                                                                                                           \
+		start = std::chrono::steady_clock::now();                                                                                                                         \
+		for (unsigned int round = 0; round < NUMBER_OF_ROUNDS; round++) {                                                                                                 \
+			for (const std::string &path : paths) {                                                                                                                   \
+				if ((HASHTABLE_GET(name, table, path.c_str(), &val) == HASHTABLE_SUCCESS) && (val.vals[0] == (void *)&path)) {                                    \
+					found++;                                                                                                                                  \
+				}                                                                                                                                                 \
+			}                                                                                                                                                         \
+		}                                                                                                                                                                 \
+		*hit_ns = ns_per_operation(start, NUMBER_OF_PATHS * NUMBER_OF_ROUNDS);                                                                                            \
+                                                                                                                                                                                  \
+		start = std::chrono::steady_clock::now();                                                                                                                         \
+		for (unsigned int round = 0; round < NUMBER_OF_ROUNDS; round++) {                                                                                                 \
+			for (const std::string &path : missing) {                                                                                                                 \
+				if (HASHTABLE_GET(name, table, path.c_str(), &val) == HASHTABLE_SUCCESS) {                                                                        \
+					found = 0;                                                                                                                                \
+				}                                                                                                                                                 \
+			}                                                                                                                                                         \
+		}                                                                                                                                                                 \
+		*miss_ns = ns_per_operation(start, NUMBER_OF_PATHS * NUMBER_OF_ROUNDS);                                                                                           \
+		HASHTABLE_DELETE(name, table);                                                                                                                                    \
+		return found == NUMBER_OF_PATHS * NUMBER_OF_ROUNDS;                                                                                                               \
+	}
+
+BENCHMARK_TABLE(hopscotch)
+BENCHMARK_TABLE(swiss)
+
+int main()
+{
+	std::vector<std::string> paths = create_paths("plant");
+	std::vector<std::string> missing = create_paths("other_plant");
+	double insert_ns;
+	double hit_ns;
+	double miss_ns;
+
+	if (!benchmark_hopscotch(paths, missing, &insert_ns, &hit_ns, &miss_ns)) {
+		fprintf(stderr, "hopscotch table failed!\n");
+		return EXIT_FAILURE;
+	}
+	printf("hopscotch: insert %6.1f ns, hit %6.1f ns, miss %6.1f ns\n", insert_ns, hit_ns, miss_ns);
+
+	if (!benchmark_swiss(paths, missing, &insert_ns, &hit_ns, &miss_ns)) {
+		fprintf(stderr, "swiss table failed!\n");
+		return EXIT_FAILURE;
+	}
+	printf("swiss:     insert %6.1f ns, hit %6.1f ns, miss %6.1f ns\n", insert_ns, hit_ns, miss_ns);
+	return EXIT_SUCCESS;
+}
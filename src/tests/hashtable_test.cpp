@@ -0,0 +1,225 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE hashtable
+
+#include <boost/test/unit_test.hpp>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "alloc.h"
+#include "hashtable.h"
+#include "swisstable.h"
+
+DECLARE_HASHTABLE_UINT32(number_table, 2, 1)
+DECLARE_SWISSTABLE_UINT32(swiss_number_table, 2, 1)
+DECLARE_SWISSTABLE_STRING(swiss_string_table, 4, 1)
+
+static const uint32_t NUMBER_OF_KEYS = 50000;
+
+static void *to_value(uint32_t key)
+{
+	return (void *)(uintptr_t)(key * 3 + 1);
+}
+
+static void collect_key(uint32_t key, void *context)
+{
+	std::set<uint32_t> *keys = (std::set<uint32_t> *)context;
+	BOOST_CHECK(keys->insert(key).second);
+}
+
+BOOST_AUTO_TEST_CASE(grow_beyond_initial_size)
+{
+	struct hashtable_number_table *table = HASHTABLE_CREATE(number_table);
+	BOOST_REQUIRE(table != NULL);
+
+	for (uint32_t key = 1; key <= NUMBER_OF_KEYS; key++) {
+		struct value_number_table val;
+		val.vals[0] = to_value(key);
+		BOOST_REQUIRE_MESSAGE(HASHTABLE_PUT(number_table, table, key, val, NULL) == HASHTABLE_SUCCESS, "could not put key " << key);
+
+		/* Keys put before and during the growth must be found in both generations. */
+		uint32_t check_key = (key / 2) + 1;
+		BOOST_REQUIRE(HASHTABLE_GET(number_table, table, check_key, &val) == HASHTABLE_SUCCESS);
+		BOOST_CHECK(val.vals[0] == to_value(check_key));
+	}
+	BOOST_CHECK(table->entries_order > 2);
+	BOOST_CHECK(table->number_of_entries == NUMBER_OF_KEYS);
+
+	for (uint32_t key = 1; key <= NUMBER_OF_KEYS; key += 2) {
+		struct value_number_table val;
+		BOOST_REQUIRE(HASHTABLE_REMOVE(number_table, table, key, &val) == HASHTABLE_SUCCESS);
+		BOOST_CHECK(val.vals[0] == to_value(key));
+	}
+
+	for (uint32_t key = 1; key <= NUMBER_OF_KEYS; key++) {
+		struct value_number_table val;
+		int ret = HASHTABLE_GET(number_table, table, key, &val);
+		if ((key % 2) == 1) {
+			BOOST_CHECK(ret == HASHTABLE_INVALIDENTRY);
+		} else {
+			BOOST_CHECK(ret == HASHTABLE_SUCCESS && val.vals[0] == to_value(key));
+		}
+	}
+
+	std::set<uint32_t> keys;
+	HASHTABLE_VISIT(number_table, table, collect_key, &keys);
+	BOOST_CHECK(keys.size() == NUMBER_OF_KEYS / 2);
+
+	HASHTABLE_DELETE(number_table, table);
+	BOOST_CHECK(cjet_get_alloc_size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(replace_value_while_growing)
+{
+	struct hashtable_number_table *table = HASHTABLE_CREATE(number_table);
+	BOOST_REQUIRE(table != NULL);
+
+	struct value_number_table val;
+	for (uint32_t key = 1; key <= 100; key++) {
+		val.vals[0] = to_value(key);
+		BOOST_REQUIRE(HASHTABLE_PUT(number_table, table, key, val, NULL) == HASHTABLE_SUCCESS);
+	}
+	for (uint32_t key = 1; key <= 100; key++) {
+		struct value_number_table prev;
+		val.vals[0] = to_value(key + 1000);
+		BOOST_REQUIRE(HASHTABLE_PUT(number_table, table, key, val, &prev) == HASHTABLE_SUCCESS);
+		BOOST_CHECK(prev.vals[0] == to_value(key));
+	}
+	BOOST_CHECK(table->number_of_entries == 100);
+	for (uint32_t key = 1; key <= 100; key++) {
+		BOOST_REQUIRE(HASHTABLE_GET(number_table, table, key, &val) == HASHTABLE_SUCCESS);
+		BOOST_CHECK(val.vals[0] == to_value(key + 1000));
+	}
+
+	BOOST_CHECK(HASHTABLE_PUT(number_table, table, (uint32_t)HASHTABLE_INVALIDENTRY, val, NULL) == HASHTABLE_KEYINVAL);
+	HASHTABLE_DELETE(number_table, table);
+}
+
+BOOST_AUTO_TEST_CASE(swisstable_grow_beyond_initial_size)
+{
+	struct hashtable_swiss_number_table *table = HASHTABLE_CREATE(swiss_number_table);
+	BOOST_REQUIRE(table != NULL);
+
+	for (uint32_t key = 0; key < NUMBER_OF_KEYS; key++) {
+		struct value_swiss_number_table val;
+		val.vals[0] = to_value(key);
+		BOOST_REQUIRE_MESSAGE(HASHTABLE_PUT(swiss_number_table, table, key, val, NULL) == HASHTABLE_SUCCESS, "could not put key " << key);
+
+		uint32_t check_key = key / 2;
+		BOOST_REQUIRE(HASHTABLE_GET(swiss_number_table, table, check_key, &val) == HASHTABLE_SUCCESS);
+		BOOST_CHECK(val.vals[0] == to_value(check_key));
+	}
+	BOOST_CHECK(table->entries.size_order > SWISSTABLE_GROUP_ORDER);
+	BOOST_CHECK(table->number_of_entries == NUMBER_OF_KEYS);
+
+	for (uint32_t key = 0; key < NUMBER_OF_KEYS; key += 2) {
+		struct value_swiss_number_table val;
+		BOOST_REQUIRE(HASHTABLE_REMOVE(swiss_number_table, table, key, &val) == HASHTABLE_SUCCESS);
+		BOOST_CHECK(val.vals[0] == to_value(key));
+		BOOST_CHECK(HASHTABLE_REMOVE(swiss_number_table, table, key, &val) == HASHTABLE_INVALIDENTRY);
+	}
+
+	for (uint32_t key = 0; key < NUMBER_OF_KEYS; key++) {
+		struct value_swiss_number_table val;
+		int ret = HASHTABLE_GET(swiss_number_table, table, key, &val);
+		if ((key % 2) == 0) {
+			BOOST_CHECK(ret == HASHTABLE_INVALIDENTRY);
+		} else {
+			BOOST_CHECK(ret == HASHTABLE_SUCCESS && val.vals[0] == to_value(key));
+		}
+	}
+
+	std::set<uint32_t> keys;
+	HASHTABLE_VISIT(swiss_number_table, table, collect_key, &keys);
+	BOOST_CHECK(keys.size() == NUMBER_OF_KEYS / 2);
+
+	HASHTABLE_DELETE(swiss_number_table, table);
+	BOOST_CHECK(cjet_get_alloc_size() == 0);
+}
+
+static void count_string(const char *key, void *context)
+{
+	(void)key;
+	unsigned int *count = (unsigned int *)context;
+	(*count)++;
+}
+
+BOOST_AUTO_TEST_CASE(swisstable_reuse_deleted_slots)
+{
+	struct hashtable_swiss_string_table *table = HASHTABLE_CREATE(swiss_string_table);
+	BOOST_REQUIRE(table != NULL);
+
+	std::vector<std::string> paths;
+	for (unsigned int i = 0; i < 1000; i++) {
+		paths.push_back("some/rather/long/path/to/a/state_" + std::to_string(i));
+	}
+
+	/* Only a few keys are alive at any time, so the table must not grow. */
+	struct value_swiss_string_table val;
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		val.vals[0] = (void *)&paths[i];
+		BOOST_REQUIRE(HASHTABLE_PUT(swiss_string_table, table, paths[i].c_str(), val, NULL) == HASHTABLE_SUCCESS);
+		if (i >= 4) {
+			BOOST_REQUIRE(HASHTABLE_REMOVE(swiss_string_table, table, paths[i - 4].c_str(), &val) == HASHTABLE_SUCCESS);
+			BOOST_CHECK(val.vals[0] == (void *)&paths[i - 4]);
+		}
+	}
+	BOOST_CHECK(table->entries.size_order == 4);
+	BOOST_CHECK(table->number_of_entries == 4);
+
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		std::string copy = paths[i];
+		int ret = HASHTABLE_GET(swiss_string_table, table, copy.c_str(), &val);
+		if (i >= paths.size() - 4) {
+			BOOST_CHECK(ret == HASHTABLE_SUCCESS && val.vals[0] == (void *)&paths[i]);
+		} else {
+			BOOST_CHECK(ret == HASHTABLE_INVALIDENTRY);
+		}
+	}
+
+	unsigned int count = 0;
+	HASHTABLE_VISIT(swiss_string_table, table, count_string, &count);
+	BOOST_CHECK(count == 4);
+
+	HASHTABLE_DELETE(swiss_string_table, table);
+}
+
+BOOST_AUTO_TEST_CASE(swisstable_string_hash)
+{
+	/* Keys of different length that share their first words must not collide systematically. */
+	std::set<uint32_t> hashes;
+	std::string key;
+	for (unsigned int i = 0; i < 64; i++) {
+		hashes.insert(swisstable_hash_string(key.c_str()));
+		key += 'a';
+	}
+	BOOST_CHECK(hashes.size() == 64);
+}
@@ -0,0 +1,213 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE json_index
+
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <string>
+
+#include "json_index.h"
+
+enum { NUMBER_OF_TOKENS = 32 };
+
+struct F {
+	F()
+	{
+		json_index_init(&index, tokens, NUMBER_OF_TOKENS, JSON_INDEX_MAX_DEPTH);
+	}
+
+	int parse(const char *json)
+	{
+		return json_index_parse(&index, json, ::strlen(json));
+	}
+
+	std::string text(unsigned int token)
+	{
+		return std::string(json_index_token_text(&index, token), json_index_token_length(&index, token));
+	}
+
+	struct json_token tokens[NUMBER_OF_TOKENS];
+	struct json_index index;
+};
+
+BOOST_FIXTURE_TEST_CASE(index_request, F)
+{
+	static const char json[] = "{\"id\":7,\"method\":\"change\",\"params\":{\"path\":\"a/b\",\"value\":{\"x\":[1,2.5e3,true,null]}}}";
+	BOOST_REQUIRE(parse(json) == 0);
+	BOOST_CHECK(index.tokens[0].type == JSON_TOKEN_OBJECT);
+	BOOST_CHECK(index.tokens[0].next == index.number_of_tokens);
+	BOOST_CHECK(text(0) == json);
+
+	unsigned int id = json_index_get_member(&index, 0, "id");
+	BOOST_REQUIRE(id != JSON_INDEX_NO_TOKEN);
+	BOOST_CHECK(index.tokens[id].type == JSON_TOKEN_NUMBER);
+	BOOST_CHECK(text(id) == "7");
+
+	unsigned int method = json_index_get_member(&index, 0, "method");
+	BOOST_CHECK(json_index_string_equals(&index, method, "change"));
+	BOOST_CHECK(!json_index_string_equals(&index, method, "chang"));
+	BOOST_CHECK(!json_index_string_equals(&index, id, "7"));
+
+	unsigned int params = json_index_get_member(&index, 0, "params");
+	BOOST_REQUIRE(params != JSON_INDEX_NO_TOKEN);
+	unsigned int value = json_index_get_member(&index, params, "value");
+	BOOST_REQUIRE(value != JSON_INDEX_NO_TOKEN);
+	BOOST_CHECK(text(value) == "{\"x\":[1,2.5e3,true,null]}");
+	BOOST_CHECK(json_index_get_member(&index, params, "id") == JSON_INDEX_NO_TOKEN);
+	BOOST_CHECK(json_index_get_member(&index, value, "x") == value + 2);
+	BOOST_CHECK(text(value + 2) == "[1,2.5e3,true,null]");
+}
+
+BOOST_FIXTURE_TEST_CASE(member_lookup, F)
+{
+	BOOST_REQUIRE(parse("{ \"Path\" : \"a\" , \"path\": \"b\", \"p\\u0061th\": \"c\", \"empty\": {}, \"last\": []}") == 0);
+	BOOST_CHECK(index.escaped_keys);
+
+	unsigned int path = json_index_get_member(&index, 0, "path");
+	BOOST_CHECK(text(path) == "\"a\"");
+	BOOST_CHECK(index.tokens[json_index_get_member(&index, 0, "empty")].type == JSON_TOKEN_OBJECT);
+	BOOST_CHECK(text(json_index_get_member(&index, 0, "last")) == "[]");
+	BOOST_CHECK(json_index_get_member(&index, 0, "pat") == JSON_INDEX_NO_TOKEN);
+}
+
+BOOST_FIXTURE_TEST_CASE(copy_string, F)
+{
+	BOOST_REQUIRE(parse("[\"abc\", \"a\\nb\", 1]") == 0);
+	BOOST_CHECK(!index.escaped_keys);
+
+	char buffer[4];
+	BOOST_CHECK(json_index_copy_string(&index, 1, buffer, sizeof(buffer)) == 0);
+	BOOST_CHECK(::strcmp(buffer, "abc") == 0);
+	BOOST_CHECK(json_index_copy_string(&index, 1, buffer, 3) < 0);
+	BOOST_CHECK(index.tokens[2].escaped);
+	BOOST_CHECK(json_index_copy_string(&index, 2, buffer, sizeof(buffer)) < 0);
+	BOOST_CHECK(json_index_copy_string(&index, 3, buffer, sizeof(buffer)) < 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(valid_json, F)
+{
+	static const char *valid[] = {
+	    "{}", "[]", "0", "-0.5", "1E+2", "\"\\u00e4\\\"\"", "true", "false", "null",
+	    "[{\"a\":[[]]},{}]", "{\"a\" :\t\r\n1}", " {}",
+	};
+
+	for (const char *json : valid) {
+		BOOST_CHECK_MESSAGE(parse(json) == 0, json);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(invalid_json, F)
+{
+	static const char *invalid[] = {
+	    "", "{} ", "{", "}", "[1,]", "{\"a\":1,}", "{\"a\"}", "{1:2}", "[1 2]",
+	    "01", "-", "1.", "1e", ".5", "+1", "tru", "nul", "\"abc", "\"\\x\"", "\"\\u12g4\"",
+	    "\"a\nb\"", "[}", "{]", "{\"a\":1]",
+	};
+
+	for (const char *json : invalid) {
+		BOOST_CHECK_MESSAGE(parse(json) < 0, json);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(limits, F)
+{
+	std::string many_tokens = "[";
+	for (unsigned int i = 0; i < NUMBER_OF_TOKENS; i++) {
+		many_tokens += "1,";
+	}
+	many_tokens += "1]";
+	BOOST_CHECK(parse(many_tokens.c_str()) < 0);
+
+	std::string deep = std::string(JSON_INDEX_MAX_DEPTH, '[') + std::string(JSON_INDEX_MAX_DEPTH, ']');
+	BOOST_CHECK(parse(deep.c_str()) == 0);
+	std::string too_deep = std::string(JSON_INDEX_MAX_DEPTH + 1, '[') + std::string(JSON_INDEX_MAX_DEPTH + 1, ']');
+	BOOST_CHECK(parse(too_deep.c_str()) < 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(utf8, F)
+{
+	static const char *valid[] = {
+	    "\"\xc3\xa4\"", "\"\xe2\x82\xac\"", "\"\xf0\x9f\x98\x80\"", "\"\xed\x9f\xbf\"", "\"\xf4\x8f\xbf\xbf\"",
+	    "[\"0123456789abcdef\xc3\xa4 0123456789abcdef\"]",
+	};
+	static const char *invalid[] = {
+	    "\"\xc3\"", "\"\xc0\xaf\"", "\"\xe0\x80\xaf\"", "\"\xed\xa0\x80\"", "\"\xf4\x90\x80\x80\"",
+	    "\"\xf5\x80\x80\x80\"", "\"\x80\"", "\"\xe2\x82\"", "\"0123456789abcdef\xff\"",
+	    "\"0123456789abcdef0123456789\x01\"",
+	};
+
+	for (const char *json : valid) {
+		BOOST_CHECK_MESSAGE(parse(json) == 0, json);
+	}
+	for (const char *json : invalid) {
+		BOOST_CHECK_MESSAGE(parse(json) < 0, json);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(long_strings, F)
+{
+	std::string plain(100, 'x');
+	std::string json = "{\"" + plain + "\":\"" + plain + "\\\"" + plain + "\"}";
+	BOOST_REQUIRE(parse(json.c_str()) == 0);
+	BOOST_CHECK(json_index_get_member(&index, 0, plain.c_str()) == 2);
+	BOOST_CHECK(index.tokens[2].escaped);
+	BOOST_CHECK(index.tokens[2].length == 2 * plain.length() + 4);
+}
+
+BOOST_AUTO_TEST_CASE(values_below_indexed_depth)
+{
+	struct json_token tokens[8];
+	struct json_index index;
+	json_index_init(&index, tokens, 8, 2);
+
+	static const char json[] = "{\"params\":{\"value\":[1,2,{\"a\\u0062\":[3,4,5,6,7,8,9]}],\"path\":\"a\"}}";
+	BOOST_REQUIRE(json_index_parse(&index, json, ::strlen(json)) == 0);
+	BOOST_CHECK(index.number_of_tokens == 7);
+	BOOST_CHECK(!index.escaped_keys);
+
+	unsigned int params = json_index_get_member(&index, 0, "params");
+	unsigned int value = json_index_get_member(&index, params, "value");
+	BOOST_REQUIRE(value != JSON_INDEX_NO_TOKEN);
+	BOOST_CHECK(index.tokens[value].type == JSON_TOKEN_ARRAY);
+	BOOST_CHECK(index.tokens[value].next == value + 1);
+	BOOST_CHECK(std::string(json_index_token_text(&index, value), json_index_token_length(&index, value)) == "[1,2,{\"a\\u0062\":[3,4,5,6,7,8,9]}]");
+	BOOST_CHECK(json_index_string_equals(&index, json_index_get_member(&index, params, "path"), "a"));
+
+	static const char invalid[] = "{\"params\":{\"value\":[1,2,{\"a\":[3,4,]}]}}";
+	BOOST_CHECK(json_index_parse(&index, invalid, ::strlen(invalid)) < 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(message_is_not_terminated, F)
+{
+	static const char json[] = "{\"a\":12}{\"b\":3}";
+	BOOST_CHECK(json_index_parse(&index, json, 8) == 0);
+	BOOST_CHECK(json_index_parse(&index, json, 7) < 0);
+	BOOST_CHECK(json_index_parse(&index, "123", 2) == 0);
+	BOOST_CHECK(text(0) == "12");
+}
@@ -0,0 +1,323 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "eventloop.h"
+#include "json/cJSON.h"
+#include "parse.h"
+#include "peer.h"
+#include "element.h"
+#include "table.h"
+
+/*
+ * Replays traffic as recorded from a plant: mostly changes of sensor
+ * states, some sets and a few method calls answered by the owner. The
+ * messages are handled by parse_message() and by building the cJSON tree
+ * of each request first, as the jet did before requests were indexed.
+ * Sets and calls include creating the timer of the routed request, so
+ * the changes are measured separately, too. The large values written by
+ * historians and batches changing the status of all devices are measured
+ * on their own.
+ */
+
+static const unsigned int NUMBER_OF_DEVICES = 1000;
+static const unsigned int NUMBER_OF_MESSAGES = 1000;
+static const unsigned int NUMBER_OF_ROUNDS = 200;
+
+extern "C" {
+
+	ssize_t socket_read(socket_type sock, void *buf, size_t count)
+	{
+		(void)sock;
+		(void)count;
+		uint64_t number_of_timeouts = 1;
+		::memcpy(buf, &number_of_timeouts, sizeof(number_of_timeouts));
+		return 8;
+	}
+
+	int socket_close(socket_type sock)
+	{
+		(void)sock;
+		return 0;
+	}
+}
+
+static std::string routed_id;
+
+static int send_message(const struct peer *p, char *rendered, size_t len)
+{
+	(void)p;
+	(void)rendered;
+	(void)len;
+	return 0;
+}
+
+/*
+ * Routed messages start with the id, which is all the owner needs to
+ * answer them.
+ */
+static int send_to_owner(const struct peer *p, char *rendered, size_t len)
+{
+	(void)p;
+	static const char prefix[] = "{\"id\":\"";
+	if ((len > sizeof(prefix)) && (::strncmp(rendered, prefix, sizeof(prefix) - 1) == 0)) {
+		const char *id = rendered + sizeof(prefix) - 1;
+		routed_id.assign(id, ::strchr(id, '"') - id);
+	}
+	return 0;
+}
+
+static enum eventloop_return fake_add(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+	return EL_CONTINUE_LOOP;
+}
+
+static void fake_remove(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+}
+
+static struct eventloop loop;
+
+static struct peer *alloc_peer(int (*send)(const struct peer *p, char *rendered, size_t len))
+{
+	struct peer *p = (struct peer *)::malloc(sizeof(*p));
+	init_peer(p, false, &loop);
+	p->send_message = send;
+	return p;
+}
+
+static void free_peer(struct peer *p)
+{
+	free_peer_resources(p);
+	::free(p);
+}
+
+static void handle(const std::string &message, struct peer *p)
+{
+	if (parse_message(message.c_str(), message.length(), p) != 0) {
+		fprintf(stderr, "could not handle %s!\n", message.c_str());
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void add_elements(struct peer *owner)
+{
+	char message[256];
+	for (unsigned int i = 0; i < NUMBER_OF_DEVICES; i++) {
+		snprintf(message, sizeof(message), "{\"id\":%u,\"method\":\"add\",\"params\":{\"path\":\"plant/device_%u/temperature\",\"value\":20}}", i, i);
+		handle(message, owner);
+		snprintf(message, sizeof(message), "{\"id\":%u,\"method\":\"add\",\"params\":{\"path\":\"plant/device_%u/status\",\"value\":{}}}", i, i);
+		handle(message, owner);
+		snprintf(message, sizeof(message), "{\"id\":%u,\"method\":\"add\",\"params\":{\"path\":\"plant/device_%u/reset\"}}", i, i);
+		handle(message, owner);
+		snprintf(message, sizeof(message), "{\"id\":%u,\"method\":\"add\",\"params\":{\"path\":\"plant/device_%u/history\",\"value\":[]}}", i, i);
+		handle(message, owner);
+	}
+}
+
+struct message {
+	std::string text;
+	bool from_owner;
+};
+
+static std::vector<message> record_traffic()
+{
+	std::vector<message> traffic;
+	char text[512];
+	for (unsigned int i = 0; i < NUMBER_OF_MESSAGES; i++) {
+		unsigned int device = (i * 7919) % NUMBER_OF_DEVICES;
+		switch (i % 20) {
+		case 0:
+		case 1:
+			snprintf(text, sizeof(text), "{\"id\":\"ui_%u\",\"method\":\"set\",\"params\":{\"path\":\"plant/device_%u/temperature\",\"value\":%u.5}}", i, device, i % 40);
+			traffic.push_back({text, false});
+			break;
+		case 2:
+			snprintf(text, sizeof(text), "{\"id\":\"ui_%u\",\"method\":\"call\",\"params\":{\"path\":\"plant/device_%u/reset\",\"args\":[\"soft\",{\"delay\":%u}]}}", i, device, i % 10);
+			traffic.push_back({text, false});
+			break;
+		case 3:
+		case 4:
+		case 5:
+			snprintf(text, sizeof(text),
+			         "{\"jsonrpc\":\"2.0\",\"method\":\"change\",\"params\":{\"path\":\"plant/device_%u/status\",\"value\":"
+			         "{\"mode\":\"auto\",\"running\":true,\"rpm\":%u,\"alarms\":[{\"code\":%u,\"text\":\"over temperature\"}],\"uptime\":%u}}}",
+			         device, 1000 + i, i % 8, i * 60);
+			traffic.push_back({text, true});
+			break;
+		default:
+			snprintf(text, sizeof(text), "{\"method\":\"change\",\"params\":{\"path\":\"plant/device_%u/temperature\",\"value\":%u.%u}}", device, 15 + i % 20, i % 10);
+			traffic.push_back({text, true});
+			break;
+		}
+	}
+	return traffic;
+}
+
+/*
+ * Historian peers write and read back trends of a hundred samples.
+ */
+static std::vector<message> record_historian_traffic()
+{
+	std::vector<message> traffic;
+	char sample[128];
+	for (unsigned int i = 0; i < NUMBER_OF_MESSAGES / 10; i++) {
+		unsigned int device = (i * 7919) % NUMBER_OF_DEVICES;
+		std::string samples;
+		for (unsigned int j = 0; j < 100; j++) {
+			snprintf(sample, sizeof(sample), "%s{\"time\":%u,\"value\":%u.%02u,\"quality\":\"good\",\"unit\":\"\u00b0C\"}",
+			         (j == 0) ? "" : ",", 1700000000 + i * 100 + j, 20 + j % 10, (i + j) % 100);
+			samples += sample;
+		}
+
+		char path[64];
+		snprintf(path, sizeof(path), "plant/device_%u/history", device);
+		if ((i % 2) == 0) {
+			traffic.push_back({std::string("{\"method\":\"change\",\"params\":{\"path\":\"") + path + "\",\"value\":[" + samples + "]}}", true});
+		} else {
+			traffic.push_back({std::string("{\"id\":\"h_") + std::to_string(i) + "\",\"method\":\"set\",\"params\":{\"path\":\"" + path + "\",\"value\":[" + samples + "]}}", false});
+		}
+	}
+	return traffic;
+}
+
+/*
+ * Gateways collect the status of all devices and change them in a single
+ * batch.
+ */
+static std::vector<message> record_batch_traffic()
+{
+	std::vector<message> traffic;
+	char change[256];
+	for (unsigned int i = 0; i < 5; i++) {
+		std::string batch = "{\"id\":" + std::to_string(i) + ",\"method\":\"changeBatch\",\"params\":{\"elements\":[";
+		for (unsigned int device = 0; device < NUMBER_OF_DEVICES; device++) {
+			snprintf(change, sizeof(change),
+			         "%s{\"path\":\"plant/device_%u/status\",\"value\":{\"mode\":\"auto\",\"running\":true,\"rpm\":%u,\"alarms\":[],\"uptime\":%u}}",
+			         (device == 0) ? "" : ",", device, 1000 + i + device, i * 60);
+			batch += change;
+		}
+		batch += "]}}";
+		traffic.push_back({batch, true});
+	}
+	return traffic;
+}
+
+/*
+ * The previous handling of change, set and call.
+ */
+static void handle_with_tree(const std::string &message, struct peer *p)
+{
+	const char *end_parse;
+	cJSON *request = cJSON_ParseWithOpts(message.c_str(), &end_parse, 0);
+	const char *method = cJSON_GetObjectItem(request, "method")->valuestring;
+	cJSON *response;
+	if (::strcmp(method, "change") == 0) {
+		response = change_state(p, request);
+	} else {
+		response = set_or_call(p, request, (::strcmp(method, "set") == 0) ? STATE : METHOD);
+	}
+	if (response != NULL) {
+		char *rendered = cJSON_PrintUnformatted(response);
+		p->send_message(p, rendered, ::strlen(rendered));
+		cJSON_free(rendered);
+		cJSON_Delete(response);
+	}
+	cJSON_Delete(request);
+}
+
+static double replay(const std::vector<message> &traffic, struct peer *owner, struct peer *client, bool indexed)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int round = 0; round < NUMBER_OF_ROUNDS; round++) {
+		for (const message &m : traffic) {
+			struct peer *p = m.from_owner ? owner : client;
+			routed_id.clear();
+			if (indexed) {
+				handle(m.text, p);
+			} else {
+				handle_with_tree(m.text, p);
+			}
+			if (!routed_id.empty()) {
+				handle("{\"id\":\"" + routed_id + "\",\"result\":true}", owner);
+			}
+		}
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+	return (double)elapsed.count() / ((double)traffic.size() * NUMBER_OF_ROUNDS);
+}
+
+int main()
+{
+	loop.this_ptr = NULL;
+	loop.init = NULL;
+	loop.destroy = NULL;
+	loop.run = NULL;
+	loop.add = fake_add;
+	loop.remove = fake_remove;
+
+	init_parser();
+	element_hashtable_create();
+	struct peer *owner = alloc_peer(send_to_owner);
+	struct peer *client = alloc_peer(send_message);
+	add_elements(owner);
+
+	std::vector<message> traffic = record_traffic();
+	std::vector<message> changes;
+	for (const message &m : traffic) {
+		if (m.from_owner) {
+			changes.push_back(m);
+		}
+	}
+
+	printf("all messages, cJSON tree: %7.1f ns per message\n", replay(traffic, owner, client, false));
+	printf("all messages, indexed:    %7.1f ns per message\n", replay(traffic, owner, client, true));
+	printf("changes, cJSON tree:      %7.1f ns per message\n", replay(changes, owner, client, false));
+	printf("changes, indexed:         %7.1f ns per message\n", replay(changes, owner, client, true));
+
+	std::vector<message> historian_traffic = record_historian_traffic();
+	printf("historian, cJSON tree:    %7.1f ns per message\n", replay(historian_traffic, owner, client, false));
+	printf("historian, indexed:       %7.1f ns per message\n", replay(historian_traffic, owner, client, true));
+
+	std::vector<message> batch_traffic = record_batch_traffic();
+	printf("change batches:           %7.1f ns per message\n", replay(batch_traffic, owner, client, true));
+
+	free_peer(client);
+	free_peer(owner);
+	element_hashtable_delete();
+	return EXIT_SUCCESS;
+}
@@ -32,6 +32,7 @@
 
 #include <cstring>
 #include <list>
+#include <string>
 
 #include "generated/cjet_config.h"
 #include "json/cJSON.h"
@@ -928,6 +929,130 @@ BOOST_FIXTURE_TEST_CASE(correct_set_with_error_response, F)
 	free(routed_id);
 }
 
+static void add_state(struct peer *peer, const char *path)
+{
+	cJSON *add_json = create_correct_add_state(path);
+	char *unformatted_json = cJSON_PrintUnformatted(add_json);
+	int ret = parse_message(unformatted_json, strlen(unformatted_json), peer);
+	cJSON_free(unformatted_json);
+	cJSON_Delete(add_json);
+	BOOST_REQUIRE(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+	check_no_error();
+}
+
+BOOST_FIXTURE_TEST_CASE(indexed_change, F)
+{
+	add_state(&p, "/foo/bar/state");
+
+	static const char change[] = "{\"id\":\"c1\",\"method\":\"change\",\"params\":{\"path\":\"/foo/bar/state\",\"value\": {\"a\": [1, 2]}}}";
+	int ret = parse_message(change, strlen(change), &p);
+	BOOST_CHECK(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+	check_no_error();
+
+	const struct element *e = get_state("/foo/bar/state");
+	const cJSON *a = cJSON_GetObjectItem(e->value, "a");
+	BOOST_REQUIRE(a != NULL);
+	BOOST_CHECK(cJSON_GetArraySize(a) == 2);
+	BOOST_CHECK(strcmp(e->rendered_value->valuestring, "{\"a\": [1, 2]}") == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(indexed_change_of_unknown_state, F)
+{
+	static const char change[] = "{\"id\":\"c2\",\"method\":\"change\",\"params\":{\"path\":\"/foo\",\"value\":1}}";
+	int ret = parse_message(change, strlen(change), &p);
+	BOOST_CHECK(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+
+	cJSON *response = events.front();
+	events.pop_front();
+	BOOST_CHECK(cJSON_GetObjectItem(response, "error") != NULL);
+	BOOST_CHECK(strcmp(cJSON_GetObjectItem(response, "id")->valuestring, "c2") == 0);
+	cJSON_Delete(response);
+}
+
+BOOST_FIXTURE_TEST_CASE(escaped_path_is_parsed_completely, F)
+{
+	add_state(&p, "/foo/bar/state");
+
+	static const char change[] = "{\"id\":3,\"method\":\"change\",\"params\":{\"path\":\"\\/foo\\/bar\\/state\",\"value\":42}}";
+	int ret = parse_message(change, strlen(change), &p);
+	BOOST_CHECK(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+	check_no_error();
+	BOOST_CHECK(get_state("/foo/bar/state")->value->valueint == 42);
+}
+
+BOOST_FIXTURE_TEST_CASE(value_outlives_message, F)
+{
+	add_state(&p, "/foo/bar/state");
+
+	static const char change[] = "{\"id\":5,\"method\":\"change\",\"params\":{\"path\":\"\\/foo\\/bar\\/state\",\"value\":{\"name\":\"pump\"}}}";
+	int ret = parse_message(change, strlen(change), &p);
+	BOOST_CHECK(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+	check_no_error();
+
+	add_state(&p, "/foo/bar/other_state");
+
+	const struct element *e = get_state("/foo/bar/state");
+	const cJSON *name = cJSON_GetObjectItem(e->value, "name");
+	BOOST_REQUIRE(name != NULL);
+	BOOST_CHECK(::strcmp(name->valuestring, "pump") == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(indexed_change_with_large_value, F)
+{
+	add_state(&p, "/foo/bar/state");
+
+	std::string value = "[0";
+	for (unsigned int i = 1; i < 200; i++) {
+		value += ",{\"sample\":" + std::to_string(i) + "}";
+	}
+	value += "]";
+	std::string change = "{\"id\":4,\"method\":\"change\",\"params\":{\"path\":\"/foo/bar/state\",\"value\":" + value + "}}";
+	int ret = parse_message(change.c_str(), change.length(), &p);
+	BOOST_CHECK(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+	check_no_error();
+
+	const struct element *e = get_state("/foo/bar/state");
+	BOOST_CHECK(cJSON_GetArraySize(e->value) == 200);
+	BOOST_CHECK(value == e->rendered_value->valuestring);
+}
+
+BOOST_FIXTURE_TEST_CASE(invalid_utf8_is_parsed_completely, F)
+{
+	add_state(&p, "/foo/bar/state");
+
+	static const char change[] = "{\"id\":5,\"method\":\"change\",\"params\":{\"path\":\"/foo/bar/state\",\"value\":\"\xff\"}}";
+	int ret = parse_message(change, strlen(change), &p);
+	BOOST_CHECK(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+	check_no_error();
+	BOOST_CHECK(get_state("/foo/bar/state")->value->type == cJSON_String);
+}
+
+BOOST_FIXTURE_TEST_CASE(indexed_set_forwards_raw_value, F)
+{
+	add_state(&p, "/foo/bar/state");
+
+	static const char set[] = "{\"id\":\"s1\",\"method\":\"set\",\"params\":{\"path\":\"/foo/bar/state\",\"value\":{\"b\" : true}}}";
+	int ret = parse_message(set, strlen(set), &set_peer);
+	BOOST_CHECK(ret == 0);
+	BOOST_REQUIRE(events.size() == 1);
+
+	cJSON *routed = events.front();
+	events.pop_front();
+	BOOST_REQUIRE(routed != NULL);
+	const cJSON *value = cJSON_GetObjectItem(cJSON_GetObjectItem(routed, "params"), "value");
+	BOOST_REQUIRE(value != NULL);
+	BOOST_CHECK(cJSON_GetObjectItem(value, "b")->type == cJSON_True);
+	BOOST_CHECK(strcmp(cJSON_GetObjectItem(routed, "method")->valuestring, "/foo/bar/state") == 0);
+	cJSON_Delete(routed);
+}
+
 BOOST_FIXTURE_TEST_CASE(parse_wrong_json, F)
 {
 	static const char wrong_json[] =   "{\"id\": 7384,\"method\": add\",\"params\":{\"path\": \"foo/bar/state\",\"value\": 123}}";
@@ -0,0 +1,193 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE path_index
+
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "alloc.h"
+#include "path_index.h"
+
+struct F {
+	F()
+	{
+		static const char *devices[] = {"pump", "valve", "sensor", "motor", "pump_station"};
+		for (unsigned int i = 0; i < 2000; i++) {
+			paths.push_back("plant/line_" + std::to_string(i % 7) + "/" + devices[i % 5] + "_" + std::to_string(i));
+		}
+		/* Children with every possible key byte. */
+		for (unsigned int c = 1; c < 256; c++) {
+			paths.push_back(std::string("bytes/") + (char)c);
+		}
+		paths.push_back("plant");
+		paths.push_back("plant/");
+		paths.push_back("a_rather_long_common_part_that_does_not_fit_into_a_node/1");
+		paths.push_back("a_rather_long_common_part_that_does_not_fit_into_a_node/2");
+		paths.push_back("a_rather_long_common_part_that_does_not_fit_into_a_node_either");
+
+		entries.resize(paths.size());
+		for (unsigned int i = 0; i < paths.size(); i++) {
+			entries[i].path = paths[i].c_str();
+		}
+	}
+
+	~F()
+	{
+		for (unsigned int i = 0; i < entries.size(); i++) {
+			path_index_remove(&entries[i]);
+		}
+		BOOST_CHECK(cjet_get_alloc_size() == 0);
+	}
+
+	void insert_all()
+	{
+		std::vector<unsigned int> order(paths.size());
+		for (unsigned int i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::shuffle(order.begin(), order.end(), std::mt19937(42));
+		for (unsigned int i : order) {
+			BOOST_REQUIRE(path_index_insert(&entries[i]) == 0);
+			inserted.insert(paths[i]);
+		}
+	}
+
+	void remove(unsigned int i)
+	{
+		path_index_remove(&entries[i]);
+		inserted.erase(paths[i]);
+	}
+
+	void check_prefix(const std::string &prefix)
+	{
+		std::vector<std::string> expected;
+		for (const std::string &path : inserted) {
+			if (path.compare(0, prefix.size(), prefix) == 0) {
+				expected.push_back(path);
+			}
+		}
+
+		std::vector<std::string> visited;
+		BOOST_CHECK(path_index_visit_prefix(prefix.c_str(), collect, &visited) == 0);
+		BOOST_CHECK_MESSAGE(visited == expected, "prefix \"" << prefix << "\" visited " << visited.size() << " instead of " << expected.size() << " paths");
+	}
+
+	static int collect(struct path_index_entry *entry, void *context)
+	{
+		std::vector<std::string> *visited = (std::vector<std::string> *)context;
+		visited->push_back(entry->path);
+		return 0;
+	}
+
+	std::vector<std::string> paths;
+	std::vector<struct path_index_entry> entries;
+	std::set<std::string> inserted;
+};
+
+static void check_prefixes(F &f)
+{
+	static const char *prefixes[] = {
+	    "",
+	    "p",
+	    "plant",
+	    "plant/",
+	    "plant/line_3/",
+	    "plant/line_3/pump",
+	    "plant/line_3/pump_",
+	    "plant/line_3/pump_station_1",
+	    "plant/line_8",
+	    "bytes/",
+	    "bytes/a",
+	    "a_rather_long_common_part",
+	    "a_rather_long_common_part_that_does_not_fit_into_a_node/",
+	    "a_rather_long_common_part_that_does_not_fit_into_a_nodX",
+	    "a_rather_long_common_part_that_does_not_fit_into_a_node_either_not",
+	    "unknown",
+	};
+	for (unsigned int i = 0; i < sizeof(prefixes) / sizeof(*prefixes); i++) {
+		f.check_prefix(prefixes[i]);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(empty_index, F)
+{
+	check_prefix("");
+	check_prefix("plant");
+}
+
+BOOST_FIXTURE_TEST_CASE(visit_prefixes_in_order, F)
+{
+	insert_all();
+	check_prefixes(*this);
+}
+
+BOOST_FIXTURE_TEST_CASE(insert_same_path_twice, F)
+{
+	insert_all();
+	struct path_index_entry duplicate = {paths[0].c_str()};
+	BOOST_CHECK(path_index_insert(&duplicate) != 0);
+	check_prefix("plant/line_0/pump_0");
+}
+
+BOOST_FIXTURE_TEST_CASE(remove_shrinks_nodes, F)
+{
+	insert_all();
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		if ((i % 3) != 0) {
+			remove(i);
+		}
+	}
+	check_prefixes(*this);
+
+	for (unsigned int i = 0; i < paths.size(); i += 3) {
+		remove(i);
+	}
+	check_prefixes(*this);
+	BOOST_CHECK(cjet_get_alloc_size() == 0);
+}
+
+static int stop_visit(struct path_index_entry *entry, void *context)
+{
+	(void)entry;
+	unsigned int *count = (unsigned int *)context;
+	(*count)++;
+	return (*count == 10) ? -1 : 0;
+}
+
+BOOST_FIXTURE_TEST_CASE(stop_visiting, F)
+{
+	insert_all();
+	unsigned int count = 0;
+	BOOST_CHECK(path_index_visit_prefix("plant/", stop_visit, &count) == -1);
+	BOOST_CHECK(count == 10);
+}
@@ -0,0 +1,140 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "jet_regex.h"
+#include "json/cJSON.h"
+
+/*
+ * Compares a regex fetch evaluated in the daemon with the client-side
+ * alternative: fetching everything and filtering the parsed
+ * notifications with std::regex.
+ */
+
+static const unsigned int NUMBER_OF_PATHS = 10000;
+static const unsigned int NUMBER_OF_ROUNDS = 10;
+
+static std::vector<std::string> create_paths()
+{
+	static const char *devices[] = {"pump", "valve", "sensor", "motor"};
+	static const char *properties[] = {"temperature", "pressure", "state", "speed"};
+	char path[128];
+
+	std::vector<std::string> paths;
+	for (unsigned int i = 0; i < NUMBER_OF_PATHS; i++) {
+		snprintf(path, sizeof(path), "plant/line_%u/%s_%u/%s", i % 16, devices[i % 4], i, properties[(i / 4) % 4]);
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+static std::vector<std::string> create_notifications(const std::vector<std::string> &paths)
+{
+	std::vector<std::string> notifications;
+	for (const std::string &path : paths) {
+		notifications.push_back("{\"method\":\"fetch_id\",\"params\":{\"path\":\"" + path + "\",\"event\":\"change\",\"value\":42}}");
+	}
+	return notifications;
+}
+
+static double server_side_filtering(const struct jet_regex *re, const std::vector<std::string> &paths, unsigned int *matches)
+{
+	*matches = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int round = 0; round < NUMBER_OF_ROUNDS; round++) {
+		for (const std::string &path : paths) {
+			if (jet_regex_match(re, path.c_str(), path.size())) {
+				(*matches)++;
+			}
+		}
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+	*matches /= NUMBER_OF_ROUNDS;
+	return (double)elapsed.count() / (NUMBER_OF_PATHS * NUMBER_OF_ROUNDS);
+}
+
+static double client_side_filtering(const std::regex &re, const std::vector<std::string> &notifications, unsigned int *matches)
+{
+	*matches = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int round = 0; round < NUMBER_OF_ROUNDS; round++) {
+		for (const std::string &notification : notifications) {
+			cJSON *json = cJSON_Parse(notification.c_str());
+			const cJSON *params = cJSON_GetObjectItem(json, "params");
+			const cJSON *path = cJSON_GetObjectItem(params, "path");
+			if (std::regex_search(path->valuestring, re)) {
+				(*matches)++;
+			}
+			cJSON_Delete(json);
+		}
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+	*matches /= NUMBER_OF_ROUNDS;
+	return (double)elapsed.count() / (NUMBER_OF_PATHS * NUMBER_OF_ROUNDS);
+}
+
+int main()
+{
+	static const char *patterns[] = {
+		"^plant/line_1[0-5]/",
+		"(pump|valve)_\\d+/pressure$",
+		"/sensor_\\d*6/(temperature|speed)$",
+	};
+
+	std::vector<std::string> paths = create_paths();
+	std::vector<std::string> notifications = create_notifications(paths);
+
+	for (unsigned int i = 0; i < sizeof(patterns) / sizeof(*patterns); i++) {
+		struct jet_regex *re = jet_regex_compile(patterns[i], false);
+		if (re == NULL) {
+			fprintf(stderr, "could not compile %s!\n", patterns[i]);
+			return EXIT_FAILURE;
+		}
+		std::regex client_re(patterns[i], std::regex::ECMAScript | std::regex::optimize);
+
+		unsigned int server_matches;
+		unsigned int client_matches;
+		double server_ns = server_side_filtering(re, paths, &server_matches);
+		double client_ns = client_side_filtering(client_re, notifications, &client_matches);
+		jet_regex_free(re);
+
+		if (server_matches != client_matches) {
+			fprintf(stderr, "%s: %u matches in daemon, %u in client!\n", patterns[i], server_matches, client_matches);
+			return EXIT_FAILURE;
+		}
+		printf("%-40s %5u of %u paths: daemon %8.1f ns, client %8.1f ns per path\n",
+		       patterns[i], server_matches, NUMBER_OF_PATHS, server_ns, client_ns);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,274 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE snapshot
+
+#include <boost/test/unit_test.hpp>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "element.h"
+#include "json/cJSON.h"
+#include "parse.h"
+#include "peer.h"
+#include "snapshot.h"
+#include "table.h"
+
+static const char snapshot_file[] = "snapshot_test.snap";
+
+extern "C" {
+	ssize_t socket_read(socket_type sock, void *buf, size_t count)
+	{
+		(void)sock;
+		(void)buf;
+		(void)count;
+		return 0;
+	}
+
+	int socket_close(socket_type sock)
+	{
+		(void)sock;
+		return 0;
+	}
+}
+
+static int send_message(const struct peer *p, char *rendered, size_t len)
+{
+	(void)p;
+	(void)rendered;
+	(void)len;
+	return 0;
+}
+
+static enum eventloop_return fake_add(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+	return EL_CONTINUE_LOOP;
+}
+
+static void fake_remove(const void *this_ptr, const struct io_event *ev)
+{
+	(void)this_ptr;
+	(void)ev;
+}
+
+static struct eventloop loop;
+
+static struct element *get_state(const char *path)
+{
+	return (struct element *)element_table_get(path);
+}
+
+static cJSON *create_add(const char *path, cJSON *value)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "path", path);
+	if (value != NULL) {
+		cJSON_AddItemToObject(params, "value", value);
+	}
+
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "add_request_1");
+	cJSON_AddStringToObject(root, "method", "add");
+	return root;
+}
+
+static bool add(struct peer *p, const char *path, cJSON *value)
+{
+	cJSON *request = create_add(path, value);
+	cJSON *response = add_element_to_peer(p, request);
+	bool success = (cJSON_GetObjectItem(response, "result") != NULL);
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+	return success;
+}
+
+struct F {
+	F()
+	{
+		loop.this_ptr = NULL;
+		loop.init = NULL;
+		loop.destroy = NULL;
+		loop.run = NULL;
+		loop.add = fake_add;
+		loop.remove = fake_remove;
+
+		init_parser();
+		element_hashtable_create();
+		init_peer(&owner, false, &loop);
+		owner.send_message = send_message;
+		set_peer_name(&owner, "owner");
+		init_peer(&other, false, &loop);
+		other.send_message = send_message;
+		set_peer_name(&other, "other");
+	}
+
+	~F()
+	{
+		snapshot_stop();
+		free_peer_resources(&other);
+		free_peer_resources(&owner);
+		element_hashtable_delete();
+		unlink(snapshot_file);
+	}
+
+	void restart()
+	{
+		BOOST_REQUIRE(snapshot_write(snapshot_file) == 0);
+		remove_all_elements_from_peer(&owner);
+		BOOST_REQUIRE(snapshot_load(snapshot_file, &loop) == 0);
+	}
+
+	struct peer owner;
+	struct peer other;
+};
+
+BOOST_FIXTURE_TEST_CASE(states_survive_restart, F)
+{
+	cJSON *value = cJSON_CreateObject();
+	cJSON_AddNumberToObject(value, "speed", 42);
+	BOOST_REQUIRE(add(&owner, "/foo/bar", value));
+	BOOST_REQUIRE(add(&owner, "/foo/method", NULL));
+
+	restart();
+
+	const struct element *e = get_state("/foo/bar");
+	BOOST_REQUIRE(e != NULL);
+	BOOST_CHECK(element_is_orphaned(e));
+	BOOST_CHECK(e->peer != &owner);
+	BOOST_CHECK(strcmp(e->orphan_owner, "owner") == 0);
+	BOOST_CHECK(cJSON_GetObjectItem(e->value, "speed")->valueint == 42);
+	BOOST_CHECK(get_state("/foo/method") == NULL);
+}
+
+BOOST_FIXTURE_TEST_CASE(set_on_orphaned_state, F)
+{
+	BOOST_REQUIRE(add(&owner, "/foo/bar", cJSON_CreateNumber(1)));
+	restart();
+
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "path", "/foo/bar");
+	cJSON_AddNumberToObject(params, "value", 2);
+	cJSON *request = cJSON_CreateObject();
+	cJSON_AddItemToObject(request, "params", params);
+	cJSON_AddStringToObject(request, "id", "set_request_1");
+	cJSON_AddStringToObject(request, "method", "set");
+
+	cJSON *response = set_or_call(&other, request, STATE);
+	BOOST_CHECK(cJSON_GetObjectItem(response, "error") != NULL);
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+}
+
+BOOST_FIXTURE_TEST_CASE(owner_reclaims_state, F)
+{
+	BOOST_REQUIRE(add(&owner, "/foo/bar", cJSON_CreateNumber(1)));
+	restart();
+
+	BOOST_CHECK(!add(&other, "/foo/bar", cJSON_CreateNumber(2)));
+	BOOST_CHECK(add(&owner, "/foo/bar", cJSON_CreateNumber(3)));
+
+	const struct element *e = get_state("/foo/bar");
+	BOOST_REQUIRE(e != NULL);
+	BOOST_CHECK(!element_is_orphaned(e));
+	BOOST_CHECK(e->peer == &owner);
+	BOOST_CHECK(e->value->valueint == 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(unnamed_peer_cannot_reclaim_state, F)
+{
+	BOOST_REQUIRE(add(&owner, "/foo/bar", cJSON_CreateNumber(1)));
+	restart();
+
+	struct peer unnamed;
+	init_peer(&unnamed, false, &loop);
+	unnamed.send_message = send_message;
+	BOOST_CHECK(!add(&unnamed, "/foo/bar", cJSON_CreateNumber(2)));
+	free_peer_resources(&unnamed);
+
+	const struct element *e = get_state("/foo/bar");
+	BOOST_REQUIRE(e != NULL);
+	BOOST_CHECK(element_is_orphaned(e));
+	BOOST_CHECK(e->value->valueint == 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(corrupted_snapshot, F)
+{
+	BOOST_REQUIRE(add(&owner, "/foo/bar", cJSON_CreateNumber(1)));
+	BOOST_REQUIRE(snapshot_write(snapshot_file) == 0);
+	remove_all_elements_from_peer(&owner);
+
+	FILE *file = fopen(snapshot_file, "r+b");
+	BOOST_REQUIRE(file != NULL);
+	fseek(file, -1, SEEK_END);
+	fputc('x', file);
+	fclose(file);
+
+	BOOST_CHECK(snapshot_load(snapshot_file, &loop) == 0);
+	BOOST_CHECK(get_state("/foo/bar") == NULL);
+}
+
+BOOST_FIXTURE_TEST_CASE(missing_snapshot, F)
+{
+	BOOST_CHECK(snapshot_load("does_not_exist.snap", &loop) == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(state_changes_are_counted, F)
+{
+	uint64_t changes = get_state_changes();
+	BOOST_REQUIRE(add(&owner, "/foo/bar", cJSON_CreateNumber(1)));
+	BOOST_CHECK(get_state_changes() > changes);
+
+	changes = get_state_changes();
+	BOOST_CHECK(!add(&other, "/foo/bar", cJSON_CreateNumber(2)));
+	BOOST_CHECK(get_state_changes() == changes);
+
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddStringToObject(params, "path", "/foo/bar");
+	cJSON_AddNumberToObject(params, "value", 3);
+	cJSON *request = cJSON_CreateObject();
+	cJSON_AddItemToObject(request, "params", params);
+	cJSON_AddStringToObject(request, "id", "change_request_1");
+	cJSON_AddStringToObject(request, "method", "change");
+	cJSON *response = change_state(&owner, request);
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+	BOOST_CHECK(get_state_changes() > changes);
+
+	changes = get_state_changes();
+	set_peer_name(&other, "another");
+	BOOST_CHECK(get_state_changes() == changes);
+	set_peer_name(&owner, "new_owner");
+	BOOST_CHECK(get_state_changes() > changes);
+
+	changes = get_state_changes();
+	remove_all_elements_from_peer(&owner);
+	BOOST_CHECK(get_state_changes() > changes);
+}
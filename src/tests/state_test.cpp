@@ -30,6 +30,8 @@
 
 #include <boost/test/unit_test.hpp>
 #include <list>
+#include <string>
+#include <vector>
 
 #include "json/cJSON.h"
 #include "parse.h"
@@ -354,6 +356,25 @@ BOOST_FIXTURE_TEST_CASE(delete_nonexisting_state, F)
 	cJSON_Delete(response);
 }
 
+BOOST_FIXTURE_TEST_CASE(delete_state_of_other_peer, F)
+{
+	const char path[] = "/foo/bar/";
+
+	cJSON *request = create_add(path);
+
+	cJSON *response = add_element_to_peer(&p, request);
+	BOOST_REQUIRE_MESSAGE(response != NULL, "add_element_to_peer() had no response!");
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(response);
+
+	response = remove_element_from_peer(&owner_peer, request);
+	BOOST_REQUIRE_MESSAGE(response != NULL, "remove_element_from_peer() had no response!");
+	BOOST_CHECK_MESSAGE(response_is_error(response), "removing state of another peer did not fail!");
+	cJSON_Delete(response);
+	BOOST_CHECK(get_state(path) != NULL);
+	cJSON_Delete(request);
+}
+
 BOOST_FIXTURE_TEST_CASE(double_free_state, F)
 {
 	const char path[] = "/foo/bar/";
@@ -400,10 +421,36 @@ BOOST_FIXTURE_TEST_CASE(change, F)
 
 	struct element *e = get_state(json_path->valuestring);
 	BOOST_CHECK(e->value->valueint == new_value->valueint);
+	BOOST_CHECK(strcmp(e->rendered_value->valuestring, "4321") == 0);
 	cJSON_Delete(request);
 	cJSON_Delete(response);
 }
 
+BOOST_FIXTURE_TEST_CASE(add_takes_over_value, F)
+{
+	cJSON *request = create_add("/foo/bar/");
+	cJSON *params = cJSON_GetObjectItem(request, "params");
+	cJSON *value = cJSON_GetObjectItem(params, "value");
+
+	cJSON *response = add_element_to_peer(&p, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(response);
+
+	struct element *e = get_state("/foo/bar/");
+	BOOST_CHECK(e->value == value);
+	BOOST_CHECK(cJSON_GetObjectItem(params, "value")->valueint == 1234);
+
+	cJSON_ReplaceItemInObject(params, "path", cJSON_CreateString("/foo/baz/"));
+	response = add_element_to_peer(&p, request);
+	BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+
+	struct element *other = get_state("/foo/baz/");
+	BOOST_CHECK(other->value != e->value);
+	BOOST_CHECK(other->value->valueint == 1234);
+}
+
 BOOST_FIXTURE_TEST_CASE(change_no_params, F)
 {
 	const char path[] = "/foo/bar/";
@@ -953,3 +1000,211 @@ BOOST_FIXTURE_TEST_CASE(two_sets_all_timeout, F)
 	cJSON_Delete(routed_message2);
 	cJSON_Delete(response2);
 }
+
+static cJSON *create_batch(const char *method, cJSON *elements)
+{
+	cJSON *params = cJSON_CreateObject();
+	cJSON_AddItemToObject(params, "elements", elements);
+
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "params", params);
+	cJSON_AddStringToObject(root, "id", "batch_request_1");
+	cJSON_AddStringToObject(root, "method", method);
+	return root;
+}
+
+static cJSON *create_batch_entry(const char *path, int value)
+{
+	cJSON *entry = cJSON_CreateObject();
+	cJSON_AddStringToObject(entry, "path", path);
+	cJSON_AddNumberToObject(entry, "value", value);
+	return entry;
+}
+
+static void add_batch(struct peer *p, const char **paths, unsigned int number_of_paths, bool expect_error)
+{
+	cJSON *elements = cJSON_CreateArray();
+	for (unsigned int i = 0; i < number_of_paths; i++) {
+		cJSON_AddItemToArray(elements, create_batch_entry(paths[i], i));
+	}
+
+	cJSON *request = create_batch("addBatch", elements);
+	cJSON *response = add_elements_to_peer(p, request);
+	BOOST_REQUIRE(response != NULL);
+	BOOST_CHECK(response_is_error(response) == expect_error);
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+}
+
+BOOST_FIXTURE_TEST_CASE(add_batch_of_states, F)
+{
+	static const char *paths[] = {"/a", "/b", "/c"};
+	add_batch(&p, paths, 3, false);
+
+	for (unsigned int i = 0; i < 3; i++) {
+		struct element *e = get_state(paths[i]);
+		BOOST_REQUIRE(e != NULL);
+		BOOST_CHECK(e->value->valueint == (int)i);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(add_batch_is_atomic, F)
+{
+	static const char *existing[] = {"/b"};
+	add_batch(&p, existing, 1, false);
+
+	static const char *conflicting[] = {"/a", "/b", "/c"};
+	add_batch(&p, conflicting, 3, true);
+	BOOST_CHECK(get_state("/a") == NULL);
+	BOOST_CHECK(get_state("/c") == NULL);
+
+	static const char *duplicates[] = {"/d", "/e", "/d"};
+	add_batch(&p, duplicates, 3, true);
+	BOOST_CHECK(get_state("/d") == NULL);
+	BOOST_CHECK(get_state("/e") == NULL);
+}
+
+BOOST_FIXTURE_TEST_CASE(change_batch_of_states, F)
+{
+	static const char *paths[] = {"/a", "/b"};
+	add_batch(&p, paths, 2, false);
+
+	cJSON *elements = cJSON_CreateArray();
+	cJSON_AddItemToArray(elements, create_batch_entry("/a", 10));
+	cJSON_AddItemToArray(elements, create_batch_entry("/b", 11));
+	cJSON *request = create_batch("changeBatch", elements);
+	cJSON *response = change_states(&p, request);
+	BOOST_CHECK(!response_is_error(response));
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+	BOOST_CHECK(get_state("/a")->value->valueint == 10);
+	BOOST_CHECK(get_state("/b")->value->valueint == 11);
+
+	elements = cJSON_CreateArray();
+	cJSON_AddItemToArray(elements, create_batch_entry("/a", 20));
+	cJSON_AddItemToArray(elements, create_batch_entry("/b", 21));
+	request = create_batch("changeBatch", elements);
+	response = change_states(&owner_peer, request);
+	BOOST_CHECK(response_is_error(response));
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+	BOOST_CHECK(get_state("/a")->value->valueint == 10);
+	BOOST_CHECK(get_state("/b")->value->valueint == 11);
+}
+
+BOOST_FIXTURE_TEST_CASE(remove_batch_of_states, F)
+{
+	static const char *paths[] = {"/a", "/b", "/c"};
+	add_batch(&p, paths, 3, false);
+
+	cJSON *elements = cJSON_CreateArray();
+	cJSON_AddItemToArray(elements, create_batch_entry("/a", 0));
+	cJSON_AddItemToArray(elements, create_batch_entry("/x", 0));
+	cJSON *request = create_batch("removeBatch", elements);
+	cJSON *response = remove_elements_from_peer(&p, request);
+	BOOST_CHECK(response_is_error(response));
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+	BOOST_CHECK(get_state("/a") != NULL);
+
+	elements = cJSON_CreateArray();
+	cJSON_AddItemToArray(elements, create_batch_entry("/a", 0));
+	cJSON_AddItemToArray(elements, create_batch_entry("/c", 0));
+	request = create_batch("removeBatch", elements);
+	response = remove_elements_from_peer(&p, request);
+	BOOST_CHECK(!response_is_error(response));
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+	BOOST_CHECK(get_state("/a") == NULL);
+	BOOST_CHECK(get_state("/b") != NULL);
+	BOOST_CHECK(get_state("/c") == NULL);
+}
+
+static std::vector<std::string> get_directory_paths(const struct element_directory *dir)
+{
+	std::vector<std::string> paths;
+	for (unsigned int i = 0; i < dir->size; i++) {
+		if (dir->elements[i] != NULL) {
+			BOOST_CHECK(dir->elements[i]->directory_index == i);
+			BOOST_CHECK(strcmp(element_directory_path(dir, i), dir->elements[i]->path) == 0);
+			paths.push_back(element_directory_path(dir, i));
+		}
+	}
+	return paths;
+}
+
+BOOST_FIXTURE_TEST_CASE(directory_keeps_order_of_states, F)
+{
+	std::vector<std::string> expected;
+	for (unsigned int i = 0; i < 40; i++) {
+		std::string path = "/state/" + std::to_string(i);
+		cJSON *request = create_add(path.c_str());
+		cJSON *response = add_element_to_peer(&p, request);
+		BOOST_CHECK_MESSAGE(!response_is_error(response), "add_element_to_peer() failed!");
+		cJSON_Delete(response);
+		if ((i % 4) != 0) {
+			response = remove_element_from_peer(&p, request);
+			BOOST_CHECK_MESSAGE(!response_is_error(response), "remove_element_from_peer() failed!");
+			cJSON_Delete(response);
+		} else {
+			expected.push_back(path);
+		}
+		cJSON_Delete(request);
+	}
+
+	BOOST_CHECK(p.elements.number_of_elements == 10);
+	BOOST_CHECK(p.elements.size > p.elements.number_of_elements);
+	BOOST_CHECK(get_directory_paths(&p.elements) == expected);
+
+	BOOST_REQUIRE(element_directory_reserve(&p.elements, p.elements.capacity, 0) == 0);
+	BOOST_CHECK(p.elements.size == 10);
+	BOOST_CHECK(get_directory_paths(&p.elements) == expected);
+}
+
+BOOST_FIXTURE_TEST_CASE(directory_shrinks_after_removing_most_states, F)
+{
+	std::vector<std::string> paths;
+	for (unsigned int i = 0; i < 100; i++) {
+		paths.push_back("/a/rather/long/path/of/state/" + std::to_string(100 + i));
+	}
+	std::vector<const char *> path_pointers;
+	for (const std::string &path : paths) {
+		path_pointers.push_back(path.c_str());
+	}
+	add_batch(&p, path_pointers.data(), path_pointers.size(), false);
+	size_t full_path_buffer_size = p.elements.path_buffer_size;
+
+	cJSON *elements = cJSON_CreateArray();
+	for (unsigned int i = 0; i < 100; i++) {
+		if ((i % 10) != 0) {
+			cJSON_AddItemToArray(elements, create_batch_entry(path_pointers[i], 0));
+		}
+	}
+	cJSON *request = create_batch("removeBatch", elements);
+	cJSON *response = remove_elements_from_peer(&p, request);
+	BOOST_CHECK(!response_is_error(response));
+	cJSON_Delete(response);
+	cJSON_Delete(request);
+
+	std::vector<std::string> expected;
+	for (unsigned int i = 0; i < 100; i += 10) {
+		expected.push_back(paths[i]);
+	}
+	BOOST_CHECK(p.elements.size == 10);
+	BOOST_CHECK(p.elements.path_buffer_size == full_path_buffer_size / 10);
+	BOOST_CHECK(p.elements.capacity <= 20);
+	BOOST_CHECK(get_directory_paths(&p.elements) == expected);
+
+	for (unsigned int i = 0; i < 100; i += 10) {
+		if (i != 50) {
+			request = create_add(path_pointers[i]);
+			response = remove_element_from_peer(&p, request);
+			BOOST_CHECK(!response_is_error(response));
+			cJSON_Delete(response);
+			cJSON_Delete(request);
+		}
+	}
+	BOOST_CHECK(p.elements.size == 1);
+	BOOST_CHECK(p.elements.path_buffer_size == full_path_buffer_size / 100);
+	BOOST_CHECK(get_directory_paths(&p.elements) == std::vector<std::string>{paths[50]});
+}
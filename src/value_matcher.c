@@ -0,0 +1,343 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler.h"
+#include "jet_string.h"
+#include "peer.h"
+#include "response.h"
+#include "value_matcher.h"
+#include "json/cJSON.h"
+
+#define TYPE_MASK(type) (1U << (type))
+
+enum value_operator {
+	VALUE_EQUALS,
+	VALUE_LESS_THAN,
+	VALUE_GREATER_THAN,
+	VALUE_IS_TYPE,
+};
+
+struct value_condition {
+	char *field; /* NULL if the condition applies to the value itself */
+	enum value_operator op;
+	const cJSON *operand; /* Points into the duplicated conditions of the matcher */
+	unsigned int type_mask; /* Types accepted by isType */
+};
+
+struct value_matcher {
+	char *key;
+	cJSON *conditions; /* Copy of the "value" and "valueField" params */
+	unsigned int number_of_conditions;
+	struct value_condition condition[1];
+};
+
+struct value_type {
+	const char *name;
+	unsigned int type_mask;
+};
+
+static const struct value_type value_types[] = {
+    {.name = "number", .type_mask = TYPE_MASK(cJSON_Number)},
+    {.name = "string", .type_mask = TYPE_MASK(cJSON_String)},
+    {.name = "boolean", .type_mask = TYPE_MASK(cJSON_True) | TYPE_MASK(cJSON_False)},
+    {.name = "object", .type_mask = TYPE_MASK(cJSON_Object)},
+    {.name = "array", .type_mask = TYPE_MASK(cJSON_Array)},
+    {.name = "null", .type_mask = TYPE_MASK(cJSON_NULL)},
+};
+
+static int get_type(const cJSON *item)
+{
+	return item->type & 0xff;
+}
+
+static const char *fill_condition(struct value_condition *condition, const cJSON *operand)
+{
+	int type = get_type(operand);
+	condition->operand = operand;
+
+	if (strcmp(operand->string, "equals") == 0) {
+		if (unlikely((type == cJSON_Array) || (type == cJSON_Object))) {
+			return "equals only supports numbers, strings, booleans and null";
+		}
+		condition->op = VALUE_EQUALS;
+		return NULL;
+	}
+
+	if ((strcmp(operand->string, "lessThan") == 0) || (strcmp(operand->string, "greaterThan") == 0)) {
+		if (unlikely((type != cJSON_Number) && (type != cJSON_String))) {
+			return "lessThan and greaterThan only support numbers and strings";
+		}
+		condition->op = (operand->string[0] == 'l') ? VALUE_LESS_THAN : VALUE_GREATER_THAN;
+		return NULL;
+	}
+
+	if (strcmp(operand->string, "isType") == 0) {
+		if (unlikely(type != cJSON_String)) {
+			return "isType is not a string";
+		}
+		for (unsigned int i = 0; i < sizeof(value_types) / sizeof(value_types[0]); i++) {
+			if (strcmp(operand->valuestring, value_types[i].name) == 0) {
+				condition->op = VALUE_IS_TYPE;
+				condition->type_mask = value_types[i].type_mask;
+				return NULL;
+			}
+		}
+		return "unsupported type in isType";
+	}
+
+	return "unsupported value matcher";
+}
+
+static const char *fill_conditions(struct value_matcher *vm, unsigned int *index, const cJSON *operands, const char *field)
+{
+	if (unlikely(get_type(operands) != cJSON_Object)) {
+		return "value matcher is not an object";
+	}
+
+	for (const cJSON *operand = operands->child; operand != NULL; operand = operand->next) {
+		struct value_condition *condition = &vm->condition[*index];
+		(*index)++;
+		if (field != NULL) {
+			condition->field = duplicate_string(field);
+			if (unlikely(condition->field == NULL)) {
+				return "not enough memory to allocate value matcher";
+			}
+		}
+		const char *error = fill_condition(condition, operand);
+		if (unlikely(error != NULL)) {
+			return error;
+		}
+	}
+	return NULL;
+}
+
+static unsigned int count_conditions(const cJSON *value, const cJSON *value_field)
+{
+	unsigned int number_of_conditions = 0;
+	if (value != NULL) {
+		number_of_conditions += cJSON_GetArraySize(value);
+	}
+	if (value_field != NULL) {
+		for (const cJSON *field = value_field->child; field != NULL; field = field->next) {
+			number_of_conditions += cJSON_GetArraySize(field);
+		}
+	}
+	return number_of_conditions;
+}
+
+static const char *fill_value_matcher(struct value_matcher *vm)
+{
+	unsigned int index = 0;
+	const cJSON *value = cJSON_GetObjectItem(vm->conditions, "value");
+	if (value != NULL) {
+		const char *error = fill_conditions(vm, &index, value, NULL);
+		if (unlikely(error != NULL)) {
+			return error;
+		}
+	}
+
+	const cJSON *value_field = cJSON_GetObjectItem(vm->conditions, "valueField");
+	if (value_field != NULL) {
+		if (unlikely(get_type(value_field) != cJSON_Object)) {
+			return "valueField is not an object";
+		}
+		for (const cJSON *field = value_field->child; field != NULL; field = field->next) {
+			const char *error = fill_conditions(vm, &index, field, field->string);
+			if (unlikely(error != NULL)) {
+				return error;
+			}
+		}
+	}
+
+	if (unlikely(index == 0)) {
+		return "no condition in value matcher";
+	}
+
+	vm->key = cJSON_PrintUnformatted(vm->conditions);
+	if (unlikely(vm->key == NULL)) {
+		return "not enough memory to allocate value matcher";
+	}
+	return NULL;
+}
+
+static cJSON *copy_conditions(const cJSON *value, const cJSON *value_field)
+{
+	cJSON *conditions = cJSON_CreateObject();
+	if (unlikely(conditions == NULL)) {
+		return NULL;
+	}
+	if (value != NULL) {
+		cJSON *copy = cJSON_Duplicate(value, 1);
+		if (unlikely(copy == NULL)) {
+			goto error;
+		}
+		cJSON_AddItemToObject(conditions, "value", copy);
+	}
+	if (value_field != NULL) {
+		cJSON *copy = cJSON_Duplicate(value_field, 1);
+		if (unlikely(copy == NULL)) {
+			goto error;
+		}
+		cJSON_AddItemToObject(conditions, "valueField", copy);
+	}
+	return conditions;
+
+error:
+	cJSON_Delete(conditions);
+	return NULL;
+}
+
+int create_value_matcher(const struct peer *p, const cJSON *request, const cJSON *params, struct value_matcher **matcher_return, cJSON **response)
+{
+	*matcher_return = NULL;
+	const cJSON *value = cJSON_GetObjectItem(params, "value");
+	const cJSON *value_field = cJSON_GetObjectItem(params, "valueField");
+	if ((value == NULL) && (value_field == NULL)) {
+		return 0;
+	}
+
+	unsigned int number_of_conditions = count_conditions(value, value_field);
+	struct value_matcher *vm = cjet_calloc(1, sizeof(*vm) + (sizeof(vm->condition) * (number_of_conditions > 0 ? number_of_conditions - 1 : 0)));
+	if (unlikely(vm == NULL)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate value matcher");
+		return -1;
+	}
+	vm->number_of_conditions = number_of_conditions;
+
+	vm->conditions = copy_conditions(value, value_field);
+	if (unlikely(vm->conditions == NULL)) {
+		*response = create_error_response_from_request(p, request, INTERNAL_ERROR, "reason", "not enough memory to allocate value matcher");
+		free_value_matcher(vm);
+		return -1;
+	}
+
+	const char *error = fill_value_matcher(vm);
+	if (unlikely(error != NULL)) {
+		*response = create_error_response_from_request(p, request, INVALID_PARAMS, "reason", error);
+		free_value_matcher(vm);
+		return -1;
+	}
+
+	*matcher_return = vm;
+	return 0;
+}
+
+void free_value_matcher(struct value_matcher *vm)
+{
+	for (unsigned int i = 0; i < vm->number_of_conditions; i++) {
+		if (vm->condition[i].field != NULL) {
+			cjet_free(vm->condition[i].field);
+		}
+	}
+	if (vm->key != NULL) {
+		cjet_free(vm->key);
+	}
+	if (vm->conditions != NULL) {
+		cJSON_Delete(vm->conditions);
+	}
+	cjet_free(vm);
+}
+
+static int compare_values(const cJSON *value, const cJSON *operand)
+{
+	if (get_type(operand) == cJSON_Number) {
+		if (value->valuedouble < operand->valuedouble) {
+			return -1;
+		}
+		return (value->valuedouble > operand->valuedouble) ? 1 : 0;
+	}
+	if (get_type(operand) == cJSON_String) {
+		return strcmp(value->valuestring, operand->valuestring);
+	}
+	return 0;
+}
+
+static bool condition_matches(const struct value_condition *condition, const cJSON *value)
+{
+	int type = get_type(value);
+	if (condition->op == VALUE_IS_TYPE) {
+		return (condition->type_mask & TYPE_MASK(type)) != 0;
+	}
+	if (type != get_type(condition->operand)) {
+		return false;
+	}
+
+	int ret = compare_values(value, condition->operand);
+	switch (condition->op) {
+	case VALUE_LESS_THAN:
+		return ret < 0;
+	case VALUE_GREATER_THAN:
+		return ret > 0;
+	default:
+		return ret == 0;
+	}
+}
+
+bool value_matcher_matches(const struct value_matcher *vm, const cJSON *value)
+{
+	for (unsigned int i = 0; i < vm->number_of_conditions; i++) {
+		const struct value_condition *condition = &vm->condition[i];
+		const cJSON *item = (condition->field != NULL) ? get_value_field(value, condition->field) : value;
+		if ((item == NULL) || !condition_matches(condition, item)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const char *get_value_matcher_key(const struct value_matcher *vm)
+{
+	return vm->key;
+}
+
+static const cJSON *get_object_item(const cJSON *object, const char *name, size_t name_length)
+{
+	for (const cJSON *item = object->child; item != NULL; item = item->next) {
+		if ((strncmp(item->string, name, name_length) == 0) && (item->string[name_length] == '\0')) {
+			return item;
+		}
+	}
+	return NULL;
+}
+
+const cJSON *get_value_field(const cJSON *value, const char *field)
+{
+	while ((value != NULL) && (field != NULL)) {
+		if (get_type(value) != cJSON_Object) {
+			return NULL;
+		}
+		const char *dot = strchr(field, '.');
+		size_t length = (dot != NULL) ? (size_t)(dot - field) : strlen(field);
+		value = get_object_item(value, field, length);
+		field = (dot != NULL) ? dot + 1 : NULL;
+	}
+	return value;
+}
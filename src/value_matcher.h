@@ -0,0 +1,71 @@
+/*
+ *The MIT License (MIT)
+ *
+ * Copyright (c) <2017> <Stephan Gatzka>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CJET_VALUE_MATCHER_H
+#define CJET_VALUE_MATCHER_H
+
+#include <stdbool.h>
+
+#include "json/cJSON.h"
+#include "peer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A value matcher filters fetched states by their value. It is compiled
+ * from the "value" and "valueField" objects of the fetch params, e.g.
+ * {"value": {"greaterThan": 10}} or
+ * {"valueField": {"alarm.active": {"equals": true}}}.
+ * Supported are equals, lessThan, greaterThan and isType. All
+ * conditions have to be fulfilled.
+ */
+struct value_matcher;
+
+/*
+ * *matcher_return is NULL if the params contain no value conditions.
+ */
+int create_value_matcher(const struct peer *p, const cJSON *request, const cJSON *params, struct value_matcher **matcher_return, cJSON **response);
+void free_value_matcher(struct value_matcher *vm);
+bool value_matcher_matches(const struct value_matcher *vm, const cJSON *value);
+
+/*
+ * Canonical form of the conditions, equal for equal value matchers.
+ */
+const char *get_value_matcher_key(const struct value_matcher *vm);
+
+/*
+ * Returns the item at the dot separated field path inside value or NULL
+ * if there is no such item.
+ */
+const cJSON *get_value_field(const cJSON *value, const char *field);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif